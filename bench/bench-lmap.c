@@ -0,0 +1,1311 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks for the lmap library. Every benchmark is run for a
+ * number of problem sizes n and reports the time per operation as
+ * a single line of JSON, which makes it easy to compare runs and to
+ * see whether an operation scales linearly (constant time per
+ * operation) with the problem size. Benchmarks that process a known
+ * amount of data also report the throughput in MB/s. If the library
+ * is built with allocation counters (-DENABLE_ALLOC_STATS=ON), the
+ * objects allocated by a run and their peak bytes are reported per
+ * type. All inputs are generated deterministically, so runs are
+ * comparable.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "arena.h"
+#include "csv.h"
+#include "workspace.h"
+#include "xml-io.h"
+#include "json-io.h"
+#include "snapshot.h"
+#include "alloc.h"
+
+struct benchmark {
+    const char *name;
+    const char *description;
+    double (*run)(size_t n);		/* returns seconds for n operations */
+};
+
+/* additional JSON members reported by the last run (if any) */
+static char extra[256];
+
+/* bytes processed by the last run, 0 if not applicable */
+static size_t bytes;
+
+/* allocation counters before the last run */
+static struct lmap_alloc_stats allocs[LMAP_ALLOC_TYPES];
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char **
+make_names(const char *prefix, size_t n)
+{
+    char **names, buf[64];
+    size_t i;
+
+    names = calloc(n, sizeof(char *));
+    if (! names) {
+	fprintf(stderr, "bench-lmap: failed to allocate memory\n");
+	exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+	snprintf(buf, sizeof(buf), "%s-%zu", prefix, i);
+	names[i] = strdup(buf);
+    }
+    return names;
+}
+
+static void
+free_names(char **names, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	free(names[i]);
+    }
+    free(names);
+}
+
+static double
+bench_result_append(size_t n)
+{
+    struct lmap *lmap;
+    double start, end;
+    size_t i;
+
+    lmap = lmap_new();
+    start = now();
+    for (i = 0; i < n; i++) {
+	lmap_add_result(lmap, lmap_result_new());
+    }
+    end = now();
+    lmap_free(lmap);
+    return end - start;
+}
+
+static double
+bench_tag_append(size_t n)
+{
+    struct result *res;
+    char **names;
+    double start, end;
+    size_t i;
+
+    names = make_names("tag", n);
+    res = lmap_result_new();
+    start = now();
+    for (i = 0; i < n; i++) {
+	lmap_result_add_tag(res, names[i]);
+    }
+    end = now();
+    lmap_result_free(res);
+    free_names(names, n);
+    return end - start;
+}
+
+static double
+bench_schedule_append(size_t n)
+{
+    struct lmap *lmap;
+    struct schedule **schedules;
+    char **names;
+    double start, end;
+    size_t i;
+
+    names = make_names("schedule", n);
+    schedules = calloc(n, sizeof(*schedules));
+    for (i = 0; i < n; i++) {
+	schedules[i] = lmap_schedule_new();
+	lmap_schedule_set_name(schedules[i], names[i]);
+    }
+    lmap = lmap_new();
+    start = now();
+    for (i = 0; i < n; i++) {
+	lmap_add_schedule(lmap, schedules[i]);
+    }
+    end = now();
+    lmap_free(lmap);
+    free(schedules);
+    free_names(names, n);
+    return end - start;
+}
+
+static double
+bench_value_append(size_t n)
+{
+    struct row *row;
+    struct value *val;
+    double start, end;
+    size_t i;
+
+    row = lmap_row_new();
+    start = now();
+    for (i = 0; i < n; i++) {
+	val = lmap_value_new();
+	lmap_value_set_value(val, "42");
+	lmap_row_add_value(row, val);
+    }
+    end = now();
+    lmap_row_free(row);
+    return end - start;
+}
+
+static double
+bench_row_append(size_t n)
+{
+    struct table *tab;
+    double start, end;
+    size_t i;
+
+    tab = lmap_table_new();
+    start = now();
+    for (i = 0; i < n; i++) {
+	lmap_table_new_row(tab);
+	lmap_table_add_value(tab, "2016-03-14T07:42:12+00:00");
+	lmap_table_add_value(tab, "42");
+	lmap_table_add_value(tab, "3.14");
+	lmap_table_add_value(tab, "foo");
+    }
+    end = now();
+    lmap_table_free(tab);
+    return end - start;
+}
+
+/*
+ * Builds and releases a config with n schedules, each having two
+ * actions with options and tags, i.e., lots of small objects.
+ */
+
+static void
+build_config(struct lmap *lmap, size_t n)
+{
+    struct schedule *schedule;
+    struct action *action;
+    struct option *option;
+    char name[64];
+    size_t i, j;
+
+    for (i = 0; i < n; i++) {
+	schedule = lmap_schedule_new();
+	snprintf(name, sizeof(name), "schedule-%zu", i);
+	lmap_schedule_set_name(schedule, name);
+	lmap_schedule_set_start(schedule, "periodic");
+	lmap_schedule_add_tag(schedule, "bench");
+	for (j = 0; j < 2; j++) {
+	    action = lmap_action_new();
+	    snprintf(name, sizeof(name), "action-%zu", j);
+	    lmap_action_set_name(action, name);
+	    lmap_action_set_task(action, "ping");
+	    option = lmap_option_new();
+	    lmap_option_set_id(option, "target");
+	    lmap_option_set_value(option, "www.example.com");
+	    lmap_action_add_option(action, option);
+	    lmap_action_add_tag(action, "bench");
+	    lmap_action_add_destination(action, "schedule-0");
+	    lmap_schedule_add_action(schedule, action);
+	}
+	lmap_add_schedule(lmap, schedule);
+    }
+}
+
+static double
+bench_build_heap(size_t n)
+{
+    struct lmap *lmap;
+    double start;
+
+    start = now();
+    lmap = lmap_new();
+    build_config(lmap, n);
+    lmap_free(lmap);
+    return now() - start;
+}
+
+static double
+bench_build_arena(size_t n)
+{
+    struct lmap *lmap;
+    struct lmap_arena_stats stats;
+    double start, secs;
+
+    start = now();
+    lmap = lmap_new_with_arena();
+    (void) lmap_arena_use(lmap->arena);
+    build_config(lmap, n);
+    lmap_arena_stats(lmap->arena, &stats);
+    lmap_free(lmap);
+    secs = now() - start;
+
+    snprintf(extra, sizeof(extra),
+	     ",\"allocs\":%lu,\"bytes\":%zu,\"peak\":%zu",
+	     stats.allocs, stats.bytes, stats.peak);
+    return secs;
+}
+
+/*
+ * Generates a config document with n schedules, each with one
+ * action, followed by a task and an event.
+ */
+
+static char *
+make_config(size_t n)
+{
+    size_t i, len = 0, size = 256 + n * 512;
+    char *doc;
+
+    doc = malloc(size);
+    if (! doc) {
+	fprintf(stderr, "bench-lmap: failed to allocate memory\n");
+	exit(EXIT_FAILURE);
+    }
+    len += snprintf(doc + len, size - len,
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	"  <lmapc:lmap>\n"
+	"    <lmapc:schedules>\n");
+    for (i = 0; i < n; i++) {
+	len += snprintf(doc + len, size - len,
+	    "      <lmapc:schedule>\n"
+	    "        <lmapc:name>schedule-%zu</lmapc:name>\n"
+	    "        <lmapc:start>hourly</lmapc:start>\n"
+	    "        <lmapc:tag>bench</lmapc:tag>\n"
+	    "        <lmapc:action>\n"
+	    "          <lmapc:name>action-%zu</lmapc:name>\n"
+	    "          <lmapc:task>ping</lmapc:task>\n"
+	    "          <lmapc:option>\n"
+	    "            <lmapc:id>target</lmapc:id>\n"
+	    "            <lmapc:value>www.example.com</lmapc:value>\n"
+	    "          </lmapc:option>\n"
+	    "        </lmapc:action>\n"
+	    "      </lmapc:schedule>\n", i, i);
+    }
+    len += snprintf(doc + len, size - len,
+	"    </lmapc:schedules>\n"
+	"    <lmapc:tasks>\n"
+	"      <lmapc:task>\n"
+	"        <lmapc:name>ping</lmapc:name>\n"
+	"        <lmapc:program>/bin/ping</lmapc:program>\n"
+	"      </lmapc:task>\n"
+	"    </lmapc:tasks>\n"
+	"    <lmapc:events>\n"
+	"      <lmapc:event>\n"
+	"        <lmapc:name>hourly</lmapc:name>\n"
+	"        <lmapc:periodic>\n"
+	"          <lmapc:interval>3600</lmapc:interval>\n"
+	"        </lmapc:periodic>\n"
+	"      </lmapc:event>\n"
+	"    </lmapc:events>\n"
+	"  </lmapc:lmap>\n"
+	"</config>\n");
+    return doc;
+}
+
+static double
+bench_config_parse(size_t n)
+{
+    struct lmap *lmap;
+    char *doc;
+    double start, end;
+
+    doc = make_config(n);
+    lmap = lmap_new();
+    start = now();
+    lmap_xml_parse_config_string(lmap, doc);
+    end = now();
+    lmap_free(lmap);
+    free(doc);
+    return end - start;
+}
+
+/*
+ * The same config as make_config() in the JSON encoding.
+ */
+
+static char *
+make_config_json(size_t n)
+{
+    size_t i, len = 0, size = 256 + n * 512;
+    char *doc;
+
+    doc = malloc(size);
+    if (! doc) {
+	fprintf(stderr, "bench-lmap: failed to allocate memory\n");
+	exit(EXIT_FAILURE);
+    }
+    len += snprintf(doc + len, size - len,
+	"{\n"
+	"  \"ietf-lmap-control:lmap\": {\n"
+	"    \"schedules\": {\n"
+	"      \"schedule\": [\n");
+    for (i = 0; i < n; i++) {
+	len += snprintf(doc + len, size - len,
+	    "        {\n"
+	    "          \"name\": \"schedule-%zu\",\n"
+	    "          \"start\": \"hourly\",\n"
+	    "          \"tag\": [ \"bench\" ],\n"
+	    "          \"action\": [\n"
+	    "            {\n"
+	    "              \"name\": \"action-%zu\",\n"
+	    "              \"task\": \"ping\",\n"
+	    "              \"option\": [\n"
+	    "                {\n"
+	    "                  \"id\": \"target\",\n"
+	    "                  \"value\": \"www.example.com\"\n"
+	    "                }\n"
+	    "              ]\n"
+	    "            }\n"
+	    "          ]\n"
+	    "        }%s\n", i, i, (i + 1 < n) ? "," : "");
+    }
+    len += snprintf(doc + len, size - len,
+	"      ]\n"
+	"    },\n"
+	"    \"tasks\": {\n"
+	"      \"task\": [\n"
+	"        { \"name\": \"ping\", \"program\": \"/bin/ping\" }\n"
+	"      ]\n"
+	"    },\n"
+	"    \"events\": {\n"
+	"      \"event\": [\n"
+	"        { \"name\": \"hourly\", \"periodic\": { \"interval\": 3600 } }\n"
+	"      ]\n"
+	"    }\n"
+	"  }\n"
+	"}\n");
+    return doc;
+}
+
+static double
+bench_config_parse_json(size_t n)
+{
+    struct lmap *lmap;
+    char *doc;
+    double start, end;
+
+    doc = make_config_json(n);
+    lmap = lmap_new();
+    start = now();
+    lmap_json_parse_config_string(lmap, doc);
+    end = now();
+    lmap_free(lmap);
+    free(doc);
+    return end - start;
+}
+
+/*
+ * Builds a report with n results, each with a table of 10 rows.
+ */
+
+static void
+build_report(struct lmap *lmap, size_t n)
+{
+    struct result *res;
+    struct table *tab;
+    char name[64];
+    size_t i, j;
+
+    lmap->agent = lmap_agent_new();
+    lmap_agent_set_agent_id(lmap->agent, "550e8400-e29b-41d4-a716-446655440000");
+    lmap_agent_set_report_agent_id(lmap->agent, "true");
+    lmap_agent_set_report_date(lmap->agent, "2016-03-14T07:42:12+00:00");
+    for (i = 0; i < n; i++) {
+	res = lmap_result_new();
+	snprintf(name, sizeof(name), "action-%zu", i);
+	lmap_result_set_schedule(res, "bench");
+	lmap_result_set_action(res, name);
+	lmap_result_set_task(res, "ping");
+	lmap_result_set_start(res, "2016-03-14T07:42:12+00:00");
+	lmap_result_set_end(res, "2016-03-14T07:42:13+00:00");
+	lmap_result_set_status(res, "0");
+	tab = lmap_table_new();
+	for (j = 0; j < 10; j++) {
+	    lmap_table_new_row(tab);
+	    lmap_table_add_value(tab, "2016-03-14T07:42:12+00:00");
+	    lmap_table_add_value(tab, "www.example.com");
+	    lmap_table_add_value(tab, "12.345");
+	}
+	lmap_result_add_table(res, tab);
+	lmap_add_result(lmap, res);
+    }
+}
+
+/*
+ * Writes a report with n results, each with a table of 10 rows, to a
+ * temporary file using the given renderer.
+ */
+
+static void
+make_report(size_t n, char *(*render)(struct lmap *lmap), char *path)
+{
+    struct lmap *lmap;
+    char *doc;
+    int fd;
+
+    lmap = lmap_new();
+    build_report(lmap, n);
+    doc = render(lmap);
+    lmap_free(lmap);
+
+    fd = mkstemp(path);
+    if (fd == -1 || ! doc
+	|| write(fd, doc, strlen(doc)) != (ssize_t) strlen(doc)) {
+	fprintf(stderr, "bench-lmap: failed to write report\n");
+	exit(EXIT_FAILURE);
+    }
+    close(fd);
+    free(doc);
+}
+
+static int
+drop_result(struct result *res, void *ctx)
+{
+    (void) ctx;
+    lmap_result_free(res);
+    return 0;
+}
+
+static double
+bench_report_parse(size_t n)
+{
+    struct lmap *lmap;
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    double start, end;
+
+    make_report(n, lmap_xml_render_report, path);
+    lmap = lmap_new();
+    start = now();
+    lmap_xml_read_report_file(lmap, path, drop_result, NULL);
+    end = now();
+    lmap_free(lmap);
+    unlink(path);
+    return end - start;
+}
+
+static double
+bench_report_parse_json(size_t n)
+{
+    struct lmap *lmap;
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    double start, end;
+
+    make_report(n, lmap_json_render_report, path);
+    lmap = lmap_new();
+    start = now();
+    lmap_json_read_report_file(lmap, path, drop_result, NULL);
+    end = now();
+    lmap_free(lmap);
+    unlink(path);
+    return end - start;
+}
+
+/*
+ * Startup of lmapd: either parse and validate a config file with n
+ * schedules or load the snapshot compiled from it (which includes
+ * computing the key of the config file).
+ */
+
+static void
+write_config(size_t n, char *path)
+{
+    char *doc;
+    int fd;
+
+    doc = make_config(n);
+    fd = mkstemp(path);
+    if (fd == -1 || write(fd, doc, strlen(doc)) != (ssize_t) strlen(doc)) {
+	fprintf(stderr, "bench-lmap: failed to write config\n");
+	exit(EXIT_FAILURE);
+    }
+    close(fd);
+    free(doc);
+}
+
+static double
+bench_startup_cold(size_t n)
+{
+    struct lmap *lmap;
+    struct lmap_arena *old;
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    double start, end;
+
+    write_config(n, path);
+    start = now();
+    lmap = lmap_new_with_arena();
+    old = lmap_arena_use(lmap->arena);
+    lmap_xml_parse_config_path(lmap, path);
+    lmap_valid(lmap);
+    (void) lmap_arena_use(old);
+    end = now();
+    lmap_free(lmap);
+    unlink(path);
+    return end - start;
+}
+
+static double
+bench_startup_snapshot(size_t n)
+{
+    struct lmap *lmap;
+    struct lmap_arena *old;
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    char snap[sizeof(path) + 5];
+    const char *paths[] = { path, NULL };
+    uint64_t key;
+    double start, end;
+
+    write_config(n, path);
+    snprintf(snap, sizeof(snap), "%s.snap", path);
+    lmap = lmap_new();
+    lmap_xml_parse_config_path(lmap, path);
+    lmap_snapshot_key(paths, &key);
+    lmap_snapshot_save(lmap, snap, key);
+    lmap_free(lmap);
+
+    start = now();
+    lmap = lmap_new_with_arena();
+    old = lmap_arena_use(lmap->arena);
+    lmap_snapshot_key(paths, &key);
+    if (lmap_snapshot_load(lmap, snap, key) != 0) {
+	fprintf(stderr, "bench-lmap: failed to load snapshot\n");
+	exit(EXIT_FAILURE);
+    }
+    (void) lmap_arena_use(old);
+    end = now();
+    lmap_free(lmap);
+    unlink(snap);
+    unlink(path);
+    return end - start;
+}
+
+/*
+ * Writes a config directory with CONFIG_DIR_FILES files holding n
+ * schedules in total. The task and the event go into the first file.
+ */
+
+#define CONFIG_DIR_FILES 500
+
+static void
+write_config_dir(size_t n, const char *dir)
+{
+    char path[PATH_MAX];
+    size_t i, k;
+    FILE *f;
+
+    for (k = 0; k < CONFIG_DIR_FILES; k++) {
+	snprintf(path, sizeof(path), "%s/campaign-%03zu.xml", dir, k);
+	f = fopen(path, "w");
+	if (! f) {
+	    fprintf(stderr, "bench-lmap: failed to write config\n");
+	    exit(EXIT_FAILURE);
+	}
+	fprintf(f,
+	    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	    "  <lmapc:lmap>\n"
+	    "    <lmapc:schedules>\n");
+	for (i = k; i < n; i += CONFIG_DIR_FILES) {
+	    fprintf(f,
+		"      <lmapc:schedule>\n"
+		"        <lmapc:name>schedule-%zu</lmapc:name>\n"
+		"        <lmapc:start>hourly</lmapc:start>\n"
+		"        <lmapc:tag>bench</lmapc:tag>\n"
+		"        <lmapc:action>\n"
+		"          <lmapc:name>action-%zu</lmapc:name>\n"
+		"          <lmapc:task>ping</lmapc:task>\n"
+		"          <lmapc:option>\n"
+		"            <lmapc:id>target</lmapc:id>\n"
+		"            <lmapc:value>www.example.com</lmapc:value>\n"
+		"          </lmapc:option>\n"
+		"        </lmapc:action>\n"
+		"      </lmapc:schedule>\n", i, i);
+	}
+	fprintf(f, "    </lmapc:schedules>\n");
+	if (k == 0) {
+	    fprintf(f,
+		"    <lmapc:tasks>\n"
+		"      <lmapc:task>\n"
+		"        <lmapc:name>ping</lmapc:name>\n"
+		"        <lmapc:program>/bin/ping</lmapc:program>\n"
+		"      </lmapc:task>\n"
+		"    </lmapc:tasks>\n"
+		"    <lmapc:events>\n"
+		"      <lmapc:event>\n"
+		"        <lmapc:name>hourly</lmapc:name>\n"
+		"        <lmapc:periodic>\n"
+		"          <lmapc:interval>3600</lmapc:interval>\n"
+		"        </lmapc:periodic>\n"
+		"      </lmapc:event>\n"
+		"    </lmapc:events>\n");
+	}
+	fprintf(f, "  </lmapc:lmap>\n</config>\n");
+	fclose(f);
+    }
+}
+
+static void
+remove_config_dir(const char *dir)
+{
+    char path[PATH_MAX];
+    size_t k;
+
+    for (k = 0; k < CONFIG_DIR_FILES; k++) {
+	snprintf(path, sizeof(path), "%s/campaign-%03zu.xml", dir, k);
+	unlink(path);
+    }
+    rmdir(dir);
+}
+
+static double
+config_dir(size_t n, int threads)
+{
+    struct lmap *lmap;
+    struct lmap_arena *old;
+    char dir[] = "/tmp/bench-lmap-XXXXXX";
+    double start, end;
+
+    if (! mkdtemp(dir)) {
+	fprintf(stderr, "bench-lmap: failed to create directory\n");
+	exit(EXIT_FAILURE);
+    }
+    write_config_dir(n, dir);
+    lmap_xml_set_parse_threads(threads);
+    start = now();
+    lmap = lmap_new_with_arena();
+    old = lmap_arena_use(lmap->arena);
+    lmap_xml_parse_config_path(lmap, dir);
+    (void) lmap_arena_use(old);
+    end = now();
+    lmap_xml_set_parse_threads(0);
+    lmap_free(lmap);
+    remove_config_dir(dir);
+
+    snprintf(extra, sizeof(extra), ",\"files\":%d,\"threads\":%d",
+	     CONFIG_DIR_FILES, threads);
+    return end - start;
+}
+
+static double
+bench_config_dir(size_t n)
+{
+    return config_dir(n, 1);
+}
+
+static double
+bench_config_dir_parallel(size_t n)
+{
+    return config_dir(n, 4);
+}
+
+/*
+ * Formats n timestamps that are 37 seconds apart, i.e., the hour
+ * changes about every 100 calls, which is roughly what a report of
+ * measurement results looks like.
+ */
+
+#define DATETIME_BASE	1482221851
+#define DATETIME_STEP	37
+
+static volatile char datetime_sink;
+
+static double
+bench_datetime(size_t n)
+{
+    char buf[LMAP_DATETIME_LEN];
+    double start;
+    size_t i;
+
+    start = now();
+    for (i = 0; i < n; i++) {
+	lmap_format_datetime(DATETIME_BASE + (time_t) i * DATETIME_STEP,
+			     buf, sizeof(buf));
+	datetime_sink = buf[18];
+    }
+    return now() - start;
+}
+
+static double
+bench_datetime_strftime(size_t n)
+{
+    char buf[32];
+    struct tm *tm;
+    time_t t;
+    double start;
+    size_t i;
+
+    start = now();
+    for (i = 0; i < n; i++) {
+	t = DATETIME_BASE + (time_t) i * DATETIME_STEP;
+	tm = localtime(&t);
+	strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", tm);
+	memmove(buf + 23, buf + 22, 3);
+	buf[22] = ':';
+	datetime_sink = buf[18];
+    }
+    return now() - start;
+}
+
+/*
+ * Renders the state of a config with n actions (n/2 schedules with
+ * two actions each) whose counters and timestamps are all set. The
+ * document is streamed into a writer that only counts the bytes.
+ */
+
+static int
+count_write(void *ctx, const char *buf, size_t len)
+{
+    (void) buf;
+    *(size_t *) ctx += len;
+    return 0;
+}
+
+static double
+bench_state_render(size_t n)
+{
+    struct lmap *lmap;
+    struct schedule *schedule;
+    struct action *action;
+    size_t size = 0;
+    uint32_t k = 1000003;
+    double start, secs;
+
+    lmap = lmap_new();
+    build_config(lmap, n / 2);
+    for (schedule = lmap->schedules; schedule; schedule = schedule->next) {
+	schedule->cnt_invocations = k++;
+	schedule->cnt_failures = k++;
+	schedule->storage = (uint64_t) k++ << 20;
+	schedule->last_invocation = DATETIME_BASE + k;
+	for (action = schedule->actions; action; action = action->next) {
+	    action->cnt_invocations = k++;
+	    action->cnt_suppressions = k++;
+	    action->cnt_overlaps = k++;
+	    action->cnt_failures = k++;
+	    action->storage = (uint64_t) k++ << 10;
+	    action->last_invocation = DATETIME_BASE + k;
+	    action->last_completion = DATETIME_BASE + k + 60;
+	    action->last_status = 0;
+	}
+    }
+
+    start = now();
+    lmap_xml_write_state(lmap, count_write, &size);
+    secs = now() - start;
+    lmap_free(lmap);
+
+    bytes = size;
+    return secs;
+}
+
+/*
+ * The CSV files written by lmapd for every action: a .data file with
+ * the rows of the result table and a .meta file with key value
+ * pairs. Each row has four fields, one of which needs quoting.
+ */
+
+static size_t
+file_size(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 ? (size_t) st.st_size : 0;
+}
+
+static void
+write_rows(FILE *f, size_t n)
+{
+    char num[32];
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	snprintf(num, sizeof(num), "%zu.%03zu", i % 1000, i % 997);
+	csv_start(f, ';', "2016-03-14T07:42:12+00:00");
+	csv_append(f, ';', "www.example.com");
+	csv_append(f, ';', num);
+	csv_append(f, ';', "icmp echo reply");
+	csv_end(f);
+    }
+}
+
+static void
+write_meta(FILE *f, size_t n)
+{
+    char key[32], value[32];
+    size_t i;
+
+    csv_append_key_value(f, ';', "schedule", "bench");
+    csv_append_key_value(f, ';', "action", "ping");
+    csv_append_key_value(f, ';', "task", "ping");
+    for (i = 0; i + 3 < n; i++) {
+	snprintf(key, sizeof(key), "key-%zu", i);
+	snprintf(value, sizeof(value), "%zu", 1457941332 + i);
+	csv_append_key_value(f, ';', key, value);
+    }
+}
+
+static void
+write_csv(char *path, size_t n, void (*func)(FILE *, size_t))
+{
+    FILE *f;
+    int fd;
+
+    fd = mkstemp(path);
+    f = (fd == -1) ? NULL : fdopen(fd, "w");
+    if (! f) {
+	fprintf(stderr, "bench-lmap: failed to write '%s'\n", path);
+	exit(EXIT_FAILURE);
+    }
+    func(f, n);
+    if (fclose(f) != 0) {
+	fprintf(stderr, "bench-lmap: failed to write '%s'\n", path);
+	exit(EXIT_FAILURE);
+    }
+}
+
+static double
+bench_csv_next(size_t n)
+{
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    double start, secs;
+    size_t fields = 0;
+    FILE *f;
+    char *s;
+
+    write_csv(path, n, write_rows);
+    f = fopen(path, "r");
+    start = now();
+    while (! feof(f)) {
+	s = csv_next(f, ';');
+	if (s) {
+	    fields++;
+	    free(s);
+	}
+    }
+    secs = now() - start;
+    fclose(f);
+    bytes = file_size(path);
+    unlink(path);
+
+    if (fields != 4 * n) {
+	fprintf(stderr, "bench-lmap: read %zu fields instead of %zu\n",
+		fields, 4 * n);
+	exit(EXIT_FAILURE);
+    }
+    return secs;
+}
+
+static double
+bench_csv_key_value(size_t n)
+{
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    double start, secs;
+    size_t pairs = 0;
+    char *key, *value;
+    FILE *f;
+
+    write_csv(path, n, write_meta);
+    f = fopen(path, "r");
+    start = now();
+    while (! feof(f)) {
+	csv_next_key_value(f, ';', &key, &value);
+	if (key && value) {
+	    pairs++;
+	}
+	free(key);
+	free(value);
+    }
+    secs = now() - start;
+    fclose(f);
+    bytes = file_size(path);
+    unlink(path);
+
+    if (pairs != n) {
+	fprintf(stderr, "bench-lmap: read %zu pairs instead of %zu\n",
+		pairs, n);
+	exit(EXIT_FAILURE);
+    }
+    return secs;
+}
+
+/*
+ * Ingests a workspace with n rows spread over results of 100 rows
+ * each (a .meta file with 20 pairs and a .data file per result), as
+ * the reporter does before it renders a report.
+ */
+
+#define WORKSPACE_ROWS	100
+
+static double
+bench_workspace_read(size_t n)
+{
+    struct lmapd *lmapd;
+    struct result *res;
+    char dir[] = "/tmp/bench-lmap-XXXXXX";
+    char path[PATH_MAX], cwd[PATH_MAX];
+    size_t i, results = (n + WORKSPACE_ROWS - 1) / WORKSPACE_ROWS;
+    double start, secs;
+    FILE *f;
+
+    if (! mkdtemp(dir) || ! getcwd(cwd, sizeof(cwd))) {
+	fprintf(stderr, "bench-lmap: failed to create directory\n");
+	exit(EXIT_FAILURE);
+    }
+    bytes = 0;
+    for (i = 0; i < results; i++) {
+	snprintf(path, sizeof(path), "%s/%08zu.meta", dir, i);
+	f = fopen(path, "w");
+	if (! f) {
+	    fprintf(stderr, "bench-lmap: failed to write workspace\n");
+	    exit(EXIT_FAILURE);
+	}
+	write_meta(f, 20);
+	fclose(f);
+	bytes += file_size(path);
+	snprintf(path, sizeof(path), "%s/%08zu.data", dir, i);
+	f = fopen(path, "w");
+	if (! f) {
+	    fprintf(stderr, "bench-lmap: failed to write workspace\n");
+	    exit(EXIT_FAILURE);
+	}
+	write_rows(f, WORKSPACE_ROWS);
+	fclose(f);
+	bytes += file_size(path);
+    }
+
+    lmapd = lmapd_new();
+    lmapd->lmap = lmap_new();
+    if (chdir(dir) == -1) {
+	fprintf(stderr, "bench-lmap: failed to change directory\n");
+	exit(EXIT_FAILURE);
+    }
+    start = now();
+    lmapd_workspace_read_results(lmapd);
+    secs = now() - start;
+    if (chdir(cwd) == -1) {
+	fprintf(stderr, "bench-lmap: failed to change directory\n");
+	exit(EXIT_FAILURE);
+    }
+
+    for (i = 0, res = lmapd->lmap->results; res; res = res->next) {
+	i++;
+    }
+    if (i != results) {
+	fprintf(stderr, "bench-lmap: read %zu results instead of %zu\n",
+		i, results);
+	exit(EXIT_FAILURE);
+    }
+    lmapd_free(lmapd);
+
+    for (i = 0; i < results; i++) {
+	snprintf(path, sizeof(path), "%s/%08zu.meta", dir, i);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/%08zu.data", dir, i);
+	unlink(path);
+    }
+    rmdir(dir);
+    return secs;
+}
+
+/*
+ * Renders a report with n rows, in results of 10 rows each (see
+ * build_report()).
+ */
+
+static double
+report_render(size_t n, char *(*render)(struct lmap *lmap))
+{
+    struct lmap *lmap;
+    double start, secs;
+    char *doc;
+
+    lmap = lmap_new();
+    build_report(lmap, (n + 9) / 10);
+    start = now();
+    doc = render(lmap);
+    secs = now() - start;
+    if (! doc) {
+	fprintf(stderr, "bench-lmap: failed to render report\n");
+	exit(EXIT_FAILURE);
+    }
+    bytes = strlen(doc);
+    free(doc);
+    lmap_free(lmap);
+    return secs;
+}
+
+static double
+bench_report_render(size_t n)
+{
+    return report_render(n, lmap_xml_render_report);
+}
+
+static double
+bench_report_render_json(size_t n)
+{
+    return report_render(n, lmap_json_render_report);
+}
+
+static double
+bench_config_parse_path(size_t n)
+{
+    struct lmap *lmap;
+    char path[] = "/tmp/bench-lmap-XXXXXX";
+    double start, secs;
+
+    write_config(n, path);
+    lmap = lmap_new();
+    start = now();
+    lmap_xml_parse_config_path(lmap, path);
+    secs = now() - start;
+    bytes = file_size(path);
+    lmap_free(lmap);
+    unlink(path);
+    return secs;
+}
+
+/*
+ * Matches a calendar event (twice a day at 06:30 and 18:30 on
+ * weekdays) against n consecutive seconds.
+ */
+
+static double
+bench_calendar_match(size_t n)
+{
+    struct event *event;
+    const char *days[] = { "monday", "tuesday", "wednesday", "thursday",
+			   "friday", NULL };
+    time_t t;
+    double start, secs;
+    size_t i, matches = 0;
+
+    event = lmap_event_new();
+    lmap_event_set_name(event, "calendar");
+    lmap_event_set_type(event, "calendar");
+    lmap_event_add_month(event, "*");
+    lmap_event_add_day_of_month(event, "*");
+    for (i = 0; days[i]; i++) {
+	lmap_event_add_day_of_week(event, days[i]);
+    }
+    lmap_event_add_hour(event, "6");
+    lmap_event_add_hour(event, "18");
+    lmap_event_add_minute(event, "30");
+    lmap_event_add_second(event, "0");
+
+    start = now();
+    for (i = 0; i < n; i++) {
+	t = DATETIME_BASE + (time_t) i;
+	if (lmap_event_calendar_match(event, &t) == 1) {
+	    matches++;
+	}
+    }
+    secs = now() - start;
+    lmap_event_free(event);
+
+    snprintf(extra, sizeof(extra), ",\"matches\":%zu", matches);
+    return secs;
+}
+
+static struct benchmark benchmarks[] = {
+    { "result-append",	 "append results to an lmap",	  bench_result_append },
+    { "tag-append",	 "append unique tags to a result", bench_tag_append },
+    { "schedule-append", "append named schedules",	  bench_schedule_append },
+    { "value-append",	 "append values to a row",	  bench_value_append },
+    { "row-append",	 "append rows of 4 values to a table", bench_row_append },
+    { "build-heap",	 "build and free a config on the heap", bench_build_heap },
+    { "build-arena",	 "build and free a config in an arena", bench_build_arena },
+    { "config-parse",	 "parse a config with n schedules", bench_config_parse },
+    { "config-parse-json", "parse a JSON config with n schedules", bench_config_parse_json },
+    { "report-parse",	 "read a report file with n results", bench_report_parse },
+    { "report-parse-json", "read a JSON report file with n results", bench_report_parse_json },
+    { "config-dir",	 "parse n schedules from 500 files", bench_config_dir },
+    { "config-dir-parallel", "parse n schedules from 500 files with 4 threads", bench_config_dir_parallel },
+    { "startup-cold",	 "parse and validate a config file", bench_startup_cold },
+    { "startup-snapshot", "load the snapshot of a config file", bench_startup_snapshot },
+    { "datetime",	 "format datetimes with the cached formatter", bench_datetime },
+    { "datetime-strftime", "format datetimes with localtime and strftime", bench_datetime_strftime },
+    { "state-render",	 "render the state of n actions", bench_state_render },
+    { "csv-next",	 "read n rows of 4 fields with csv_next", bench_csv_next },
+    { "csv-key-value",	 "read n key value pairs of a meta file", bench_csv_key_value },
+    { "workspace-read",	 "ingest a workspace with n rows of results", bench_workspace_read },
+    { "report-render",	 "render an XML report with n rows", bench_report_render },
+    { "report-render-json", "render a JSON report with n rows", bench_report_render_json },
+    { "config-parse-path", "parse a config file with n schedules", bench_config_parse_path },
+    { "calendar-match",	 "match a calendar event against n seconds", bench_calendar_match },
+    { NULL, NULL, NULL }
+};
+
+static void
+quiet(int level, const char *func, const char *format, va_list args)
+{
+    (void) level;
+    (void) func;
+    (void) format;
+    (void) args;
+}
+
+static void
+usage(FILE *f)
+{
+    int i;
+
+    fprintf(f, "usage: bench-lmap [-h] [-l] [-n max] [-s size] [benchmark ...]\n"
+	    "\t-h show brief usage information and exit\n"
+	    "\t-l list the benchmarks and exit\n"
+	    "\t-n largest problem size (default 100000)\n"
+	    "\t-s run a single problem size\n"
+	    "benchmarks:\n");
+    for (i = 0; benchmarks[i].name; i++) {
+	fprintf(f, "\t%-18s %s\n", benchmarks[i].name,
+		benchmarks[i].description);
+    }
+}
+
+static void
+alloc_start(void)
+{
+    int i;
+
+    lmap_alloc_reset_peak();
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	(void) lmap_alloc_stats(i, &allocs[i]);
+    }
+}
+
+/*
+ * Prints the objects allocated by the last run and the peak of bytes
+ * above the bytes allocated before the run, for each type that was
+ * allocated at all.
+ */
+
+static void
+alloc_print(void)
+{
+    struct lmap_alloc_stats stats;
+    const char *sep = "";
+    int i;
+
+    if (! lmap_alloc_enabled()) {
+	return;
+    }
+    printf(",\"allocs\":{");
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	if (lmap_alloc_stats(i, &stats) == -1
+	    || stats.total == allocs[i].total) {
+	    continue;
+	}
+	printf("%s\"%s\":{\"count\":%llu,\"peak_bytes\":%llu}",
+	       sep, lmap_alloc_type_name(i),
+	       (unsigned long long) (stats.total - allocs[i].total),
+	       (unsigned long long) (stats.peak - allocs[i].bytes));
+	sep = ",";
+    }
+    printf("}");
+}
+
+static int
+selected(const char *name, int argc, char **argv)
+{
+    int i;
+
+    if (! argc) {
+	return 1;
+    }
+    for (i = 0; i < argc; i++) {
+	if (! strcmp(argv[i], name)) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, opt;
+    size_t n, min = 1000, max = 100000;
+    double secs;
+
+    while ((opt = getopt(argc, argv, "hln:s:")) != -1) {
+	switch (opt) {
+	case 'h':
+	    usage(stdout);
+	    exit(EXIT_SUCCESS);
+	case 'l':
+	    for (i = 0; benchmarks[i].name; i++) {
+		printf("%s\n", benchmarks[i].name);
+	    }
+	    exit(EXIT_SUCCESS);
+	case 'n':
+	    max = strtoul(optarg, NULL, 10);
+	    break;
+	case 's':
+	    min = max = strtoul(optarg, NULL, 10);
+	    break;
+	default:
+	    usage(stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    argc -= optind;
+    argv += optind;
+
+    lmap_set_log_handler(quiet);
+
+    for (i = 0; benchmarks[i].name; i++) {
+	if (! selected(benchmarks[i].name, argc, argv)) {
+	    continue;
+	}
+	for (n = min; n && n <= max; n *= 10) {
+	    extra[0] = 0;
+	    bytes = 0;
+	    alloc_start();
+	    secs = benchmarks[i].run(n);
+	    printf("{\"benchmark\":\"%s\",\"n\":%zu,\"seconds\":%.6f,"
+		   "\"ns_per_op\":%.1f",
+		   benchmarks[i].name, n, secs, secs * 1e9 / n);
+	    if (bytes) {
+		printf(",\"bytes\":%zu,\"mb_per_sec\":%.1f",
+		       bytes, secs > 0 ? bytes / secs / 1e6 : 0.0);
+	    }
+	    alloc_print();
+	    printf("%s}\n", extra);
+	}
+    }
+
+    return EXIT_SUCCESS;
+}
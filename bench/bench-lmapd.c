@@ -0,0 +1,553 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scheduler benchmark for lmapd. A synthetic config with n schedules
+ * of m actions each, started by k periodic events, plus suppressions
+ * matching schedule tags with globs, is run in-process by the lmapd
+ * runner for a number of seconds with a trivial task program. The
+ * result is a single line of JSON with the startup and reload times,
+ * the rates of fired events and spawned actions, the latencies
+ * recorded by the runner and the peak memory use, so that runs can be
+ * compared across releases. With -v, the scheduler runs on a virtual
+ * clock (see sim.c) with stubbed tasks, so that days of schedules
+ * replay in seconds and the CPU time used by the scheduler itself
+ * can be measured. With allocation counters compiled in, the bytes
+ * held by the loaded config and the peak during reloads are reported
+ * as well.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "config.h"
+#include "runner.h"
+#include "workspace.h"
+#include "latency.h"
+#include "sim.h"
+#include "alloc.h"
+
+struct params {
+    size_t schedules;		/* n */
+    size_t actions;		/* m, per schedule */
+    size_t events;		/* k */
+    size_t suppressions;
+    unsigned int interval;	/* period of the events (seconds) */
+    unsigned int duration;	/* seconds the scheduler runs */
+    unsigned int reloads;
+    const char *program;	/* task program */
+    unsigned int simulate;	/* virtual seconds, 0 runs in real time */
+    unsigned int task_ms;	/* run time of a stubbed task */
+    int task_status;		/* exit status of a stubbed task */
+    int report;			/* deliver results to a report schedule */
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+datetime(time_t t, char *buf, size_t len)
+{
+    if (lmap_format_datetime(t, buf, len) == -1) {
+	fprintf(stderr, "bench-lmapd: failed to format time\n");
+	exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Writes the synthetic config. Schedule i is started by event i % k,
+ * alternates between sequential and parallel execution and carries
+ * the suppression tag group-NN (i % 100). Suppression p matches the
+ * glob group-D* (D = p % 10) and is active every other period. With
+ * -o, all actions deliver their results to the schedule report.
+ */
+
+static void
+write_config(FILE *f, const struct params *p)
+{
+    char start[LMAP_DATETIME_LEN], end[LMAP_DATETIME_LEN];
+    time_t t = time(NULL);
+    size_t i, j;
+
+    fprintf(f,
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	"  <lmapc:lmap>\n"
+	"    <lmapc:schedules>\n");
+    for (i = 0; i < p->schedules; i++) {
+	fprintf(f,
+	    "      <lmapc:schedule>\n"
+	    "        <lmapc:name>schedule-%zu</lmapc:name>\n"
+	    "        <lmapc:start>tick-%zu</lmapc:start>\n"
+	    "        <lmapc:execution-mode>%s</lmapc:execution-mode>\n"
+	    "        <lmapc:suppression-tag>group-%02zu</lmapc:suppression-tag>\n",
+	    i, i % p->events, (i % 2) ? "parallel" : "sequential", i % 100);
+	for (j = 0; j < p->actions; j++) {
+	    fprintf(f,
+		"        <lmapc:action>\n"
+		"          <lmapc:name>action-%zu</lmapc:name>\n"
+		"          <lmapc:task>bench</lmapc:task>\n"
+		"          <lmapc:option>\n"
+		"            <lmapc:id>arg</lmapc:id>\n"
+		"            <lmapc:value>%zu</lmapc:value>\n"
+		"          </lmapc:option>\n", j, j);
+	    if (p->report) {
+		fprintf(f,
+		    "          <lmapc:destination>report</lmapc:destination>\n");
+	    }
+	    fprintf(f, "        </lmapc:action>\n");
+	}
+	fprintf(f, "      </lmapc:schedule>\n");
+    }
+    if (p->report) {
+	fprintf(f,
+	    "      <lmapc:schedule>\n"
+	    "        <lmapc:name>report</lmapc:name>\n"
+	    "        <lmapc:start>tick-0</lmapc:start>\n"
+	    "        <lmapc:action>\n"
+	    "          <lmapc:name>report</lmapc:name>\n"
+	    "          <lmapc:task>bench</lmapc:task>\n"
+	    "        </lmapc:action>\n"
+	    "      </lmapc:schedule>\n");
+    }
+    fprintf(f, "    </lmapc:schedules>\n");
+
+    if (p->suppressions) {
+	fprintf(f, "    <lmapc:suppressions>\n");
+	for (i = 0; i < p->suppressions; i++) {
+	    fprintf(f,
+		"      <lmapc:suppression>\n"
+		"        <lmapc:name>suppression-%zu</lmapc:name>\n"
+		"        <lmapc:start>suppress-on</lmapc:start>\n"
+		"        <lmapc:end>suppress-off</lmapc:end>\n"
+		"        <lmapc:match>group-%zu*</lmapc:match>\n"
+		"      </lmapc:suppression>\n", i, i % 10);
+	}
+	fprintf(f, "    </lmapc:suppressions>\n");
+    }
+
+    fprintf(f,
+	"    <lmapc:tasks>\n"
+	"      <lmapc:task>\n"
+	"        <lmapc:name>bench</lmapc:name>\n"
+	"        <lmapc:program>%s</lmapc:program>\n"
+	"      </lmapc:task>\n"
+	"    </lmapc:tasks>\n"
+	"    <lmapc:events>\n", p->program);
+    for (i = 0; i < p->events; i++) {
+	fprintf(f,
+	    "      <lmapc:event>\n"
+	    "        <lmapc:name>tick-%zu</lmapc:name>\n"
+	    "        <lmapc:periodic>\n"
+	    "          <lmapc:interval>%u</lmapc:interval>\n"
+	    "        </lmapc:periodic>\n"
+	    "      </lmapc:event>\n", i, p->interval);
+    }
+    if (p->suppressions) {
+	datetime(t + p->interval, start, sizeof(start));
+	datetime(t + 2 * p->interval, end, sizeof(end));
+	fprintf(f,
+	    "      <lmapc:event>\n"
+	    "        <lmapc:name>suppress-on</lmapc:name>\n"
+	    "        <lmapc:periodic>\n"
+	    "          <lmapc:interval>%u</lmapc:interval>\n"
+	    "          <lmapc:start>%s</lmapc:start>\n"
+	    "        </lmapc:periodic>\n"
+	    "      </lmapc:event>\n"
+	    "      <lmapc:event>\n"
+	    "        <lmapc:name>suppress-off</lmapc:name>\n"
+	    "        <lmapc:periodic>\n"
+	    "          <lmapc:interval>%u</lmapc:interval>\n"
+	    "          <lmapc:start>%s</lmapc:start>\n"
+	    "        </lmapc:periodic>\n"
+	    "      </lmapc:event>\n",
+	    2 * p->interval, start, 2 * p->interval, end);
+    }
+    fprintf(f,
+	"    </lmapc:events>\n"
+	"  </lmapc:lmap>\n"
+	"</config>\n");
+}
+
+static void
+write_capabilities(FILE *f, const struct params *p)
+{
+    fprintf(f,
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<data xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	"  <lmapc:lmap>\n"
+	"    <lmapc:capabilities>\n"
+	"      <lmapc:tasks>\n"
+	"        <lmapc:task>\n"
+	"          <lmapc:name>bench</lmapc:name>\n"
+	"          <lmapc:program>%s</lmapc:program>\n"
+	"        </lmapc:task>\n"
+	"      </lmapc:tasks>\n"
+	"    </lmapc:capabilities>\n"
+	"  </lmapc:lmap>\n"
+	"</data>\n", p->program);
+}
+
+static void
+write_file(const char *path, const struct params *p,
+	   void (*func)(FILE *, const struct params *))
+{
+    FILE *f = fopen(path, "w");
+
+    if (! f) {
+	fprintf(stderr, "bench-lmapd: failed to write '%s'\n", path);
+	exit(EXIT_FAILURE);
+    }
+    func(f, p);
+    if (fclose(f) != 0) {
+	fprintf(stderr, "bench-lmapd: failed to write '%s'\n", path);
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+merge(struct lmap_histogram *to, const struct lmap_histogram *from)
+{
+    int i;
+
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->max > to->max) {
+	to->max = from->max;
+    }
+    for (i = 0; i < LMAP_HISTOGRAM_BUCKETS; i++) {
+	to->buckets[i] += from->buckets[i];
+    }
+}
+
+static void
+print_histogram(const char *name, const struct lmap_histogram *h)
+{
+    printf(",\"%s_p50_us\":%llu,\"%s_p99_us\":%llu,\"%s_max_us\":%llu",
+	   name, (unsigned long long) lmap_histogram_percentile(h, 50),
+	   name, (unsigned long long) lmap_histogram_percentile(h, 99),
+	   name, (unsigned long long) h->max);
+}
+
+/*
+ * Returns the sum of the bytes (or peaks) of all types. The sum of
+ * the peaks is an upper bound since the peaks of different types need
+ * not have been reached at the same time.
+ */
+
+static unsigned long long
+alloc_bytes(int peak)
+{
+    struct lmap_alloc_stats stats;
+    unsigned long long sum = 0;
+    int i;
+
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	if (lmap_alloc_stats(i, &stats) == 0) {
+	    sum += peak ? stats.peak : stats.bytes;
+	}
+    }
+    return sum;
+}
+
+static void
+alarm_handler(int signum)
+{
+    (void) signum;
+    raise(SIGINT);
+}
+
+static void
+quiet(int level, const char *func, const char *format, va_list args)
+{
+    (void) level;
+    (void) func;
+    (void) format;
+    (void) args;
+}
+
+static void
+run(const struct params *p)
+{
+    struct lmapd *lmapd;
+    struct schedule *sched;
+    struct action *act;
+    struct event *event;
+    struct lmap_histogram lag, stages[LMAP_LATENCY_STAGES];
+    struct rusage ru;
+    struct sim *sim = NULL;
+    char dir[] = "/tmp/bench-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX], queue[PATH_MAX];
+    double start, startup, reload = 0, secs;
+    unsigned long long spawns = 0, fired = 0, overlaps = 0, suppressions = 0;
+    unsigned long long failures = 0, queued = 0;
+    unsigned long long config_bytes, reload_bytes;
+    unsigned int i;
+    int valid = 0;
+
+    if (! mkdtemp(dir)) {
+	fprintf(stderr, "bench-lmapd: failed to create directory\n");
+	exit(EXIT_FAILURE);
+    }
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/capabilities.xml", dir);
+    snprintf(queue, sizeof(queue), "%s/queue", dir);
+    write_file(config, p, write_config);
+    write_file(caps, p, write_capabilities);
+    if (mkdir(queue, 0700) == -1) {
+	fprintf(stderr, "bench-lmapd: failed to create '%s'\n", queue);
+	exit(EXIT_FAILURE);
+    }
+
+    lmapd = lmapd_new();
+    if (! lmapd) {
+	exit(EXIT_FAILURE);
+    }
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    lmapd_set_queue_path(lmapd, queue);
+
+    /* startup: what lmapd does before it enters the event loop */
+    config_bytes = alloc_bytes(0);
+    start = now();
+    if (lmapd_read_config(lmapd, &valid) != 0 || ! valid
+	|| lmapd_workspace_init(lmapd) != 0) {
+	fprintf(stderr, "bench-lmapd: failed to load the config\n");
+	exit(EXIT_FAILURE);
+    }
+    startup = now() - start;
+    config_bytes = alloc_bytes(0) - config_bytes;
+
+    /* reload: an unchanged config, as after a SIGHUP without edits */
+    lmap_alloc_reset_peak();
+    reload_bytes = alloc_bytes(0);
+    lmapd->base = event_base_new();
+    for (i = 0; i < p->reloads; i++) {
+	start = now();
+	if (lmapd_reload(lmapd) != 0) {
+	    fprintf(stderr, "bench-lmapd: failed to reload the config\n");
+	    exit(EXIT_FAILURE);
+	}
+	reload += now() - start;
+    }
+    event_base_free(lmapd->base);
+    lmapd->base = NULL;
+    reload_bytes = alloc_bytes(1) - reload_bytes;
+
+    if (p->simulate) {
+	sim = lmapd_sim_new(time(NULL), p->simulate);
+	if (! sim || lmapd_sim_stub(sim, NULL, p->task_ms * 1000ULL,
+				    p->task_status, 1024) != 0) {
+	    exit(EXIT_FAILURE);
+	}
+	lmapd->sim = sim;
+    } else {
+	(void) signal(SIGALRM, alarm_handler);
+	(void) alarm(p->duration);
+    }
+    start = now();
+    (void) lmapd_run(lmapd);
+    secs = now() - start;
+    while (waitpid(-1, NULL, 0) > 0) ;
+    if (! sim) {
+	(void) lmapd_workspace_update(lmapd);
+    }
+
+    memset(&lag, 0, sizeof(lag));
+    memset(stages, 0, sizeof(stages));
+    for (event = lmapd->lmap->events; event; event = event->next) {
+	if (event->lag) {
+	    fired += event->lag->count;
+	    merge(&lag, event->lag);
+	}
+    }
+    for (sched = lmapd->lmap->schedules; sched; sched = sched->next) {
+	overlaps += sched->cnt_overlaps;
+	suppressions += sched->cnt_suppressions;
+	failures += sched->cnt_failures;
+	queued += sched->storage;
+	for (act = sched->actions; act; act = act->next) {
+	    spawns += act->cnt_invocations;
+	    if (act->latency) {
+		for (i = 0; i < LMAP_LATENCY_STAGES; i++) {
+		    merge(&stages[i], &act->latency->stages[i]);
+		}
+	    }
+	}
+    }
+    (void) getrusage(RUSAGE_SELF, &ru);
+
+    printf("{\"benchmark\":\"scheduler\",\"schedules\":%zu,\"actions\":%zu,"
+	   "\"events\":%zu,\"suppressions\":%zu,\"interval\":%u,"
+	   "\"virtual_seconds\":%u,\"seconds\":%.3f,\"cpu_ms\":%.3f,"
+	   "\"startup_ms\":%.3f,\"reload_ms\":%.3f,"
+	   "\"fired\":%llu,\"events_per_sec\":%.1f,"
+	   "\"spawns\":%llu,\"spawns_per_sec\":%.1f,\"reaps\":%llu,"
+	   "\"overlaps\":%llu,\"suppressed\":%llu,\"failures\":%llu,"
+	   "\"queued_bytes\":%llu",
+	   p->schedules, p->actions, p->events, p->suppressions, p->interval,
+	   p->simulate, secs,
+	   (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3
+	   + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3,
+	   startup * 1e3, p->reloads ? reload * 1e3 / p->reloads : 0.0,
+	   fired, fired / secs, spawns, spawns / secs,
+	   (unsigned long long) stages[LMAP_LATENCY_REAP].count,
+	   overlaps, suppressions, failures, queued);
+    print_histogram("lag", &lag);
+    for (i = 0; i < LMAP_LATENCY_STAGES; i++) {
+	print_histogram(lmap_latency_stage_name(i), &stages[i]);
+    }
+    if (lmap_alloc_enabled()) {
+	printf(",\"config_bytes\":%llu,\"reload_peak_bytes\":%llu",
+	       config_bytes, reload_bytes);
+    }
+    printf(",\"maxrss_kb\":%ld}\n", ru.ru_maxrss);
+
+    (void) lmapd_workspace_clean(lmapd);
+    lmapd_free(lmapd);
+    lmapd_sim_free(sim);
+    (void) rmdir(queue);
+    (void) unlink(caps);
+    (void) unlink(config);
+    (void) rmdir(dir);
+}
+
+static void
+usage(FILE *f)
+{
+    fprintf(f, "usage: bench-lmapd [-h] [-g] [-n schedules] [-m actions] [-k events]\n"
+	    "                   [-p suppressions] [-i interval] [-d duration]\n"
+	    "                   [-r reloads] [-t program] [-o]\n"
+	    "                   [-v seconds [-e msecs] [-x status]]\n"
+	    "\t-h show brief usage information and exit\n"
+	    "\t-g write the synthetic config to stdout and exit\n"
+	    "\t-n number of schedules (default 100)\n"
+	    "\t-m number of actions per schedule (default 2)\n"
+	    "\t-k number of periodic events (default 10)\n"
+	    "\t-p number of suppressions (default 2)\n"
+	    "\t-i period of the events in seconds (default 1)\n"
+	    "\t-d seconds to run the scheduler (default 5)\n"
+	    "\t-r number of reloads to time (default 5)\n"
+	    "\t-t task program (default /bin/true)\n"
+	    "\t-o deliver all results to a report schedule\n"
+	    "\t-v seconds to simulate on a virtual clock instead of -d\n"
+	    "\t-e run time of a simulated task in milliseconds (default 100)\n"
+	    "\t-x exit status of a simulated task (default 0)\n");
+}
+
+static size_t
+number(const char *arg, uint64_t min, uint64_t max)
+{
+    uint64_t value;
+
+    if (lmap_atou64(arg, max, &value) != 0 || value < min) {
+	fprintf(stderr, "bench-lmapd: invalid number '%s'\n", arg);
+	exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct params p = {
+	.schedules = 100, .actions = 2, .events = 10, .suppressions = 2,
+	.interval = 1, .duration = 5, .reloads = 5, .program = "/bin/true",
+	.task_ms = 100
+    };
+    int opt, generate = 0;
+
+    while ((opt = getopt(argc, argv, "hgn:m:k:p:i:d:r:t:ov:e:x:")) != -1) {
+	switch (opt) {
+	case 'h':
+	    usage(stdout);
+	    exit(EXIT_SUCCESS);
+	case 'g':
+	    generate = 1;
+	    break;
+	case 'n':
+	    p.schedules = number(optarg, 1, 10000000);
+	    break;
+	case 'm':
+	    p.actions = number(optarg, 1, 1000);
+	    break;
+	case 'k':
+	    p.events = number(optarg, 1, 1000000);
+	    break;
+	case 'p':
+	    p.suppressions = number(optarg, 0, 1000000);
+	    break;
+	case 'i':
+	    p.interval = number(optarg, 1, 86400);
+	    break;
+	case 'd':
+	    p.duration = number(optarg, 1, 86400);
+	    break;
+	case 'r':
+	    p.reloads = number(optarg, 0, 1000);
+	    break;
+	case 't':
+	    p.program = optarg;
+	    break;
+	case 'o':
+	    p.report = 1;
+	    break;
+	case 'v':
+	    p.simulate = number(optarg, 1, 3650 * 86400);
+	    break;
+	case 'e':
+	    p.task_ms = number(optarg, 0, 86400000);
+	    break;
+	case 'x':
+	    p.task_status = number(optarg, 0, 255);
+	    break;
+	default:
+	    usage(stderr);
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    if (generate) {
+	write_config(stdout, &p);
+	return EXIT_SUCCESS;
+    }
+
+    lmap_set_log_handler(quiet);
+    run(&p);
+    return EXIT_SUCCESS;
+}
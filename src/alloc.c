@@ -0,0 +1,160 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Allocation counters per object type. The constructors and free
+ * functions in data.c count the objects and the bytes they own.
+ * Configuration files may be parsed by several threads, hence the
+ * counters are updated with relaxed atomic operations; the values
+ * read by lmap_alloc_stats() are therefore only approximately
+ * consistent with each other while other threads allocate.
+ */
+
+#include <string.h>
+
+#include "alloc.h"
+
+static const char *type_names[LMAP_ALLOC_TYPES] = {
+    "schedule", "action", "task", "event", "supp", "option",
+    "tag", "result", "table", "row", "value", "string"
+};
+
+#ifdef HAVE_ALLOC_STATS
+
+static struct lmap_alloc_stats counters[LMAP_ALLOC_TYPES];
+
+/**
+ * @brief Counts allocated objects
+ *
+ * @param type the type of the objects (LMAP_ALLOC_*)
+ * @param count the number of objects (may be 0 if an object grows)
+ * @param bytes the number of bytes allocated
+ */
+
+void
+lmap_alloc_count(int type, uint64_t count, uint64_t bytes)
+{
+    struct lmap_alloc_stats *c = &counters[type];
+    uint64_t now, peak;
+
+    __atomic_add_fetch(&c->live, count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->total, count, __ATOMIC_RELAXED);
+    now = __atomic_add_fetch(&c->bytes, bytes, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+    while (now > peak
+	   && ! __atomic_compare_exchange_n(&c->peak, &peak, now, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+}
+
+/**
+ * @brief Counts released objects
+ *
+ * @param type the type of the objects (LMAP_ALLOC_*)
+ * @param count the number of objects
+ * @param bytes the number of bytes released
+ */
+
+void
+lmap_alloc_uncount(int type, uint64_t count, uint64_t bytes)
+{
+    struct lmap_alloc_stats *c = &counters[type];
+
+    __atomic_sub_fetch(&c->live, count, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&c->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+#endif
+
+/**
+ * @brief Tells whether the allocation counters are compiled in
+ *
+ * @return 1 if the counters are available, 0 otherwise
+ */
+
+int
+lmap_alloc_enabled(void)
+{
+#ifdef HAVE_ALLOC_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Returns the name of an object type
+ *
+ * @param type the type of the objects (LMAP_ALLOC_*)
+ * @return the name of the type or NULL for an unknown type
+ */
+
+const char *
+lmap_alloc_type_name(int type)
+{
+    if (type < 0 || type >= LMAP_ALLOC_TYPES) {
+	return NULL;
+    }
+    return type_names[type];
+}
+
+/**
+ * @brief Returns the allocation counters of an object type
+ *
+ * @param type the type of the objects (LMAP_ALLOC_*)
+ * @param stats the counters to fill in
+ * @return 0 on success, -1 for an unknown type or if the counters
+ *         are not compiled in
+ */
+
+int
+lmap_alloc_stats(int type, struct lmap_alloc_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (type < 0 || type >= LMAP_ALLOC_TYPES) {
+	return -1;
+    }
+#ifdef HAVE_ALLOC_STATS
+    stats->live = __atomic_load_n(&counters[type].live, __ATOMIC_RELAXED);
+    stats->total = __atomic_load_n(&counters[type].total, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&counters[type].bytes, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&counters[type].peak, __ATOMIC_RELAXED);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * @brief Resets the peaks to the bytes currently allocated
+ *
+ * Allows to measure the peak of an operation, e.g., rendering a
+ * report or reloading the configuration.
+ */
+
+void
+lmap_alloc_reset_peak(void)
+{
+#ifdef HAVE_ALLOC_STATS
+    int i;
+
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	__atomic_store_n(&counters[i].peak,
+			 __atomic_load_n(&counters[i].bytes, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
+    }
+#endif
+}
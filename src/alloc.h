@@ -0,0 +1,79 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAP_ALLOC_H
+#define LMAP_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Allocation counters per object type. The counters are compiled in
+ * if lmapd is configured with -DENABLE_ALLOC_STATS=ON; otherwise the
+ * counting macros expand to nothing and lmap_alloc_stats() fails.
+ * Rows and values of tables count the cells and the columnar storage
+ * (row offsets and the string arena) of the tables.
+ */
+
+#define LMAP_ALLOC_SCHEDULE	0
+#define LMAP_ALLOC_ACTION	1
+#define LMAP_ALLOC_TASK		2
+#define LMAP_ALLOC_EVENT	3
+#define LMAP_ALLOC_SUPP		4
+#define LMAP_ALLOC_OPTION	5
+#define LMAP_ALLOC_TAG		6
+#define LMAP_ALLOC_RESULT	7
+#define LMAP_ALLOC_TABLE	8
+#define LMAP_ALLOC_ROW		9
+#define LMAP_ALLOC_VALUE	10
+#define LMAP_ALLOC_STRING	11
+#define LMAP_ALLOC_TYPES	12
+
+struct lmap_alloc_stats {
+    uint64_t live;		/* objects currently allocated */
+    uint64_t total;		/* objects allocated since the start */
+    uint64_t bytes;		/* bytes currently allocated */
+    uint64_t peak;		/* peak of bytes */
+};
+
+#ifdef HAVE_ALLOC_STATS
+
+extern void lmap_alloc_count(int type, uint64_t count, uint64_t bytes);
+extern void lmap_alloc_uncount(int type, uint64_t count, uint64_t bytes);
+
+#define LMAP_ALLOC_COUNT(type, count, bytes) \
+	lmap_alloc_count(type, count, bytes)
+#define LMAP_ALLOC_UNCOUNT(type, count, bytes) \
+	lmap_alloc_uncount(type, count, bytes)
+
+#else
+
+/* sizeof() keeps the arguments "used" without evaluating them */
+
+#define LMAP_ALLOC_COUNT(type, count, bytes) \
+	do { (void) sizeof(count); (void) sizeof(bytes); } while (0)
+#define LMAP_ALLOC_UNCOUNT(type, count, bytes) \
+	do { (void) sizeof(count); (void) sizeof(bytes); } while (0)
+
+#endif
+
+extern int lmap_alloc_enabled(void);
+extern const char *lmap_alloc_type_name(int type);
+extern int lmap_alloc_stats(int type, struct lmap_alloc_stats *stats);
+extern void lmap_alloc_reset_peak(void);
+
+#endif
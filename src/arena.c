@@ -0,0 +1,481 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A region allocator for the lmap data model. Memory is handed out
+ * from large chunks by bumping a pointer and all memory of an arena
+ * is released at once when the arena is freed; there is no way to
+ * release individual allocations. Every allocation is preceded by
+ * its size so that it can be grown (which is required for the
+ * columnar result tables).
+ *
+ * The data model allocates new objects from the arena that is in
+ * use by the current thread (see lmap_arena_use()). Every object
+ * remembers its arena so that data.c can allocate the strings stored
+ * in an object from the object's arena and never passes arena memory
+ * to free(). An arena merged into another arena stays around as an
+ * alias of that arena for the objects that still refer to it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "lmap.h"
+#include "utils.h"
+#include "arena.h"
+
+#define LMAP_ARENA_CHUNK_MIN	(64 * 1024)
+#define LMAP_ARENA_CHUNK_MAX	(8 * 1024 * 1024)
+#define LMAP_ARENA_ALIGN	sizeof(uint64_t)
+#define LMAP_ARENA_HEADER	sizeof(uint64_t)
+
+struct chunk {
+    struct chunk *next;
+    char *base;				/* first usable byte */
+    char *end;				/* one after the last byte */
+    char *pos;				/* next free byte */
+    char *last;				/* most recent allocation */
+};
+
+struct lmap_arena {
+    struct chunk *chunks;		/* most recent chunk first */
+    size_t chunk_size;			/* size of the next chunk */
+    int foreign;			/* holds foreign (heap) objects */
+    struct lmap_arena_stats stats;
+    struct lmap_arena *merged;		/* arena this one was merged into */
+    struct lmap_arena *aliases;		/* arenas merged into this one */
+    struct lmap_arena *next;		/* list of live arenas or aliases */
+};
+
+static __thread struct lmap_arena *current = NULL;
+
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lmap_arena *arenas = NULL;
+static size_t live_reserved = 0;
+static size_t peak_reserved = 0;
+
+static inline size_t
+align(size_t size)
+{
+    return (size + LMAP_ARENA_ALIGN - 1) & ~(LMAP_ARENA_ALIGN - 1);
+}
+
+static inline struct lmap_arena *
+resolve(struct lmap_arena *arena)
+{
+    while (arena->merged) {
+	arena = arena->merged;
+    }
+    return arena;
+}
+
+static void
+release(struct lmap_arena *arena)
+{
+    struct lmap_arena *alias;
+
+    while (arena->aliases) {
+	alias = arena->aliases;
+	arena->aliases = alias->next;
+	release(alias);
+    }
+    if (current == arena) {
+	current = NULL;
+    }
+    free(arena);
+}
+
+static int
+contains(struct lmap_arena *arena, const void *ptr)
+{
+    struct chunk *c;
+    const char *p = ptr;
+
+    for (c = arena->chunks; c; c = c->next) {
+	if (p >= c->base && p < c->end) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/**
+ * @brief Creates a new arena
+ *
+ * Creates a new, empty arena. No memory is reserved until the first
+ * allocation is made.
+ *
+ * @return pointer to the arena or NULL on error
+ */
+
+struct lmap_arena *
+lmap_arena_new(void)
+{
+    struct lmap_arena *arena;
+
+    arena = calloc(1, sizeof(*arena));
+    if (! arena) {
+	lmap_err("failed to allocate memory");
+	return NULL;
+    }
+    arena->chunk_size = LMAP_ARENA_CHUNK_MIN;
+
+    pthread_mutex_lock(&arenas_lock);
+    arena->next = arenas;
+    arenas = arena;
+    pthread_mutex_unlock(&arenas_lock);
+    return arena;
+}
+
+/**
+ * @brief Releases an arena and all memory allocated from it
+ *
+ * If the arena is in use by the calling thread, the thread stops
+ * using it. The aliases of arenas merged into the arena are released
+ * as well. An arena that was merged into another arena is released
+ * together with that arena.
+ *
+ * @param arena The arena to release
+ */
+
+void
+lmap_arena_free(struct lmap_arena *arena)
+{
+    struct lmap_arena **ap;
+    struct chunk *c;
+
+    if (! arena || arena->merged) {
+	return;
+    }
+
+    pthread_mutex_lock(&arenas_lock);
+    for (ap = &arenas; *ap; ap = &(*ap)->next) {
+	if (*ap == arena) {
+	    *ap = arena->next;
+	    break;
+	}
+    }
+    live_reserved -= arena->stats.reserved;
+    pthread_mutex_unlock(&arenas_lock);
+
+    while (arena->chunks) {
+	c = arena->chunks;
+	arena->chunks = c->next;
+	free(c);
+    }
+    release(arena);
+}
+
+/**
+ * @brief Moves all memory of an arena into another arena
+ *
+ * The chunks of src are handed over to dst and src becomes an alias
+ * of dst: allocations from src are served by dst and src is released
+ * together with dst. Objects allocated from src stay where they are
+ * and are released together with dst. This allows to build object
+ * graphs in several threads, each using its own arena, and to combine
+ * them without copying.
+ *
+ * @param dst The arena receiving the memory
+ * @param src The arena to merge into dst
+ */
+
+void
+lmap_arena_merge(struct lmap_arena *dst, struct lmap_arena *src)
+{
+    struct lmap_arena **ap;
+    struct chunk **cp;
+
+    if (! dst || ! src) {
+	return;
+    }
+    dst = resolve(dst);
+    src = resolve(src);
+    if (dst == src) {
+	return;
+    }
+
+    pthread_mutex_lock(&arenas_lock);
+    for (ap = &arenas; *ap; ap = &(*ap)->next) {
+	if (*ap == src) {
+	    *ap = src->next;
+	    break;
+	}
+    }
+
+    /* keep the current chunk of dst in front, it is used for allocations */
+    for (cp = &dst->chunks; *cp; cp = &(*cp)->next) ;
+    *cp = src->chunks;
+    dst->foreign |= src->foreign;
+    dst->stats.allocs += src->stats.allocs;
+    dst->stats.bytes += src->stats.bytes;
+    dst->stats.reserved += src->stats.reserved;
+    src->chunks = NULL;
+    memset(&src->stats, 0, sizeof(src->stats));
+    src->merged = dst;
+    src->next = dst->aliases;
+    dst->aliases = src;
+    pthread_mutex_unlock(&arenas_lock);
+}
+
+static struct chunk *
+chunk_new(struct lmap_arena *arena, size_t need)
+{
+    struct chunk *c;
+    size_t size = arena->chunk_size;
+
+    while (size < need + sizeof(struct chunk) + LMAP_ARENA_ALIGN) {
+	size *= 2;
+    }
+    c = malloc(size);
+    if (! c) {
+	return NULL;
+    }
+    c->base = (char *) c + align(sizeof(struct chunk));
+    c->end = (char *) c + size;
+    c->pos = c->base;
+    c->last = NULL;
+    c->next = arena->chunks;
+    arena->chunks = c;
+    if (arena->chunk_size < LMAP_ARENA_CHUNK_MAX) {
+	arena->chunk_size *= 2;
+    }
+
+    arena->stats.reserved += size;
+    pthread_mutex_lock(&arenas_lock);
+    live_reserved += size;
+    if (live_reserved > peak_reserved) {
+	peak_reserved = live_reserved;
+    }
+    pthread_mutex_unlock(&arenas_lock);
+    return c;
+}
+
+/**
+ * @brief Allocates zeroed memory from an arena
+ *
+ * @param arena The arena
+ * @param size The number of bytes to allocate
+ * @return pointer to the memory or NULL on error
+ */
+
+void *
+lmap_arena_alloc(struct lmap_arena *arena, size_t size)
+{
+    struct chunk *c = (arena = resolve(arena))->chunks;
+    size_t need = LMAP_ARENA_HEADER + align(size ? size : 1);
+    char *p;
+
+    if (size > SIZE_MAX / 2) {
+	lmap_err("failed to allocate memory");
+	return NULL;
+    }
+    if (! c || (size_t) (c->end - c->pos) < need) {
+	c = chunk_new(arena, need);
+	if (! c) {
+	    lmap_err("failed to allocate memory");
+	    return NULL;
+	}
+    }
+
+    p = c->pos;
+    c->pos += need;
+    c->last = p;
+    *(uint64_t *) p = size;
+    p += LMAP_ARENA_HEADER;
+    memset(p, 0, size);
+
+    arena->stats.allocs++;
+    arena->stats.bytes += need;
+    return p;
+}
+
+/**
+ * @brief Resizes memory allocated from an arena
+ *
+ * The most recent allocation of an arena is grown in place if there
+ * is space left in its chunk. Otherwise, new memory is allocated and
+ * the old memory remains unused until the arena is freed. Memory
+ * added by growing an allocation is zeroed.
+ *
+ * @param arena The arena
+ * @param ptr The memory to resize or NULL
+ * @param size The new size in bytes
+ * @return pointer to the memory or NULL on error
+ */
+
+void *
+lmap_arena_realloc(struct lmap_arena *arena, void *ptr, size_t size)
+{
+    struct chunk *c = (arena = resolve(arena))->chunks;
+    char *hdr;
+    size_t old, need;
+    void *p;
+
+    if (! ptr) {
+	return lmap_arena_alloc(arena, size);
+    }
+
+    hdr = (char *) ptr - LMAP_ARENA_HEADER;
+    old = *(uint64_t *) hdr;
+    if (size <= old) {
+	return ptr;
+    }
+
+    need = LMAP_ARENA_HEADER + align(size);
+    if (c && c->last == hdr && (size_t) (c->end - hdr) >= need) {
+	arena->stats.bytes += need - (c->pos - hdr);
+	c->pos = hdr + need;
+	*(uint64_t *) hdr = size;
+	memset((char *) ptr + old, 0, size - old);
+	return ptr;
+    }
+
+    p = lmap_arena_alloc(arena, size);
+    if (p) {
+	memcpy(p, ptr, old);
+    }
+    return p;
+}
+
+/**
+ * @brief Duplicates a string into an arena
+ *
+ * @param arena The arena
+ * @param s The string to duplicate
+ * @return pointer to the copy or NULL on error
+ */
+
+char *
+lmap_arena_strdup(struct lmap_arena *arena, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *p;
+
+    p = lmap_arena_alloc(arena, len);
+    if (p) {
+	memcpy(p, s, len);
+    }
+    return p;
+}
+
+/**
+ * @brief Finds the arena a pointer was allocated from
+ *
+ * The arena in use by the calling thread is checked first, then all
+ * live arenas are scanned under a global lock. This is meant for
+ * diagnostics; the data model takes the arena from the object.
+ *
+ * @param ptr The pointer
+ * @return The arena owning ptr or NULL if ptr is not arena memory
+ */
+
+struct lmap_arena *
+lmap_arena_find(const void *ptr)
+{
+    struct lmap_arena *arena;
+
+    if (! ptr) {
+	return NULL;
+    }
+    if (current && contains(current, ptr)) {
+	return current;
+    }
+    if (! __atomic_load_n(&arenas, __ATOMIC_ACQUIRE)) {
+	return NULL;
+    }
+
+    pthread_mutex_lock(&arenas_lock);
+    for (arena = arenas; arena; arena = arena->next) {
+	if (arena != current && contains(arena, ptr)) {
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&arenas_lock);
+    return arena;
+}
+
+/**
+ * @brief Marks an arena as holding objects not allocated from it
+ *
+ * The data model calls this function when a heap allocated object
+ * is linked into an object graph allocated from the arena. The graph
+ * then has to be released object by object.
+ *
+ * @param arena The arena
+ */
+
+void
+lmap_arena_set_foreign(struct lmap_arena *arena)
+{
+    if (arena) {
+	resolve(arena)->foreign = 1;
+    }
+}
+
+int
+lmap_arena_foreign(struct lmap_arena *arena)
+{
+    return arena ? resolve(arena)->foreign : 0;
+}
+
+/**
+ * @brief Returns the allocation statistics of an arena
+ *
+ * @param arena The arena
+ * @param stats The statistics to fill in
+ */
+
+void
+lmap_arena_stats(struct lmap_arena *arena, struct lmap_arena_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (arena) {
+	*stats = resolve(arena)->stats;
+    }
+    pthread_mutex_lock(&arenas_lock);
+    stats->peak = peak_reserved;
+    pthread_mutex_unlock(&arenas_lock);
+}
+
+/**
+ * @brief Selects the arena used by the calling thread
+ *
+ * All objects of the data model created by the calling thread are
+ * allocated from this arena until another arena is selected. NULL
+ * selects the heap.
+ *
+ * @param arena The arena to use or NULL
+ * @return The arena that was used before
+ */
+
+struct lmap_arena *
+lmap_arena_use(struct lmap_arena *arena)
+{
+    struct lmap_arena *old = current;
+
+    current = arena ? resolve(arena) : NULL;
+    return old;
+}
+
+struct lmap_arena *
+lmap_arena_current(void)
+{
+    return current;
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAP_ARENA_H
+#define LMAP_ARENA_H
+
+#include <stddef.h>
+
+struct lmap_arena;
+
+/**
+ * Allocation statistics of an arena. The peak is the largest number
+ * of bytes reserved by all arenas of the process at the same time.
+ */
+
+struct lmap_arena_stats {
+    unsigned long allocs;		/* number of allocations */
+    size_t bytes;			/* bytes handed out */
+    size_t reserved;			/* bytes reserved in chunks */
+    size_t peak;			/* peak reserved bytes (process) */
+};
+
+extern struct lmap_arena * lmap_arena_new(void);
+extern void lmap_arena_free(struct lmap_arena *arena);
+extern void lmap_arena_merge(struct lmap_arena *dst, struct lmap_arena *src);
+extern void * lmap_arena_alloc(struct lmap_arena *arena, size_t size);
+extern void * lmap_arena_realloc(struct lmap_arena *arena, void *ptr, size_t size);
+extern char * lmap_arena_strdup(struct lmap_arena *arena, const char *s);
+extern struct lmap_arena * lmap_arena_find(const void *ptr);
+extern void lmap_arena_set_foreign(struct lmap_arena *arena);
+extern int lmap_arena_foreign(struct lmap_arena *arena);
+extern void lmap_arena_stats(struct lmap_arena *arena,
+			     struct lmap_arena_stats *stats);
+
+extern struct lmap_arena * lmap_arena_use(struct lmap_arena *arena);
+extern struct lmap_arena * lmap_arena_current(void);
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Report chunks: the results of a report are split into multiple
+ * self-contained report documents that are bounded by the number of
+ * results and by their size. A manifest next to each chunk lists the
+ * workspace files consumed by the chunk. Once a chunk was delivered,
+ * it is acknowledged, which removes the workspace files, the manifest
+ * and the chunk. Results of chunks that are still pending are not
+ * reported again.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "lmap.h"
+#include "utils.h"
+#include "compress.h"
+#include "chunk.h"
+
+static int
+count_write(void *ctx, const char *buf, size_t len)
+{
+    (void) buf;
+    *(size_t *) ctx += len;
+    return 0;
+}
+
+/*
+ * Returns the (uncompressed) size of a report of the results of
+ * the lmap.
+ */
+
+static size_t
+report_size(struct lmap_chunker *chunker, struct lmap *lmap)
+{
+    size_t size = 0;
+
+    (void) chunker->report(lmap, count_write, &size);
+    return size;
+}
+
+/*
+ * Renders the report chunk into the file tmp and the manifest into
+ * the file mtmp.
+ */
+
+static int
+write_files(struct lmap_chunker *chunker, struct lmap *chunk,
+	    const char *tmp, const char *mtmp)
+{
+    struct result *res;
+    struct lmap_compress *z;
+    FILE *f;
+    int fd, ret;
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+	lmap_err("failed to create '%s': %s", tmp, strerror(errno));
+	return -1;
+    }
+    z = lmap_compress_new(chunker->compress_method, chunker->compress_level,
+			  chunker->compress_workers, lmap_write_fd, &fd);
+    if (! z) {
+	(void) close(fd);
+	return -1;
+    }
+    ret = chunker->report(chunk, lmap_compress_write, z);
+    if (lmap_compress_finish(z) == -1) {
+	ret = -1;
+    }
+    if (close(fd) == -1 || ret == -1) {
+	lmap_err("failed to write '%s'", tmp);
+	return -1;
+    }
+
+    f = fopen(mtmp, "w");
+    if (! f) {
+	lmap_err("failed to create '%s': %s", mtmp, strerror(errno));
+	return -1;
+    }
+    for (res = chunk->results; res; res = res->next) {
+	if (res->file) {
+	    fprintf(f, "%s.meta\n%s.data\n", res->file, res->file);
+	}
+    }
+    if (fclose(f) == EOF) {
+	lmap_err("failed to write '%s'", mtmp);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Writes a self-contained report with the results of the chunk lmap
+ * into the chunk directory. The chunk and its manifest
+ * are written under temporary names and then linked to their final
+ * names. Since link() never replaces an existing file, a chunk of an
+ * earlier run that is still pending is never overwritten; if a name
+ * is taken, the next sequence number is tried. The manifest is linked
+ * first so that the results are known to be pending as soon as the
+ * chunk shows up.
+ */
+
+static int
+write_chunk(struct lmap_chunker *chunker, struct lmap *chunk, int *seq)
+{
+    char path[PATH_MAX], manifest[PATH_MAX + 8];
+    char tmp[PATH_MAX], mtmp[PATH_MAX + 8];
+    int err, ret = -1;
+
+    snprintf(tmp, sizeof(tmp), "%s/.chunk-%d.tmp",
+	     chunker->dir, (int) getpid());
+    snprintf(mtmp, sizeof(mtmp), "%s/.chunk-%d%s.tmp",
+	     chunker->dir, (int) getpid(), LMAP_CHUNK_MANIFEST_SUFFIX);
+    if (write_files(chunker, chunk, tmp, mtmp) == -1) {
+	goto exit;
+    }
+
+    for (;;) {
+	if (snprintf(path, sizeof(path), "%s/report-%lu-%04d%s",
+		     chunker->dir, (unsigned long) chunk->agent->report_date,
+		     ++(*seq), chunker->suffix) >= (int) sizeof(path)) {
+	    lmap_err("chunk directory path '%s' too long", chunker->dir);
+	    goto exit;
+	}
+	snprintf(manifest, sizeof(manifest), "%s%s",
+		 path, LMAP_CHUNK_MANIFEST_SUFFIX);
+	if (link(mtmp, manifest) == -1) {
+	    if (errno == EEXIST) {
+		continue;
+	    }
+	    lmap_err("failed to write manifest '%s': %s",
+		     manifest, strerror(errno));
+	    goto exit;
+	}
+	if (link(tmp, path) == -1) {
+	    err = errno;
+	    (void) unlink(manifest);
+	    if (err == EEXIST) {
+		continue;
+	    }
+	    lmap_err("failed to write report chunk '%s': %s",
+		     path, strerror(err));
+	    goto exit;
+	}
+	break;
+    }
+
+    if (chunker->names) {
+	if (chunker->names(chunker->names_ctx, path, strlen(path)) == -1
+	    || chunker->names(chunker->names_ctx, "\n", 1) == -1) {
+	    goto exit;
+	}
+    }
+    ret = 0;
+
+exit:
+    (void) unlink(tmp);
+    (void) unlink(mtmp);
+    return ret;
+}
+
+static int
+strcmp_cb(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * Removes all results from the lmap that are already part of a
+ * report chunk that has not been acknowledged yet. Pending chunks
+ * are identified by their manifests in the chunk directory.
+ */
+
+static int
+skip_pending(struct lmap_chunker *chunker, struct lmap *lmap)
+{
+    DIR *dir;
+    struct dirent *dp;
+    FILE *f;
+    char path[PATH_MAX], line[PATH_MAX];
+    char **files = NULL, **p;
+    size_t len, cnt = 0, size = 0;
+    struct result *res, **rp;
+    const size_t slen = strlen(LMAP_CHUNK_MANIFEST_SUFFIX);
+
+    dir = opendir(chunker->dir);
+    if (! dir) {
+	lmap_err("failed to open chunk directory '%s'", chunker->dir);
+	return -1;
+    }
+    while ((dp = readdir(dir)) != NULL) {
+	len = strlen(dp->d_name);
+	if (len <= slen
+	    || strcmp(dp->d_name + len - slen, LMAP_CHUNK_MANIFEST_SUFFIX)) {
+	    continue;
+	}
+	snprintf(path, sizeof(path), "%s/%s", chunker->dir, dp->d_name);
+	f = fopen(path, "r");
+	if (! f) {
+	    continue;
+	}
+	while (fgets(line, sizeof(line), f)) {
+	    len = strlen(line);
+	    if (len < 6 || strcmp(line + len - 6, ".meta\n")) {
+		continue;
+	    }
+	    line[len - 6] = 0;
+	    if (cnt == size) {
+		size = size ? 2 * size : 64;
+		p = realloc(files, size * sizeof(char *));
+		if (! p) {
+		    lmap_err("failed to allocate memory");
+		    break;
+		}
+		files = p;
+	    }
+	    files[cnt] = strdup(line);
+	    if (files[cnt]) {
+		cnt++;
+	    }
+	}
+	(void) fclose(f);
+    }
+    (void) closedir(dir);
+
+    if (cnt) {
+	qsort(files, cnt, sizeof(char *), strcmp_cb);
+	for (rp = &lmap->results; *rp; ) {
+	    res = *rp;
+	    if (res->file && bsearch(&res->file, files, cnt,
+				     sizeof(char *), strcmp_cb)) {
+		lmap_result_free(lmap_unlink_result(lmap, rp));
+		continue;
+	    }
+	    rp = &res->next;
+	}
+    }
+    while (cnt) {
+	free(files[--cnt]);
+    }
+    free(files);
+    return 0;
+}
+
+/*
+ * Moves all results of the lmap from into the lmap to.
+ */
+
+static void
+move_results(struct lmap *from, struct lmap *to)
+{
+    struct result *res;
+
+    while (from->results) {
+	res = lmap_unlink_result(from, &from->results);
+	if (lmap_add_result(to, res) == -1) {
+	    lmap_result_free(res);
+	}
+    }
+}
+
+/**
+ * @brief Writes the results of an lmap into report chunks
+ *
+ * Splits the results into multiple self-contained report documents
+ * that are bounded by the number of results and by their size. The
+ * size of a chunk is the size of the empty report plus the sizes of
+ * the results it contains, which are obtained by rendering them
+ * individually into a byte counter. A single result exceeding the
+ * size limit is reported in a chunk of its own. Results that are
+ * part of a pending chunk are removed from the lmap first. The path
+ * of every chunk written is passed to the names function of the
+ * chunker, followed by a newline.
+ *
+ * The results are moved one by one into a temporary lmap holding the
+ * chunk (sharing the agent) and back into the lmap once the chunk
+ * was written, so the results of the lmap keep their order.
+ *
+ * @param lmap pointer to the lmap with the agent and the results
+ * @param chunker pointer to the chunk parameters
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_chunk_report(struct lmap *lmap, struct lmap_chunker *chunker)
+{
+    struct lmap *chunk = NULL, *probe = NULL;
+    struct result *res;
+    size_t empty, size = 0, rsize;
+    unsigned long cnt = 0, todo = 0;
+    int seq = 0, ret = -1;
+
+    if (! lmap->agent) {
+	lmap_err("report chunks require an agent");
+	return -1;
+    }
+
+    if (skip_pending(chunker, lmap) == -1) {
+	return -1;
+    }
+
+    chunk = lmap_new();
+    probe = lmap_new();
+    if (! chunk || ! probe) {
+	goto exit;
+    }
+    chunk->agent = probe->agent = lmap->agent;
+
+    empty = report_size(chunker, chunk);
+    for (res = lmap->results; res; res = res->next) {
+	todo++;
+    }
+    for (; todo; todo--) {
+	res = lmap_unlink_result(lmap, &lmap->results);
+	rsize = 0;
+	if (chunker->max_bytes) {
+	    if (lmap_add_result(probe, res) == -1) {
+		lmap_result_free(res);
+		goto exit;
+	    }
+	    rsize = report_size(chunker, probe) - empty;
+	    (void) lmap_unlink_result(probe, &probe->results);
+	}
+	if (cnt && ((chunker->max_results && cnt >= chunker->max_results)
+		    || (chunker->max_bytes
+			&& size + rsize > chunker->max_bytes))) {
+	    if (write_chunk(chunker, chunk, &seq) == -1) {
+		if (lmap_add_result(chunk, res) == -1) {
+		    lmap_result_free(res);
+		}
+		goto exit;
+	    }
+	    move_results(chunk, lmap);
+	    cnt = 0;
+	}
+	if (! cnt) {
+	    size = empty;
+	    if (chunker->max_bytes && size + rsize > chunker->max_bytes) {
+		lmap_wrn("result '%s' exceeds the chunk size limit",
+			 res->file ? res->file : "?");
+	    }
+	}
+	if (lmap_add_result(chunk, res) == -1) {
+	    lmap_result_free(res);
+	    goto exit;
+	}
+	size += rsize;
+	cnt++;
+    }
+    if (cnt && write_chunk(chunker, chunk, &seq) == -1) {
+	goto exit;
+    }
+    ret = 0;
+
+exit:
+    /* the results not written yet follow those already written */
+    if (chunk) {
+	move_results(chunk, lmap);
+	chunk->agent = NULL;
+	lmap_free(chunk);
+    }
+    if (probe) {
+	probe->agent = NULL;
+	lmap_free(probe);
+    }
+    while (todo-- > 1) {
+	res = lmap_unlink_result(lmap, &lmap->results);
+	if (lmap_add_result(lmap, res) == -1) {
+	    lmap_result_free(res);
+	}
+    }
+    return ret;
+}
+
+/**
+ * @brief Acknowledges a delivered report chunk
+ *
+ * Removes the workspace files listed in the manifest of the chunk,
+ * followed by the manifest and the chunk itself. If a workspace file
+ * cannot be removed, the manifest and the chunk are kept so that the
+ * chunk can be acknowledged again.
+ *
+ * @param path the path of the report chunk
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_chunk_ack(const char *path)
+{
+    FILE *f;
+    char manifest[PATH_MAX + 8];
+    char line[PATH_MAX];
+    size_t len;
+    int ret = 0;
+
+    if (snprintf(manifest, sizeof(manifest), "%s%s",
+		 path, LMAP_CHUNK_MANIFEST_SUFFIX) >= (int) sizeof(manifest)) {
+	lmap_err("chunk path '%s' too long", path);
+	return -1;
+    }
+    f = fopen(manifest, "r");
+    if (! f) {
+	lmap_err("failed to open manifest '%s'", manifest);
+	return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+	len = strlen(line);
+	if (len && line[len-1] == '\n') {
+	    line[len-1] = 0;
+	}
+	if (line[0] && unlink(line) == -1 && errno != ENOENT) {
+	    lmap_err("failed to remove '%s'", line);
+	    ret = -1;
+	}
+    }
+    (void) fclose(f);
+    if (ret == 0) {
+	if (unlink(manifest) == -1
+	    || (unlink(path) == -1 && errno != ENOENT)) {
+	    lmap_err("failed to remove chunk '%s'", path);
+	    ret = -1;
+	}
+    }
+    return ret;
+}
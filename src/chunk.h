@@ -0,0 +1,49 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAP_CHUNK_H
+#define LMAP_CHUNK_H
+
+#include "lmap.h"
+
+#define LMAP_CHUNK_MANIFEST_SUFFIX	".files"
+
+/*
+ * Renders a report of the results of an lmap, e.g.,
+ * lmap_xml_write_report() or lmap_json_write_report().
+ */
+
+typedef int (lmap_report_func) (struct lmap *lmap,
+				lmap_write_func *func, void *ctx);
+
+struct lmap_chunker {
+    const char *dir;			/* directory receiving the chunks */
+    const char *suffix;			/* suffix of chunk names (".xml.gz") */
+    unsigned long max_results;		/* results per chunk (0 = no limit) */
+    unsigned long max_bytes;		/* uncompressed bytes (0 = no limit) */
+    lmap_report_func *report;		/* renders a report */
+    int compress_method;		/* see compress.h */
+    int compress_level;
+    int compress_workers;
+    lmap_write_func *names;		/* receives the chunk paths (or NULL) */
+    void *names_ctx;
+};
+
+extern int lmap_chunk_report(struct lmap *lmap, struct lmap_chunker *chunker);
+extern int lmap_chunk_ack(const char *path);
+
+#endif
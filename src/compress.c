@@ -0,0 +1,318 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A compressing output stream. Renderers hand their output to
+ * lmap_compress_write() as they produce it and the compressed bytes
+ * are passed on to the next writer (usually a file descriptor). Only
+ * a fixed size output buffer is kept, i.e., there is never a complete
+ * uncompressed (or compressed) copy of a document in memory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "lmap.h"
+#include "utils.h"
+#include "compress.h"
+
+#define LMAP_COMPRESS_BUFSIZE	65536
+
+struct lmap_compress {
+    int method;
+    lmap_write_func *func;
+    void *ctx;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *cctx;
+#endif
+    char buf[LMAP_COMPRESS_BUFSIZE];
+};
+
+static struct {
+    const char *name;
+    int method;
+} methods[] = {
+    { "none",	LMAP_COMPRESS_NONE },
+#ifdef HAVE_ZLIB
+    { "gzip",	LMAP_COMPRESS_GZIP },
+#endif
+#ifdef HAVE_ZSTD
+    { "zstd",	LMAP_COMPRESS_ZSTD },
+#endif
+    { NULL, 0 }
+};
+
+/**
+ * @brief Maps a compression method name to a compression method
+ *
+ * @param name The name of the compression method (none, gzip, zstd)
+ * @return The compression method or -1 if the method is unknown or
+ *         not supported by this build
+ */
+
+int
+lmap_compress_method(const char *name)
+{
+    int i;
+
+    for (i = 0; name && methods[i].name; i++) {
+	if (! strcmp(methods[i].name, name)) {
+	    return methods[i].method;
+	}
+    }
+
+    lmap_err("unsupported compression method '%s'", name ? name : "");
+    return -1;
+}
+
+/**
+ * @brief Creates a new compressing output stream
+ *
+ * Creates a new compressing output stream that writes the compressed
+ * data to the writer func. The level is passed to the compression
+ * library; LMAP_COMPRESS_LEVEL_DEFAULT selects the library default.
+ * Lower levels trade compression ratio for throughput; zstd also
+ * accepts negative (fast) levels. The number of workers is only used
+ * by zstd and requires a multi-threaded libzstd.
+ *
+ * @param method The compression method
+ * @param level The compression level
+ * @param workers The number of zstd worker threads (0 = none)
+ * @param func The writer receiving the compressed data
+ * @param ctx The context passed to the writer
+ * @return pointer to the stream or NULL on error
+ */
+
+struct lmap_compress *
+lmap_compress_new(int method, int level, int workers,
+		  lmap_write_func *func, void *ctx)
+{
+    struct lmap_compress *z;
+
+    assert(func);
+
+    z = calloc(1, sizeof(*z));
+    if (! z) {
+	lmap_err("failed to allocate memory");
+	return NULL;
+    }
+    z->method = method;
+    z->func = func;
+    z->ctx = ctx;
+
+    switch (method) {
+    case LMAP_COMPRESS_NONE:
+	break;
+#ifdef HAVE_ZLIB
+    case LMAP_COMPRESS_GZIP:
+	if (level == LMAP_COMPRESS_LEVEL_DEFAULT) {
+	    level = Z_DEFAULT_COMPRESSION;
+	}
+	if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION) {
+	    lmap_err("illegal gzip compression level %d", level);
+	    goto error;
+	}
+	/* 16 + MAX_WBITS asks zlib for a gzip header and trailer */
+	if (deflateInit2(&z->zs, level, Z_DEFLATED, 16 + MAX_WBITS,
+			 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+	    lmap_err("failed to initialize gzip compression");
+	    goto error;
+	}
+	break;
+#endif
+#ifdef HAVE_ZSTD
+    case LMAP_COMPRESS_ZSTD:
+	z->cctx = ZSTD_createCCtx();
+	if (! z->cctx) {
+	    lmap_err("failed to initialize zstd compression");
+	    goto error;
+	}
+	if (level == LMAP_COMPRESS_LEVEL_DEFAULT) {
+	    level = ZSTD_CLEVEL_DEFAULT;
+	}
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(z->cctx,
+				ZSTD_c_compressionLevel, level))) {
+	    lmap_err("illegal zstd compression level %d", level);
+	    goto error;
+	}
+	if (workers > 0
+	    && ZSTD_isError(ZSTD_CCtx_setParameter(z->cctx,
+				ZSTD_c_nbWorkers, workers))) {
+	    lmap_wrn("zstd workers not supported - compressing inline");
+	}
+	break;
+#endif
+    default:
+	lmap_err("unsupported compression method %d", method);
+	goto error;
+    }
+
+    (void) workers;
+    return z;
+
+error:
+#ifdef HAVE_ZSTD
+    if (z->cctx) {
+	ZSTD_freeCCtx(z->cctx);
+    }
+#endif
+    free(z);
+    return NULL;
+}
+
+#ifdef HAVE_ZLIB
+static int
+gzip_write(struct lmap_compress *z, const char *buf, size_t len, int flush)
+{
+    int ret;
+
+    z->zs.next_in = (Bytef *) buf;
+    z->zs.avail_in = len;
+    do {
+	z->zs.next_out = (Bytef *) z->buf;
+	z->zs.avail_out = sizeof(z->buf);
+	ret = deflate(&z->zs, flush);
+	if (ret == Z_STREAM_ERROR) {
+	    lmap_err("gzip compression failed");
+	    return -1;
+	}
+	if (sizeof(z->buf) - z->zs.avail_out) {
+	    if (z->func(z->ctx, z->buf, sizeof(z->buf) - z->zs.avail_out) == -1) {
+		return -1;
+	    }
+	}
+    } while (z->zs.avail_out == 0);
+    return 0;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int
+zstd_write(struct lmap_compress *z, const char *buf, size_t len,
+	   ZSTD_EndDirective mode)
+{
+    ZSTD_inBuffer in = { buf, len, 0 };
+    ZSTD_outBuffer out;
+    size_t remaining;
+
+    do {
+	out.dst = z->buf;
+	out.size = sizeof(z->buf);
+	out.pos = 0;
+	remaining = ZSTD_compressStream2(z->cctx, &out, &in, mode);
+	if (ZSTD_isError(remaining)) {
+	    lmap_err("zstd compression failed: %s",
+		     ZSTD_getErrorName(remaining));
+	    return -1;
+	}
+	if (out.pos) {
+	    if (z->func(z->ctx, z->buf, out.pos) == -1) {
+		return -1;
+	    }
+	}
+    } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    return 0;
+}
+#endif
+
+/**
+ * @brief Writes data into a compressing output stream
+ *
+ * This function has the signature of an lmap_write_func so that it
+ * can be passed directly to the streaming renderers.
+ *
+ * @param ctx The compressing output stream
+ * @param buf The data to compress
+ * @param len The number of bytes in buf
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_compress_write(void *ctx, const char *buf, size_t len)
+{
+    struct lmap_compress *z = ctx;
+
+    assert(z);
+
+    if (! len) {
+	return 0;
+    }
+
+    switch (z->method) {
+#ifdef HAVE_ZLIB
+    case LMAP_COMPRESS_GZIP:
+	return gzip_write(z, buf, len, Z_NO_FLUSH);
+#endif
+#ifdef HAVE_ZSTD
+    case LMAP_COMPRESS_ZSTD:
+	return zstd_write(z, buf, len, ZSTD_e_continue);
+#endif
+    default:
+	return z->func(z->ctx, buf, len);
+    }
+}
+
+/**
+ * @brief Flushes and frees a compressing output stream
+ *
+ * Writes any pending compressed data and the stream trailer and
+ * releases all resources. The underlying writer is not closed.
+ *
+ * @param z The compressing output stream
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_compress_finish(struct lmap_compress *z)
+{
+    int ret = 0;
+
+    if (! z) {
+	return 0;
+    }
+
+    switch (z->method) {
+#ifdef HAVE_ZLIB
+    case LMAP_COMPRESS_GZIP:
+	ret = gzip_write(z, NULL, 0, Z_FINISH);
+	deflateEnd(&z->zs);
+	break;
+#endif
+#ifdef HAVE_ZSTD
+    case LMAP_COMPRESS_ZSTD:
+	ret = zstd_write(z, NULL, 0, ZSTD_e_end);
+	ZSTD_freeCCtx(z->cctx);
+	break;
+#endif
+    default:
+	break;
+    }
+
+    free(z);
+    return ret;
+}
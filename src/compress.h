@@ -0,0 +1,43 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAP_COMPRESS_H
+#define LMAP_COMPRESS_H
+
+#include "lmap.h"
+
+#define LMAP_COMPRESS_NONE	0x00
+#define LMAP_COMPRESS_GZIP	0x01
+#define LMAP_COMPRESS_ZSTD	0x02
+
+/* the range of levels accepted by any method (zstd: -(1 << 17) .. 22) */
+#define LMAP_COMPRESS_LEVEL_MIN		(-131072)
+#define LMAP_COMPRESS_LEVEL_MAX		22
+#define LMAP_COMPRESS_LEVEL_DEFAULT	(LMAP_COMPRESS_LEVEL_MIN - 1)
+#define LMAP_COMPRESS_WORKERS_MAX	64
+
+struct lmap_compress;
+
+extern int lmap_compress_method(const char *name);
+extern struct lmap_compress * lmap_compress_new(int method, int level,
+						int workers,
+						lmap_write_func *func,
+						void *ctx);
+extern int lmap_compress_write(void *ctx, const char *buf, size_t len);
+extern int lmap_compress_finish(struct lmap_compress *z);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "xml-io.h"
+#include "arena.h"
+#include "snapshot.h"
+#include "config.h"
+
+/**
+ * @brief Reads the XML config file
+ *
+ * Function to read the XML config file and initialize the
+ * coresponding data structures with data. If a snapshot file is
+ * configured, the config is loaded from the snapshot as long as the
+ * config files did not change and a new snapshot is written after
+ * the config files have been parsed and validated.
+ *
+ * @param lmapd pointer to the lmapd struct
+ * @param valid set to 1 if the config is valid
+ * @return 0 on success -1 or error
+ */
+
+int
+lmapd_read_config(struct lmapd *lmapd, int *valid)
+{
+    int ret = 0, have_key = 0;
+    uint64_t key = 0;
+    struct lmap_arena *old;
+    struct lmap_arena_stats stats;
+
+    /*
+     * The config is built in an arena owned by the lmap so that the
+     * whole data model is released in one go on a restart.
+     */
+
+    lmapd->lmap = lmap_new_with_arena();
+    if (! lmapd->lmap) {
+	return -1;
+    }
+    old = lmap_arena_use(lmapd->lmap->arena);
+
+    if (lmapd->snapshot_path) {
+	const char *paths[] = {
+	    lmapd->config_path, lmapd->capability_path, NULL
+	};
+	have_key = (lmap_snapshot_key(paths, &key) == 0);
+    }
+    if (have_key) {
+	ret = lmap_snapshot_load(lmapd->lmap, lmapd->snapshot_path, key);
+	if (ret == 0) {
+	    lmap_dbg("loaded config snapshot '%s'", lmapd->snapshot_path);
+	    *valid = 1;
+	    goto loaded;
+	}
+	if (ret == -1) {
+	    /* partially loaded, start over with an empty config */
+	    lmap_free(lmapd->lmap);
+	    lmapd->lmap = lmap_new_with_arena();
+	    if (! lmapd->lmap) {
+		(void) lmap_arena_use(old);
+		return -1;
+	    }
+	    (void) lmap_arena_use(lmapd->lmap->arena);
+	}
+    }
+    
+    ret = lmap_xml_parse_config_path(lmapd->lmap, lmapd->config_path);
+    if (ret != 0) {
+	lmap_free(lmapd->lmap);
+	lmapd->lmap = NULL;
+	(void) lmap_arena_use(old);
+	return -1;
+    }
+    
+    ret = lmap_xml_parse_state_path(lmapd->lmap, lmapd->capability_path);
+    if (ret != 0) {
+	lmap_free(lmapd->lmap);
+	lmapd->lmap = NULL;
+	(void) lmap_arena_use(old);
+	return -1;
+    }
+
+    *valid = lmap_valid(lmapd->lmap);
+    if (*valid && have_key) {
+	(void) lmap_snapshot_save(lmapd->lmap, lmapd->snapshot_path, key);
+    }
+
+loaded:
+    if (lmapd->lmap->agent) {
+	lmapd->lmap->agent->last_started = time(NULL);
+    }
+
+    if (!lmapd->lmap->capabilities) {
+	lmapd->lmap->capabilities = lmap_capability_new();
+    }
+    if (lmapd->lmap->capabilities) {
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s version %d.%d.%d", LMAPD_LMAPD,
+		 LMAP_VERSION_MAJOR, LMAP_VERSION_MINOR, LMAP_VERSION_PATCH);
+	lmap_capability_set_version(lmapd->lmap->capabilities, buf);
+	lmap_capability_add_system_tags(lmapd->lmap->capabilities);
+    }
+
+    (void) lmap_arena_use(old);
+    lmap_arena_stats(lmapd->lmap->arena, &stats);
+    lmap_dbg("config uses %lu allocations, %zu bytes (%zu reserved)",
+	     stats.allocs, stats.bytes, stats.reserved);
+    return 0;
+}
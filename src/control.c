@@ -0,0 +1,478 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The control socket lets lmapctl talk to a running lmapd. It is a
+ * Unix domain stream socket in the run directory that is served by
+ * the libevent loop. A client sends a single request line (e.g.,
+ * "status") and receives a status line ("ok" or "error <message>"),
+ * possibly followed by a document, e.g., the lmap state in XML.
+ * The daemon closes the connection once the response has been sent.
+ *
+ * Requests are handled synchronously in the event loop; documents
+ * are rendered straight into the output buffer of the connection, so
+ * there is no file round-trip and no need to guess when the daemon
+ * is done.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "xml-io.h"
+#include "runner.h"
+#include "workspace.h"
+#include "control.h"
+#include "latency.h"
+
+#define CONTROL_LINE_MAX	256
+#define CONTROL_TIMEOUT		10	/* seconds */
+
+struct control_conn {
+    struct bufferevent *bev;
+    struct control *control;
+    int shutdown;			/* stop lmapd once the response is out */
+    struct control_conn *next;
+};
+
+struct control {
+    struct lmapd *lmapd;
+    struct evconnlistener *listener;
+    struct control_conn *conns;
+    char path[PATH_MAX];
+};
+
+static int
+control_path(const char *run_path, char *path, size_t size)
+{
+    struct sockaddr_un addr;
+
+    if (snprintf(path, size, "%s/%s", run_path, LMAPD_CONTROL_SOCKET)
+	>= (int) sizeof(addr.sun_path)) {
+	lmap_err("control socket path '%s/%s' too long",
+		 run_path, LMAPD_CONTROL_SOCKET);
+	return -1;
+    }
+    return 0;
+}
+
+static int
+evbuffer_write_cb(void *ctx, const char *buf, size_t len)
+{
+    return evbuffer_add((struct evbuffer *) ctx, buf, len);
+}
+
+static int
+status_req(struct lmapd *lmapd, struct evbuffer *doc)
+{
+    lmapd_workspace_update(lmapd);
+    return lmap_xml_write_state(lmapd->lmap, evbuffer_write_cb, doc);
+}
+
+static int
+config_req(struct lmapd *lmapd, struct evbuffer *doc)
+{
+    return lmap_xml_write_config(lmapd->lmap, evbuffer_write_cb, doc);
+}
+
+static int
+reload_req(struct lmapd *lmapd, struct evbuffer *doc)
+{
+    (void) doc;
+    return lmapd_reload(lmapd);
+}
+
+static int
+clean_req(struct lmapd *lmapd, struct evbuffer *doc)
+{
+    (void) doc;
+    if (lmapd_workspace_clean(lmapd) != 0) {
+	return -1;
+    }
+    return lmapd_workspace_init(lmapd);
+}
+
+static int
+shutdown_req(struct lmapd *lmapd, struct evbuffer *doc)
+{
+    (void) lmapd;
+    (void) doc;
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*func)(struct lmapd *lmapd, struct evbuffer *doc);
+    int need_lmap;
+} requests[] = {
+    { "status",		status_req,	1 },
+    { "config",		config_req,	1 },
+    { "reload",		reload_req,	0 },
+    { "clean",		clean_req,	0 },
+    { "shutdown",	shutdown_req,	0 },
+    { NULL,		NULL,		0 }
+};
+
+static void
+conn_free(struct control_conn *conn)
+{
+    struct control_conn **pp;
+
+    for (pp = &conn->control->conns; *pp; pp = &(*pp)->next) {
+	if (*pp == conn) {
+	    *pp = conn->next;
+	    break;
+	}
+    }
+    bufferevent_free(conn->bev);
+    free(conn);
+}
+
+static void
+conn_written_cb(struct bufferevent *bev, void *ctx)
+{
+    struct control_conn *conn = ctx;
+    struct lmapd *lmapd = conn->control->lmapd;
+    int shutdown = conn->shutdown;
+
+    (void) bev;
+    conn_free(conn);
+    if (shutdown) {
+	lmapd_stop(lmapd);
+    }
+}
+
+static void
+conn_event_cb(struct bufferevent *bev, short events, void *ctx)
+{
+    (void) bev;
+    (void) events;
+    conn_free((struct control_conn *) ctx);
+}
+
+static void
+conn_respond(struct control_conn *conn, const char *line)
+{
+    struct control *control = conn->control;
+    struct evbuffer *out = bufferevent_get_output(conn->bev);
+    struct evbuffer *doc;
+    uint64_t start = lmap_latency_now();
+    int i, ret = -1;
+
+    for (i = 0; requests[i].name; i++) {
+	if (! strcmp(requests[i].name, line)) {
+	    break;
+	}
+    }
+    if (! requests[i].name) {
+	evbuffer_add_printf(out, "error unknown request '%s'\n", line);
+	return;
+    }
+    if (requests[i].need_lmap && ! control->lmapd->lmap) {
+	evbuffer_add_printf(out, "error no configuration loaded\n");
+	return;
+    }
+
+    doc = evbuffer_new();
+    if (doc) {
+	ret = requests[i].func(control->lmapd, doc);
+    }
+    if (ret == 0) {
+	evbuffer_add_printf(out, "ok\n");
+	evbuffer_add_buffer(out, doc);
+	conn->shutdown = (requests[i].func == shutdown_req);
+    } else {
+	evbuffer_add_printf(out, "error %s failed\n", line);
+    }
+    if (doc) {
+	evbuffer_free(doc);
+    }
+    lmapd_watchdog(control->lmapd, "control request", start);
+}
+
+static void
+conn_read_cb(struct bufferevent *bev, void *ctx)
+{
+    struct control_conn *conn = ctx;
+    struct evbuffer *in = bufferevent_get_input(bev);
+    char *line;
+    size_t len;
+
+    line = evbuffer_readln(in, &len, EVBUFFER_EOL_LF);
+    if (! line) {
+	if (evbuffer_get_length(in) > CONTROL_LINE_MAX) {
+	    lmap_wrn("dropping control connection with an overlong request");
+	    conn_free(conn);
+	}
+	return;
+    }
+
+    /*
+     * Only one request per connection. The connection is released
+     * by conn_written_cb() once the response has been sent.
+     */
+
+    bufferevent_disable(bev, EV_READ);
+    conn_respond(conn, line);
+    free(line);
+    bufferevent_setcb(bev, NULL, conn_written_cb, conn_event_cb, conn);
+}
+
+static void
+accept_cb(struct evconnlistener *listener, evutil_socket_t fd,
+	  struct sockaddr *addr, int len, void *ctx)
+{
+    struct control *control = ctx;
+    struct control_conn *conn;
+    struct timeval timeout = { .tv_sec = CONTROL_TIMEOUT, .tv_usec = 0 };
+
+    (void) addr;
+    (void) len;
+
+    conn = calloc(1, sizeof(*conn));
+    if (! conn) {
+	lmap_err("failed to allocate memory");
+	evutil_closesocket(fd);
+	return;
+    }
+    conn->control = control;
+    conn->bev = bufferevent_socket_new(evconnlistener_get_base(listener),
+				       fd, BEV_OPT_CLOSE_ON_FREE);
+    if (! conn->bev) {
+	lmap_err("failed to create control connection");
+	evutil_closesocket(fd);
+	free(conn);
+	return;
+    }
+    conn->next = control->conns;
+    control->conns = conn;
+    bufferevent_setcb(conn->bev, conn_read_cb, NULL, conn_event_cb, conn);
+    bufferevent_set_timeouts(conn->bev, &timeout, &timeout);
+    bufferevent_enable(conn->bev, EV_READ);
+}
+
+/**
+ * @brief Opens the control socket
+ *
+ * Creates the control socket in the run directory (replacing a stale
+ * one) and registers it with the event loop of lmapd. The socket is
+ * only accessible by the owner of the lmapd process.
+ *
+ * @param lmapd pointer to the lmapd struct
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_control_open(struct lmapd *lmapd)
+{
+    struct control *control;
+    struct sockaddr_un addr;
+    evutil_socket_t fd;
+    mode_t mask;
+
+    if (! lmapd->run_path || ! lmapd->base) {
+	return 0;
+    }
+
+    control = calloc(1, sizeof(*control));
+    if (! control) {
+	lmap_err("failed to allocate memory");
+	return -1;
+    }
+    control->lmapd = lmapd;
+    if (control_path(lmapd->run_path, control->path,
+		     sizeof(control->path)) == -1) {
+	free(control);
+	return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, control->path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+	lmap_err("failed to create control socket: %s", strerror(errno));
+	free(control);
+	return -1;
+    }
+    (void) unlink(control->path);
+    mask = umask(0177);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+	(void) umask(mask);
+	lmap_err("failed to bind control socket '%s': %s",
+		 control->path, strerror(errno));
+	goto error;
+    }
+    (void) umask(mask);
+
+    if (evutil_make_socket_nonblocking(fd) == -1
+	|| evutil_make_socket_closeonexec(fd) == -1) {
+	goto error;
+    }
+    control->listener = evconnlistener_new(lmapd->base, accept_cb, control,
+					   LEV_OPT_CLOSE_ON_FREE
+					   | LEV_OPT_CLOSE_ON_EXEC, -1, fd);
+    if (! control->listener) {
+	lmap_err("failed to listen on control socket '%s'", control->path);
+	(void) unlink(control->path);
+	goto error;
+    }
+
+    lmapd->control = control;
+    return 0;
+
+error:
+    evutil_closesocket(fd);
+    free(control);
+    return -1;
+}
+
+/**
+ * @brief Closes the control socket
+ *
+ * Drops all pending control connections and removes the control
+ * socket. This must be called before the event base is freed.
+ *
+ * @param lmapd pointer to the lmapd struct
+ */
+
+void
+lmapd_control_close(struct lmapd *lmapd)
+{
+    struct control *control = lmapd->control;
+
+    if (! control) {
+	return;
+    }
+    while (control->conns) {
+	conn_free(control->conns);
+    }
+    evconnlistener_free(control->listener);
+    (void) unlink(control->path);
+    free(control);
+    lmapd->control = NULL;
+}
+
+/**
+ * @brief Sends a request to lmapd over the control socket
+ *
+ * Connects to the control socket in the run directory, sends the
+ * request and passes the document in the response (if any) to the
+ * writer func. Errors reported by lmapd are logged.
+ *
+ * @param run_path the run directory of lmapd
+ * @param request the request, e.g., "status"
+ * @param func writer receiving the document (may be NULL)
+ * @param ctx context passed to the writer
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_control_request(const char *run_path, const char *request,
+		      lmap_write_func *func, void *ctx)
+{
+    struct sockaddr_un addr;
+    char buf[8192], line[CONTROL_LINE_MAX];
+    size_t linelen = 0;
+    ssize_t n;
+    char *p, *nl;
+    int fd, ret = -1;
+    int done = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (control_path(run_path, addr.sun_path, sizeof(addr.sun_path)) == -1) {
+	return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+	lmap_err("failed to create socket: %s", strerror(errno));
+	return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+	lmap_err("failed to connect to lmapd at '%s': %s",
+		 addr.sun_path, strerror(errno));
+	goto exit;
+    }
+    if (lmap_write_fd(&fd, request, strlen(request)) == -1
+	|| lmap_write_fd(&fd, "\n", 1) == -1) {
+	goto exit;
+    }
+
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+	if (n == -1) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    lmap_err("failed to read from lmapd: %s", strerror(errno));
+	    goto exit;
+	}
+	p = buf;
+	if (! done) {
+	    nl = memchr(buf, '\n', n);
+	    if (linelen + (nl ? nl - buf : n) >= sizeof(line)) {
+		lmap_err("malformed response from lmapd");
+		goto exit;
+	    }
+	    memcpy(line + linelen, buf, nl ? nl - buf : n);
+	    linelen += nl ? nl - buf : n;
+	    if (! nl) {
+		continue;
+	    }
+	    line[linelen] = 0;
+	    if (strcmp(line, "ok") != 0) {
+		lmap_err("lmapd: %s",
+			 strncmp(line, "error ", 6) ? line : line + 6);
+		goto exit;
+	    }
+	    done = 1;
+	    n -= nl + 1 - buf;
+	    p = nl + 1;
+	}
+	if (n && func && func(ctx, p, n) == -1) {
+	    goto exit;
+	}
+    }
+    if (! done) {
+	lmap_err("lmapd closed the connection without a response");
+	goto exit;
+    }
+    ret = 0;
+
+exit:
+    (void) close(fd);
+    return ret;
+}
@@ -0,0 +1,29 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAPD_CONTROL_H
+#define LMAPD_CONTROL_H
+
+#include "lmap.h"
+#include "lmapd.h"
+
+extern int lmapd_control_open(struct lmapd *lmapd);
+extern void lmapd_control_close(struct lmapd *lmapd);
+extern int lmapd_control_request(const char *run_path, const char *request,
+				 lmap_write_func *func, void *ctx);
+
+#endif
@@ -159,6 +159,7 @@ csv_next(FILE *file, const char delimiter)
 		    break;
 		}
 		if (c == '\n') {
+		    ungetc(c, file);
 		    break;
 		}
 		buf[i] = c;
@@ -19,6 +19,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
@@ -32,45 +33,105 @@
 #include "lmap.h"
 #include "lmapd.h"
 #include "utils.h"
+#include "arena.h"
+#include "alloc.h"
 
 #define UNUSED(x) (void)(x)
 
+/*
+ * Memory management: New objects are allocated from the arena in use
+ * by the calling thread (if any) and remember that arena in their
+ * pool field. Memory hanging off an object (strings, indexes, table
+ * columns) is allocated from the object's pool, which is passed to
+ * the helpers below. Arena memory is never passed to free().
+ */
+
 static void *
-xcalloc(size_t count, size_t size, const char *func)
+xarena_calloc(struct lmap_arena *arena, size_t count, size_t size,
+	      const char *func)
 {
-    char *p = calloc(count, size);
+    char *p;
+
+    if (arena) {
+	if (size && count > SIZE_MAX / size) {
+	    p = NULL;
+	} else {
+	    p = lmap_arena_alloc(arena, count * size);
+	}
+    } else {
+	p = calloc(count, size);
+    }
     if (!p) {
         lmap_log(LOG_ERR, func, "failed to allocate memory");
     }
     return p;
 }
 
+static void *
+xcalloc(size_t count, size_t size, const char *func)
+{
+    return xarena_calloc(lmap_arena_current(), count, size, func);
+}
+
 static void
-xfree(void *ptr)
+xfree(struct lmap_arena *arena, void *ptr)
 {
-    if (ptr) {
+    if (! arena) {
         free(ptr);
     }
 }
 
+/*
+ * Strings stored in objects are allocated by set_string() and must be
+ * released with xfree_string() so that the allocation counters (see
+ * alloc.h) stay balanced.
+ */
+
+static void
+xfree_string(struct lmap_arena *arena, char *s)
+{
+    if (s) {
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_STRING, 1, strlen(s) + 1);
+	xfree(arena, s);
+    }
+}
+
+/*
+ * Arena memory cannot be released before the arena is freed. Hence a
+ * string of an arena object is overwritten in place if the new value
+ * fits; otherwise the old copy stays unused until the arena is freed.
+ */
+
 static int
-set_string(char **dp, const char *s, const char *func)
+set_string(struct lmap_arena *arena, char **dp, const char *s,
+	   const char *func)
 {
-    xfree(*dp);
+    size_t len;
+
+    if (arena && *dp && s && (len = strlen(s)) <= strlen(*dp)) {
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_STRING, 1, strlen(*dp) + 1);
+	memmove(*dp, s, len + 1);
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_STRING, 1, len + 1);
+	return 0;
+    }
+
+    xfree_string(arena, *dp);
     *dp = NULL;
     if (s) {
-        *dp = strdup(s);
+        *dp = arena ? lmap_arena_strdup(arena, s) : strdup(s);
 	if (! *dp) {
 	    lmap_log(LOG_ERR, func, "failed to allocate memory");
 	    return -1;
 	}
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_STRING, 1, strlen(s) + 1);
     }
     return 0;
 }
 
 #if 0
 static int
-set_yang_identifier(char **dp, const char *s, const char *func)
+set_yang_identifier(struct lmap_arena *arena, char **dp, const char *s,
+		    const char *func)
 {
     int i;
 
@@ -93,12 +154,13 @@ set_yang_identifier(char **dp, const char *s, const char *func)
 	}
     }
     
-    return set_string(dp, s, func);
+    return set_string(arena, dp, s, func);
 }
 #endif
 
 static int
-set_lmap_identifier(char **dp, const char *s, const char *func)
+set_lmap_identifier(struct lmap_arena *arena, char **dp, const char *s,
+		    const char *func)
 {
     int i;
     const char safe[] = "-.,_";
@@ -116,7 +178,7 @@ set_lmap_identifier(char **dp, const char *s, const char *func)
 	}
     }
     
-    return set_string(dp, s, func);
+    return set_string(arena, dp, s, func);
 }
 
 static int
@@ -134,24 +196,22 @@ set_boolean(int *dst, const char *value, const char *func)
 }
 
 static int
-set_tag(char **dp, const char *s, const char *func)
+set_tag(struct lmap_arena *arena, char **dp, const char *s, const char *func)
 {
     if (s && strlen(s) == 0) {
 	lmap_log(LOG_ERR, func, "illegal zero-length tag '%s'", s);
 	return -1;
     }
-    return set_string(dp, s, func);
+    return set_string(arena, dp, s, func);
 }
 
 static int
 set_int32(int32_t *ip, const char *s, const char *func)
 {
-    intmax_t i;
-    char *end;
+    int64_t i;
 
-    i = strtoimax(s, &end, 10);
-    if (*end || i > INT32_MAX) {
-	lmap_err("illegal int32 value '%s'", s);
+    if (lmap_atoi64(s, INT32_MIN, INT32_MAX, &i) == -1) {
+	lmap_log(LOG_ERR, func, "illegal int32 value '%s'", s);
 	return -1;
     }
     *ip = i;
@@ -161,12 +221,10 @@ set_int32(int32_t *ip, const char *s, const char *func)
 static int
 set_uint32(uint32_t *up, const char *s, const char *func)
 {
-    uintmax_t u;
-    char *end;
+    uint64_t u;
 
-    u = strtoumax(s, &end, 10);
-    if (*end || u > UINT32_MAX) {
-	lmap_err("illegal uint32 value '%s'", s);
+    if (lmap_atou64(s, UINT32_MAX, &u) == -1) {
+	lmap_log(LOG_ERR, func, "illegal uint32 value '%s'", s);
 	return -1;
     }
     *up = u;
@@ -176,15 +234,10 @@ set_uint32(uint32_t *up, const char *s, const char *func)
 static int
 set_uint64(uint64_t *up, const char *s, const char *func)
 {
-    uintmax_t u;
-    char *end;
-
-    u = strtoumax(s, &end, 10);
-    if (*end || u > UINT64_MAX) {
-	lmap_err("illegal uint64 value '%s'", s);
+    if (lmap_atou64(s, UINT64_MAX, up) == -1) {
+	lmap_log(LOG_ERR, func, "illegal uint64 value '%s'", s);
 	return -1;
     }
-    *up = u;
     return 0;
 }
 
@@ -265,11 +318,230 @@ set_dateandtime(time_t *tp, const char *s, const char *func)
 
 }
 
+/*
+ * List indexes: An index remembers the tail and the length of a list
+ * so that elements can be appended in constant time. Lists of named
+ * elements (key_off != LIST_NOKEY) additionally get an open addressing
+ * hash table of element pointers once they have LMAP_INDEX_HASH_MIN
+ * elements; the keys are not copied but read from the elements. A
+ * missing index is rebuilt from the list, hence code that links list
+ * elements by other means only has to make sure that the index of
+ * the list is dropped.
+ */
+
+struct lmap_index {
+    struct lmap_arena *pool;		/* arena the index lives in */
+    void *tail;
+    size_t count;
+    size_t size;			/* number of hash slots */
+    void **slots;
+};
+
+#define LMAP_INDEX_HASH_MIN	8
+
+#define LIST_NOKEY		((size_t) -1)
+#define LIST_NEXT(elem, off)	(*(void **) ((char *) (elem) + (off)))
+#define LIST_KEY(elem, off)	(*(char **) ((char *) (elem) + (off)))
+
+static uint32_t
+hash_string(const char *s)
+{
+    uint32_t h = 2166136261u;		/* 32-bit FNV-1a */
+
+    while (*s) {
+	h ^= (unsigned char) *s++;
+	h *= 16777619u;
+    }
+    return h;
+}
+
+static void
+index_free(struct lmap_index *idx)
+{
+    if (idx) {
+	xfree(idx->pool, idx->slots);
+	xfree(idx->pool, idx);
+    }
+}
+
+static void
+index_hash_insert(struct lmap_index *idx, void *elem, size_t key_off)
+{
+    size_t i, mask = idx->size - 1;
+
+    for (i = hash_string(LIST_KEY(elem, key_off)) & mask;
+	 idx->slots[i]; i = (i + 1) & mask) ;
+    idx->slots[i] = elem;
+}
+
+static int
+index_rehash(struct lmap_index *idx, void *head,
+	     size_t next_off, size_t key_off, size_t size, const char *func)
+{
+    void **slots, *elem;
+
+    slots = xarena_calloc(idx->pool, size, sizeof(void *), func);
+    if (! slots) {
+	return -1;
+    }
+    xfree(idx->pool, idx->slots);
+    idx->slots = slots;
+    idx->size = size;
+    for (elem = head; elem; elem = LIST_NEXT(elem, next_off)) {
+	if (LIST_KEY(elem, key_off)) {
+	    index_hash_insert(idx, elem, key_off);
+	}
+    }
+    return 0;
+}
+
+static struct lmap_index *
+index_get(struct lmap_arena *arena, struct lmap_index **idxp, void *head,
+	  size_t next_off, const char *func)
+{
+    struct lmap_index *idx = *idxp;
+    void *elem;
+
+    if (! idx) {
+	idx = xarena_calloc(arena, 1, sizeof(*idx), func);
+	if (! idx) {
+	    return NULL;
+	}
+	idx->pool = arena;
+	for (elem = head; elem; elem = LIST_NEXT(elem, next_off)) {
+	    idx->tail = elem;
+	    idx->count++;
+	}
+	*idxp = idx;
+    }
+    return idx;
+}
+
+static void *
+list_find(void *head, struct lmap_index *idx, const char *key,
+	  size_t next_off, size_t key_off)
+{
+    void *elem;
+    size_t i, mask;
+
+    if (idx && idx->slots) {
+	mask = idx->size - 1;
+	for (i = hash_string(key) & mask;
+	     (elem = idx->slots[i]) != NULL; i = (i + 1) & mask) {
+	    if (! strcmp(LIST_KEY(elem, key_off), key)) {
+		return elem;
+	    }
+	}
+	return NULL;
+    }
+
+    for (elem = head; elem; elem = LIST_NEXT(elem, next_off)) {
+	if (LIST_KEY(elem, key_off) && ! strcmp(LIST_KEY(elem, key_off), key)) {
+	    return elem;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Appends elem (living in elem_arena) to the list starting at *headp
+ * of an object living in arena. Returns 0 on success, 1 if the list
+ * already contains an element with the same key and -1 if memory
+ * allocation failed.
+ */
+
+static int
+list_append(struct lmap_arena *arena, void **headp, struct lmap_index **idxp,
+	    void *elem, struct lmap_arena *elem_arena,
+	    size_t next_off, size_t key_off, const char *func)
+{
+    struct lmap_index *idx;
+    const int keyed = (key_off != LIST_NOKEY);
+    const char *key = keyed ? LIST_KEY(elem, key_off) : NULL;
+
+    idx = index_get(arena, idxp, *headp, next_off, func);
+    if (! idx) {
+	return -1;
+    }
+
+    if (key && list_find(*headp, idx, key, next_off, key_off)) {
+	return 1;
+    }
+
+    if (arena && ! elem_arena) {
+	lmap_arena_set_foreign(arena);
+    }
+
+    if (idx->tail) {
+	LIST_NEXT(idx->tail, next_off) = elem;
+    } else {
+	*headp = elem;
+    }
+    idx->tail = elem;
+    idx->count++;
+
+    if (keyed && idx->count >= LMAP_INDEX_HASH_MIN) {
+	if (! idx->slots || 4 * idx->count > 3 * idx->size) {
+	    /* keep the load factor below 3/4 */
+	    if (index_rehash(idx, *headp, next_off, key_off,
+			     idx->size ? 2 * idx->size : 4 * LMAP_INDEX_HASH_MIN,
+			     func) == -1) {
+		index_free(idx);
+		*idxp = NULL;
+	    }
+	} else if (key) {
+	    index_hash_insert(idx, elem, key_off);
+	}
+    }
+    return 0;
+}
+
+/*
+ * Unlinks the element *elemp points to from the list starting at
+ * *headp. The elemp pointer must point into the list, i.e., it is
+ * either headp or the next field of an element.
+ */
+
+static void *
+list_unlink(void **headp, struct lmap_index **idxp, void **elemp,
+	    size_t next_off)
+{
+    struct lmap_index *idx = *idxp;
+    void *elem = *elemp;
+
+    if (! elem) {
+	return NULL;
+    }
+    *elemp = LIST_NEXT(elem, next_off);
+    LIST_NEXT(elem, next_off) = NULL;
+
+    if (idx && idx->slots) {
+	/* rebuilt on demand, deleting from the hash table is not worth it */
+	index_free(idx);
+	*idxp = NULL;
+    } else if (idx) {
+	if (idx->tail == elem) {
+	    idx->tail = (elemp == headp) ? NULL : (char *) elemp - next_off;
+	}
+	idx->count--;
+    }
+    return elem;
+}
+
+#define LIST_APPEND(arena, headp, idxp, elem, type, key, func) \
+    list_append((arena), (void **) (headp), (idxp), (elem), (elem)->pool, \
+		offsetof(type, next), offsetof(type, key), (func))
+
+#define LIST_FIND(head, idx, name, type, key) \
+    ((type *) list_find((head), (idx), (name), \
+			offsetof(type, next), offsetof(type, key)))
+
 static int
-add_tag(struct tag **tagp, const char *value, const char *func)
+add_tag(struct lmap_arena *arena, struct tag **tagp, struct lmap_index **idxp,
+	const char *value, const char *func)
 {
-    struct tag *tail;
     struct tag *tag;
+    int ret;
 
     tag = lmap_tag_new();
     if (! tag) {
@@ -277,125 +549,95 @@ add_tag(struct tag **tagp, const char *value, const char *func)
     }
     lmap_tag_set_tag(tag, value);
 
-    if (!*tagp) {
-	*tagp = tag;
-	return 0;
-    }
-
-    for (tail = *tagp; tail; ) {
-	if (strcmp(tail->tag, value) == 0) {
-	    lmap_tag_free(tag);
+    ret = LIST_APPEND(arena, tagp, idxp, tag, struct tag, tag, func);
+    if (ret) {
+	lmap_tag_free(tag);
+	if (ret == 1) {
 	    lmap_log(LOG_WARNING, func, "ignoring duplicate tag '%s'", value);
-	    return -1;
-	}
-	if (tail->next) {
-	    tail = tail->next;
-	} else {
-	    tail->next = tag;
-	    break;
 	}
+	return -1;
     }
     return 0;
 }
 
 static void
-free_all_tags(struct tag *tags)
+free_all_tags(struct tag *tags, struct lmap_index *idx)
 {
     while (tags) {
 	struct tag *old = tags;
 	tags = tags->next;
 	lmap_tag_free(old);
     }
+    index_free(idx);
 }
 
 static int
-add_option(struct option **optionp, struct option *option, const char *func)
+add_option(struct lmap_arena *arena, struct option **optionp,
+	   struct lmap_index **idxp, struct option *option, const char *func)
 {
-    struct option **tail = optionp;
-    struct option *cur;
+    int ret;
 
     if (! option->id) {
 	lmap_log(LOG_ERR, func, "unnamed option");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->id, option->id)) {
-		lmap_log(LOG_ERR, func, "duplicate option '%s'", option->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(arena, optionp, idxp, option, struct option, id, func);
+    if (ret == 1) {
+	lmap_log(LOG_ERR, func, "duplicate option '%s'", option->name);
     }
-    *tail = option;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 static void
-free_all_options(struct option *options)
+free_all_options(struct option *options, struct lmap_index *idx)
 {
     while (options) {
 	struct option *old = options;
 	options = options->next;
 	lmap_option_free(old);
     }
+    index_free(idx);
 }
 
 struct event *
 lmap_find_event(struct lmap *lmap, const char *name)
 {
-    struct event *event;
-
     if (!lmap || !name) {
 	return NULL;
     }
-    
-    for (event = lmap->events; event; event = event->next) {
-	if (event->name && strcmp(event->name, name) == 0) {
-	    return event;
-	}
-    }
 
-    return NULL;
+    return LIST_FIND(lmap->events, lmap->events_idx, name, struct event, name);
 }
 
 struct task *
 lmap_find_task(struct lmap *lmap, const char *name)
 {
-    struct task *task;
-
     if (!lmap || !name) {
 	return NULL;
     }
-    
-    for (task = lmap->tasks; task; task = task->next) {
-	if (task->name && strcmp(task->name, name) == 0) {
-	    return task;
-	}
+
+    return LIST_FIND(lmap->tasks, lmap->tasks_idx, name, struct task, name);
+}
+
+struct supp *
+lmap_find_supp(struct lmap *lmap, const char *name)
+{
+    if (!lmap || !name) {
+	return NULL;
     }
 
-    return NULL;
+    return LIST_FIND(lmap->supps, lmap->supps_idx, name, struct supp, name);
 }
 
 struct schedule *
 lmap_find_schedule(struct lmap *lmap, const char *name)
 {
-    struct schedule *schedule;
-
-    if (! lmap || !name) {
+    if (!lmap || !name) {
 	return NULL;
     }
-    
-    for (schedule = lmap->schedules; schedule; schedule = schedule->next) {
-	if (schedule->name && strcmp(schedule->name, name) == 0) {
-	    return schedule;
-	}
-    }
 
-    return NULL;
+    return LIST_FIND(lmap->schedules, lmap->schedules_idx, name, struct schedule, name);
 }
 
 /*
@@ -416,6 +658,40 @@ lmap_new()
     struct lmap *lmap;
 
     lmap = (struct lmap*) xcalloc(1, sizeof(struct lmap), __FUNCTION__);
+    if (lmap) {
+	lmap->pool = lmap_arena_current();
+    }
+    return lmap;
+}
+
+/**
+ * @brief Allocates a struct lmap that owns an arena
+ *
+ * Allocates a new arena and a struct lmap in it. Objects added to
+ * the lmap should be created while the arena is in use, see
+ * lmap_arena_use(). Freeing the lmap releases the arena.
+ *
+ * @return pointer to a struct lmap on success, NULL on error
+ */
+
+struct lmap*
+lmap_new_with_arena()
+{
+    struct lmap_arena *arena, *old;
+    struct lmap *lmap;
+
+    arena = lmap_arena_new();
+    if (! arena) {
+	return NULL;
+    }
+    old = lmap_arena_use(arena);
+    lmap = lmap_new();
+    (void) lmap_arena_use(old);
+    if (! lmap) {
+	lmap_arena_free(arena);
+	return NULL;
+    }
+    lmap->arena = arena;
     return lmap;
 }
 
@@ -429,43 +705,221 @@ lmap_new()
 void
 lmap_free(struct lmap *lmap)
 {
+    struct lmap_arena *arena;
+    struct schedule *sched;
+    struct action *act;
+    struct event *ev;
+
+    /* the allocation counters need the objects released one by one */
+    if (lmap && lmap->arena && ! lmap_arena_foreign(lmap->arena)
+	&& ! lmap_alloc_enabled()) {
+	/* runtime statistics are allocated lazily on the heap */
+	for (sched = lmap->schedules; sched; sched = sched->next) {
+	    for (act = sched->actions; act; act = act->next) {
+		free(act->latency);
+	    }
+	}
+	for (ev = lmap->events; ev; ev = ev->next) {
+	    free(ev->lag);
+	}
+	/* everything else lives in the arena, release it in one go */
+	lmap_arena_free(lmap->arena);
+	return;
+    }
+
     if (lmap) {
+	arena = lmap->arena;
         if (lmap->agent) {
 	    lmap_agent_free(lmap->agent);
 	}
 
+	if (lmap->capabilities) {
+	    lmap_capability_free(lmap->capabilities);
+	}
+
 	while (lmap->schedules) {
 	    struct schedule *next = lmap->schedules->next;
 	    lmap_schedule_free(lmap->schedules);
 	    lmap->schedules = next;
 	}
+	index_free(lmap->schedules_idx);
 	
 	while (lmap->supps) {
 	    struct supp *next = lmap->supps->next;
 	    lmap_supp_free(lmap->supps);
 	    lmap->supps = next;
 	}
+	index_free(lmap->supps_idx);
 	
 	while (lmap->tasks) {
 	    struct task *next = lmap->tasks->next;
 	    lmap_task_free(lmap->tasks);
 	    lmap->tasks = next;
 	}
+	index_free(lmap->tasks_idx);
 	
 	while (lmap->events) {
 	    struct event *next = lmap->events->next;
 	    lmap_event_free(lmap->events);
 	    lmap->events = next;
 	}
+	index_free(lmap->events_idx);
 	
 	while (lmap->results) {
 	    struct result *next = lmap->results->next;
 	    lmap_result_free(lmap->results);
 	    lmap->results = next;
 	}
+	index_free(lmap->results_idx);
 	
-	xfree(lmap);
+	xfree(lmap->pool, lmap);
+	lmap_arena_free(arena);
+    }
+}
+
+/*
+ * Moves the string *src of an object living in src_arena to *dst of
+ * an object living in dst_arena. The string is copied if it cannot be
+ * released together with the destination object.
+ */
+
+static void
+move_string(struct lmap_arena *dst_arena, char **dst,
+	    struct lmap_arena *src_arena, char **src)
+{
+    if (! *src) {
+	return;
+    }
+    if (! dst_arena != ! src_arena) {
+	(void) set_string(dst_arena, dst, *src, __FUNCTION__);
+	xfree_string(src_arena, *src);
+    } else {
+	xfree_string(dst_arena, *dst);
+	*dst = *src;
+    }
+    *src = NULL;
+}
+
+static void
+merge_agent(struct agent *dst, struct agent *src)
+{
+    move_string(dst->pool, &dst->agent_id, src->pool, &src->agent_id);
+    move_string(dst->pool, &dst->group_id, src->pool, &src->group_id);
+    move_string(dst->pool, &dst->measurement_point,
+		src->pool, &src->measurement_point);
+    if (src->flags & LMAP_AGENT_FLAG_REPORT_AGENT_ID_SET) {
+	dst->report_agent_id = src->report_agent_id;
+    }
+    if (src->flags & LMAP_AGENT_FLAG_REPORT_GROUP_ID_SET) {
+	dst->report_group_id = src->report_group_id;
+    }
+    if (src->flags & LMAP_AGENT_FLAG_REPORT_MEASUREMENT_POINT_SET) {
+	dst->report_measurement_point = src->report_measurement_point;
+    }
+    if (src->flags & LMAP_AGENT_FLAG_CONTROLLER_TIMEOUT_SET) {
+	dst->controller_timeout = src->controller_timeout;
+    }
+    dst->flags |= src->flags;
+    if (src->report_date) {
+	dst->report_date = src->report_date;
+    }
+    if (src->last_started) {
+	dst->last_started = src->last_started;
+    }
+}
+
+static void
+merge_capability(struct capability *dst, struct capability *src)
+{
+    struct tag *tag;
+    struct task *task;
+
+    move_string(dst->pool, &dst->version, src->pool, &src->version);
+    for (tag = src->tags; tag; tag = tag->next) {
+	(void) lmap_capability_add_tag(dst, tag->tag);
+    }
+    while (src->tasks) {
+	task = src->tasks;
+	src->tasks = task->next;
+	task->next = NULL;
+	if (lmap_capability_add_task(dst, task) != 0) {
+	    lmap_task_free(task);
+	}
+    }
+    index_free(src->tasks_idx);
+    src->tasks_idx = NULL;
+}
+
+/*
+ * Moves all elements of the list *srcp to the lmap using the add
+ * function. Elements rejected by the add function are released.
+ */
+
+#define MERGE_LIST(lmap, srcp, idxp, type, add, release)	\
+    do {								\
+	while (*(srcp)) {						\
+	    type *elem = *(srcp);					\
+	    *(srcp) = elem->next;					\
+	    elem->next = NULL;						\
+	    if (add((lmap), elem) != 0) {				\
+		release(elem);						\
+	    }								\
+	}								\
+	index_free(*(idxp));						\
+	*(idxp) = NULL;							\
+    } while (0)
+
+/**
+ * @brief Merges an lmap fragment into an lmap
+ *
+ * Moves the objects of the fragment into the lmap, following the
+ * semantics of parsing the fragment's document into the lmap: agent
+ * and capability leafs present in the fragment replace those of the
+ * lmap while schedules, suppressions, tasks and events are appended
+ * (duplicates are reported and dropped). The fragment is left empty
+ * and still needs to be released with lmap_free(). If the fragment
+ * was built in another arena, merge that arena into the arena of the
+ * lmap first, see lmap_arena_merge().
+ *
+ * @param lmap The lmap to merge into
+ * @param frag The fragment to merge
+ */
+
+void
+lmap_merge(struct lmap *lmap, struct lmap *frag)
+{
+    if (!lmap || !frag) {
+	return;
+    }
+
+    if (frag->agent) {
+	if (! lmap->agent) {
+	    lmap->agent = frag->agent;
+	} else {
+	    merge_agent(lmap->agent, frag->agent);
+	    lmap_agent_free(frag->agent);
+	}
+	frag->agent = NULL;
     }
+
+    if (frag->capabilities) {
+	if (! lmap->capabilities) {
+	    lmap->capabilities = frag->capabilities;
+	} else {
+	    merge_capability(lmap->capabilities, frag->capabilities);
+	    lmap_capability_free(frag->capabilities);
+	}
+	frag->capabilities = NULL;
+    }
+
+    MERGE_LIST(lmap, &frag->schedules, &frag->schedules_idx,
+	       struct schedule, lmap_add_schedule, lmap_schedule_free);
+    MERGE_LIST(lmap, &frag->supps, &frag->supps_idx,
+	       struct supp, lmap_add_supp, lmap_supp_free);
+    MERGE_LIST(lmap, &frag->tasks, &frag->tasks_idx,
+	       struct task, lmap_add_task, lmap_task_free);
+    MERGE_LIST(lmap, &frag->events, &frag->events_idx,
+	       struct event, lmap_add_event, lmap_event_free);
 }
 
 int
@@ -503,118 +957,102 @@ lmap_valid(struct lmap *lmap)
 int
 lmap_add_schedule(struct lmap *lmap, struct schedule *schedule)
 {
-    struct schedule **tail = &lmap->schedules;
-    struct schedule *cur = NULL;
+    int ret;
 
     if (! schedule->name) {
 	lmap_err("unnamed schedule");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->name, schedule->name)) {
-		lmap_err("duplicate schedule '%s'", schedule->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(lmap->pool, &lmap->schedules, &lmap->schedules_idx,
+		      schedule, struct schedule, name, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate schedule '%s'", schedule->name);
     }
-    *tail = schedule;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 int
 lmap_add_supp(struct lmap *lmap, struct supp *supp)
 {
-    struct supp **tail = &lmap->supps;
-    struct supp *cur = NULL;
+    int ret;
 
     if (! supp->name) {
 	lmap_err("unnamed suppression");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->name, supp->name)) {
-		lmap_err("duplicate suppression '%s'", supp->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(lmap->pool, &lmap->supps, &lmap->supps_idx,
+		      supp, struct supp, name, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate suppression '%s'", supp->name);
     }
-    *tail = supp;
-
-    return 0;
-}
+    return ret ? -1 : 0;
+}
 
 int
 lmap_add_task(struct lmap *lmap, struct task *task)
 {
-    struct task **tail = &lmap->tasks;
-    struct task *cur = NULL;
+    int ret;
 
     if (! task->name) {
 	lmap_err("unnamed task");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->name, task->name)) {
-		lmap_err("duplicate task '%s'", task->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(lmap->pool, &lmap->tasks, &lmap->tasks_idx,
+		      task, struct task, name, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate task '%s'", task->name);
     }
-    *tail = task;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 int
 lmap_add_event(struct lmap *lmap, struct event *event)
 {
-    struct event **tail = &lmap->events;
-    struct event *cur = NULL;
+    int ret;
 
     if (! event->name) {
 	lmap_err("unnamed event");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->name, event->name)) {
-		lmap_err("duplicate event '%s'", event->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(lmap->pool, &lmap->events, &lmap->events_idx,
+		      event, struct event, name, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate event '%s'", event->name);
     }
-    *tail = event;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 int
 lmap_add_result(struct lmap *lmap, struct result *res)
 {
-    struct result **tail = &lmap->results;
+    return list_append(lmap->pool, (void **) &lmap->results,
+		       &lmap->results_idx,
+		       res, res->pool,
+		       offsetof(struct result, next), LIST_NOKEY,
+		       __FUNCTION__) ? -1 : 0;
+}
 
-    while (*tail != NULL) {
-	tail = &((*tail)->next);
-    }
-    *tail = res;
+/**
+ * @brief Unlinks a result from the list of results
+ *
+ * Unlinks the result resp points to from the results of the lmap
+ * in constant time. The resp pointer must point into the list, i.e.,
+ * it is either &lmap->results or the next field of a result.
+ *
+ * @param lmap The struct lmap
+ * @param resp Pointer to the link to the result to unlink
+ * @return The unlinked result (which must be freed by the caller)
+ */
 
-    return 0;
+struct result *
+lmap_unlink_result(struct lmap *lmap, struct result **resp)
+{
+    return list_unlink((void **) &lmap->results, &lmap->results_idx,
+		       (void **) resp, offsetof(struct result, next));
 }
 
 /*
@@ -628,6 +1066,7 @@ lmap_agent_new()
 
     agent = (struct agent*) xcalloc(1, sizeof(struct agent), __FUNCTION__);
     if (agent) {
+	agent->pool = lmap_arena_current();
         agent->controller_timeout = 604800;	/* one week in seconds */
     }
     return agent;
@@ -637,10 +1076,10 @@ void
 lmap_agent_free(struct agent *agent)
 {
     if (agent) {
-        xfree(agent->agent_id);
-	xfree(agent->group_id);
-	xfree(agent->measurement_point);
-	xfree(agent);
+        xfree_string(agent->pool, agent->agent_id);
+	xfree_string(agent->pool, agent->group_id);
+	xfree_string(agent->pool, agent->measurement_point);
+	xfree(agent->pool, agent);
     }
 }
 
@@ -694,19 +1133,19 @@ lmap_agent_set_agent_id(struct agent *agent, const char *value)
 	}
     }
 
-    return set_string(&agent->agent_id, value, __FUNCTION__);
+    return set_string(agent->pool, &agent->agent_id, value, __FUNCTION__);
 }
 
 int
 lmap_agent_set_group_id(struct agent *agent, const char *value)
 {
-    return set_string(&agent->group_id, value, __FUNCTION__);
+    return set_string(agent->pool, &agent->group_id, value, __FUNCTION__);
 }
 
 int
 lmap_agent_set_measurement_point(struct agent *agent, const char *value)
 {
-    return set_string(&agent->measurement_point, value, __FUNCTION__);
+    return set_string(agent->pool, &agent->measurement_point, value, __FUNCTION__);
 }
 
 int
@@ -779,6 +1218,9 @@ lmap_capability_new()
     struct capability *capability;
 
     capability = (struct capability*) xcalloc(1, sizeof(struct capability), __FUNCTION__);
+    if (capability) {
+	capability->pool = lmap_arena_current();
+    }
     return capability;
 }
 
@@ -786,8 +1228,15 @@ void
 lmap_capability_free(struct capability *capability)
 {
     if (capability) {
-	xfree(capability->version);
-	xfree(capability);
+	xfree_string(capability->pool, capability->version);
+	while (capability->tasks) {
+	    struct task *next = capability->tasks->next;
+	    lmap_task_free(capability->tasks);
+	    capability->tasks = next;
+	}
+	index_free(capability->tasks_idx);
+	free_all_tags(capability->tags, capability->tags_idx);
+	xfree(capability->pool, capability);
     }
 }
 
@@ -804,39 +1253,31 @@ lmap_capability_valid(struct lmap *lmap, struct capability *capability)
 int
 lmap_capability_set_version(struct capability *capability, const char *value)
 {
-    return set_string(&capability->version, value, __FUNCTION__);
+    return set_string(capability->pool, &capability->version, value, __FUNCTION__);
 }
 
 int
 lmap_capability_add_tag(struct capability *capability, const char *value)
 {
-    return add_tag(&capability->tags, value, __FUNCTION__);
+    return add_tag(capability->pool, &capability->tags, &capability->tags_idx, value, __FUNCTION__);
 }
 
 int
 lmap_capability_add_task(struct capability *capability, struct task *task)
 {
-    struct task **tail = &capability->tasks;
-    struct task *cur = NULL;
+    int ret;
 
     if (! task->name) {
 	lmap_err("unnamed task");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->name, task->name)) {
-		lmap_err("duplicate task '%s'", task->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(capability->pool, &capability->tasks,
+		      &capability->tasks_idx, task, struct task, name, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate task '%s'", task->name);
     }
-    *tail = task;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 void
@@ -871,6 +1312,9 @@ lmap_registry_new()
     struct registry *registry;
 
     registry = (struct registry*) xcalloc(1, sizeof(struct registry), __FUNCTION__);
+    if (registry) {
+	registry->pool = lmap_arena_current();
+    }
     return registry;
 }
 
@@ -878,9 +1322,9 @@ void
 lmap_registry_free(struct registry *registry)
 {
     if (registry) {
-	xfree(registry->uri);
-	free_all_tags(registry->roles);
-	xfree(registry);
+	xfree_string(registry->pool, registry->uri);
+	free_all_tags(registry->roles, registry->roles_idx);
+	xfree(registry->pool, registry);
     }
 }
 
@@ -902,14 +1346,14 @@ lmap_registry_valid(struct lmap *lmap, struct registry *registry)
 int
 lmap_registry_set_uri(struct registry *registry, const char *value)
 {
-    return set_string(&registry->uri, value, __FUNCTION__);
+    return set_string(registry->pool, &registry->uri, value, __FUNCTION__);
 }
 
 int
 lmap_registry_add_role(struct registry *registry, const char *value)
 {
 
-    return add_tag(&registry->roles, value, __FUNCTION__);
+    return add_tag(registry->pool, &registry->roles, &registry->roles_idx, value, __FUNCTION__);
 }
 
 /*
@@ -922,6 +1366,10 @@ lmap_option_new()
     struct option *option;
 
     option = (struct option*) xcalloc(1, sizeof(struct option), __FUNCTION__);
+    if (option) {
+	option->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_OPTION, 1, sizeof(struct option));
+    }
     return option;
 }
 
@@ -929,10 +1377,11 @@ void
 lmap_option_free(struct option *option)
 {
     if (option) {
-	xfree(option->id);
-	xfree(option->name);
-	xfree(option->value);
-	xfree(option);
+	xfree_string(option->pool, option->id);
+	xfree_string(option->pool, option->name);
+	xfree_string(option->pool, option->value);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_OPTION, 1, sizeof(struct option));
+	xfree(option->pool, option);
     }
 }
 
@@ -954,19 +1403,19 @@ lmap_option_valid(struct lmap *lmap, struct option *option)
 int
 lmap_option_set_id(struct option *option, const char *value)
 {
-    return set_lmap_identifier(&option->id, value, __FUNCTION__);
+    return set_lmap_identifier(option->pool, &option->id, value, __FUNCTION__);
 }
 
 int
 lmap_option_set_name(struct option *option, const char *value)
 {
-    return set_string(&option->name, value, __FUNCTION__);
+    return set_string(option->pool, &option->name, value, __FUNCTION__);
 }
 
 int
 lmap_option_set_value(struct option *option, const char *value)
 {
-    return set_string(&option->value, value, __FUNCTION__);
+    return set_string(option->pool, &option->value, value, __FUNCTION__);
 }
 
 /*
@@ -979,6 +1428,10 @@ lmap_tag_new()
     struct tag *tag;
 
     tag = (struct tag*) xcalloc(1, sizeof(struct tag), __FUNCTION__);
+    if (tag) {
+	tag->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_TAG, 1, sizeof(struct tag));
+    }
     return tag;
 }
 
@@ -986,8 +1439,9 @@ void
 lmap_tag_free(struct tag *tag)
 {
     if (tag) {
-	xfree(tag->tag);
-	xfree(tag);
+	xfree_string(tag->pool, tag->tag);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_TAG, 1, sizeof(struct tag));
+	xfree(tag->pool, tag);
     }
 }
 
@@ -1009,7 +1463,7 @@ lmap_tag_valid(struct lmap *lmap, struct tag *tag)
 int
 lmap_tag_set_tag(struct tag *tag, const char *value)
 {
-    return set_tag(&tag->tag, value, __FUNCTION__);
+    return set_tag(tag->pool, &tag->tag, value, __FUNCTION__);
 }
 
 /*
@@ -1022,6 +1476,10 @@ lmap_supp_new()
     struct supp *supp;
 
     supp = (struct supp*) xcalloc(1, sizeof(struct supp), __FUNCTION__);
+    if (supp) {
+	supp->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_SUPP, 1, sizeof(struct supp));
+    }
     supp->state = LMAP_SUPP_STATE_ENABLED;
     return supp;
 }
@@ -1030,11 +1488,12 @@ void
 lmap_supp_free(struct supp *supp)
 {
     if (supp) {
-	xfree(supp->name);
-	xfree(supp->start);
-	xfree(supp->end);
-	free_all_tags(supp->match);
-	xfree(supp);
+	xfree_string(supp->pool, supp->name);
+	xfree_string(supp->pool, supp->start);
+	xfree_string(supp->pool, supp->end);
+	free_all_tags(supp->match, supp->match_idx);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_SUPP, 1, sizeof(struct supp));
+	xfree(supp->pool, supp);
     }
 }
 
@@ -1071,25 +1530,25 @@ lmap_supp_valid(struct lmap *lmap, struct supp *supp)
 int
 lmap_supp_set_name(struct supp *supp, const char *value)
 {
-    return set_lmap_identifier(&supp->name, value, __FUNCTION__);
+    return set_lmap_identifier(supp->pool, &supp->name, value, __FUNCTION__);
 }
 
 int
 lmap_supp_set_start(struct supp *supp, const char *value)
 {
-    return set_lmap_identifier(&supp->start, value, __FUNCTION__);
+    return set_lmap_identifier(supp->pool, &supp->start, value, __FUNCTION__);
 }
 
 int
 lmap_supp_set_end(struct supp *supp, const char *value)
 {
-    return set_lmap_identifier(&supp->end, value, __FUNCTION__);
+    return set_lmap_identifier(supp->pool, &supp->end, value, __FUNCTION__);
 }
 
 int
 lmap_supp_add_match(struct supp *supp, const char *value)
 {
-    return add_tag(&supp->match, value, __FUNCTION__);
+    return add_tag(supp->pool, &supp->match, &supp->match_idx, value, __FUNCTION__);
 }
 
 int
@@ -1130,6 +1589,10 @@ lmap_event_new()
     struct event *event;
 
     event = (struct event*) xcalloc(1, sizeof(struct event), __FUNCTION__);
+    if (event) {
+	event->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_EVENT, 1, sizeof(struct event));
+    }
     return event;
 }
 
@@ -1137,8 +1600,10 @@ void
 lmap_event_free(struct event *event)
 {
     if (event) {
-	xfree(event->name);
-	xfree(event);
+	xfree_string(event->pool, event->name);
+	free(event->lag);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_EVENT, 1, sizeof(struct event));
+	xfree(event->pool, event);
     }
 }
 
@@ -1239,7 +1704,7 @@ lmap_event_valid(struct lmap *lmap, struct event *event)
 int
 lmap_event_set_name(struct event *event, const char *value)
 {
-    return set_lmap_identifier(&event->name, value, __FUNCTION__);
+    return set_lmap_identifier(event->pool, &event->name, value, __FUNCTION__);
 }
 
 int
@@ -1582,6 +2047,10 @@ lmap_task_new()
     struct task *task;
 
     task = (struct task*) xcalloc(1, sizeof(struct task), __FUNCTION__);
+    if (task) {
+	task->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_TASK, 1, sizeof(struct task));
+    }
     return task;
 }
 
@@ -1589,17 +2058,19 @@ void
 lmap_task_free(struct task *task)
 {
     if (task) {
-	xfree(task->name);
+	xfree_string(task->pool, task->name);
 	while (task->registries) {
 	    struct registry *old = task->registries;
 	    task->registries = task->registries->next;
 	    lmap_registry_free(old);
 	}
-	xfree(task->version);
-	xfree(task->program);
-	free_all_options(task->options);
-	free_all_tags(task->tags);
-	xfree(task);
+	index_free(task->registries_idx);
+	xfree_string(task->pool, task->version);
+	xfree_string(task->pool, task->program);
+	free_all_options(task->options, task->options_idx);
+	free_all_tags(task->tags, task->tags_idx);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_TASK, 1, sizeof(struct task));
+	xfree(task->pool, task);
     }
 }
 
@@ -1629,57 +2100,49 @@ lmap_task_valid(struct lmap *lmap, struct task *task)
 int
 lmap_task_set_name(struct task *task, const char *value)
 {
-    return set_lmap_identifier(&task->name, value, __FUNCTION__);
+    return set_lmap_identifier(task->pool, &task->name, value, __FUNCTION__);
 }
 
 int
 lmap_task_set_version(struct task *task, const char *value)
 {
-    return set_string(&task->version, value, __FUNCTION__);
+    return set_string(task->pool, &task->version, value, __FUNCTION__);
 }
 
 int
 lmap_task_set_program(struct task *task, const char *value)
 {
-    return set_string(&task->program, value, __FUNCTION__);
+    return set_string(task->pool, &task->program, value, __FUNCTION__);
 }
 
 int
 lmap_task_add_registry(struct task *task, struct registry *registry)
 {
-    struct registry **tail = &task->registries;
-    struct registry *cur;
+    int ret;
 
     if (! registry->uri) {
 	lmap_err("unnamed registry");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->uri, registry->uri)) {
-		lmap_err("duplicate registry '%s'", registry->uri);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(task->pool, &task->registries, &task->registries_idx,
+		      registry, struct registry, uri, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate registry '%s'", registry->uri);
     }
-    *tail = registry;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 int
 lmap_task_add_option(struct task *task, struct option *option)
 {
-    return add_option(&task->options, option, __FUNCTION__);
+    return add_option(task->pool, &task->options, &task->options_idx, option, __FUNCTION__);
 }
 
 int
 lmap_task_add_tag(struct task *task, const char *value)
 {
-    return add_tag(&task->tags, value, __FUNCTION__);
+    return add_tag(task->pool, &task->tags, &task->tags_idx, value, __FUNCTION__);
 }
 
 /*
@@ -1692,6 +2155,10 @@ lmap_schedule_new()
     struct schedule *schedule;
 
     schedule = (struct schedule*) xcalloc(1, sizeof(struct schedule), __FUNCTION__);
+    if (schedule) {
+	schedule->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_SCHEDULE, 1, sizeof(struct schedule));
+    }
     schedule->mode = LMAP_SCHEDULE_EXEC_MODE_PIPELINED;
     schedule->state = LMAP_SCHEDULE_STATE_ENABLED;
     return schedule;
@@ -1701,18 +2168,20 @@ void
 lmap_schedule_free(struct schedule *schedule)
 {
     if (schedule) {
-	xfree(schedule->name);
-	xfree(schedule->start);
-	xfree(schedule->end);
+	xfree_string(schedule->pool, schedule->name);
+	xfree_string(schedule->pool, schedule->start);
+	xfree_string(schedule->pool, schedule->end);
 	while (schedule->actions) {
 	    struct action *old = schedule->actions;
 	    schedule->actions = schedule->actions->next;
 	    lmap_action_free(old);
 	}
-	free_all_tags(schedule->tags);
-	free_all_tags(schedule->suppression_tags);
-	xfree(schedule->workspace);
-	xfree(schedule);
+	index_free(schedule->actions_idx);
+	free_all_tags(schedule->tags, schedule->tags_idx);
+	free_all_tags(schedule->suppression_tags, schedule->suppression_tags_idx);
+	xfree_string(schedule->pool, schedule->workspace);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_SCHEDULE, 1, sizeof(struct schedule));
+	xfree(schedule->pool, schedule);
     }
 }
 
@@ -1766,13 +2235,13 @@ lmap_schedule_valid(struct lmap *lmap, struct schedule *schedule)
 int
 lmap_schedule_set_name(struct schedule *schedule, const char *value)
 {
-    return set_lmap_identifier(&schedule->name, value, __FUNCTION__);
+    return set_lmap_identifier(schedule->pool, &schedule->name, value, __FUNCTION__);
 }
 
 int
 lmap_schedule_set_start(struct schedule *schedule, const char *value)
 {
-    return set_lmap_identifier(&schedule->start, value, __FUNCTION__);
+    return set_lmap_identifier(schedule->pool, &schedule->start, value, __FUNCTION__);
 }
 
 int
@@ -1785,7 +2254,7 @@ lmap_schedule_set_end(struct schedule *schedule, const char *value)
 	schedule->flags &= ~LMAP_SCHEDULE_FLAG_DURATION_SET;
     }
 
-    ret = set_lmap_identifier(&schedule->end, value, __FUNCTION__);
+    ret = set_lmap_identifier(schedule->pool, &schedule->end, value, __FUNCTION__);
     if (ret == 0) {
 	schedule->flags |= LMAP_SCHEDULE_FLAG_END_SET;
     }
@@ -1798,7 +2267,7 @@ lmap_schedule_set_duration(struct schedule *schedule, const char *value)
     int ret;
 
     if (schedule->flags & LMAP_SCHEDULE_FLAG_END_SET) {
-	xfree(schedule->end);
+	xfree_string(schedule->pool, schedule->end);
 	schedule->end = NULL;
 	schedule->flags &= ~LMAP_SCHEDULE_FLAG_END_SET;
     }
@@ -1884,45 +2353,37 @@ lmap_schedule_set_last_invocation(struct schedule *schedule, const char *value)
 int
 lmap_schedule_add_tag(struct schedule *schedule, const char *value)
 {
-    return add_tag(&schedule->tags, value, __FUNCTION__);
+    return add_tag(schedule->pool, &schedule->tags, &schedule->tags_idx, value, __FUNCTION__);
 }
 
 int
 lmap_schedule_add_suppression_tag(struct schedule *schedule, const char *value)
 {
-    return add_tag(&schedule->suppression_tags, value, __FUNCTION__);
+    return add_tag(schedule->pool, &schedule->suppression_tags, &schedule->suppression_tags_idx, value, __FUNCTION__);
 }
 
 int
 lmap_schedule_add_action(struct schedule *schedule, struct action *action)
 {
-    struct action **tail = &schedule->actions;
-    struct action *cur;
+    int ret;
 
     if (! action->name) {
 	lmap_err("unnamed action");
 	return -1;
     }
 
-    while (*tail != NULL) {
-	cur = *tail;
-	if (cur) {
-	    if (! strcmp(cur->name, action->name)) {
-		lmap_err("duplicate action '%s'", action->name);
-		return -1;
-	    }
-	}
-	tail = &((*tail)->next);
+    ret = LIST_APPEND(schedule->pool, &schedule->actions,
+		      &schedule->actions_idx, action, struct action, name, __FUNCTION__);
+    if (ret == 1) {
+	lmap_err("duplicate action '%s'", action->name);
     }
-    *tail = action;
-
-    return 0;
+    return ret ? -1 : 0;
 }
 
 int
 lmap_schedule_set_workspace(struct schedule *schedule, const char *value)
 {
-    return set_string(&schedule->workspace, value, __FUNCTION__);
+    return set_string(schedule->pool, &schedule->workspace, value, __FUNCTION__);
 }
 
 /*
@@ -1935,6 +2396,10 @@ lmap_action_new()
     struct action *action;
 
     action = (struct action*) xcalloc(1, sizeof(struct action), __FUNCTION__);
+    if (action) {
+	action->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_ACTION, 1, sizeof(struct action));
+    }
     action->state = LMAP_ACTION_STATE_ENABLED;
     return action;
 }
@@ -1943,16 +2408,18 @@ void
 lmap_action_free(struct action *action)
 {
     if (action) {
-	xfree(action->name);
-	xfree(action->task);
-	free_all_tags(action->destinations);
-	free_all_options(action->options);
-	free_all_tags(action->tags);
-	free_all_tags(action->suppression_tags);
-	xfree(action->last_message);
-	xfree(action->last_failed_message);
-	xfree(action->workspace);
-	xfree(action);
+	xfree_string(action->pool, action->name);
+	xfree_string(action->pool, action->task);
+	free_all_tags(action->destinations, action->destinations_idx);
+	free_all_options(action->options, action->options_idx);
+	free_all_tags(action->tags, action->tags_idx);
+	free_all_tags(action->suppression_tags, action->suppression_tags_idx);
+	xfree_string(action->pool, action->last_message);
+	xfree_string(action->pool, action->last_failed_message);
+	xfree_string(action->pool, action->workspace);
+	free(action->latency);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_ACTION, 1, sizeof(struct action));
+	xfree(action->pool, action);
     }
 }
 
@@ -2000,37 +2467,37 @@ lmap_action_valid(struct lmap *lmap, struct action *action)
 int
 lmap_action_set_name(struct action *action, const char *value)
 {
-    return set_lmap_identifier(&action->name, value, __FUNCTION__);
+    return set_lmap_identifier(action->pool, &action->name, value, __FUNCTION__);
 }
 
 int
 lmap_action_set_task(struct action *action, const char *value)
 {
-    return set_string(&action->task, value, __FUNCTION__);
+    return set_string(action->pool, &action->task, value, __FUNCTION__);
 }
 
 int
 lmap_action_add_option(struct action *action, struct option *option)
 {
-    return add_option(&action->options, option, __FUNCTION__);
+    return add_option(action->pool, &action->options, &action->options_idx, option, __FUNCTION__);
 }
 
 int
 lmap_action_add_destination(struct action *action, const char *value)
 {
-    return add_tag(&action->destinations, value, __FUNCTION__);
+    return add_tag(action->pool, &action->destinations, &action->destinations_idx, value, __FUNCTION__);
 }
 
 int
 lmap_action_add_tag(struct action *action, const char *value)
 {
-    return add_tag(&action->tags, value, __FUNCTION__);
+    return add_tag(action->pool, &action->tags, &action->tags_idx, value, __FUNCTION__);
 }
 
 int
 lmap_action_add_suppression_tag(struct action *action, const char *value)
 {
-    return add_tag(&action->suppression_tags, value, __FUNCTION__);
+    return add_tag(action->pool, &action->suppression_tags, &action->suppression_tags_idx, value, __FUNCTION__);
 }
 
 int
@@ -2102,7 +2569,7 @@ lmap_action_set_last_status(struct action *action, const char *value)
 int
 lmap_action_set_last_message(struct action *action, const char *value)
 {
-    return set_string(&action->last_message, value, __FUNCTION__);
+    return set_string(action->pool, &action->last_message, value, __FUNCTION__);
 }
 
 int
@@ -2120,13 +2587,13 @@ lmap_action_set_last_failed_status(struct action *action, const char *value)
 int
 lmap_action_set_last_failed_message(struct action *action, const char *value)
 {
-    return set_string(&action->last_failed_message, value, __FUNCTION__);
+    return set_string(action->pool, &action->last_failed_message, value, __FUNCTION__);
 }
 
 int
 lmap_action_set_workspace(struct action *action, const char *value)
 {
-    return set_string(&action->workspace, value, __FUNCTION__);
+    return set_string(action->pool, &action->workspace, value, __FUNCTION__);
 }
 
 /*
@@ -2138,19 +2605,35 @@ lmapd_new()
 {
     struct lmapd *lmapd;
 
-    lmapd = (struct lmapd*) xcalloc(1, sizeof(struct lmapd), __FUNCTION__);
+    /* the daemon state outlives the lmap data models (and arenas) */
+    lmapd = (struct lmapd*) xarena_calloc(NULL, 1, sizeof(struct lmapd), __FUNCTION__);
+    if (lmapd) {
+	lmapd->journal_fd = -1;
+    }
     return lmapd;
 }
 
 void
 lmapd_free(struct lmapd *lmapd)
 {
+    size_t i;
+
     if (lmapd) {
 	lmap_free(lmapd->lmap);
-	xfree(lmapd->config_path);
-	xfree(lmapd->queue_path);
-	xfree(lmapd->run_path);
-	xfree(lmapd);
+	for (i = 0; i < lmapd->retired_len; i++) {
+	    lmap_free(lmapd->retired[i]);
+	}
+	free(lmapd->retired);
+	xfree_string(NULL, lmapd->config_path);
+	xfree_string(NULL, lmapd->queue_path);
+	xfree_string(NULL, lmapd->run_path);
+	xfree_string(NULL, lmapd->capability_path);
+	xfree_string(NULL, lmapd->snapshot_path);
+	xfree_string(NULL, lmapd->journal_path);
+	if (lmapd->journal_fd != -1) {
+	    (void) close(lmapd->journal_fd);
+	}
+	xfree(NULL, lmapd);
     }
 }
 
@@ -2169,7 +2652,7 @@ lmapd_set_config_path(struct lmapd *lmapd, const char *value)
     }
 
     if (S_ISREG(sb.st_mode) || S_ISDIR(sb.st_mode)) {
-	return set_string(&lmapd->config_path, value, __FUNCTION__);
+	return set_string(NULL, &lmapd->config_path, value, __FUNCTION__);
     } else {
 	goto invalid;
     }
@@ -2180,16 +2663,16 @@ lmapd_set_config_path(struct lmapd *lmapd, const char *value)
      */
     
     len = strlen(value) + strlen(LMAPD_CONFIG_FILE) + 2;
-    name = xcalloc(len, 1, __FUNCTION__);
+    name = xarena_calloc(NULL, len, 1, __FUNCTION__);
     snprintf(name, len, "%s/%s", value, LMAPD_CONFIG_FILE);
     if (! name || stat(name, &sb) == -1 || ! S_ISREG(sb.st_mode)) {
 	lmap_err("invalid config file '%s'", name);
-	xfree(name);
+	xfree(NULL, name);
 	return -1;
     }
 
-    ret = set_string(&lmapd->config_path, name ? name : value, __FUNCTION__);
-    xfree(name);
+    ret = set_string(NULL, &lmapd->config_path, name ? name : value, __FUNCTION__);
+    xfree(NULL, name);
     return ret;
 }
 
@@ -2208,7 +2691,7 @@ lmapd_set_capability_path(struct lmapd *lmapd, const char *value)
     }
 
     if (S_ISREG(sb.st_mode) || S_ISDIR(sb.st_mode)) {
-	return set_string(&lmapd->capability_path, value, __FUNCTION__);
+	return set_string(NULL, &lmapd->capability_path, value, __FUNCTION__);
     } else {
 	goto invalid;
     }
@@ -2219,16 +2702,16 @@ lmapd_set_capability_path(struct lmapd *lmapd, const char *value)
      */
     
     len = strlen(value) + strlen(LMAPD_CONFIG_FILE) + 2;
-    name = xcalloc(len, 1, __FUNCTION__);
+    name = xarena_calloc(NULL, len, 1, __FUNCTION__);
     snprintf(name, len, "%s/%s", value, LMAPD_CAPABILITY_FILE);
     if (! name || stat(name, &sb) == -1 || ! S_ISREG(sb.st_mode)) {
 	lmap_err("invalid capability file '%s'", name);
-	xfree(name);
+	xfree(NULL, name);
 	return -1;
     }
 
-    ret = set_string(&lmapd->capability_path, name ? name : value, __FUNCTION__);
-    xfree(name);
+    ret = set_string(NULL, &lmapd->capability_path, name ? name : value, __FUNCTION__);
+    xfree(NULL, name);
     return ret;
 }
 
@@ -2242,7 +2725,7 @@ lmapd_set_queue_path(struct lmapd *lmapd, const char *value)
 	return -1;
     }
     
-    return set_string(&lmapd->queue_path, value, __FUNCTION__);
+    return set_string(NULL, &lmapd->queue_path, value, __FUNCTION__);
 }
 
 int
@@ -2255,7 +2738,19 @@ lmapd_set_run_path(struct lmapd *lmapd, const char *value)
 	return -1;
     }
     
-    return set_string(&lmapd->run_path, value, __FUNCTION__);
+    return set_string(NULL, &lmapd->run_path, value, __FUNCTION__);
+}
+
+int
+lmapd_set_snapshot_path(struct lmapd *lmapd, const char *value)
+{
+    return set_string(NULL, &lmapd->snapshot_path, value, __FUNCTION__);
+}
+
+int
+lmapd_set_journal_path(struct lmapd *lmapd, const char *value)
+{
+    return set_string(NULL, &lmapd->journal_path, value, __FUNCTION__);
 }
 
 /*
@@ -2268,6 +2763,10 @@ lmap_value_new()
     struct value *val;
 
     val = (struct value*) xcalloc(1, sizeof(struct value), __FUNCTION__);
+    if (val) {
+	val->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_VALUE, 1, sizeof(struct value));
+    }
     return val;
 }
 
@@ -2275,8 +2774,9 @@ void
 lmap_value_free(struct value *val)
 {
     if (val) {
-	xfree(val->value);
-	xfree(val);
+	xfree_string(val->pool, val->value);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_VALUE, 1, sizeof(struct value));
+	xfree(val->pool, val);
     }
 }
 
@@ -2298,7 +2798,7 @@ lmap_value_valid(struct lmap *lmap, struct value *val)
 int
 lmap_value_set_value(struct value *val, const char *value)
 {
-    return set_string(&val->value, value, __FUNCTION__);
+    return set_string(val->pool, &val->value, value, __FUNCTION__);
 }
 
 /*
@@ -2311,6 +2811,10 @@ lmap_row_new()
     struct row *row;
 
     row = (struct row*) xcalloc(1, sizeof(struct row), __FUNCTION__);
+    if (row) {
+	row->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_ROW, 1, sizeof(struct row));
+    }
     return row;
 }
 
@@ -2323,7 +2827,9 @@ lmap_row_free(struct row *row)
 	    row->values = val->next;
 	    lmap_value_free(val);
 	}
-	xfree(row);
+	index_free(row->values_idx);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_ROW, 1, sizeof(struct row));
+	xfree(row->pool, row);
     }
 }
 
@@ -2345,78 +2851,678 @@ lmap_row_valid(struct lmap *lmap, struct row *row)
 int
 lmap_row_add_value(struct row *row, struct value *val)
 {
-    struct value *tail;
+    return list_append(row->pool, (void **) &row->values, &row->values_idx,
+		       val, val->pool,
+		       offsetof(struct value, next), LIST_NOKEY,
+		       __FUNCTION__) ? -1 : 0;
+}
 
-    if (! row->values) {
-	row->values = val;
-	return 0;
+/*
+ * struct table functions...
+ */
+
+static void *
+xrealloc(struct lmap_arena *arena, void *ptr, size_t size, const char *func)
+{
+    void *p;
+
+    p = arena ? lmap_arena_realloc(arena, ptr, size) : realloc(ptr, size);
+    if (!p) {
+	lmap_log(LOG_ERR, func, "failed to allocate memory");
     }
+    return p;
+}
 
-    for (tail = row->values; tail; ) {
-	if (tail->next) {
-	    tail = tail->next;
-	} else {
-	    tail->next = val;
+/*
+ * Returns the types a value may have. Integers must be canonical so
+ * that the typed value renders back into the same string. Date and
+ * time values must follow the YANG date-and-time format without
+ * fractional seconds.
+ */
+
+static uint32_t
+value_types(const char *s)
+{
+    uint32_t types = 0;
+    const char *p = s;
+    char *end;
+    int i;
+
+    /* integers with up to 18 digits always fit into an int64_t */
+    if (*p == '-') {
+	p++;
+    }
+    for (i = 0; isdigit((unsigned char) p[i]); i++) ;
+    if (i > 0 && i <= 18 && ! p[i]
+	&& ! (p[0] == '0' && (i > 1 || p != s))) {
+	types |= LMAP_COLUMN_TYPE_INT64;
+    }
+
+    if (*s && strspn(s, "0123456789+-.eE") == strlen(s)) {
+	(void) strtod(s, &end);
+	if (end != s && *end == 0) {
+	    types |= LMAP_COLUMN_TYPE_DOUBLE;
+	}
+    }
+
+    /* YYYY-MM-DDTHH:MM:SS followed by Z or [+-]HH:MM */
+    for (i = 0; i < 19; i++) {
+	if (i == 4 || i == 7) {
+	    if (s[i] != '-') break;
+	} else if (i == 10) {
+	    if (s[i] != 'T') break;
+	} else if (i == 13 || i == 16) {
+	    if (s[i] != ':') break;
+	} else if (! isdigit((unsigned char) s[i])) {
 	    break;
 	}
     }
+    if (i == 19) {
+	p = s + 19;
+	if ((p[0] == 'Z' && p[1] == 0)
+	    || ((p[0] == '+' || p[0] == '-')
+		&& isdigit((unsigned char) p[1]) && isdigit((unsigned char) p[2])
+		&& p[3] == ':'
+		&& isdigit((unsigned char) p[4]) && isdigit((unsigned char) p[5])
+		&& p[6] == 0)) {
+	    types |= LMAP_COLUMN_TYPE_DATETIME;
+	}
+    }
+
+    return types;
+}
+
+/*
+ * Converts a date-and-time value (already checked by value_types())
+ * into seconds since the epoch. Does not depend on the local time
+ * zone (days since the epoch of the proleptic Gregorian calendar).
+ */
+
+static int64_t
+datetime_to_epoch(const char *s)
+{
+    int64_t y, m, d, era, yoe, doy, doe, days, secs;
+    int offset = 0;
+
+#define DIGITS2(p) (((p)[0]-'0')*10 + ((p)[1]-'0'))
+    y = DIGITS2(s) * 100 + DIGITS2(s + 2);
+    m = DIGITS2(s + 5);
+    d = DIGITS2(s + 8);
+    secs = DIGITS2(s + 11) * 3600 + DIGITS2(s + 14) * 60 + DIGITS2(s + 17);
+    if (s[19] != 'Z') {
+	offset = DIGITS2(s + 20) * 3600 + DIGITS2(s + 23) * 60;
+	if (s[19] == '-') {
+	    offset = -offset;
+	}
+    }
+#undef DIGITS2
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    days = era * 146097 + doe - 719468;
+
+    return days * 86400 + secs - offset;
+}
+
+static void
+table_drop_view(struct table *tab)
+{
+    while (tab->rows) {
+	struct row *row = tab->rows;
+	tab->rows = row->next;
+	lmap_row_free(row);
+    }
+}
+
+static void
+column_drop_typed(struct table *tab, struct column *col)
+{
+    xfree(tab->pool, col->int64s);
+    col->int64s = NULL;
+    xfree(tab->pool, col->doubles);
+    col->doubles = NULL;
+}
+
+/*
+ * Makes sure that there is space for one more row in all columns.
+ * The row lengths and the offsets of all columns are grown together:
+ * the new arrays are allocated first and only replace the old ones
+ * if all allocations succeeded, so that a failure leaves the table
+ * as it was.
+ */
+
+static int
+table_grow_rows(struct table *tab)
+{
+    uint32_t size, c, n;
+    uint32_t **p;
+
+    if (tab->nrows < tab->rows_size) {
+	return 0;
+    }
+    if (tab->rows_size > UINT32_MAX / 4) {
+	lmap_err("table too large");
+	return -1;
+    }
+
+    size = tab->rows_size ? 2 * tab->rows_size : 16;
+    p = calloc(1 + tab->ncols, sizeof(uint32_t *));
+    if (! p) {
+	lmap_err("failed to allocate memory");
+	return -1;
+    }
+    for (n = 0; n < 1 + tab->ncols; n++) {
+	p[n] = xarena_calloc(tab->pool, size, sizeof(uint32_t), __FUNCTION__);
+	if (! p[n]) {
+	    while (n--) {
+		xfree(tab->pool, p[n]);
+	    }
+	    free(p);
+	    return -1;
+	}
+    }
+
+    if (tab->rows_size) {
+	memcpy(p[0], tab->row_len, tab->rows_size * sizeof(uint32_t));
+    }
+    xfree(tab->pool, tab->row_len);
+    tab->row_len = p[0];
+    for (c = 0; c < tab->ncols; c++) {
+	if (tab->rows_size) {
+	    memcpy(p[1 + c], tab->columns[c].offsets,
+		   tab->rows_size * sizeof(uint32_t));
+	}
+	xfree(tab->pool, tab->columns[c].offsets);
+	tab->columns[c].offsets = p[1 + c];
+    }
+    free(p);
+    LMAP_ALLOC_COUNT(LMAP_ALLOC_ROW, 0, (uint64_t) (size - tab->rows_size)
+		     * sizeof(uint32_t) * (1 + tab->ncols));
+    tab->rows_size = size;
     return 0;
 }
 
 /*
- * struct table functions...
+ * Returns the column c, creating the column (and all columns before
+ * it) if necessary. New columns have no values in existing rows.
  */
 
+static struct column *
+table_column(struct table *tab, uint32_t c)
+{
+    struct column *col;
+    uint32_t size, r;
+    void *p;
+
+    while (tab->ncols <= c) {
+	if (tab->ncols == tab->columns_size) {
+	    size = tab->columns_size ? 2 * tab->columns_size : 8;
+	    p = xrealloc(tab->pool, tab->columns, size * sizeof(struct column),
+			 __FUNCTION__);
+	    if (! p) {
+		return NULL;
+	    }
+	    tab->columns = p;
+	    LMAP_ALLOC_COUNT(LMAP_ALLOC_TABLE, 0, (size - tab->columns_size)
+			     * sizeof(struct column));
+	    tab->columns_size = size;
+	}
+	col = &tab->columns[tab->ncols];
+	memset(col, 0, sizeof(*col));
+	col->types = (LMAP_COLUMN_TYPE_INT64 | LMAP_COLUMN_TYPE_DOUBLE
+		      | LMAP_COLUMN_TYPE_DATETIME);
+	col->offsets = xarena_calloc(tab->pool, tab->rows_size, sizeof(uint32_t),
+			       __FUNCTION__);
+	if (! col->offsets) {
+	    return NULL;
+	}
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_ROW, 0,
+			 (uint64_t) tab->rows_size * sizeof(uint32_t));
+	for (r = 0; r < tab->nrows; r++) {
+	    col->offsets[r] = LMAP_TABLE_NULL;
+	}
+	tab->ncols++;
+    }
+    return &tab->columns[c];
+}
+
+static int
+table_arena_add(struct table *tab, const char *value, uint32_t *offset)
+{
+    size_t len = strlen(value) + 1;
+    size_t size;
+    char *p;
+
+    if (tab->arena_len + len >= LMAP_TABLE_NULL) {
+	lmap_err("table too large");
+	return -1;
+    }
+    if (tab->arena_len + len > tab->arena_size) {
+	size = tab->arena_size ? tab->arena_size : 256;
+	while (tab->arena_len + len > size) {
+	    size *= 2;
+	}
+	p = xrealloc(tab->pool, tab->arena, size, __FUNCTION__);
+	if (! p) {
+	    return -1;
+	}
+	tab->arena = p;
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_VALUE, 0, size - tab->arena_size);
+	tab->arena_size = size;
+    }
+    memcpy(tab->arena + tab->arena_len, value, len);
+    *offset = tab->arena_len;
+    tab->arena_len += len;
+    return 0;
+}
+
 struct table *
 lmap_table_new()
 {
     struct table *tab;
 
     tab = (struct table*) xcalloc(1, sizeof(struct table), __FUNCTION__);
+    if (tab) {
+	tab->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_TABLE, 1, sizeof(struct table));
+    }
     return tab;
 }
 
+static void
+table_uncount(struct table *tab)
+{
+#ifdef HAVE_ALLOC_STATS
+    uint64_t values = 0;
+    uint32_t r;
+
+    for (r = 0; r < tab->nrows; r++) {
+	values += tab->row_len[r];
+    }
+    LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_VALUE, values, tab->arena_size);
+    LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_ROW, tab->nrows, (uint64_t) tab->rows_size
+		       * sizeof(uint32_t) * (1 + tab->ncols));
+    LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_TABLE, 1, sizeof(struct table)
+		       + tab->columns_size * sizeof(struct column));
+#else
+    UNUSED(tab);
+#endif
+}
+
 void
 lmap_table_free(struct table *tab)
 {
+    uint32_t c;
+    
     if (tab) {
-	while (tab->rows) {
-	    struct row *row = tab->rows;
-	    tab->rows = row->next;
+	table_drop_view(tab);
+	while (tab->added) {
+	    struct row *row = tab->added;
+	    tab->added = row->next;
 	    lmap_row_free(row);
 	}
-	xfree(tab);
+	table_uncount(tab);
+	for (c = 0; c < tab->ncols; c++) {
+	    xfree(tab->pool, tab->columns[c].offsets);
+	    column_drop_typed(tab, &tab->columns[c]);
+	}
+	xfree(tab->pool, tab->columns);
+	xfree(tab->pool, tab->row_len);
+	xfree(tab->pool, tab->arena);
+	xfree(tab->pool, tab);
     }
 }
 
 int
 lmap_table_valid(struct lmap *lmap, struct table *tab)
 {
-    struct row *row;
+    uint32_t r, c;
     int valid = 1;
 
     UNUSED(lmap);
 
-    for (row = tab->rows; row; row = row->next) {
-	valid &= lmap_row_valid(lmap, row);
+    (void) lmap_table_flatten(tab);
+    for (r = 0; r < tab->nrows; r++) {
+	for (c = 0; c < tab->row_len[r]; c++) {
+	    if (tab->columns[c].offsets[r] == LMAP_TABLE_NULL) {
+		lmap_err("val requires a value");
+		valid = 0;
+	    }
+	}
     }
     
     return valid;
 }
 
+/**
+ * @brief Starts a new (empty) row in a table
+ *
+ * @param tab The table
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_table_new_row(struct table *tab)
+{
+    if (table_grow_rows(tab) == -1) {
+	return -1;
+    }
+    table_drop_view(tab);
+    tab->row_len[tab->nrows++] = 0;
+    LMAP_ALLOC_COUNT(LMAP_ALLOC_ROW, 1, 0);
+    return 0;
+}
+
+/*
+ * Appends a value to the row r of a table.
+ */
+
+static int
+table_add_value(struct table *tab, uint32_t r, const char *value)
+{
+    struct column *col;
+    uint32_t offset = LMAP_TABLE_NULL;
+
+    col = table_column(tab, tab->row_len[r]);
+    if (! col) {
+	return -1;
+    }
+    if (value) {
+	if (table_arena_add(tab, value, &offset) == -1) {
+	    return -1;
+	}
+	if (col->types) {
+	    col->types &= value_types(value);
+	}
+    }
+    col->offsets[r] = offset;
+    column_drop_typed(tab, col);
+    table_drop_view(tab);
+    tab->row_len[r]++;
+    LMAP_ALLOC_COUNT(LMAP_ALLOC_VALUE, 1, 0);
+    return 0;
+}
+
+/**
+ * @brief Appends a value to the last row of a table
+ *
+ * Appends a value to the last row of a table. A new row is started
+ * if the table has no rows yet. A NULL value creates a cell without
+ * a value.
+ *
+ * @param tab The table
+ * @param value The value (copied into the string arena of the table)
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_table_add_value(struct table *tab, const char *value)
+{
+    if (lmap_table_flatten(tab) == -1) {
+	return -1;
+    }
+    if (! tab->nrows && lmap_table_new_row(tab) == -1) {
+	return -1;
+    }
+    return table_add_value(tab, tab->nrows - 1, value);
+}
+
+/**
+ * @brief Appends a row to a table
+ *
+ * The table reserves the next row for the row and takes ownership of
+ * it; the row is released together with the table. Values may still
+ * be appended to the row after it was added. They are copied into the
+ * columnar storage of the table when the table is read, rendered or
+ * modified the next time (see lmap_table_flatten()). Values must not
+ * be changed once they were copied. On error, the row is not added
+ * and remains owned by the caller.
+ *
+ * @param tab The table
+ * @param row The row to add
+ * @return 0 on success, -1 on error
+ */
+
 int
 lmap_table_add_row(struct table *tab, struct row *row)
 {
-    struct row **tail = &tab->rows;
+    if (! row) {
+	return 0;
+    }
+    
+    if (lmap_table_flatten(tab) == -1 || lmap_table_new_row(tab) == -1) {
+	return -1;
+    }
+    row->table_row = tab->nrows - 1;
+    row->copied = NULL;
+    row->next = tab->added;
+    tab->added = row;
+    return 0;
+}
+
+/**
+ * @brief Copies the values of added rows into a table
+ *
+ * Copies the values appended to the rows added with
+ * lmap_table_add_row() since the last call into the columnar storage
+ * of the table. The functions reading a table call this function;
+ * code accessing the columnar storage of a table directly (such as
+ * the report renderers) has to call it first.
+ *
+ * @param tab The table
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_table_flatten(struct table *tab)
+{
+    struct row *row;
+    struct value *val;
 
-    while (*tail != NULL) {
-	tail = &((*tail)->next);
+    for (row = tab->added; row; row = row->next) {
+	for (val = row->copied ? row->copied->next : row->values;
+	     val; val = val->next) {
+	    if (table_add_value(tab, row->table_row, val->value) == -1) {
+		return -1;
+	    }
+	    row->copied = val;
+	}
     }
-    *tail = row;
+    return 0;
+}
+
+/**
+ * @brief Returns the value of a table cell
+ *
+ * @return The value or NULL if the cell does not exist or has no value
+ */
 
+const char *
+lmap_table_get_value(struct table *tab, uint32_t row, uint32_t col)
+{
+    uint32_t offset;
+    
+    (void) lmap_table_flatten(tab);
+    if (row >= tab->nrows || col >= tab->row_len[row]) {
+	return NULL;
+    }
+    offset = tab->columns[col].offsets[row];
+    return offset == LMAP_TABLE_NULL ? NULL : tab->arena + offset;
+}
+
+/**
+ * @brief Returns the type detected for a column
+ *
+ * @return LMAP_COLUMN_TYPE_INT64, LMAP_COLUMN_TYPE_DATETIME,
+ *         LMAP_COLUMN_TYPE_DOUBLE or LMAP_COLUMN_TYPE_STRING
+ */
+
+int
+lmap_table_column_type(struct table *tab, uint32_t col)
+{
+    uint32_t types;
+    
+    (void) lmap_table_flatten(tab);
+    if (col >= tab->ncols) {
+	return LMAP_COLUMN_TYPE_STRING;
+    }
+    types = tab->columns[col].types;
+    if (types & LMAP_COLUMN_TYPE_INT64) {
+	return LMAP_COLUMN_TYPE_INT64;
+    }
+    if (types & LMAP_COLUMN_TYPE_DATETIME) {
+	return LMAP_COLUMN_TYPE_DATETIME;
+    }
+    if (types & LMAP_COLUMN_TYPE_DOUBLE) {
+	return LMAP_COLUMN_TYPE_DOUBLE;
+    }
+    return LMAP_COLUMN_TYPE_STRING;
+}
+
+/**
+ * @brief Returns the integer value of a table cell
+ *
+ * Works for columns of type LMAP_COLUMN_TYPE_INT64 and
+ * LMAP_COLUMN_TYPE_DATETIME (seconds since the epoch). The typed
+ * values of the column are materialized on first use.
+ *
+ * @return 0 on success, -1 if the cell has no integer value
+ */
+
+int
+lmap_table_get_int64(struct table *tab, uint32_t row, uint32_t col,
+		     int64_t *value)
+{
+    struct column *column;
+    int type;
+    uint32_t r;
+
+    type = lmap_table_column_type(tab, col);
+    if ((type != LMAP_COLUMN_TYPE_INT64 && type != LMAP_COLUMN_TYPE_DATETIME)
+	|| ! lmap_table_get_value(tab, row, col)) {
+	return -1;
+    }
+    column = &tab->columns[col];
+    if (! column->int64s) {
+	column->int64s = xarena_calloc(tab->pool, tab->nrows, sizeof(int64_t),
+				    __FUNCTION__);
+	if (! column->int64s) {
+	    return -1;
+	}
+	for (r = 0; r < tab->nrows; r++) {
+	    const char *s = lmap_table_get_value(tab, r, col);
+	    if (s) {
+		column->int64s[r] = (type == LMAP_COLUMN_TYPE_INT64)
+		    ? strtoll(s, NULL, 10) : datetime_to_epoch(s);
+	    }
+	}
+    }
+    *value = column->int64s[row];
+    return 0;
+}
+
+/**
+ * @brief Returns the floating point value of a table cell
+ *
+ * Works for columns of type LMAP_COLUMN_TYPE_INT64 and
+ * LMAP_COLUMN_TYPE_DOUBLE. The typed values of the column are
+ * materialized on first use.
+ *
+ * @return 0 on success, -1 if the cell has no numeric value
+ */
+
+int
+lmap_table_get_double(struct table *tab, uint32_t row, uint32_t col,
+		      double *value)
+{
+    struct column *column;
+    uint32_t r;
+
+    (void) lmap_table_flatten(tab);
+    if (col >= tab->ncols
+	|| ! (tab->columns[col].types & LMAP_COLUMN_TYPE_DOUBLE)
+	|| ! lmap_table_get_value(tab, row, col)) {
+	return -1;
+    }
+    column = &tab->columns[col];
+    if (! column->doubles) {
+	column->doubles = xarena_calloc(tab->pool, tab->nrows, sizeof(double),
+				     __FUNCTION__);
+	if (! column->doubles) {
+	    return -1;
+	}
+	for (r = 0; r < tab->nrows; r++) {
+	    const char *s = lmap_table_get_value(tab, r, col);
+	    if (s) {
+		column->doubles[r] = strtod(s, NULL);
+	    }
+	}
+    }
+    *value = column->doubles[row];
     return 0;
 }
 
+/**
+ * @brief Returns the rows of a table as a list of rows
+ *
+ * Builds the row and value lists (the compatibility view) of the
+ * table. The lists are owned by the table and remain valid until the
+ * table is modified or freed.
+ *
+ * @return The first row or NULL if the table has no rows (or on
+ *         memory allocation failures)
+ */
+
+struct row *
+lmap_table_rows(struct table *tab)
+{
+    struct row *row, **rowp;
+    struct value *val, **valp;
+    struct lmap_arena *arena;
+    uint32_t r, c;
+
+    if (lmap_table_flatten(tab) == -1) {
+	return NULL;
+    }
+    if (tab->rows || ! tab->nrows) {
+	return tab->rows;
+    }
+
+    /* the view lives in the arena of the table (if any) */
+    arena = lmap_arena_use(tab->pool);
+    rowp = &tab->rows;
+    for (r = 0; r < tab->nrows; r++) {
+	row = lmap_row_new();
+	if (! row) {
+	    goto error;
+	}
+	*rowp = row;
+	rowp = &row->next;
+	valp = &row->values;
+	for (c = 0; c < tab->row_len[r]; c++) {
+	    val = lmap_value_new();
+	    if (! val) {
+		goto error;
+	    }
+	    *valp = val;
+	    valp = &val->next;
+	    if (lmap_value_set_value(val, lmap_table_get_value(tab, r, c))) {
+		goto error;
+	    }
+	}
+    }
+    (void) lmap_arena_use(arena);
+    return tab->rows;
+
+error:
+    (void) lmap_arena_use(arena);
+    table_drop_view(tab);
+    return NULL;
+}
+
 /*
  * struct result functions...
  */
@@ -2427,6 +3533,10 @@ lmap_result_new()
     struct result *res;
 
     res = (struct result*) xcalloc(1, sizeof(struct result), __FUNCTION__);
+    if (res) {
+	res->pool = lmap_arena_current();
+	LMAP_ALLOC_COUNT(LMAP_ALLOC_RESULT, 1, sizeof(struct result));
+    }
     return res;
 }
 
@@ -2434,18 +3544,21 @@ void
 lmap_result_free(struct result *res)
 {
     if (res) {
-	xfree(res->schedule);
-	xfree(res->action);
-	xfree(res->task);
-	free_all_options(res->options);
-	free_all_tags(res->tags);
-	xfree(res->cycle_number);
+	xfree_string(res->pool, res->schedule);
+	xfree_string(res->pool, res->action);
+	xfree_string(res->pool, res->task);
+	free_all_options(res->options, res->options_idx);
+	free_all_tags(res->tags, res->tags_idx);
+	xfree_string(res->pool, res->cycle_number);
+	xfree_string(res->pool, res->file);
 	while (res->tables) {
 	    struct table *tab = res->tables;
 	    res->tables = tab->next;
 	    lmap_table_free(tab);
 	}
-	xfree(res);
+	index_free(res->tables_idx);
+	LMAP_ALLOC_UNCOUNT(LMAP_ALLOC_RESULT, 1, sizeof(struct result));
+	xfree(res->pool, res);
     }
 }
 
@@ -2477,44 +3590,40 @@ lmap_result_valid(struct lmap *lmap, struct result *res)
 int
 lmap_result_add_table(struct result *res, struct table *tab)
 {
-    struct table **tail = &res->tables;
-
-    while (*tail != NULL) {
-	tail = &((*tail)->next);
-    }
-    *tail = tab;
-
-    return 0;
+    return list_append(res->pool, (void **) &res->tables, &res->tables_idx,
+		       tab, tab->pool,
+		       offsetof(struct table, next), LIST_NOKEY,
+		       __FUNCTION__) ? -1 : 0;
 }
 
 int
 lmap_result_set_schedule(struct result *res, const char *value)
 {
-    return set_lmap_identifier(&res->schedule, value, __FUNCTION__);
+    return set_lmap_identifier(res->pool, &res->schedule, value, __FUNCTION__);
 }
 
 int
 lmap_result_set_action(struct result *res, const char *value)
 {
-    return set_lmap_identifier(&res->action, value, __FUNCTION__);
+    return set_lmap_identifier(res->pool, &res->action, value, __FUNCTION__);
 }
 
 int
 lmap_result_set_task(struct result *res, const char *value)
 {
-    return set_lmap_identifier(&res->task, value, __FUNCTION__);
+    return set_lmap_identifier(res->pool, &res->task, value, __FUNCTION__);
 }
 
 int
 lmap_result_add_option(struct result *res, struct option *option)
 {
-    return add_option(&res->options, option, __FUNCTION__);
+    return add_option(res->pool, &res->options, &res->options_idx, option, __FUNCTION__);
 }
 
 int
 lmap_result_add_tag(struct result *res, const char *value)
 {
-    return add_tag(&res->tags, value, __FUNCTION__);
+    return add_tag(res->pool, &res->tags, &res->tags_idx, value, __FUNCTION__);
 }
 
 int
@@ -2580,7 +3689,13 @@ lmap_result_set_end_epoch(struct result *res, const char *value)
 int
 lmap_result_set_cycle_number(struct result *res, const char *value)
 {
-    return set_string(&res->cycle_number, value, __FUNCTION__);
+    return set_string(res->pool, &res->cycle_number, value, __FUNCTION__);
+}
+
+int
+lmap_result_set_file(struct result *res, const char *value)
+{
+    return set_string(res->pool, &res->file, value, __FUNCTION__);
 }
 
 int
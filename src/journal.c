@@ -0,0 +1,456 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The state journal keeps the counters and timestamps of schedules
+ * and actions across restarts of lmapd. It is an append-only file of
+ * small binary records; whenever an action completes, a record for
+ * the action and its schedule is appended with a single write(). On
+ * startup, the journal is replayed (the last record of an object
+ * wins) and then compacted, i.e., rewritten with one record per
+ * object of the current config. The journal is also compacted when
+ * the config is reloaded, when lmapd exits and, so that a daemon
+ * running for months does not fill a small flash file system, once
+ * the records appended since the last compaction reach
+ * LMAPD_JOURNAL_LIMIT bytes or four times the size of the compacted
+ * journal, whichever is larger. The journal thus never grows much
+ * beyond five times its compacted size.
+ *
+ * Every record carries its length and a checksum, replay stops at the
+ * first record that is truncated or damaged (e.g., after a crash in
+ * the middle of a write). Like snapshots, the journal is only meant
+ * to be read by the lmapd binary that wrote it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC		"LMAPJRNL"
+#define JOURNAL_VERSION		1
+#define JOURNAL_BYTE_ORDER	0x01020304
+
+#define JOURNAL_SCHEDULE	1
+#define JOURNAL_ACTION		2
+
+#define JOURNAL_NAME_MAX	1024
+
+#define FNV_OFFSET		2166136261U
+#define FNV_PRIME		16777619U
+
+struct journal_header {
+    char magic[8];
+    uint32_t version;			/* JOURNAL_VERSION */
+    uint32_t byte_order;		/* JOURNAL_BYTE_ORDER */
+    uint32_t time_size;			/* sizeof(time_t) */
+};
+
+/*
+ * A record is a struct record_header followed by the name of the
+ * schedule, the name of the action (empty for schedule records) and
+ * the struct counters.
+ */
+
+struct record_header {
+    uint32_t length;			/* length of the payload */
+    uint32_t checksum;			/* FNV-1a hash of the payload */
+    uint8_t type;			/* JOURNAL_SCHEDULE or _ACTION */
+    uint8_t pad;
+    uint16_t schedule_len;
+    uint16_t action_len;
+    uint16_t pad2;
+};
+
+struct counters {
+    time_t last_invocation;
+    time_t last_completion;
+    time_t last_failed_completion;
+    int32_t last_status;
+    int32_t last_failed_status;
+    uint32_t cnt_invocations;
+    uint32_t cnt_failures;
+    uint32_t cnt_suppressions;
+    uint32_t cnt_overlaps;
+};
+
+struct record {
+    struct record_header hdr;
+    char buf[2 * JOURNAL_NAME_MAX + sizeof(struct counters)];
+};
+
+static inline uint32_t
+fnv(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint32_t h = FNV_OFFSET;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	h ^= p[i];
+	h *= FNV_PRIME;
+    }
+    return h;
+}
+
+/*
+ * Encodes a record into rec and returns its total size or 0 if the
+ * names are too long to be journaled.
+ */
+
+static size_t
+encode(struct record *rec, struct schedule *schedule, struct action *action)
+{
+    struct counters c;
+    size_t slen, alen;
+    char *p = rec->buf;
+
+    memset(&c, 0, sizeof(c));
+    slen = strlen(schedule->name);
+    alen = action ? strlen(action->name) : 0;
+    if (slen >= JOURNAL_NAME_MAX || alen >= JOURNAL_NAME_MAX) {
+	return 0;
+    }
+
+    if (action) {
+	c.last_invocation = action->last_invocation;
+	c.last_completion = action->last_completion;
+	c.last_failed_completion = action->last_failed_completion;
+	c.last_status = action->last_status;
+	c.last_failed_status = action->last_failed_status;
+	c.cnt_invocations = action->cnt_invocations;
+	c.cnt_failures = action->cnt_failures;
+	c.cnt_suppressions = action->cnt_suppressions;
+	c.cnt_overlaps = action->cnt_overlaps;
+    } else {
+	c.last_invocation = schedule->last_invocation;
+	c.cnt_invocations = schedule->cnt_invocations;
+	c.cnt_failures = schedule->cnt_failures;
+	c.cnt_suppressions = schedule->cnt_suppressions;
+	c.cnt_overlaps = schedule->cnt_overlaps;
+    }
+
+    memcpy(p, schedule->name, slen);
+    p += slen;
+    if (alen) {
+	memcpy(p, action->name, alen);
+	p += alen;
+    }
+    memcpy(p, &c, sizeof(c));
+    p += sizeof(c);
+
+    memset(&rec->hdr, 0, sizeof(rec->hdr));
+    rec->hdr.length = p - rec->buf;
+    rec->hdr.checksum = fnv(rec->buf, rec->hdr.length);
+    rec->hdr.type = action ? JOURNAL_ACTION : JOURNAL_SCHEDULE;
+    rec->hdr.schedule_len = slen;
+    rec->hdr.action_len = alen;
+    return sizeof(rec->hdr) + rec->hdr.length;
+}
+
+static void
+apply(struct lmap *lmap, struct record *rec)
+{
+    struct counters c;
+    struct schedule *schedule;
+    struct action *action;
+    char sname[JOURNAL_NAME_MAX], aname[JOURNAL_NAME_MAX];
+    const char *p = rec->buf;
+
+    memcpy(sname, p, rec->hdr.schedule_len);
+    sname[rec->hdr.schedule_len] = 0;
+    p += rec->hdr.schedule_len;
+    memcpy(aname, p, rec->hdr.action_len);
+    aname[rec->hdr.action_len] = 0;
+    p += rec->hdr.action_len;
+    memcpy(&c, p, sizeof(c));
+
+    schedule = lmap_find_schedule(lmap, sname);
+    if (! schedule) {
+	return;
+    }
+
+    if (rec->hdr.type == JOURNAL_SCHEDULE) {
+	schedule->last_invocation = c.last_invocation;
+	schedule->cnt_invocations = c.cnt_invocations;
+	schedule->cnt_failures = c.cnt_failures;
+	schedule->cnt_suppressions = c.cnt_suppressions;
+	schedule->cnt_overlaps = c.cnt_overlaps;
+	return;
+    }
+
+    for (action = schedule->actions; action; action = action->next) {
+	if (action->name && ! strcmp(action->name, aname)) {
+	    break;
+	}
+    }
+    if (! action) {
+	return;
+    }
+    action->last_invocation = c.last_invocation;
+    action->last_completion = c.last_completion;
+    action->last_failed_completion = c.last_failed_completion;
+    action->last_status = c.last_status;
+    action->last_failed_status = c.last_failed_status;
+    action->cnt_invocations = c.cnt_invocations;
+    action->cnt_failures = c.cnt_failures;
+    action->cnt_suppressions = c.cnt_suppressions;
+    action->cnt_overlaps = c.cnt_overlaps;
+}
+
+/*
+ * Replays the journal file into the lmap. Returns the number of
+ * records applied or -1 if the file does not exist or is not a
+ * journal written by this lmapd.
+ */
+
+static int
+replay(struct lmap *lmap, const char *file)
+{
+    struct journal_header hdr;
+    struct record rec;
+    size_t len;
+    int n = 0;
+    FILE *f;
+
+    f = fopen(file, "r");
+    if (! f) {
+	if (errno != ENOENT) {
+	    lmap_err("cannot open '%s': %s", file, strerror(errno));
+	}
+	return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+	|| memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic))
+	|| hdr.version != JOURNAL_VERSION
+	|| hdr.byte_order != JOURNAL_BYTE_ORDER
+	|| hdr.time_size != sizeof(time_t)) {
+	lmap_wrn("ignoring incompatible journal '%s'", file);
+	(void) fclose(f);
+	return -1;
+    }
+
+    while (fread(&rec.hdr, sizeof(rec.hdr), 1, f) == 1) {
+	len = rec.hdr.length;
+	if (len > sizeof(rec.buf)
+	    || rec.hdr.schedule_len >= JOURNAL_NAME_MAX
+	    || rec.hdr.action_len >= JOURNAL_NAME_MAX
+	    || len != (size_t) rec.hdr.schedule_len + rec.hdr.action_len
+	              + sizeof(struct counters)
+	    || (rec.hdr.type != JOURNAL_SCHEDULE
+		&& rec.hdr.type != JOURNAL_ACTION)
+	    || fread(rec.buf, len, 1, f) != 1
+	    || fnv(rec.buf, len) != rec.hdr.checksum) {
+	    lmap_wrn("ignoring damaged tail of journal '%s'", file);
+	    break;
+	}
+	apply(lmap, &rec);
+	n++;
+    }
+
+    (void) fclose(f);
+    return n;
+}
+
+/**
+ * @brief Rewrites the journal from the current state
+ *
+ * Writes a new journal with one record per schedule and action of
+ * the current lmap and atomically replaces the journal file with it.
+ * The journal is reopened for appending.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_journal_checkpoint(struct lmapd *lmapd)
+{
+    struct journal_header hdr;
+    struct schedule *schedule;
+    struct action *action;
+    struct record rec;
+    char tmp[PATH_MAX];
+    size_t len;
+    long size;
+    FILE *f;
+
+    if (! lmapd->journal_path || ! lmapd->lmap) {
+	return 0;
+    }
+
+    (void) snprintf(tmp, sizeof(tmp), "%s.tmp", lmapd->journal_path);
+    f = fopen(tmp, "w");
+    if (! f) {
+	lmap_err("cannot open '%s': %s", tmp, strerror(errno));
+	return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+    hdr.version = JOURNAL_VERSION;
+    hdr.byte_order = JOURNAL_BYTE_ORDER;
+    hdr.time_size = sizeof(time_t);
+    (void) fwrite(&hdr, sizeof(hdr), 1, f);
+
+    for (schedule = lmapd->lmap->schedules; schedule; schedule = schedule->next) {
+	if (! schedule->name) {
+	    continue;
+	}
+	len = encode(&rec, schedule, NULL);
+	if (len) {
+	    (void) fwrite(&rec, len, 1, f);
+	}
+	for (action = schedule->actions; action; action = action->next) {
+	    if (! action->name) {
+		continue;
+	    }
+	    len = encode(&rec, schedule, action);
+	    if (len) {
+		(void) fwrite(&rec, len, 1, f);
+	    }
+	}
+    }
+
+    size = ftell(f);
+    if (ferror(f) || size == -1) {
+	(void) fclose(f);
+	lmap_err("cannot write '%s'", tmp);
+	(void) unlink(tmp);
+	return -1;
+    }
+    if (fclose(f) != 0) {
+	lmap_err("cannot write '%s': %s", tmp, strerror(errno));
+	(void) unlink(tmp);
+	return -1;
+    }
+    if (rename(tmp, lmapd->journal_path) == -1) {
+	lmap_err("cannot rename '%s': %s", tmp, strerror(errno));
+	(void) unlink(tmp);
+	return -1;
+    }
+
+    lmapd_journal_close(lmapd);
+    lmapd->journal_fd = open(lmapd->journal_path, O_WRONLY | O_APPEND);
+    if (lmapd->journal_fd == -1) {
+	lmap_err("cannot open '%s': %s", lmapd->journal_path, strerror(errno));
+	return -1;
+    }
+    lmapd->journal_bytes = 0;
+    lmapd->journal_limit = LMAPD_JOURNAL_LIMIT;
+    if ((size_t) size > lmapd->journal_limit / 4) {
+	lmapd->journal_limit = 4 * (size_t) size;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the journal
+ *
+ * Replays the journal into the current lmap, which restores the
+ * counters and timestamps of the schedules and actions that still
+ * exist, and compacts the journal afterwards.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_journal_open(struct lmapd *lmapd)
+{
+    int n;
+
+    if (! lmapd->journal_path || ! lmapd->lmap) {
+	return 0;
+    }
+
+    n = replay(lmapd->lmap, lmapd->journal_path);
+    if (n > 0) {
+	lmap_dbg("replayed %d records from journal '%s'",
+		 n, lmapd->journal_path);
+    }
+    return lmapd_journal_checkpoint(lmapd);
+}
+
+void
+lmapd_journal_close(struct lmapd *lmapd)
+{
+    if (lmapd->journal_fd != -1) {
+	(void) close(lmapd->journal_fd);
+	lmapd->journal_fd = -1;
+    }
+}
+
+/**
+ * @brief Appends the state of an action and its schedule
+ *
+ * Checkpoints the journal (see lmapd_journal_checkpoint()) once the
+ * records appended since the last checkpoint reach the limit.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @param schedule pointer to the schedule
+ * @param action pointer to the action
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_journal_action(struct lmapd *lmapd,
+		     struct schedule *schedule, struct action *action)
+{
+    struct record rec[2];
+    size_t len, alen;
+
+    if (lmapd->journal_fd == -1 || ! schedule->name || ! action->name) {
+	return 0;
+    }
+
+    len = encode(&rec[0], schedule, NULL);
+    alen = encode(&rec[1], schedule, action);
+    if (! len || ! alen) {
+	return 0;
+    }
+
+    /* both records go out with a single write() */
+    memmove((char *) &rec[0] + len, &rec[1], alen);
+    if (write(lmapd->journal_fd, &rec[0], len + alen) != (ssize_t) (len + alen)) {
+	lmap_err("cannot append to '%s': %s",
+		 lmapd->journal_path, strerror(errno));
+	return -1;
+    }
+
+    lmapd->journal_bytes += len + alen;
+    if (lmapd->journal_bytes >= lmapd->journal_limit) {
+	/* a failed checkpoint is retried after the next limit */
+	lmapd->journal_bytes = 0;
+	return lmapd_journal_checkpoint(lmapd);
+    }
+    return 0;
+}
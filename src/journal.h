@@ -0,0 +1,38 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAPD_JOURNAL_H
+#define LMAPD_JOURNAL_H
+
+#include "lmap.h"
+#include "lmapd.h"
+
+/*
+ * The journal is checkpointed once the records appended since the
+ * last checkpoint reach this many bytes or four times the size of
+ * the last checkpoint, whichever is larger.
+ */
+
+#define LMAPD_JOURNAL_LIMIT	(64 * 1024)
+
+extern int lmapd_journal_open(struct lmapd *lmapd);
+extern int lmapd_journal_checkpoint(struct lmapd *lmapd);
+extern void lmapd_journal_close(struct lmapd *lmapd);
+extern int lmapd_journal_action(struct lmapd *lmapd,
+				struct schedule *schedule, struct action *action);
+
+#endif
@@ -26,201 +26,344 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
-
-#include <json.h>
+#include <limits.h>
 
 #include "lmap.h"
 #include "utils.h"
+#include "arena.h"
 #include "json-io.h"
+#include "model.h"
+
+/*
+ * A small streaming JSON writer. The renderers emit the document
+ * member by member into a writer func, which allows the output to
+ * be written to a file descriptor or passed through a compressor
+ * without building a document tree or a serialized copy first. The
+ * layout follows the pretty printed format of json-c.
+ */
 
+#define JSON_MAX_DEPTH	16
+
+struct json_writer {
+    lmap_write_func *func;
+    void *ctx;
+    int depth;
+    int count[JSON_MAX_DEPTH];
+    int failed;
+};
 
 static void
-render_leaf(json_object *jobj, char *name, char *content)
+json_write(struct json_writer *jw, const char *buf, size_t len)
 {
-    assert(jobj);
-    
-    if (name && content) {
-	json_object_object_add(jobj, name, json_object_new_string(content));
+    if (! jw->failed && len) {
+	if (jw->func(jw->ctx, buf, len) == -1) {
+	    jw->failed = 1;
+	}
     }
 }
 
 static void
-render_leaf_int32(json_object *jobj, char *name, int32_t value)
+json_write_indent(struct json_writer *jw)
 {
-    json_object_object_add(jobj, name, json_object_new_int(value));
+    static const char spaces[2*JSON_MAX_DEPTH] =
+	"                                ";
+
+    json_write(jw, "\n", 1);
+    json_write(jw, spaces, 2 * jw->depth);
 }
 
 static void
-render_leaf_datetime(json_object *jobj, char *name, time_t *tp)
+json_write_string(struct json_writer *jw, const char *s)
 {
-    char buf[32];
-    struct tm *tmp;
-    
-    tmp = localtime(tp);
-    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", tmp);
+    const char *p;
+    char esc[8];
 
-    /*
-     * Hack to insert the ':' in the timezone offset since strftime()
-     * implementations do not generate this separator.
-     */
-    
-    if (strlen(buf) == 24) {
-	buf[25] = buf[24];
-	buf[24] = buf[23];
-	buf[23] = buf[22];
-	buf[22] = ':';
+    json_write(jw, "\"", 1);
+    for (p = s; *p; p++) {
+	unsigned char c = *p;
+	if (c >= 0x20 && c != '"' && c != '\\') {
+	    continue;
+	}
+	json_write(jw, s, p - s);
+	s = p + 1;
+	switch (c) {
+	case '"':  json_write(jw, "\\\"", 2); break;
+	case '\\': json_write(jw, "\\\\", 2); break;
+	case '\b': json_write(jw, "\\b", 2); break;
+	case '\f': json_write(jw, "\\f", 2); break;
+	case '\n': json_write(jw, "\\n", 2); break;
+	case '\r': json_write(jw, "\\r", 2); break;
+	case '\t': json_write(jw, "\\t", 2); break;
+	default:
+	    snprintf(esc, sizeof(esc), "\\u%04x", c);
+	    json_write(jw, esc, 6);
+	    break;
+	}
+    }
+    json_write(jw, s, p - s);
+    json_write(jw, "\"", 1);
+}
+
+/*
+ * Starts a new member of the current object (name != NULL) or a new
+ * element of the current array (name == NULL).
+ */
+
+static void
+json_write_member(struct json_writer *jw, const char *name)
+{
+    if (jw->depth > 0) {
+	if (jw->count[jw->depth]++) {
+	    json_write(jw, ",", 1);
+	}
+	json_write_indent(jw);
+    }
+    if (name) {
+	json_write_string(jw, name);
+	json_write(jw, ":", 1);
+    }
+}
+
+static void
+json_write_open(struct json_writer *jw, const char *name, char c)
+{
+    json_write_member(jw, name);
+    json_write(jw, &c, 1);
+    if (jw->depth + 1 < JSON_MAX_DEPTH) {
+	jw->depth++;
+	jw->count[jw->depth] = 0;
+    } else {
+	jw->failed = 1;
+    }
+}
+
+static void
+json_write_close(struct json_writer *jw, char c)
+{
+    if (jw->depth > 0) {
+	jw->depth--;
+	if (jw->count[jw->depth + 1]) {
+	    json_write_indent(jw);
+	}
     }
+    json_write(jw, &c, 1);
+}
+
+static void
+render_leaf(struct json_writer *jw, char *name, char *content)
+{
+    assert(jw);
     
-    render_leaf(jobj, name, buf); 
+    if (content) {
+	json_write_member(jw, name);
+	json_write_string(jw, content);
+    }
+}
+
+static void
+render_leaf_int32(struct json_writer *jw, char *name, int32_t value)
+{
+    char buf[LMAP_INT_LEN];
+
+    json_write_member(jw, name);
+    json_write(jw, buf, lmap_i64toa(value, buf));
 }
 
 static void
-render_option(struct option *option, json_object *jobj)
+render_leaf_datetime(struct json_writer *jw, char *name, time_t *tp)
 {
-    json_object *robj;
+    char buf[LMAP_DATETIME_LEN];
     
-    if (! option) {
+    if (lmap_format_datetime(*tp, buf, sizeof(buf)) == -1) {
 	return;
     }
+    render_leaf(jw, name, buf);
+}
 
-    robj = json_object_new_object();
-    if (! robj) {
+static void
+render_option(struct option *option, struct json_writer *jw)
+{
+    if (! option) {
 	return;
     }
-    json_object_array_add(jobj, robj);
 
-    render_leaf(robj, "id", option->id);
-    render_leaf(robj, "name", option->name);
-    render_leaf(robj, "value", option->value);
+    json_write_open(jw, NULL, '{');
+    render_leaf(jw, "id", option->id);
+    render_leaf(jw, "name", option->name);
+    render_leaf(jw, "value", option->value);
+    json_write_close(jw, '}');
 }
 
 static void
-render_agent_report(struct agent *agent, json_object *jobj)
+render_agent_report(struct agent *agent, struct json_writer *jw)
 {
     if (! agent) {
 	return;
     }
 
-    render_leaf_datetime(jobj, "date", &agent->report_date);
+    render_leaf_datetime(jw, "date", &agent->report_date);
     if (agent->agent_id && agent->report_agent_id) {
-	render_leaf(jobj, "agent-id", agent->agent_id);
+	render_leaf(jw, "agent-id", agent->agent_id);
     }
     if (agent->group_id && agent->report_group_id) {
-	render_leaf(jobj, "group-id", agent->group_id);
+	render_leaf(jw, "group-id", agent->group_id);
     }
     if (agent->measurement_point && agent->report_measurement_point) {
-	render_leaf(jobj, "measurement-point", agent->measurement_point);
+	render_leaf(jw, "measurement-point", agent->measurement_point);
     }
 }
 
 static void
-render_row(struct row *row, json_object *jobj)
+render_row(struct table *tab, uint32_t r, struct json_writer *jw)
 {
-    json_object *robj;
-    json_object *aobj;
-    struct value *val;
+    uint32_t c, offset;
 
-    robj = json_object_new_object();
-    if (! robj) {
-	return;
-    }
-    json_object_array_add(jobj, robj);
-
-    aobj = json_object_new_array();
-    if (!aobj) {
-	return;
-    }
-
-    json_object_object_add(robj, "value", aobj);
-    for (val = row->values; val; val = val->next) {
-	json_object_array_add(aobj, json_object_new_string(val->value ? val->value : ""));
+    json_write_open(jw, NULL, '{');
+    json_write_open(jw, "value", '[');
+    for (c = 0; c < tab->row_len[r]; c++) {
+	offset = tab->columns[c].offsets[r];
+	json_write_member(jw, NULL);
+	json_write_string(jw,
+			  offset == LMAP_TABLE_NULL ? "" : tab->arena + offset);
     }
+    json_write_close(jw, ']');
+    json_write_close(jw, '}');
 }
 
 static void
-render_table(struct table *tab, json_object *jobj)
+render_table(struct table *tab, struct json_writer *jw)
 {
-    json_object *robj;
-    json_object *aobj;
-    struct row *row;
-
-    robj = json_object_new_object();
-    if (! robj) {
-	return;
-    }
-    json_object_array_add(jobj, robj);
-
-    aobj = json_object_new_array();
-    if (! aobj) {
-	return;
-    }
+    uint32_t r;
 
-    json_object_object_add(robj, "row", aobj);
-    for (row = tab->rows; row; row = row->next) {
-	render_row(row, aobj);
+    (void) lmap_table_flatten(tab);
+    json_write_open(jw, NULL, '{');
+    json_write_open(jw, "row", '[');
+    for (r = 0; r < tab->nrows; r++) {
+	render_row(tab, r, jw);
     }
+    json_write_close(jw, ']');
+    json_write_close(jw, '}');
 }
 
 static void
-render_result(struct result *res, json_object *jobj)
+render_result(struct result *res, struct json_writer *jw)
 {
-    json_object *robj;
-    json_object *aobj;
     struct option *option;
     struct tag *tag;
     struct table *tab;
     
-    robj = json_object_new_object();
-    if (! robj) {
-	return;
-    }
-    json_object_array_add(jobj, robj);
+    json_write_open(jw, NULL, '{');
     
-    render_leaf(robj, "schedule", res->schedule);
-    render_leaf(robj, "action", res->action);
-    render_leaf(robj, "task", res->task);
-    aobj = json_object_new_array();
-    if (aobj) {
-	json_object_object_add(robj, "option", aobj);
-	for (option = res->options; option; option = option->next) {
-	    render_option(option, aobj);
-	}
+    render_leaf(jw, "schedule", res->schedule);
+    render_leaf(jw, "action", res->action);
+    render_leaf(jw, "task", res->task);
+    json_write_open(jw, "option", '[');
+    for (option = res->options; option; option = option->next) {
+	render_option(option, jw);
     }
-    aobj = json_object_new_array();
-    if (aobj) {
-	json_object_object_add(robj, "tag", aobj);
-	for (tag = res->tags; tag; tag = tag->next) {
-	    json_object_array_add(aobj, json_object_new_string(tag->tag));
-	}
+    json_write_close(jw, ']');
+    json_write_open(jw, "tag", '[');
+    for (tag = res->tags; tag; tag = tag->next) {
+	json_write_member(jw, NULL);
+	json_write_string(jw, tag->tag);
     }
+    json_write_close(jw, ']');
     
     if (res->event) {
-	render_leaf_datetime(robj, "event", &res->start);
+	render_leaf_datetime(jw, "event", &res->start);
     }
     
     if (res->start) {
-	render_leaf_datetime(robj, "start", &res->start);
+	render_leaf_datetime(jw, "start", &res->start);
     }
     
     if (res->end) {
-	render_leaf_datetime(robj, "end", &res->end);
+	render_leaf_datetime(jw, "end", &res->end);
     }
 
     if (res->cycle_number) {
-	render_leaf(robj, "cycle-number", res->cycle_number);
+	render_leaf(jw, "cycle-number", res->cycle_number);
     }
 
     if (res->flags & LMAP_RESULT_FLAG_STATUS_SET) {
-	render_leaf_int32(robj, "status", res->status);
+	render_leaf_int32(jw, "status", res->status);
     }
 
-    aobj = json_object_new_array();
-    if (aobj) {
-	json_object_object_add(robj, "table", aobj);
-	for (tab = res->tables; tab; tab = tab->next) {
-	    render_table(tab, aobj);
+    json_write_open(jw, "table", '[');
+    for (tab = res->tables; tab; tab = tab->next) {
+	render_table(tab, jw);
+    }
+    json_write_close(jw, ']');
+
+    json_write_close(jw, '}');
+}
+
+/**
+ * @brief Writes a JSON rendering of the lmap report
+ *
+ * This function renders the current lmap report into a JSON document
+ * according to the IETF's LMAP YANG data model. The document is
+ * written incrementally into the writer func.
+ *
+ * @param lmap The pointer to the lmap report to be rendered.
+ * @param func The writer receiving the serialized document.
+ * @param ctx The context passed to the writer.
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_json_write_report(struct lmap *lmap, lmap_write_func *func, void *ctx)
+{
+    struct json_writer jw = { .func = func, .ctx = ctx };
+    struct result *res;
+
+    assert(lmap && func);
+
+    json_write_open(&jw, NULL, '{');
+    json_write_open(&jw, LMAPR_JSON_NAMESPACE ":" "report", '{');
+    render_agent_report(lmap->agent, &jw);
+    json_write_open(&jw, "result", '[');
+    for (res = lmap->results; res; res = res->next) {
+	render_result(res, &jw);
+    }
+    json_write_close(&jw, ']');
+    json_write_close(&jw, '}');
+    json_write_close(&jw, '}');
+    json_write(&jw, "\n", 1);
+
+    return jw.failed ? -1 : 0;
+}
+
+struct buffer {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static int
+buffer_write(void *ctx, const char *buf, size_t len)
+{
+    struct buffer *b = ctx;
+    char *p;
+    size_t size;
+
+    if (b->len + len + 1 > b->size) {
+	size = b->size ? b->size : 4096;
+	while (b->len + len + 1 > size) {
+	    size *= 2;
 	}
+	p = realloc(b->buf, size);
+	if (! p) {
+	    lmap_err("failed to allocate memory");
+	    return -1;
+	}
+	b->buf = p;
+	b->size = size;
     }
+    memcpy(b->buf + b->len, buf, len);
+    b->len += len;
+    b->buf[b->len] = 0;
+    return 0;
 }
 
 /**
@@ -237,21 +380,1653 @@ render_result(struct result *res, json_object *jobj)
 char *
 lmap_json_render_report(struct lmap *lmap)
 {
-    const char *report = NULL;
-    json_object *jobj, *aobj, *robj;
-    struct result *res;
+    struct buffer b = { .buf = NULL, .len = 0, .size = 0 };
 
-    assert(lmap);
+    if (lmap_json_write_report(lmap, buffer_write, &b) == -1) {
+	free(b.buf);
+	return NULL;
+    }
+    return b.buf;
+}
 
-    jobj = json_object_new_object();
-    robj = json_object_new_object();
-    json_object_object_add(jobj, LMAPR_JSON_NAMESPACE ":" "report", robj);
-    render_agent_report(lmap->agent, robj);
-    aobj = json_object_new_array();
-    json_object_object_add(robj, "result", aobj);
-    for (res = lmap->results; res; res = res->next) {
-	render_result(res, aobj);
+/*
+ * A small streaming JSON tokenizer. The input is read in chunks and
+ * the parsers pull one token at a time, i.e., there is no document
+ * tree and only the current token is kept in memory. The tokenizer
+ * keeps track of the nesting of objects and arrays and consumes the
+ * ',' and ':' separators, so the parsers only see names and values.
+ * Documents are expected to follow the JSON encoding of YANG data
+ * (RFC 7951).
+ */
+
+#define JSON_CHUNK	65536
+#define JSON_NAME_MAX	64
+#define JSON_NEST_MAX	64
+
+#define JSON_EXPECT_VALUE	0	/* a value */
+#define JSON_EXPECT_FIRST_VALUE	1	/* a value or ']' */
+#define JSON_EXPECT_NAME	2	/* a member name */
+#define JSON_EXPECT_FIRST_NAME	3	/* a member name or '}' */
+#define JSON_EXPECT_COLON	4	/* ':' */
+#define JSON_EXPECT_COMMA	5	/* ',' or the end of the container */
+#define JSON_EXPECT_END		6	/* the end of the input */
+
+#define JSON_ERROR		-1
+#define JSON_EOF		0
+#define JSON_BEGIN_OBJECT	1
+#define JSON_END_OBJECT		2
+#define JSON_BEGIN_ARRAY	3
+#define JSON_END_ARRAY		4
+#define JSON_STRING		5
+#define JSON_NUMBER		6
+#define JSON_TRUE		7
+#define JSON_FALSE		8
+#define JSON_NULL		9
+
+struct json_reader {
+    FILE *in;				/* NULL when reading from memory */
+    char *buf;				/* input buffer (files only) */
+    size_t size;			/* size of the input buffer */
+    const char *p;			/* next input character */
+    const char *end;			/* end of the buffered input */
+    int eof;
+    int error;
+    unsigned int line;
+    const char *module;			/* module of unqualified members */
+    char *str;				/* value of a string or number */
+    size_t len;
+    size_t str_size;
+    int expect;				/* next expected token */
+    int depth;				/* nesting of objects and arrays */
+    char nest[JSON_NEST_MAX];		/* '{' or '[' for each level */
+};
+
+static void
+json_error(struct json_reader *jr, const char *msg)
+{
+    if (! jr->error) {
+	lmap_err("json parse error in line %u: %s", jr->line, msg);
+	jr->error = 1;
+    }
+}
+
+/*
+ * Reads more input, keeping the unconsumed part of the buffer (the
+ * beginning of the current token). Returns 1 if there is more input.
+ */
+
+static int
+json_fill(struct json_reader *jr)
+{
+    size_t keep, n;
+    char *p;
+
+    if (! jr->in || jr->eof) {
+	return 0;
+    }
+
+    keep = jr->end - jr->p;
+    if (keep && jr->p != jr->buf) {
+	memmove(jr->buf, jr->p, keep);
+    }
+    if (keep == jr->size) {
+	p = realloc(jr->buf, 2 * jr->size);
+	if (! p) {
+	    lmap_err("failed to allocate memory");
+	    jr->error = 1;
+	    return 0;
+	}
+	jr->buf = p;
+	jr->size *= 2;
+    }
+
+    n = fread(jr->buf + keep, 1, jr->size - keep, jr->in);
+    jr->p = jr->buf;
+    jr->end = jr->buf + keep + n;
+    if (n == 0) {
+	if (ferror(jr->in)) {
+	    json_error(jr, "read error");
+	}
+	jr->eof = 1;
+	return 0;
+    }
+    return 1;
+}
+
+static int
+json_putc(struct json_reader *jr, char c)
+{
+    char *p;
+
+    if (jr->len + 1 >= jr->str_size) {
+	p = realloc(jr->str, jr->str_size ? 2 * jr->str_size : 256);
+	if (! p) {
+	    lmap_err("failed to allocate memory");
+	    jr->error = 1;
+	    return -1;
+	}
+	jr->str = p;
+	jr->str_size = jr->str_size ? 2 * jr->str_size : 256;
+    }
+    jr->str[jr->len++] = c;
+    jr->str[jr->len] = 0;
+    return 0;
+}
+
+static int
+json_clear(struct json_reader *jr)
+{
+    jr->len = 0;
+    if (! jr->str && json_putc(jr, 0) == -1) {
+	return -1;
+    }
+    jr->len = 0;
+    jr->str[0] = 0;
+    return 0;
+}
+
+static int
+json_hex(const char *s, unsigned int *u)
+{
+    int i;
+
+    *u = 0;
+    for (i = 0; i < 4; i++) {
+	*u <<= 4;
+	if (s[i] >= '0' && s[i] <= '9') {
+	    *u |= s[i] - '0';
+	} else if (s[i] >= 'a' && s[i] <= 'f') {
+	    *u |= s[i] - 'a' + 10;
+	} else if (s[i] >= 'A' && s[i] <= 'F') {
+	    *u |= s[i] - 'A' + 10;
+	} else {
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+static void
+json_putu(struct json_reader *jr, unsigned int u)
+{
+    if (u < 0x80) {
+	json_putc(jr, u);
+    } else if (u < 0x800) {
+	json_putc(jr, 0xc0 | (u >> 6));
+	json_putc(jr, 0x80 | (u & 0x3f));
+    } else if (u < 0x10000) {
+	json_putc(jr, 0xe0 | (u >> 12));
+	json_putc(jr, 0x80 | ((u >> 6) & 0x3f));
+	json_putc(jr, 0x80 | (u & 0x3f));
+    } else {
+	json_putc(jr, 0xf0 | (u >> 18));
+	json_putc(jr, 0x80 | ((u >> 12) & 0x3f));
+	json_putc(jr, 0x80 | ((u >> 6) & 0x3f));
+	json_putc(jr, 0x80 | (u & 0x3f));
+    }
+}
+
+/*
+ * Scans a string token. If the token extends beyond the buffered
+ * input, more input is read and the token is scanned again.
+ */
+
+static int
+json_string(struct json_reader *jr)
+{
+    const char *q;
+    unsigned int u, l;
+
+again:
+    if (json_clear(jr) == -1) {
+	return JSON_ERROR;
+    }
+    for (q = jr->p + 1; q < jr->end && *q != '"'; q++) {
+	if ((unsigned char) *q < 0x20) {
+	    json_error(jr, "control character in string");
+	    return JSON_ERROR;
+	}
+	if (*q != '\\') {
+	    if (json_putc(jr, *q) == -1) {
+		return JSON_ERROR;
+	    }
+	    continue;
+	}
+	if (jr->end - q < 12 && ! jr->eof) {
+	    /* escape sequence may be incomplete, a surrogate pair needs
+	     * 12 characters */
+	    if (json_fill(jr)) {
+		goto again;
+	    }
+	}
+	if (jr->end - q < 2) {
+	    break;
+	}
+	switch (*++q) {
+	case '"':
+	case '\\':
+	case '/':  json_putc(jr, *q); break;
+	case 'b':  json_putc(jr, '\b'); break;
+	case 'f':  json_putc(jr, '\f'); break;
+	case 'n':  json_putc(jr, '\n'); break;
+	case 'r':  json_putc(jr, '\r'); break;
+	case 't':  json_putc(jr, '\t'); break;
+	case 'u':
+	    if (jr->end - q < 5 || json_hex(q + 1, &u) == -1) {
+		json_error(jr, "illegal unicode escape");
+		return JSON_ERROR;
+	    }
+	    q += 4;
+	    if (u >= 0xd800 && u < 0xdc00 && jr->end - q >= 7
+		&& q[1] == '\\' && q[2] == 'u'
+		&& json_hex(q + 3, &l) == 0 && l >= 0xdc00 && l < 0xe000) {
+		u = 0x10000 + ((u - 0xd800) << 10) + (l - 0xdc00);
+		q += 6;
+	    }
+	    if (u == 0) {
+		json_error(jr, "NUL character in string");
+		return JSON_ERROR;
+	    }
+	    json_putu(jr, u);
+	    break;
+	default:
+	    json_error(jr, "illegal escape sequence");
+	    return JSON_ERROR;
+	}
+	if (jr->error) {
+	    return JSON_ERROR;
+	}
+    }
+
+    if (q >= jr->end) {
+	if (json_fill(jr)) {
+	    goto again;
+	}
+	json_error(jr, "unterminated string");
+	return JSON_ERROR;
+    }
+    jr->p = q + 1;
+    return JSON_STRING;
+}
+
+static int
+json_number(struct json_reader *jr)
+{
+    const char *q;
+
+again:
+    for (q = jr->p; q < jr->end && *q && strchr("+-.0123456789eE", *q); q++) ;
+    if (q == jr->end && json_fill(jr)) {
+	goto again;
+    }
+
+    if (json_clear(jr) == -1) {
+	return JSON_ERROR;
+    }
+    for (; jr->p < q; jr->p++) {
+	if (json_putc(jr, *jr->p) == -1) {
+	    return JSON_ERROR;
+	}
+    }
+    return JSON_NUMBER;
+}
+
+static int
+json_literal(struct json_reader *jr)
+{
+    int i;
+
+    struct {
+	const char *name;
+	int token;
+    } tab[] = {
+	{ "true",	JSON_TRUE },
+	{ "false",	JSON_FALSE },
+	{ "null",	JSON_NULL },
+	{ NULL,		0 }
+    };
+
+    while (jr->end - jr->p < 5 && json_fill(jr)) ;
+
+    for (i = 0; tab[i].name; i++) {
+	size_t len = strlen(tab[i].name);
+	if ((size_t) (jr->end - jr->p) >= len
+	    && ! strncmp(jr->p, tab[i].name, len)) {
+	    jr->p += len;
+	    return tab[i].token;
+	}
+    }
+    json_error(jr, "unexpected character");
+    return JSON_ERROR;
+}
+
+/*
+ * Skips white space and the separator expected before the next token
+ * and checks that the next token may follow the previous one. Returns
+ * the next character, 0 at the end of the input and -1 on error.
+ */
+
+static int
+json_space(struct json_reader *jr)
+{
+    int c, top;
+
+again:
+    for (;; jr->p++) {
+	if (jr->p == jr->end && ! json_fill(jr)) {
+	    return jr->error ? -1 : 0;
+	}
+	if (*jr->p == '\n') {
+	    jr->line++;
+	} else if (*jr->p != ' ' && *jr->p != '\t' && *jr->p != '\r') {
+	    break;
+	}
+    }
+
+    c = *jr->p;
+    top = jr->depth ? jr->nest[jr->depth - 1] : 0;
+    switch (jr->expect) {
+    case JSON_EXPECT_COLON:
+	if (c != ':') {
+	    json_error(jr, "':' expected");
+	    return -1;
+	}
+	jr->p++;
+	jr->expect = JSON_EXPECT_VALUE;
+	goto again;
+    case JSON_EXPECT_COMMA:
+	if (c == ',') {
+	    jr->p++;
+	    jr->expect = (top == '{') ? JSON_EXPECT_NAME : JSON_EXPECT_VALUE;
+	    goto again;
+	}
+	if (c != (top == '{' ? '}' : ']')) {
+	    json_error(jr, "',' expected");
+	    return -1;
+	}
+	break;
+    case JSON_EXPECT_NAME:
+    case JSON_EXPECT_FIRST_NAME:
+	if (c != '"' && ! (c == '}' && jr->expect == JSON_EXPECT_FIRST_NAME)) {
+	    json_error(jr, "member name expected");
+	    return -1;
+	}
+	break;
+    case JSON_EXPECT_VALUE:
+    case JSON_EXPECT_FIRST_VALUE:
+	if (c == ']' && jr->expect == JSON_EXPECT_FIRST_VALUE) {
+	    break;
+	}
+	if (c == '}' || c == ']' || c == ',' || c == ':') {
+	    json_error(jr, "value expected");
+	    return -1;
+	}
+	break;
+    case JSON_EXPECT_END:
+	json_error(jr, "trailing characters");
+	return -1;
+    }
+    return c;
+}
+
+static int
+json_push(struct json_reader *jr, char c)
+{
+    if (jr->depth == JSON_NEST_MAX) {
+	json_error(jr, "nesting too deep");
+	return -1;
+    }
+    jr->nest[jr->depth++] = c;
+    jr->expect = (c == '{') ? JSON_EXPECT_FIRST_NAME : JSON_EXPECT_FIRST_VALUE;
+    jr->p++;
+    return 0;
+}
+
+static int
+json_next(struct json_reader *jr)
+{
+    int c, tok, expect;
+
+    if (jr->error) {
+	return JSON_ERROR;
+    }
+
+    c = json_space(jr);
+    if (c <= 0) {
+	return c ? JSON_ERROR : JSON_EOF;
+    }
+
+    expect = jr->expect;
+    switch (c) {
+    case '{':
+    case '[':
+	if (json_push(jr, c) == -1) {
+	    return JSON_ERROR;
+	}
+	return (c == '{') ? JSON_BEGIN_OBJECT : JSON_BEGIN_ARRAY;
+    case '}':
+    case ']':
+	jr->p++;
+	jr->depth--;
+	tok = (c == '}') ? JSON_END_OBJECT : JSON_END_ARRAY;
+	break;
+    case '"':
+	tok = json_string(jr);
+	break;
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+	tok = json_number(jr);
+	break;
+    default:
+	tok = json_literal(jr);
+	break;
+    }
+
+    if (tok == JSON_ERROR) {
+	return tok;
+    }
+    if (expect == JSON_EXPECT_NAME || expect == JSON_EXPECT_FIRST_NAME) {
+	jr->expect = (tok == JSON_STRING) ? JSON_EXPECT_COLON
+	    : jr->depth ? JSON_EXPECT_COMMA : JSON_EXPECT_END;
+    } else {
+	jr->expect = jr->depth ? JSON_EXPECT_COMMA : JSON_EXPECT_END;
+    }
+    return tok;
+}
+
+/*
+ * Skips the next value, including all nested objects and arrays.
+ */
+
+static void
+json_skip(struct json_reader *jr)
+{
+    int depth = 0;
+
+    do {
+	switch (json_next(jr)) {
+	case JSON_BEGIN_OBJECT:
+	case JSON_BEGIN_ARRAY:
+	    depth++;
+	    break;
+	case JSON_END_OBJECT:
+	case JSON_END_ARRAY:
+	    depth--;
+	    break;
+	case JSON_EOF:
+	    json_error(jr, "unexpected end of input");
+	    return;
+	case JSON_ERROR:
+	    return;
+	}
+    } while (depth > 0);
+}
+
+/*
+ * Reads the name of the next member of the current object. Returns 1
+ * if there is a member, 0 at the end of the object and -1 on error.
+ * The module name of qualified members of the document's module is
+ * removed; members of other modules are skipped.
+ */
+
+static int
+json_member(struct json_reader *jr, char *name, size_t size)
+{
+    char *colon, *p;
+    size_t len;
+
+    while (1) {
+	switch (json_next(jr)) {
+	case JSON_END_OBJECT:
+	    return 0;
+	case JSON_STRING:
+	    break;
+	case JSON_ERROR:
+	    return -1;
+	default:
+	    json_error(jr, "member name expected");
+	    return -1;
+	}
+
+	colon = strchr(jr->str, ':');
+	if (! colon) {
+	    p = jr->str;
+	} else {
+	    len = colon - jr->str;
+	    if (len != strlen(jr->module)
+		|| strncmp(jr->str, jr->module, len)) {
+		json_skip(jr);
+		continue;
+	    }
+	    p = colon + 1;
+	}
+	if (strlen(p) >= size) {
+	    json_error(jr, "member name too long");
+	    return -1;
+	}
+	memcpy(name, p, strlen(p) + 1);
+	return 1;
+    }
+}
+
+/*
+ * Iterates over the values of a leaf or a leaf-list member (encoded
+ * as an array). Empty leafs are encoded as [null] and returned as an
+ * empty string. The state must be 0 for the first call.
+ */
+
+static const char *
+json_value(struct json_reader *jr, int *state)
+{
+    int tok;
+
+    if (*state == 2) {
+	return NULL;
+    }
+
+    tok = json_next(jr);
+    if (*state == 0 && tok == JSON_BEGIN_ARRAY) {
+	*state = 1;
+	tok = json_next(jr);
+    } else if (*state == 0) {
+	*state = 2;
+    }
+    if (*state == 1 && tok == JSON_END_ARRAY) {
+	*state = 2;
+	return NULL;
+    }
+
+    switch (tok) {
+    case JSON_STRING:
+    case JSON_NUMBER:
+	return jr->str;
+    case JSON_TRUE:
+	return "true";
+    case JSON_FALSE:
+	return "false";
+    case JSON_NULL:
+	return "";
+    case JSON_ERROR:
+	break;
+    default:
+	json_error(jr, "leaf value expected");
+	break;
+    }
+    *state = 2;
+    return NULL;
+}
+
+/*
+ * Iterates over the entries of a list member (encoded as an array of
+ * objects) or the single object of a container member. Returns 1 if
+ * the next object has been opened. The state must be 0 for the first
+ * call.
+ */
+
+static int
+json_entry(struct json_reader *jr, int *state)
+{
+    int tok;
+
+    if (*state == 2) {
+	return 0;
+    }
+
+    tok = json_next(jr);
+    if (*state == 0 && tok == JSON_BEGIN_ARRAY) {
+	*state = 1;
+	tok = json_next(jr);
+    } else if (*state == 0) {
+	*state = 2;
+    }
+    if (*state == 1 && tok == JSON_END_ARRAY) {
+	*state = 2;
+	return 0;
     }
-    report = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
-    return report ? strdup(report) : NULL;
+
+    if (tok == JSON_BEGIN_OBJECT) {
+	return 1;
+    }
+    if (tok != JSON_ERROR) {
+	json_error(jr, "object expected");
+    }
+    *state = 2;
+    return 0;
+}
+
+static void
+json_unexpected(struct json_reader *jr, const char *name)
+{
+    lmap_wrn("unexpected member '%s'", name);
+    json_skip(jr);
+}
+
+static int
+json_reader_init(struct json_reader *jr, FILE *in, const char *string,
+		 const char *module)
+{
+    memset(jr, 0, sizeof(*jr));
+    jr->line = 1;
+    jr->module = module;
+    if (in) {
+	jr->in = in;
+	jr->size = JSON_CHUNK;
+	jr->buf = malloc(jr->size);
+	if (! jr->buf) {
+	    lmap_err("failed to allocate memory");
+	    return -1;
+	}
+	jr->p = jr->end = jr->buf;
+    } else {
+	jr->p = string;
+	jr->end = string + strlen(string);
+    }
+    return 0;
+}
+
+static void
+json_reader_done(struct json_reader *jr)
+{
+    free(jr->buf);
+    free(jr->str);
+}
+
+static int
+parse_agent(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+
+
+    if (! lmap->agent) {
+	lmap->agent = lmap_agent_new();
+	if (! lmap->agent) {
+	    return -1;
+	}
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_agent_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(lmap->agent, value);
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static struct supp *
+parse_suppression(struct json_reader *jr, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct supp *supp;
+
+
+    supp = lmap_supp_new();
+    if (! supp) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_supp_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(supp, value);
+	}
+    }
+
+    return supp;
+}
+
+static int
+parse_suppressions(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    struct supp *supp;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "suppression")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    supp = parse_suppression(jr, what);
+	    if (! supp || jr->error || lmap_add_supp(lmap, supp) == -1) {
+		lmap_supp_free(supp);
+	    }
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static struct option *
+parse_option(struct json_reader *jr, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct option *option;
+
+
+    option = lmap_option_new();
+    if (! option) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_option_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(option, value);
+	}
+    }
+
+    return option;
+}
+
+static struct registry *
+parse_registry(struct json_reader *jr, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct registry *registry;
+
+
+    registry = lmap_registry_new();
+    if (! registry) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_registry_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(registry, value);
+	}
+    }
+
+    return registry;
+}
+
+/*
+ * Parses the members of a measurement task. Capability tasks use the
+ * same encoding but their leafs are all state data.
+ */
+
+static struct task *
+parse_task(struct json_reader *jr, int what, int capability)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct task *task;
+
+
+    task = lmap_task_new();
+    if (! task) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (!capability && !strcmp(name, "option")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		struct option *option = parse_option(jr, what);
+		if (! option || jr->error
+		    || lmap_task_add_option(task, option) == -1) {
+		    lmap_option_free(option);
+		}
+	    }
+	    continue;
+	}
+	if (!strcmp(name, "function")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		struct registry *registry = parse_registry(jr, what);
+		if (! registry || jr->error
+		    || lmap_task_add_registry(task, registry) == -1) {
+		    lmap_registry_free(registry);
+		}
+	    }
+	    continue;
+	}
+	leaf = lmap_leaf_find(capability ? lmap_capability_task_leafs
+				    : lmap_task_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(task, value);
+	}
+    }
+
+    return task;
+}
+
+static int
+parse_tasks(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    struct task *task;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "task")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    task = parse_task(jr, what, 0);
+	    if (! task || jr->error || lmap_add_task(lmap, task) == -1) {
+		lmap_task_free(task);
+	    }
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static int
+parse_capability_tasks(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    struct task *task;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "task")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    task = parse_task(jr, what, 1);
+	    if (! task || jr->error
+		|| lmap_capability_add_task(lmap->capabilities, task) == -1) {
+		lmap_task_free(task);
+	    }
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static int
+parse_capabilities(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+
+
+    if (! lmap->capabilities) {
+	lmap->capabilities = lmap_capability_new();
+	if (! lmap->capabilities) {
+	    return -1;
+	}
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (!strcmp(name, "tasks")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		parse_capability_tasks(jr, lmap, what);
+	    }
+	    continue;
+	}
+	leaf = lmap_leaf_find(lmap_capability_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(lmap->capabilities, value);
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static void
+parse_periodic(struct json_reader *jr, struct event *event, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_periodic_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(event, value);
+	}
+    }
+}
+
+static void
+parse_calendar(struct json_reader *jr, struct event *event, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_calendar_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(event, value);
+	}
+    }
+}
+
+static void
+parse_one_off(struct json_reader *jr, struct event *event, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    const char *value;
+
+    (void) what;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "time")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    lmap_event_set_start(event, value);
+	}
+    }
+}
+
+static struct event *
+parse_event(struct json_reader *jr, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    const struct lmap_leaf *leaf;
+    struct event *event;
+    void (*parse)(struct json_reader *jr, struct event *e, int what);
+
+    event = lmap_event_new();
+    if (! event) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	leaf = lmap_leaf_find(lmap_event_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	if (leaf->func != (lmap_leaf_func *) lmap_event_set_type) {
+	    for (state = 0; (value = json_value(jr, &state)); ) {
+		leaf->func(event, value);
+	    }
+	    continue;
+	}
+	leaf->func(event, name);
+	if (!strcmp(name, "periodic")) {
+	    parse = parse_periodic;
+	} else if (!strcmp(name, "calendar")) {
+	    parse = parse_calendar;
+	} else if (!strcmp(name, "one-off")) {
+	    parse = parse_one_off;
+	} else {
+	    json_skip(jr);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    parse(jr, event, what);
+	}
+    }
+
+    return event;
+}
+
+static int
+parse_events(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    struct event *event;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "event")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    event = parse_event(jr, what);
+	    if (! event || jr->error || lmap_add_event(lmap, event) == -1) {
+		lmap_event_free(event);
+	    }
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static struct action *
+parse_action(struct json_reader *jr, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct action *action;
+
+
+    action = lmap_action_new();
+    if (! action) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (!strcmp(name, "option")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		struct option *option = parse_option(jr, what);
+		if (! option || jr->error
+		    || lmap_action_add_option(action, option) == -1) {
+		    lmap_option_free(option);
+		}
+	    }
+	    continue;
+	}
+	leaf = lmap_leaf_find(lmap_action_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(action, value);
+	}
+    }
+
+    return action;
+}
+
+static struct schedule *
+parse_schedule(struct json_reader *jr, int what)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct schedule *schedule;
+
+
+    schedule = lmap_schedule_new();
+    if (! schedule) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (!strcmp(name, "action")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		struct action *action = parse_action(jr, what);
+		if (! action || jr->error
+		    || lmap_schedule_add_action(schedule, action) == -1) {
+		    lmap_action_free(action);
+		}
+	    }
+	    continue;
+	}
+	leaf = lmap_leaf_find(lmap_schedule_leafs, name, what);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(schedule, value);
+	}
+    }
+
+    return schedule;
+}
+
+static int
+parse_schedules(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    struct schedule *schedule;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "schedule")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    schedule = parse_schedule(jr, what);
+	    if (! schedule || jr->error
+		|| lmap_add_schedule(lmap, schedule) == -1) {
+		lmap_schedule_free(schedule);
+	    }
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static int
+parse_lmap(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int j, state;
+    char name[JSON_NAME_MAX];
+
+    struct {
+	char *name;
+	int (*parse)(struct json_reader *jr, struct lmap *lmap, int what);
+    } tab[] = {
+	{ "agent",		parse_agent },
+	{ "capabilities",	parse_capabilities },
+	{ "suppressions",	parse_suppressions },
+	{ "tasks",		parse_tasks },
+	{ "schedules",		parse_schedules },
+	{ "events",		parse_events },
+	{ NULL, NULL }
+    };
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	for (j = 0; tab[j].name; j++) {
+	    if (!strcmp(name, tab[j].name)) {
+		for (state = 0; json_entry(jr, &state); ) {
+		    if (tab[j].parse(jr, lmap, what) != 0) {
+			return -1;
+		    }
+		}
+		break;
+	    }
+	}
+	if (! tab[j].name) {
+	    json_unexpected(jr, name);
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static int
+parse_control(struct json_reader *jr, struct lmap *lmap, int what)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+
+    assert(lmap);
+
+    if (json_next(jr) != JSON_BEGIN_OBJECT) {
+	json_error(jr, "object expected");
+	return -1;
+    }
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "lmap")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    if (parse_lmap(jr, lmap, what) != 0) {
+		return -1;
+	    }
+	}
+    }
+    if (! jr->error && json_next(jr) != JSON_EOF) {
+	json_error(jr, "trailing garbage");
+    }
+    if (jr->error) {
+	return -1;
+    }
+
+    /* the XML parser always creates the capabilities, do the same */
+    if (! lmap->capabilities) {
+	lmap->capabilities = lmap_capability_new();
+	if (! lmap->capabilities) {
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+static int
+parse_control_file(struct lmap *lmap, const char *file, int what)
+{
+    int ret;
+    FILE *in;
+    struct json_reader jr;
+
+    assert(file);
+
+    in = fopen(file, "r");
+    if (! in) {
+	lmap_err("cannot open '%s': %s", file, strerror(errno));
+	return -1;
+    }
+    if (json_reader_init(&jr, in, NULL, LMAPC_JSON_NAMESPACE) == -1) {
+	fclose(in);
+	return -1;
+    }
+    ret = parse_control(&jr, lmap, what);
+    if (ret != 0) {
+	lmap_err("cannot parse %s file '%s'",
+		 (what & PARSE_CONFIG_FALSE) ? "state" : "config", file);
+    }
+    json_reader_done(&jr);
+    fclose(in);
+    return ret;
+}
+
+static int
+parse_control_string(struct lmap *lmap, const char *string, int what)
+{
+    int ret;
+    struct json_reader jr;
+
+    assert(string);
+
+    json_reader_init(&jr, NULL, string, LMAPC_JSON_NAMESPACE);
+    ret = parse_control(&jr, lmap, what);
+    if (ret != 0) {
+	lmap_err("cannot parse from string");
+    }
+    json_reader_done(&jr);
+    return ret;
+}
+
+static int
+parse_control_path(struct lmap *lmap, const char *path, int what)
+{
+    int ret = 0;
+    char filepath[PATH_MAX];
+    struct dirent *dp;
+    DIR *dfd;
+
+    assert(path);
+
+    dfd = opendir(path);
+    if (!dfd) {
+	if (errno == ENOTDIR) {
+	    return parse_control_file(lmap, path, what);
+	} else {
+	    lmap_err("cannot read %s path '%s'",
+		     (what & PARSE_CONFIG_FALSE) ? "state" : "config", path);
+	    return -1;
+	}
+    }
+
+    while ((dp = readdir(dfd)) != NULL) {
+	if (! lmap_has_suffix(dp->d_name, ".json")) {
+	    continue;
+	}
+	(void) snprintf(filepath, sizeof(filepath), "%s/%s", path, dp->d_name);
+	if (parse_control_file(lmap, filepath, what) < 0) {
+	    ret = -1;
+	    break;
+	}
+    }
+    (void) closedir(dfd);
+
+    return ret;
+}
+
+/**
+ * @brief Parses JSON config files
+ *
+ * Parses a JSON config file or all files with the suffix .json of a
+ * config directory and adds the config objects to lmap.
+ *
+ * @param lmap The lmap to add the config to
+ * @param path The config file or directory
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_json_parse_config_path(struct lmap *lmap, const char *path)
+{
+    return parse_control_path(lmap, path, PARSE_CONFIG_TRUE);
+}
+
+int
+lmap_json_parse_config_file(struct lmap *lmap, const char *file)
+{
+    return parse_control_file(lmap, file, PARSE_CONFIG_TRUE);
+}
+
+int
+lmap_json_parse_config_string(struct lmap *lmap, const char *string)
+{
+    return parse_control_string(lmap, string, PARSE_CONFIG_TRUE);
+}
+
+int
+lmap_json_parse_state_path(struct lmap *lmap, const char *path)
+{
+    return parse_control_path(lmap, path,
+			      PARSE_CONFIG_TRUE | PARSE_CONFIG_FALSE);
+}
+
+int
+lmap_json_parse_state_file(struct lmap *lmap, const char *file)
+{
+    return parse_control_file(lmap, file,
+			      PARSE_CONFIG_TRUE | PARSE_CONFIG_FALSE);
+}
+
+int
+lmap_json_parse_state_string(struct lmap *lmap, const char *string)
+{
+    return parse_control_string(lmap, string,
+				PARSE_CONFIG_TRUE | PARSE_CONFIG_FALSE);
+}
+
+static int
+parse_row(struct json_reader *jr, struct table *tab)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    const char *value;
+
+    if (lmap_table_new_row(tab) == -1) {
+	jr->error = 1;
+	return -1;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "value")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    if (lmap_table_add_value(tab, value) == -1) {
+		jr->error = 1;
+		return -1;
+	    }
+	}
+    }
+    return jr->error ? -1 : 0;
+}
+
+static struct table *
+parse_table(struct json_reader *jr)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    struct table *tab;
+
+    tab = lmap_table_new();
+    if (! tab) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "row")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    if (parse_row(jr, tab) == -1) {
+		break;
+	    }
+	}
+    }
+    return tab;
+}
+
+static struct result *
+parse_result(struct json_reader *jr)
+{
+    int state;
+    const struct lmap_leaf *leaf;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    struct result *res;
+
+
+    res = lmap_result_new();
+    if (! res) {
+	jr->error = 1;
+	return NULL;
+    }
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (!strcmp(name, "option")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		struct option *option = parse_option(jr,
+				PARSE_CONFIG_TRUE | PARSE_CONFIG_FALSE);
+		if (! option || jr->error
+		    || lmap_result_add_option(res, option) == -1) {
+		    lmap_option_free(option);
+		}
+	    }
+	    continue;
+	}
+	if (!strcmp(name, "table")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		struct table *tab = parse_table(jr);
+		if (! tab || jr->error
+		    || lmap_result_add_table(res, tab) == -1) {
+		    lmap_table_free(tab);
+		}
+	    }
+	    continue;
+	}
+	leaf = lmap_leaf_find(lmap_result_leafs, name, 0);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(res, value);
+	}
+    }
+
+    return res;
+}
+
+static int
+parse_report(struct json_reader *jr, struct lmap *lmap,
+	     lmap_result_func *func, void *ctx)
+{
+    int state;
+    char name[JSON_NAME_MAX];
+    const char *value;
+    const struct lmap_leaf *leaf;
+    struct result *res;
+    struct lmap_arena *arena;
+
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (! lmap->agent) {
+	    lmap->agent = lmap_agent_new();
+	    if (! lmap->agent) {
+		return -1;
+	    }
+	}
+
+	if (!strcmp(name, "result")) {
+	    for (state = 0; json_entry(jr, &state); ) {
+		if (func) {
+		    /* see read_report() in xml-io.c */
+		    arena = lmap_arena_use(NULL);
+		    res = parse_result(jr);
+		    (void) lmap_arena_use(arena);
+		} else {
+		    res = parse_result(jr);
+		}
+		if (! res || jr->error) {
+		    lmap_result_free(res);
+		    break;
+		}
+		if (! func) {
+		    if (lmap_add_result(lmap, res) == -1) {
+			lmap_result_free(res);
+			jr->error = 1;
+			break;
+		    }
+		} else if (func(res, ctx) == -1) {
+		    return 1;
+		}
+	    }
+	    continue;
+	}
+
+	leaf = lmap_leaf_find(lmap_report_leafs, name, 0);
+	if (! leaf) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	if (leaf->report) {
+	    leaf->report(lmap->agent, "true");
+	}
+	for (state = 0; (value = json_value(jr, &state)); ) {
+	    leaf->func(lmap->agent, value);
+	}
+    }
+
+    return jr->error ? -1 : 0;
+}
+
+static int
+read_report(struct json_reader *jr, struct lmap *lmap,
+	    lmap_result_func *func, void *ctx)
+{
+    int ret, state;
+    char name[JSON_NAME_MAX];
+
+    assert(lmap);
+
+    if (json_next(jr) != JSON_BEGIN_OBJECT) {
+	json_error(jr, "object expected");
+	return -1;
+    }
+    while (json_member(jr, name, sizeof(name)) == 1) {
+	if (strcmp(name, "report")) {
+	    json_unexpected(jr, name);
+	    continue;
+	}
+	for (state = 0; json_entry(jr, &state); ) {
+	    ret = parse_report(jr, lmap, func, ctx);
+	    if (ret) {
+		/* stopped by the result handler (1) or failed (-1) */
+		return ret < 0 ? -1 : 0;
+	    }
+	}
+    }
+    if (! jr->error && json_next(jr) != JSON_EOF) {
+	json_error(jr, "trailing garbage");
+    }
+    return jr->error ? -1 : 0;
+}
+
+/**
+ * @brief Reads a JSON report file and passes each result to a handler
+ *
+ * The report is parsed incrementally so that memory use does not grow
+ * with the size of the report as long as the handler releases the
+ * results. Report meta data is stored in the agent of lmap. If func
+ * is NULL, the results are added to lmap.
+ *
+ * @param lmap The lmap receiving the report meta data
+ * @param file The name of the report file
+ * @param func The result handler or NULL
+ * @param ctx The context passed to the result handler
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_json_read_report_file(struct lmap *lmap, const char *file,
+			   lmap_result_func *func, void *ctx)
+{
+    int ret;
+    FILE *in;
+    struct json_reader jr;
+
+    assert(file);
+
+    in = fopen(file, "r");
+    if (! in) {
+	lmap_err("cannot open '%s': %s", file, strerror(errno));
+	return -1;
+    }
+    if (json_reader_init(&jr, in, NULL, LMAPR_JSON_NAMESPACE) == -1) {
+	fclose(in);
+	return -1;
+    }
+    ret = read_report(&jr, lmap, func, ctx);
+    if (ret != 0) {
+	lmap_err("cannot parse report file '%s'", file);
+    }
+    json_reader_done(&jr);
+    fclose(in);
+    return ret;
+}
+
+int
+lmap_json_read_report_string(struct lmap *lmap, const char *string,
+			     lmap_result_func *func, void *ctx)
+{
+    int ret;
+    struct json_reader jr;
+
+    assert(string);
+
+    json_reader_init(&jr, NULL, string, LMAPR_JSON_NAMESPACE);
+    ret = read_report(&jr, lmap, func, ctx);
+    if (ret != 0) {
+	lmap_err("cannot parse from string");
+    }
+    json_reader_done(&jr);
+    return ret;
+}
+
+int
+lmap_json_parse_report_file(struct lmap *lmap, const char *file)
+{
+    return lmap_json_read_report_file(lmap, file, NULL, NULL);
+}
+
+int
+lmap_json_parse_report_string(struct lmap *lmap, const char *string)
+{
+    return lmap_json_read_report_string(lmap, string, NULL, NULL);
 }
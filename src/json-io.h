@@ -28,14 +28,22 @@ extern int lmap_json_parse_config_path(struct lmap *lmap, const char *path);
 extern int lmap_json_parse_config_file(struct lmap *lmap, const char *file);
 extern int lmap_json_parse_config_string(struct lmap *lmap, const char *string);
 
+extern int lmap_json_parse_state_path(struct lmap *lmap, const char *path);
 extern int lmap_json_parse_state_file(struct lmap *lmap, const char *file);
 extern int lmap_json_parse_state_string(struct lmap *lmap, const char *string);
 
 extern int lmap_json_parse_report_file(struct lmap *lmap, const char *file);
 extern int lmap_json_parse_report_string(struct lmap *lmap, const char *string);
+extern int lmap_json_read_report_file(struct lmap *lmap, const char *file,
+				      lmap_result_func *func, void *ctx);
+extern int lmap_json_read_report_string(struct lmap *lmap, const char *string,
+					lmap_result_func *func, void *ctx);
 
 extern char * lmap_json_render_config(struct lmap *lmap);
 extern char * lmap_json_render_state(struct lmap *lmap);
 extern char * lmap_json_render_report(struct lmap *lmap);
 
+extern int lmap_json_write_report(struct lmap *lmap,
+				  lmap_write_func *func, void *ctx);
+
 #endif
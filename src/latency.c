@@ -0,0 +1,184 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-action latency histograms. The runner takes monotonic
+ * timestamps along the life of an invocation and records the time
+ * spent in each stage; the histograms of an action are allocated
+ * when the action is invoked for the first time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "lmap.h"
+#include "utils.h"
+#include "latency.h"
+
+static const char *stage_names[LMAP_LATENCY_STAGES] = {
+    "queue", "launch", "run", "reap", "move"
+};
+
+static int
+bucket_index(uint64_t value)
+{
+    int msb = 63 - __builtin_clzll(value | 1);
+    int idx;
+
+    if (value < (1 << LMAP_HISTOGRAM_SUB_BITS)) {
+	return (int) value;
+    }
+    idx = ((msb - LMAP_HISTOGRAM_SUB_BITS + 1) << LMAP_HISTOGRAM_SUB_BITS)
+	+ (int) ((value >> (msb - LMAP_HISTOGRAM_SUB_BITS))
+		 & ((1 << LMAP_HISTOGRAM_SUB_BITS) - 1));
+    return idx < LMAP_HISTOGRAM_BUCKETS ? idx : LMAP_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @brief Records a value in a histogram
+ *
+ * @param h pointer to the histogram
+ * @param value the value to record
+ */
+
+void
+lmap_histogram_record(struct lmap_histogram *h, uint64_t value)
+{
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+	h->max = value;
+    }
+    h->buckets[bucket_index(value)]++;
+}
+
+/**
+ * @brief Returns the largest value that goes into a bucket
+ *
+ * @param bucket the index of the bucket
+ * @return the largest value of the bucket (UINT64_MAX for the last)
+ */
+
+uint64_t
+lmap_histogram_bucket_max(int bucket)
+{
+    const int sub = 1 << LMAP_HISTOGRAM_SUB_BITS;
+    int shift;
+
+    if (bucket < sub) {
+	return bucket;
+    }
+    if (bucket >= LMAP_HISTOGRAM_BUCKETS - 1) {
+	return UINT64_MAX;
+    }
+    shift = (bucket >> LMAP_HISTOGRAM_SUB_BITS) - 1;
+    return ((uint64_t) (sub + (bucket & (sub - 1)) + 1) << shift) - 1;
+}
+
+/**
+ * @brief Estimates a percentile of the values in a histogram
+ *
+ * @param h pointer to the histogram
+ * @param percent the percentile (0..100)
+ * @return the upper bound of the bucket holding the percentile,
+ *         never more than the largest value recorded
+ */
+
+uint64_t
+lmap_histogram_percentile(const struct lmap_histogram *h, unsigned int percent)
+{
+    uint64_t rank, seen = 0, value;
+    int i;
+
+    if (! h->count) {
+	return 0;
+    }
+    rank = (h->count * (percent > 100 ? 100 : percent) + 99) / 100;
+    if (rank == 0) {
+	rank = 1;
+    }
+    for (i = 0; i < LMAP_HISTOGRAM_BUCKETS; i++) {
+	seen += h->buckets[i];
+	if (seen >= rank) {
+	    break;
+	}
+    }
+    value = lmap_histogram_bucket_max(i);
+    return value < h->max ? value : h->max;
+}
+
+/**
+ * @brief Returns the monotonic time in microseconds
+ */
+
+uint64_t
+lmap_latency_now(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+	return 0;
+    }
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Returns the name of a latency stage
+ */
+
+const char *
+lmap_latency_stage_name(int stage)
+{
+    return (stage >= 0 && stage < LMAP_LATENCY_STAGES)
+	? stage_names[stage] : NULL;
+}
+
+/**
+ * @brief Records the time an action spent in a stage
+ *
+ * Allocates the histograms of the action if necessary. Intervals
+ * with an unknown start (0) or a clock going backwards are ignored.
+ *
+ * @param action pointer to the action
+ * @param stage the stage (one of the LMAP_LATENCY_ constants)
+ * @param start monotonic time the stage started
+ * @param end monotonic time the stage ended
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_latency_record(struct action *action, int stage,
+		    uint64_t start, uint64_t end)
+{
+    if (stage < 0 || stage >= LMAP_LATENCY_STAGES) {
+	return -1;
+    }
+    if (! action->latency) {
+	action->latency = calloc(1, sizeof(struct lmap_latency));
+	if (! action->latency) {
+	    lmap_err("failed to allocate memory");
+	    return -1;
+	}
+    }
+    if (start && end >= start) {
+	lmap_histogram_record(&action->latency->stages[stage], end - start);
+    }
+    return 0;
+}
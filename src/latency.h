@@ -0,0 +1,72 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAP_LATENCY_H
+#define LMAP_LATENCY_H
+
+#include <stdint.h>
+
+#include "lmap.h"
+
+/*
+ * Log-linear histogram of durations in microseconds: values below 4
+ * have a bucket of their own, every power of two above is split into
+ * four equally sized buckets (relative error below 25%). Values of
+ * 2^40 us (about 12 days) and above go into the last bucket.
+ */
+
+#define LMAP_HISTOGRAM_SUB_BITS		2
+#define LMAP_HISTOGRAM_BUCKETS		160
+
+struct lmap_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint32_t buckets[LMAP_HISTOGRAM_BUCKETS];
+};
+
+extern void lmap_histogram_record(struct lmap_histogram *h, uint64_t value);
+extern uint64_t lmap_histogram_bucket_max(int bucket);
+extern uint64_t lmap_histogram_percentile(const struct lmap_histogram *h,
+					  unsigned int percent);
+
+/*
+ * The stages an invocation of an action goes through: waiting from
+ * the event firing until the fork (queue), forking (launch), running
+ * until the child is reaped (run), completion bookkeeping including
+ * the meta data (reap) and moving results and cleaning the workspace
+ * (move).
+ */
+
+#define LMAP_LATENCY_QUEUE	0
+#define LMAP_LATENCY_LAUNCH	1
+#define LMAP_LATENCY_RUN	2
+#define LMAP_LATENCY_REAP	3
+#define LMAP_LATENCY_MOVE	4
+#define LMAP_LATENCY_STAGES	5
+
+struct lmap_latency {
+    struct lmap_histogram stages[LMAP_LATENCY_STAGES];
+    uint64_t forked;		/* when the running child was forked */
+};
+
+extern uint64_t lmap_latency_now(void);
+extern const char *lmap_latency_stage_name(int stage);
+extern int lmap_latency_record(struct action *action, int stage,
+			       uint64_t start, uint64_t end);
+
+#endif
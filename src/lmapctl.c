@@ -15,7 +15,7 @@
  * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,9 +38,14 @@
 #include "pidfile.h"
 #include "xml-io.h"
 #include "json-io.h"
+#include "compress.h"
+#include "chunk.h"
 #include "runner.h"
 #include "workspace.h"
+#include "arena.h"
+#include "control.h"
 
+static int ack_cmd(int argc, char *argv[]);
 static int clean_cmd(int argc, char *argv[]);
 static int config_cmd(int argc, char *argv[]);
 static int help_cmd(int argc, char *argv[]);
@@ -58,6 +63,7 @@ static struct
     char *description;
     int (*func) (int argc, char *argv[]);
 } cmds[] = {
+    { "ack",      "acknowledge delivered report chunks",    ack_cmd },
     { "clean",    "clean the workspace (be careful!)",      clean_cmd },
     { "config",   "validate and render lmap configuration", config_cmd },
     { "help",     "show brief list of commands",            help_cmd },
@@ -77,6 +83,14 @@ static struct lmapd *lmapd = NULL;
 #define LMAP_FORMAT_JSON	0x02
 static int format = LMAP_FORMAT_XML;
 
+static int compress_method = LMAP_COMPRESS_NONE;
+static int compress_level = LMAP_COMPRESS_LEVEL_DEFAULT;
+static int compress_workers = 0;
+
+static char *chunk_dir = NULL;
+static unsigned long chunk_max_results = 0;
+static unsigned long chunk_max_bytes = 0;
+
 static void
 atexit_cb()
 {
@@ -105,7 +119,13 @@ usage(FILE *f)
 	    "\t-C path in which the program is executed\n"
 	    "\t-h show brief usage information and exit\n"
 	    "\t-j use json format when generating output\n"
-	    "\t-x use xml format when generating output (default)\n",
+	    "\t-x use xml format when generating output (default)\n"
+	    "\t-z compress reports (none, gzip, zstd)\n"
+	    "\t-Z compression level (lower levels are faster)\n"
+	    "\t-W number of compression worker threads (zstd only)\n"
+	    "\t-o write report chunks into this directory\n"
+	    "\t-N maximum number of results per report chunk\n"
+	    "\t-B maximum size of a report chunk in bytes (uncompressed)\n",
 	    LMAPD_LMAPCTL);
 }
 
@@ -224,10 +244,16 @@ render_uint32(uint32_t num)
 static int
 read_config(struct lmapd *lmapd)
 {
-    lmapd->lmap = lmap_new();
+    /*
+     * lmapctl builds its data model (including the results of a
+     * report) in an arena that stays in use until the lmap is freed.
+     */
+
+    lmapd->lmap = lmap_new_with_arena();
     if (! lmapd->lmap) {
 	return -1;
     }
+    (void) lmap_arena_use(lmapd->lmap->arena);
     
     if (lmap_xml_parse_config_path(lmapd->lmap, lmapd->config_path)) {
 	lmap_free(lmapd->lmap);
@@ -238,11 +264,43 @@ read_config(struct lmapd *lmapd)
     return 0;
 }
 
+struct buffer {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+static int
+buffer_write(void *ctx, const char *buf, size_t len)
+{
+    struct buffer *b = ctx;
+    char *data;
+
+    if (b->len + len + 1 > b->size) {
+	size_t size = b->size ? b->size : 8192;
+	while (b->len + len + 1 > size) {
+	    size *= 2;
+	}
+	data = realloc(b->data, size);
+	if (! data) {
+	    lmap_err("failed to allocate memory");
+	    return -1;
+	}
+	b->data = data;
+	b->size = size;
+    }
+    memcpy(b->data + b->len, buf, len);
+    b->len += len;
+    b->data[b->len] = 0;
+    return 0;
+}
+
 /**
- * @brief Reads the XML state file
+ * @brief Reads the state from the running lmapd
  *
- * Function to read the XML state file and initialize the
- * coresponding data structures with data.
+ * Function to obtain the XML state from the running lmapd over the
+ * control socket and initialize the coresponding data structures
+ * with data.
  *
  * @param lmapd pointer to the lmapd struct
  * @return 0 on success -1 or error
@@ -251,44 +309,71 @@ read_config(struct lmapd *lmapd)
 static int
 read_state(struct lmapd *lmapd)
 {
-    char statefile[PATH_MAX];
+    struct buffer b = { NULL, 0, 0 };
+    int ret = -1;
 
-    snprintf(statefile, sizeof(statefile), "%s/%s",
-	     lmapd->run_path, LMAPD_STATUS_FILE);
+    if (lmapd_control_request(lmapd->run_path, "status",
+			      buffer_write, &b) != 0 || ! b.data) {
+	goto exit;
+    }
     
-    lmapd->lmap = lmap_new();
+    lmapd->lmap = lmap_new_with_arena();
     if (! lmapd->lmap) {
-	return -1;
+	goto exit;
     }
+    (void) lmap_arena_use(lmapd->lmap->arena);
     
-    if (lmap_xml_parse_state_file(lmapd->lmap, statefile)) {
+    if (lmap_xml_parse_state_string(lmapd->lmap, b.data)) {
 	lmap_free(lmapd->lmap);
 	lmapd->lmap = NULL;
-	return -1;
+	goto exit;
     }
-    
-    return 0;
+    ret = 0;
+
+exit:
+    free(b.data);
+    return ret;
 }
 
+/**
+ * @brief Removes the workspace files of delivered report chunks
+ *
+ * Each argument is the path of a report chunk written by the report
+ * command. Every chunk is acknowledged on its own, see
+ * lmap_chunk_ack(), i.e., a chunk that cannot be acknowledged does
+ * not keep the remaining chunks from being acknowledged.
+ */
+
 static int
-clean_cmd(int argc, char *argv[]) 
+ack_cmd(int argc, char *argv[])
 {
-    pid_t pid;
-    
-    if (argc != 1) {
-	printf("%s: wrong # of args: should be '%s'\n",
+    int i, ret = 0;
+
+    if (argc < 2) {
+	printf("%s: wrong # of args: should be '%s chunk...'\n",
 	       LMAPD_LMAPCTL, argv[0]);
 	return 1;
     }
 
-    pid = lmapd_pid_read(lmapd);
-    if (! pid) {
-	lmap_err("failed to obtain PID of lmapd");
+    for (i = 1; i < argc; i++) {
+	if (lmap_chunk_ack(argv[i]) == -1) {
+	    ret = 1;
+	}
+    }
+
+    return ret;
+}
+
+static int
+clean_cmd(int argc, char *argv[]) 
+{
+    if (argc != 1) {
+	printf("%s: wrong # of args: should be '%s'\n",
+	       LMAPD_LMAPCTL, argv[0]);
 	return 1;
     }
 
-    if (kill(pid, SIGUSR2) == -1) {
-	lmap_err("failed to send SIGUSR2 to process %d", pid);
+    if (lmapd_control_request(lmapd->run_path, "clean", NULL, NULL) != 0) {
 	return 1;
     }
 
@@ -298,7 +383,7 @@ clean_cmd(int argc, char *argv[])
 static int
 config_cmd(int argc, char *argv[]) 
 {
-    char *xml;
+    int fd = STDOUT_FILENO;
 
     if (argc != 1) {
 	printf("%s: wrong # of args: should be '%s'\n",
@@ -313,12 +398,10 @@ config_cmd(int argc, char *argv[])
 	return 1;
     }
     
-    xml = lmap_xml_render_config(lmapd->lmap);
-    if (! xml) {
+    (void) fflush(stdout);
+    if (lmap_xml_write_config(lmapd->lmap, lmap_write_fd, &fd) == -1) {
 	return 1;
     }
-    fputs(xml, stdout);
-    free(xml);
     return 0;
 }
 
@@ -338,39 +421,96 @@ help_cmd(int argc, char *argv[])
 static int
 reload_cmd(int argc, char *argv[])
 {
-    pid_t pid;
-    
     if (argc != 1) {
 	printf("%s: wrong # of args: should be '%s'\n",
 	       LMAPD_LMAPCTL, argv[0]);
 	return 1;
     }
 
-    pid = lmapd_pid_read(lmapd);
-    if (! pid) {
-	lmap_err("failed to obtain PID of lmapd");
+    if (lmapd_control_request(lmapd->run_path, "reload", NULL, NULL) != 0) {
 	return 1;
     }
 
-    if (kill(pid, SIGHUP) == -1) {
-	lmap_err("failed to send SIGHUP to process %d", pid);
-	return 1;
+    return 0;
+}
+
+static int
+write_report(struct lmap *lmap, lmap_write_func *func, void *ctx)
+{
+    switch (format) {
+    case LMAP_FORMAT_XML:
+	return lmap_xml_write_report(lmap, func, ctx);
+    case LMAP_FORMAT_JSON:
+	return lmap_json_write_report(lmap, func, ctx);
     }
+    return -1;
+}
 
-    return 0;
+static int
+write_report_fd(struct lmap *lmap, int fd)
+{
+    struct lmap_compress *z;
+    int ret;
+
+    /*
+     * The report is rendered straight into the (compressing) output
+     * stream so that we never hold a serialized copy in memory.
+     */
+
+    z = lmap_compress_new(compress_method, compress_level,
+			  compress_workers, lmap_write_fd, &fd);
+    if (! z) {
+	return -1;
+    }
+    ret = write_report(lmap, lmap_compress_write, z);
+    if (lmap_compress_finish(z) == -1) {
+	ret = -1;
+    }
+    return ret;
 }
 
 static int
-report_cmd(int argc, char *argv[])
+write_chunks(struct lmap *lmap)
 {
-    char *report = NULL;
+    struct lmap_chunker chunker;
+    char suffix[16];
+    int fd = STDOUT_FILENO;
+
+    snprintf(suffix, sizeof(suffix), ".%s%s",
+	     format == LMAP_FORMAT_JSON ? "json" : "xml",
+	     compress_method == LMAP_COMPRESS_GZIP ? ".gz"
+	     : compress_method == LMAP_COMPRESS_ZSTD ? ".zst" : "");
+
+    memset(&chunker, 0, sizeof(chunker));
+    chunker.dir = chunk_dir;
+    chunker.suffix = suffix;
+    chunker.max_results = chunk_max_results;
+    chunker.max_bytes = chunk_max_bytes;
+    chunker.report = write_report;
+    chunker.compress_method = compress_method;
+    chunker.compress_level = compress_level;
+    chunker.compress_workers = compress_workers;
+    chunker.names = lmap_write_fd;
+    chunker.names_ctx = &fd;
+
+    (void) fflush(stdout);
+    return lmap_chunk_report(lmap, &chunker);
+}
 
+static int
+report_cmd(int argc, char *argv[])
+{
     if (argc != 1) {
 	printf("%s: wrong # of args: should be '%s'\n",
 	       LMAPD_LMAPCTL, argv[0]);
 	return 1;
     }
 
+    if ((chunk_max_results || chunk_max_bytes) && ! chunk_dir) {
+	lmap_err("report chunks require an output directory (-o)");
+	return 1;
+    }
+
     if (read_config(lmapd) != 0) {
 	return 1;
     }
@@ -392,20 +532,11 @@ report_cmd(int argc, char *argv[])
 	return 1;
     }
 
-    switch (format) {
-    case LMAP_FORMAT_XML:
-	report = lmap_xml_render_report(lmapd->lmap);
-	break;
-    case LMAP_FORMAT_JSON:
-	report = lmap_json_render_report(lmapd->lmap);
-	break;
-    }
-    if (! report) {
-	return 1;
+    if (chunk_dir) {
+	return write_chunks(lmapd->lmap) == 0 ? 0 : 1;
     }
-    fputs(report, stdout);
-    free(report);
-    return 0;
+
+    return write_report_fd(lmapd->lmap, STDOUT_FILENO) == 0 ? 0 : 1;
 }
 
 static int
@@ -430,22 +561,13 @@ running_cmd(int argc, char *argv[])
 static int
 shutdown_cmd(int argc, char *argv[])
 {
-    pid_t pid;
-    
     if (argc != 1) {
 	printf("%s: wrong # of args: should be '%s'\n",
 	       LMAPD_LMAPCTL, argv[0]);
 	return 1;
     }
 
-    pid = lmapd_pid_read(lmapd);
-    if (! pid) {
-	lmap_err("failed to obtain PID of lmapd");
-	return 1;
-    }
-
-    if (kill(pid, SIGTERM) == -1) {
-	lmap_err("failed to send SIGTERM to process %d", pid);
+    if (lmapd_control_request(lmapd->run_path, "shutdown", NULL, NULL) != 0) {
 	return 1;
     }
 
@@ -456,8 +578,6 @@ static int
 status_cmd(int argc, char *argv[])
 {
     struct lmap *lmap = NULL;
-    pid_t pid;
-    struct timespec tp = { .tv_sec = 0, .tv_nsec = 87654321 };
     
     if (argc != 1) {
 	printf("%s: wrong # of args: should be '%s'\n",
@@ -465,23 +585,6 @@ status_cmd(int argc, char *argv[])
 	return 1;
     }
 
-    pid = lmapd_pid_read(lmapd);
-    if (! pid) {
-	lmap_err("failed to obtain PID of lmapd");
-	return 1;
-    }
-
-    if (kill(pid, SIGUSR1) == -1) {
-	lmap_err("failed to send SIGUSR1 to process %d", pid);
-	return 1;
-    }
-    /*
-     * I should do something more intelligent here, e.g., wait unti
-     * the state file is available with a matching touch date and
-     * nobody is writing it (i.e., obtain an exclusing open).
-     */
-    (void) nanosleep(&tp, NULL);
-
     if (read_state(lmapd) != 0) {
 	return 1;
     }
@@ -671,11 +774,15 @@ int
 main(int argc, char *argv[])
 {
     int i, opt;
+    int64_t num;
+    uint64_t unum;
     char *config_path = NULL;
     char *queue_path = NULL;
     char *run_path = NULL;
+
+    lmap_set_log_handler(vlog);
     
-    while ((opt = getopt(argc, argv, "q:c:r:C:hjx")) != -1) {
+    while ((opt = getopt(argc, argv, "q:c:r:C:hjxz:Z:W:o:N:B:")) != -1) {
 	switch (opt) {
 	case 'q':
 	    queue_path = optarg;
@@ -701,14 +808,50 @@ main(int argc, char *argv[])
 	case 'x':
 	    format = LMAP_FORMAT_XML;
 	    break;
+	case 'z':
+	    compress_method = lmap_compress_method(optarg);
+	    if (compress_method == -1) {
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'Z':
+	    if (lmap_atoi64(optarg, LMAP_COMPRESS_LEVEL_MIN,
+			    LMAP_COMPRESS_LEVEL_MAX, &num) == -1) {
+		lmap_err("illegal compression level '%s'", optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    compress_level = num;
+	    break;
+	case 'W':
+	    if (lmap_atou64(optarg, LMAP_COMPRESS_WORKERS_MAX, &unum) == -1) {
+		lmap_err("illegal number of compression workers '%s'", optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    compress_workers = unum;
+	    break;
+	case 'o':
+	    chunk_dir = optarg;
+	    break;
+	case 'N':
+	    if (lmap_atou64(optarg, ULONG_MAX, &unum) == -1) {
+		lmap_err("illegal number of results per chunk '%s'", optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    chunk_max_results = unum;
+	    break;
+	case 'B':
+	    if (lmap_atou64(optarg, ULONG_MAX, &unum) == -1) {
+		lmap_err("illegal chunk size '%s'", optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    chunk_max_bytes = unum;
+	    break;
 	default:
 	    usage(stderr);
 	    exit(EXIT_FAILURE);
 	}
     }
 
-    lmap_set_log_handler(vlog);
-
     lmapd = lmapd_new();
     if (! lmapd) {
 	exit(EXIT_FAILURE);
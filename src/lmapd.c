@@ -32,6 +32,8 @@
 #include "xml-io.h"
 #include "runner.h"
 #include "workspace.h"
+#include "config.h"
+#include "journal.h"
 
 static struct lmapd *lmapd = NULL;
 
@@ -45,6 +47,8 @@ atexit_cb()
     if (lmapd) {
 	lmapd_free(lmapd);
     }
+
+    lmap_log_stop();
 }
 
 static void
@@ -59,6 +63,10 @@ usage(FILE *f)
 	    "\t-c path to config directory or file\n"
 	    "\t-b path to capability directory or file\n"
 	    "\t-r path to run directory (pid file and status file)\n"
+	    "\t-k path to a compiled config snapshot (speeds up startup)\n"
+	    "\t-j path to the state journal (keeps counters across restarts)\n"
+	    "\t-m port serving Prometheus metrics on localhost\n"
+	    "\t-l log format (text, kv or json)\n"
 	    "\t-v show version information and exit\n"
 	    "\t-h show brief usage information and exit\n",
 	    LMAPD_LMAPD);
@@ -121,58 +129,6 @@ daemonize()
     openlog("lmapd", LOG_PID | LOG_NDELAY, LOG_DAEMON);
 }
 
-/**
- * @brief Reads the XML config file
- *
- * Function to read the XML config file and initialize the
- * coresponding data structures with data.
- *
- * @param lmapd pointer to the lmapd struct
- * @return 0 on success -1 or error
- */
-
-static int
-read_config(struct lmapd *lmapd)
-{
-    int ret = 0;
-
-    lmapd->lmap = lmap_new();
-    if (! lmapd->lmap) {
-	return -1;
-    }
-    
-    ret = lmap_xml_parse_config_path(lmapd->lmap, lmapd->config_path);
-    if (ret != 0) {
-	lmap_free(lmapd->lmap);
-	lmapd->lmap = NULL;
-	return -1;
-    }
-    
-    if (lmapd->lmap->agent) {
-	lmapd->lmap->agent->last_started = time(NULL);
-    }
-
-    ret = lmap_xml_parse_state_path(lmapd->lmap, lmapd->capability_path);
-    if (ret != 0) {
-	lmap_free(lmapd->lmap);
-	lmapd->lmap = NULL;
-	return -1;
-    }
-
-    if (!lmapd->lmap->capabilities) {
-	lmapd->lmap->capabilities = lmap_capability_new();
-    }
-    if (lmapd->lmap->capabilities) {
-	char buf[256];
-	snprintf(buf, sizeof(buf), "%s version %d.%d.%d", LMAPD_LMAPD,
-		 LMAP_VERSION_MAJOR, LMAP_VERSION_MINOR, LMAP_VERSION_PATCH);
-	lmap_capability_set_version(lmapd->lmap->capabilities, buf);
-	lmap_capability_add_system_tags(lmapd->lmap->capabilities);
-    }
-
-    return 0;
-}
-
 int
 main(int argc, char *argv[])
 {
@@ -181,9 +137,13 @@ main(int argc, char *argv[])
     char *capability_path = NULL;
     char *queue_path = NULL;
     char *run_path = NULL;
+    char *snapshot_path = NULL;
+    char *journal_path = NULL;
+    uint64_t metrics_port = 0;
+    int log_format;
     pid_t pid;
     
-    while ((opt = getopt(argc, argv, "fnszq:c:b:r:vh")) != -1) {
+    while ((opt = getopt(argc, argv, "fnszq:c:b:r:k:j:m:l:vh")) != -1) {
 	switch (opt) {
 	case 'f':
 	    daemon = 1;
@@ -209,6 +169,29 @@ main(int argc, char *argv[])
 	case 'r':
 	    run_path = optarg;
 	    break;
+	case 'k':
+	    snapshot_path = optarg;
+	    break;
+	case 'j':
+	    journal_path = optarg;
+	    break;
+	case 'm':
+	    if (lmap_atou64(optarg, 65535, &metrics_port) != 0
+		|| metrics_port == 0) {
+		fprintf(stderr, "%s: invalid metrics port '%s'\n",
+			LMAPD_LMAPD, optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'l':
+	    log_format = lmap_log_parse_format(optarg);
+	    if (log_format == -1) {
+		fprintf(stderr, "%s: invalid log format '%s'\n",
+			LMAPD_LMAPD, optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    lmap_log_set_format(log_format);
+	    break;
 	case 'v':
 	    printf("%s version %d.%d.%d\n", LMAPD_LMAPD,
 		   LMAP_VERSION_MAJOR, LMAP_VERSION_MINOR, LMAP_VERSION_PATCH);
@@ -228,6 +211,7 @@ main(int argc, char *argv[])
     }
     
     atexit(atexit_cb);
+    lmap_xml_set_render_allocations(1);
     
     openlog("lmapd", LOG_PID | LOG_NDELAY, LOG_DAEMON);
     
@@ -238,27 +222,29 @@ main(int argc, char *argv[])
     }
     (void) lmapd_set_capability_path(lmapd,
 		capability_path ? capability_path : LMAPD_CAPABILITY_DIR);
+    if (snapshot_path) {
+	(void) lmapd_set_snapshot_path(lmapd, snapshot_path);
+    }
+    if (journal_path) {
+	(void) lmapd_set_journal_path(lmapd, journal_path);
+    }
+    lmapd->metrics_port = (unsigned short) metrics_port;
     
     if (noop || state) {
-	if (read_config(lmapd) != 0) {
+	if (lmapd_read_config(lmapd, &valid) != 0) {
 	    exit(EXIT_FAILURE);
 	}
-	valid = lmap_valid(lmapd->lmap);
 	if (valid && noop) {
-	    char *xml = lmap_xml_render_config(lmapd->lmap);
-	    if (! xml) {
+	    int fd = STDOUT_FILENO;
+	    if (lmap_xml_write_config(lmapd->lmap, lmap_write_fd, &fd) == -1) {
 		exit(EXIT_FAILURE);
 	    }
-	    fputs(xml, stdout);
-	    free(xml);
 	}
 	if (valid && state) {
-	    char *xml = lmap_xml_render_state(lmapd->lmap);
-	    if (! xml) {
+	    int fd = STDOUT_FILENO;
+	    if (lmap_xml_write_state(lmapd->lmap, lmap_write_fd, &fd) == -1) {
 		exit(EXIT_FAILURE);
 	    }
-	    fputs(xml, stdout);
-	    free(xml);
 	}
 	if (fflush(stdout) == EOF) {
 	    lmap_err("flushing stdout failed");
@@ -283,6 +269,16 @@ main(int argc, char *argv[])
 	daemonize();
     }
 
+    /*
+     * From now on, log messages are written by a separate thread and
+     * rate limited per call site so that a flood of messages does
+     * not stall the event loop.
+     */
+
+    if (lmap_log_start() != 0) {
+	lmap_wrn("failed to start the log writer - logging synchronously");
+    }
+
     /*
      * Initialize the random number generator. Since random numbers
      * are only used to calculate random spreads, using time() might
@@ -301,16 +297,16 @@ main(int argc, char *argv[])
     lmapd_pid_write(lmapd);
 
     do {
-	if (read_config(lmapd) != 0) {
+	if (lmapd_read_config(lmapd, &valid) != 0) {
 	    exit(EXIT_FAILURE);
 	}
-	valid = lmap_valid(lmapd->lmap);
 	if (! valid) {
 	    lmap_err("configuration is invalid - exiting...");
 	    exit(EXIT_FAILURE);
 	}
 
 	(void) lmapd_workspace_init(lmapd);
+	(void) lmapd_journal_open(lmapd);
 	ret = lmapd_run(lmapd);
 	
 	/*
@@ -0,0 +1,630 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Non-blocking log handler for lmapd. Messages are formatted by the
+ * caller into a slot of a bounded ring buffer (a lock-free queue
+ * that several threads may write into) and written to stderr, syslog
+ * or an output function by a writer thread, so that a slow syslog
+ * never stalls the event loop. If the ring is full, messages are
+ * dropped and counted. Every call site, identified by its format
+ * string, may log a burst of messages per interval; further messages
+ * are suppressed and summarized when the interval is over. Lines can
+ * be rendered as plain text, as key=value pairs or as JSON objects.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lmap.h"
+#include "utils.h"
+
+#define LOG_RING_SIZE	1024		/* must be a power of two */
+#define LOG_MSG_LEN	512
+#define LOG_SITES	256
+#define LOG_PROBES	8
+#define LOG_LINE_LEN	(2 * LOG_MSG_LEN + 256)
+
+struct log_slot {
+    uint64_t seq;			/* sequence number (see log_put()) */
+    int level;
+    const char *func;
+    struct timespec ts;
+    char msg[LOG_MSG_LEN];
+};
+
+struct log_site {
+    const char *format;			/* identifies the call site */
+    const char *func;
+    int level;
+    uint64_t window;			/* current rate limit interval */
+    uint32_t count;			/* messages in the interval */
+    uint32_t suppressed;		/* messages suppressed in the interval */
+};
+
+static struct log_slot ring[LOG_RING_SIZE];
+static uint64_t ring_head;		/* next slot to fill (writers) */
+static uint64_t ring_tail;		/* next slot to drain (reader) */
+
+static struct log_site sites[LOG_SITES];
+
+static int log_format = LMAP_LOG_FORMAT_TEXT;
+static unsigned int log_burst = LMAP_LOG_BURST;
+static unsigned int log_interval = LMAP_LOG_INTERVAL;
+static lmap_write_func *log_output = NULL;
+static void *log_output_ctx = NULL;
+
+static uint64_t cnt_suppressed;
+static uint64_t cnt_dropped;
+static uint64_t cnt_dropped_reported;
+
+static pthread_t log_thread;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static int log_running;			/* the writer thread drains the ring */
+static int log_sleeping;		/* the writer thread waits for work */
+static int log_stopping;
+static int log_atfork;
+
+static const char *level_names[] = {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+static const char *
+level_name(int level)
+{
+    return (level >= 0 && level <= LOG_DEBUG) ? level_names[level] : "unknown";
+}
+
+static uint64_t
+mono_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/*
+ * Appends s to the line, escaping quotes, backslashes and control
+ * characters so that the value can be put into double quotes both
+ * in key=value pairs and in JSON strings.
+ */
+
+static size_t
+put_escaped(char *line, size_t len, size_t size, const char *s)
+{
+    const unsigned char *p;
+
+    for (p = (const unsigned char *) s; *p && len + 7 < size; p++) {
+	if (*p == '"' || *p == '\\') {
+	    line[len++] = '\\';
+	    line[len++] = *p;
+	} else if (*p == '\n') {
+	    line[len++] = '\\';
+	    line[len++] = 'n';
+	} else if (*p < 0x20) {
+	    len += snprintf(line + len, size - len, "\\u%04x", *p);
+	} else {
+	    line[len++] = *p;
+	}
+    }
+    line[len] = 0;
+    return len;
+}
+
+static size_t
+put_string(char *line, size_t len, size_t size, const char *s)
+{
+    int n;
+
+    n = snprintf(line + len, size - len, "%s", s);
+    if (n < 0) {
+	return len;
+    }
+    return (len + n < size) ? len + n : size - 1;
+}
+
+/*
+ * Renders a message into a line (without the newline). Text lines
+ * sent to syslog carry the message only since syslog adds the rest.
+ */
+
+static size_t
+render_line(const struct log_slot *slot, int to_syslog, char *line, size_t size)
+{
+    char tbuf[32];
+    struct tm tm;
+    size_t len = 0;
+
+    if (log_format == LMAP_LOG_FORMAT_TEXT) {
+	if (to_syslog) {
+	    return put_string(line, 0, size, slot->msg);
+	}
+	len = snprintf(line, size, "lmapd[%d]: [%s] ", (int) getpid(),
+		       slot->level == LOG_ERR ? "ERR"
+		       : slot->level == LOG_WARNING ? "WRN"
+		       : slot->level == LOG_DEBUG ? "DBG" : level_name(slot->level));
+	if (slot->func) {
+	    len = put_string(line, len, size, slot->func);
+	    len = put_string(line, len, size, ": ");
+	}
+	return put_string(line, len, size, slot->msg);
+    }
+
+    gmtime_r(&slot->ts.tv_sec, &tm);
+    strftime(tbuf, sizeof(tbuf), "%Y-%m-%dT%H:%M:%S", &tm);
+    if (log_format == LMAP_LOG_FORMAT_JSON) {
+	len = snprintf(line, size, "{\"time\":\"%s.%03ldZ\",\"level\":\"%s\","
+		       "\"func\":\"%s\",\"msg\":\"", tbuf,
+		       slot->ts.tv_nsec / 1000000, level_name(slot->level),
+		       slot->func ? slot->func : "");
+	len = put_escaped(line, len, size, slot->msg);
+	return put_string(line, len, size, "\"}");
+    }
+    len = snprintf(line, size, "time=%s.%03ldZ level=%s func=%s msg=\"",
+		   tbuf, slot->ts.tv_nsec / 1000000, level_name(slot->level),
+		   slot->func ? slot->func : "-");
+    len = put_escaped(line, len, size, slot->msg);
+    return put_string(line, len, size, "\"");
+}
+
+static void
+log_write(const struct log_slot *slot)
+{
+    char line[LOG_LINE_LEN];
+    size_t len;
+
+    if (log_output) {
+	len = render_line(slot, 0, line, sizeof(line) - 1);
+	line[len++] = '\n';
+	(void) log_output(log_output_ctx, line, len);
+    } else if (isatty(STDERR_FILENO)) {
+	len = render_line(slot, 0, line, sizeof(line) - 1);
+	line[len++] = '\n';
+	(void) fwrite(line, 1, len, stderr);
+    } else {
+	(void) render_line(slot, 1, line, sizeof(line));
+	syslog(slot->level, "%s", line);
+    }
+}
+
+/*
+ * Puts a message into the ring (a bounded queue after D. Vyukov). A
+ * slot whose sequence number equals the position is free; a writer
+ * claims it by advancing the head and hands it to the reader by
+ * setting the sequence number to position + 1. The reader frees it
+ * again by setting it to position + LOG_RING_SIZE.
+ */
+
+static int
+log_put(const struct log_slot *msg)
+{
+    struct log_slot *slot;
+    uint64_t pos, seq;
+    int64_t diff;
+
+    pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    for (;;) {
+	slot = &ring[pos & (LOG_RING_SIZE - 1)];
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	diff = (int64_t) seq - (int64_t) pos;
+	if (diff == 0) {
+	    if (__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		break;
+	    }
+	} else if (diff < 0) {
+	    return -1;
+	} else {
+	    pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+	}
+    }
+
+    slot->level = msg->level;
+    slot->func = msg->func;
+    slot->ts = msg->ts;
+    memcpy(slot->msg, msg->msg, sizeof(slot->msg));
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int
+log_get(struct log_slot *msg)
+{
+    struct log_slot *slot = &ring[ring_tail & (LOG_RING_SIZE - 1)];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring_tail + 1) {
+	return 0;
+    }
+    *msg = *slot;
+    __atomic_store_n(&slot->seq, ring_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+    ring_tail++;
+    return 1;
+}
+
+static void
+log_emit(int level, const char *func, const char *msg)
+{
+    struct log_slot slot;
+
+    slot.level = level;
+    slot.func = func;
+    clock_gettime(CLOCK_REALTIME, &slot.ts);
+    snprintf(slot.msg, sizeof(slot.msg), "%s", msg);
+
+    if (! __atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+	log_write(&slot);
+	return;
+    }
+    if (log_put(&slot) == -1) {
+	__atomic_add_fetch(&cnt_dropped, 1, __ATOMIC_RELAXED);
+	return;
+    }
+
+    /*
+     * The read-modify-write operations on log_sleeping are totally
+     * ordered: either the writer thread sets log_sleeping after this
+     * one and then sees the new message (see log_writer()), or we see
+     * log_sleeping set. The writer holds the mutex until it waits, so
+     * the signal cannot get lost between its check and the wait.
+     */
+
+    if (__atomic_fetch_add(&log_sleeping, 0, __ATOMIC_SEQ_CST)) {
+	(void) pthread_mutex_lock(&log_mutex);
+	(void) pthread_cond_signal(&log_cond);
+	(void) pthread_mutex_unlock(&log_mutex);
+    }
+}
+
+/*
+ * Starts a new interval for a call site if the interval has changed
+ * (or if force is set) and summarizes the messages suppressed in the
+ * interval that ended. Several threads may race here; only the one
+ * that moves the interval forward reports the summary.
+ */
+
+static void
+site_roll(struct log_site *site, uint64_t window, int force)
+{
+    char msg[LOG_MSG_LEN];
+    uint64_t old;
+    uint32_t n;
+
+    old = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+    if (! force && old == window) {
+	return;
+    }
+    if (old != window
+	&& ! __atomic_compare_exchange_n(&site->window, &old, window, 0,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	return;
+    }
+    __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+    n = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    if (n) {
+	snprintf(msg, sizeof(msg), "suppressed %u messages like \"%s\"",
+		 n, site->format);
+	log_emit(site->level, site->func, msg);
+    }
+}
+
+static struct log_site *
+site_find(int level, const char *func, const char *format)
+{
+    struct log_site *site;
+    const char *cur;
+    uintptr_t h = (uintptr_t) format;
+    int i;
+
+    h ^= h >> 17;
+    h *= 0x9e3779b97f4a7c15ULL;
+    for (i = 0; i < LOG_PROBES; i++) {
+	site = &sites[(h + i) & (LOG_SITES - 1)];
+	cur = __atomic_load_n(&site->format, __ATOMIC_ACQUIRE);
+	if (cur == format) {
+	    return site;
+	}
+	if (! cur) {
+	    if (__atomic_compare_exchange_n(&site->format, &cur, format, 0,
+					    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		site->func = func;
+		site->level = level;
+		return site;
+	    }
+	    if (cur == format) {
+		return site;
+	    }
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Returns 1 if a message of the call site may be logged and 0 if it
+ * is suppressed. Call sites that do not fit into the table are never
+ * rate limited.
+ */
+
+static int
+site_admit(int level, const char *func, const char *format)
+{
+    struct log_site *site;
+
+    if (! log_burst || ! format) {
+	return 1;
+    }
+    site = site_find(level, func, format);
+    if (! site) {
+	return 1;
+    }
+    site_roll(site, mono_seconds() / log_interval, 0);
+    if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > log_burst) {
+	__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&cnt_suppressed, 1, __ATOMIC_RELAXED);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Summarizes suppressed messages of call sites that have been quiet
+ * since their interval ended (or all of them if force is set) and
+ * reports messages dropped because the ring was full.
+ */
+
+static void
+log_sweep(int force)
+{
+    char msg[LOG_MSG_LEN];
+    uint64_t window = mono_seconds() / log_interval;
+    uint64_t dropped;
+    int i;
+
+    for (i = 0; i < LOG_SITES; i++) {
+	if (__atomic_load_n(&sites[i].format, __ATOMIC_ACQUIRE)
+	    && __atomic_load_n(&sites[i].suppressed, __ATOMIC_RELAXED)) {
+	    site_roll(&sites[i], window, force);
+	}
+    }
+
+    dropped = __atomic_load_n(&cnt_dropped, __ATOMIC_RELAXED);
+    if (dropped != cnt_dropped_reported) {
+	snprintf(msg, sizeof(msg), "dropped %llu log messages (ring full)",
+		 (unsigned long long) (dropped - cnt_dropped_reported));
+	cnt_dropped_reported = dropped;
+	log_emit(LOG_WARNING, __FUNCTION__, msg);
+    }
+}
+
+static void *
+log_writer(void *arg)
+{
+    struct log_slot slot;
+    struct timespec ts;
+    int stopping = 0;
+
+    (void) arg;
+
+    while (! stopping) {
+	while (log_get(&slot)) {
+	    log_write(&slot);
+	}
+	log_sweep(0);
+
+	(void) pthread_mutex_lock(&log_mutex);
+	(void) __atomic_exchange_n(&log_sleeping, 1, __ATOMIC_SEQ_CST);
+	stopping = log_stopping;
+	if (! stopping && ! log_get(&slot)) {
+	    clock_gettime(CLOCK_REALTIME, &ts);
+	    ts.tv_sec += 1;
+	    (void) pthread_cond_timedwait(&log_cond, &log_mutex, &ts);
+	} else if (! stopping) {
+	    log_write(&slot);
+	}
+	__atomic_store_n(&log_sleeping, 0, __ATOMIC_RELEASE);
+	(void) pthread_mutex_unlock(&log_mutex);
+    }
+
+    while (log_get(&slot)) {
+	log_write(&slot);
+    }
+    return NULL;
+}
+
+/*
+ * A forked child has no writer thread; it logs synchronously. The
+ * rate limits and counters are the parent's and are reset so that a
+ * child exiting through lmap_log_stop() does not report them again.
+ */
+
+static void
+log_child(void)
+{
+    __atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+    memset(sites, 0, sizeof(sites));
+    cnt_suppressed = 0;
+    cnt_dropped = 0;
+    cnt_dropped_reported = 0;
+}
+
+/**
+ * @brief Log handler writing through the ring buffer
+ *
+ * Log handler (see lmap_set_log_handler()) that applies the rate
+ * limit of the call site, formats the message and queues it for the
+ * writer thread. Without a writer thread (see lmap_log_start()), the
+ * message is written synchronously.
+ *
+ * @param level level of log message
+ * @param func name of the function generating the log message
+ * @param format printf style of format for the log message
+ * @param args arguments according to the format string
+ */
+
+void
+lmap_vlog_ring(int level, const char *func, const char *format, va_list args)
+{
+    char msg[LOG_MSG_LEN];
+
+    if (! site_admit(level, func, format)) {
+	return;
+    }
+    vsnprintf(msg, sizeof(msg), format, args);
+    log_emit(level, func, msg);
+}
+
+/**
+ * @brief Selects how log lines are rendered
+ *
+ * @param format LMAP_LOG_FORMAT_TEXT, LMAP_LOG_FORMAT_KV (key=value
+ *		 pairs) or LMAP_LOG_FORMAT_JSON (one object per line)
+ */
+
+void
+lmap_log_set_format(int format)
+{
+    log_format = format;
+}
+
+/**
+ * @brief Returns the log format with the given name
+ *
+ * @param name "text", "kv" or "json"
+ * @return the log format or -1 for an unknown name
+ */
+
+int
+lmap_log_parse_format(const char *name)
+{
+    if (! strcmp(name, "text")) {
+	return LMAP_LOG_FORMAT_TEXT;
+    } else if (! strcmp(name, "kv")) {
+	return LMAP_LOG_FORMAT_KV;
+    } else if (! strcmp(name, "json")) {
+	return LMAP_LOG_FORMAT_JSON;
+    }
+    return -1;
+}
+
+/**
+ * @brief Sets the rate limit of the call sites
+ *
+ * @param burst messages a call site may log per interval (0 disables
+ *		rate limiting)
+ * @param interval length of the interval in seconds
+ */
+
+void
+lmap_log_set_rate(unsigned int burst, unsigned int interval)
+{
+    log_burst = burst;
+    log_interval = interval ? interval : 1;
+}
+
+/**
+ * @brief Sends log lines to a writer instead of stderr or syslog
+ *
+ * @param func the writer or NULL to restore stderr or syslog
+ * @param ctx the context passed to the writer
+ */
+
+void
+lmap_log_set_output(lmap_write_func *func, void *ctx)
+{
+    log_output = func;
+    log_output_ctx = ctx;
+}
+
+/**
+ * @brief Returns the number of suppressed and dropped messages
+ *
+ * @param suppressed messages suppressed by the rate limit
+ * @param dropped messages dropped because the ring was full
+ */
+
+void
+lmap_log_stats(uint64_t *suppressed, uint64_t *dropped)
+{
+    *suppressed = __atomic_load_n(&cnt_suppressed, __ATOMIC_RELAXED);
+    *dropped = __atomic_load_n(&cnt_dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Installs the ring log handler and starts the writer thread
+ *
+ * @return 0 on success, -1 if the writer thread could not be started
+ *         (messages are then written synchronously)
+ */
+
+int
+lmap_log_start(void)
+{
+    uint64_t i;
+
+    lmap_set_log_handler(lmap_vlog_ring);
+    if (log_running) {
+	return 0;
+    }
+
+    for (i = 0; i < LOG_RING_SIZE; i++) {
+	ring[i].seq = i;
+    }
+    ring_head = ring_tail = 0;
+    log_stopping = 0;
+    if (! log_atfork) {
+	if (pthread_atfork(NULL, NULL, log_child) != 0) {
+	    return -1;
+	}
+	log_atfork = 1;
+    }
+    if (pthread_create(&log_thread, NULL, log_writer, NULL) != 0) {
+	return -1;
+    }
+    __atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Stops the writer thread
+ *
+ * Writes all queued messages and the summaries of suppressed
+ * messages. The ring log handler stays installed and writes further
+ * messages synchronously.
+ */
+
+void
+lmap_log_stop(void)
+{
+    if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+	/* new messages are written synchronously from now on */
+	__atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+	(void) pthread_mutex_lock(&log_mutex);
+	log_stopping = 1;
+	(void) pthread_cond_signal(&log_cond);
+	(void) pthread_mutex_unlock(&log_mutex);
+	(void) pthread_join(log_thread, NULL);
+    }
+    log_sweep(1);
+}
@@ -0,0 +1,438 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Optional metrics endpoint in the Prometheus text exposition format.
+ * When a port is configured (-m), lmapd serves http://127.0.0.1:port/
+ * metrics from its event loop. The metrics are taken from the data
+ * model as it is; in particular, the storage figures are the ones
+ * computed by the last workspace update and a scrape never walks the
+ * file system.
+ *
+ * The document is rendered into a buffer that is kept across scrapes
+ * and handed to libevent by reference, so a scrape does not allocate
+ * once the buffer has grown to its working size.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/http.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "metrics.h"
+
+#define METRICS_ADDRESS		"127.0.0.1"
+#define METRICS_CONTENT_TYPE	"text/plain; version=0.0.4"
+
+struct metrics_buf {
+    char *data;
+    size_t len;
+    size_t size;
+    int failed;			/* out of memory while rendering */
+};
+
+struct metrics {
+    struct evhttp *http;
+    struct metrics_buf buf;
+    int busy;			/* buf is referenced by a pending reply */
+};
+
+static void
+put(struct metrics_buf *mb, const char *s, size_t len)
+{
+    char *data;
+    size_t size;
+
+    if (mb->len + len > mb->size) {
+	size = mb->size ? mb->size : 4096;
+	while (mb->len + len > size) {
+	    size *= 2;
+	}
+	data = realloc(mb->data, size);
+	if (! data) {
+	    mb->failed = 1;
+	    return;
+	}
+	mb->data = data;
+	mb->size = size;
+    }
+    memcpy(mb->data + mb->len, s, len);
+    mb->len += len;
+}
+
+static void
+puts_(struct metrics_buf *mb, const char *s)
+{
+    put(mb, s, strlen(s));
+}
+
+static void
+put_u64(struct metrics_buf *mb, uint64_t v)
+{
+    char buf[LMAP_INT_LEN];
+
+    put(mb, buf, lmap_u64toa(v, buf));
+}
+
+/* label values escape backslash, double quote and newline */
+
+static void
+put_label(struct metrics_buf *mb, const char *s)
+{
+    const char *p;
+
+    for (p = s ? s : ""; *p; s = ++p) {
+	p += strcspn(p, "\\\"\n");
+	put(mb, s, p - s);
+	if (! *p) {
+	    break;
+	}
+	puts_(mb, *p == '\n' ? "\\n" : *p == '"' ? "\\\"" : "\\\\");
+    }
+}
+
+static void
+put_help(struct metrics_buf *mb, const char *name,
+	 const char *type, const char *help)
+{
+    puts_(mb, "# HELP ");
+    puts_(mb, name);
+    puts_(mb, " ");
+    puts_(mb, help);
+    puts_(mb, "\n# TYPE ");
+    puts_(mb, name);
+    puts_(mb, " ");
+    puts_(mb, type);
+    puts_(mb, "\n");
+}
+
+static void
+put_sample(struct metrics_buf *mb, const char *name,
+	   const char *schedule, const char *action, uint64_t value)
+{
+    puts_(mb, name);
+    if (schedule) {
+	puts_(mb, "{schedule=\"");
+	put_label(mb, schedule);
+	if (action) {
+	    puts_(mb, "\",action=\"");
+	    put_label(mb, action);
+	}
+	puts_(mb, "\"}");
+    }
+    puts_(mb, " ");
+    put_u64(mb, value);
+    puts_(mb, "\n");
+}
+
+/*
+ * The per-schedule and per-action metrics. The offsets select the
+ * field of struct schedule or struct action; both use the same
+ * types for the counters.
+ */
+
+enum { U32, U64 };
+
+static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    size_t schedule;
+    size_t action;
+    int size;
+} object_metrics[] = {
+    { "invocations_total", "counter", "Number of invocations.",
+      offsetof(struct schedule, cnt_invocations),
+      offsetof(struct action, cnt_invocations), U32 },
+    { "suppressions_total", "counter", "Number of suppressed invocations.",
+      offsetof(struct schedule, cnt_suppressions),
+      offsetof(struct action, cnt_suppressions), U32 },
+    { "overlaps_total", "counter", "Number of overlapping invocations.",
+      offsetof(struct schedule, cnt_overlaps),
+      offsetof(struct action, cnt_overlaps), U32 },
+    { "failures_total", "counter", "Number of failed invocations.",
+      offsetof(struct schedule, cnt_failures),
+      offsetof(struct action, cnt_failures), U32 },
+    { "storage_bytes", "gauge", "Storage used by the workspace.",
+      offsetof(struct schedule, storage),
+      offsetof(struct action, storage), U64 },
+    { NULL, NULL, NULL, 0, 0, 0 }
+};
+
+static uint64_t
+field(const void *obj, size_t offset, int size)
+{
+    const char *p = (const char *) obj + offset;
+
+    return size == U64 ? *(const uint64_t *) p : *(const uint32_t *) p;
+}
+
+static void
+render(struct lmapd *lmapd, struct metrics_buf *mb)
+{
+    struct lmap *lmap = lmapd->lmap;
+    struct schedule *schedule;
+    struct action *action;
+    uint64_t running = 0, queued = 0, nschedules = 0, nactions = 0;
+    uint64_t suppressed, dropped;
+    char name[64];
+    int i;
+
+    mb->len = 0;
+    mb->failed = 0;
+
+    for (schedule = lmap ? lmap->schedules : NULL;
+	 schedule; schedule = schedule->next) {
+	nschedules++;
+	queued += schedule->storage;
+	for (action = schedule->actions; action; action = action->next) {
+	    nactions++;
+	    running += (action->pid != 0);
+	}
+    }
+
+    put_help(mb, "lmapd_up", "gauge", "Whether a configuration is loaded.");
+    put_sample(mb, "lmapd_up", NULL, NULL, lmap != NULL);
+    if (lmap && lmap->agent && lmap->agent->last_started) {
+	put_help(mb, "lmapd_start_time_seconds", "gauge",
+		 "Time the agent was started since the epoch.");
+	put_sample(mb, "lmapd_start_time_seconds", NULL, NULL,
+		   lmap->agent->last_started);
+    }
+    put_help(mb, "lmapd_schedules", "gauge", "Number of schedules.");
+    put_sample(mb, "lmapd_schedules", NULL, NULL, nschedules);
+    put_help(mb, "lmapd_actions", "gauge", "Number of actions.");
+    put_sample(mb, "lmapd_actions", NULL, NULL, nactions);
+    put_help(mb, "lmapd_running_children", "gauge",
+	     "Number of running action processes.");
+    put_sample(mb, "lmapd_running_children", NULL, NULL, running);
+    put_help(mb, "lmapd_queue_bytes", "gauge",
+	     "Data queued in the schedule workspaces.");
+    put_sample(mb, "lmapd_queue_bytes", NULL, NULL, queued);
+    put_help(mb, "lmapd_loop_blocked_total", "counter",
+	     "Number of callbacks that blocked the event loop.");
+    put_sample(mb, "lmapd_loop_blocked_total", NULL, NULL, lmapd->cnt_blocked);
+    put_help(mb, "lmapd_loop_blocked_max_microseconds", "gauge",
+	     "Longest time a callback blocked the event loop.");
+    put_sample(mb, "lmapd_loop_blocked_max_microseconds", NULL, NULL,
+	       lmapd->max_blocked);
+    lmap_log_stats(&suppressed, &dropped);
+    put_help(mb, "lmapd_log_suppressed_total", "counter",
+	     "Number of log messages suppressed by the rate limit.");
+    put_sample(mb, "lmapd_log_suppressed_total", NULL, NULL, suppressed);
+    put_help(mb, "lmapd_log_dropped_total", "counter",
+	     "Number of log messages dropped because the log ring was full.");
+    put_sample(mb, "lmapd_log_dropped_total", NULL, NULL, dropped);
+
+    for (i = 0; object_metrics[i].name; i++) {
+	snprintf(name, sizeof(name), "lmapd_schedule_%s",
+		 object_metrics[i].name);
+	put_help(mb, name, object_metrics[i].type, object_metrics[i].help);
+	for (schedule = lmap ? lmap->schedules : NULL;
+	     schedule; schedule = schedule->next) {
+	    put_sample(mb, name, schedule->name, NULL,
+		       field(schedule, object_metrics[i].schedule,
+			     object_metrics[i].size));
+	}
+    }
+
+    for (i = 0; object_metrics[i].name; i++) {
+	snprintf(name, sizeof(name), "lmapd_action_%s",
+		 object_metrics[i].name);
+	put_help(mb, name, object_metrics[i].type, object_metrics[i].help);
+	for (schedule = lmap ? lmap->schedules : NULL;
+	     schedule; schedule = schedule->next) {
+	    for (action = schedule->actions; action; action = action->next) {
+		put_sample(mb, name, schedule->name, action->name,
+			   field(action, object_metrics[i].action,
+				 object_metrics[i].size));
+	    }
+	}
+    }
+}
+
+static struct metrics *
+metrics_get(struct lmapd *lmapd)
+{
+    if (! lmapd->metrics) {
+	lmapd->metrics = calloc(1, sizeof(struct metrics));
+	if (! lmapd->metrics) {
+	    lmap_err("failed to allocate memory");
+	}
+    }
+    return lmapd->metrics;
+}
+
+/**
+ * @brief Renders the metrics
+ *
+ * Renders the metrics of lmapd in the Prometheus text format into
+ * the reusable metrics buffer.
+ *
+ * @param lmapd pointer to the lmapd struct
+ * @param len pointer receiving the length of the document
+ * @return pointer to the document (valid until the next call) or
+ *         NULL on error
+ */
+
+const char *
+lmapd_metrics_render(struct lmapd *lmapd, size_t *len)
+{
+    struct metrics *metrics = metrics_get(lmapd);
+
+    if (! metrics) {
+	return NULL;
+    }
+    render(lmapd, &metrics->buf);
+    if (metrics->buf.failed) {
+	lmap_err("failed to allocate memory");
+	return NULL;
+    }
+    *len = metrics->buf.len;
+    return metrics->buf.data;
+}
+
+static void
+released_cb(const void *data, size_t len, void *ctx)
+{
+    (void) data;
+    (void) len;
+    ((struct metrics *) ctx)->busy = 0;
+}
+
+static void
+metrics_cb(struct evhttp_request *req, void *ctx)
+{
+    struct lmapd *lmapd = ctx;
+    struct metrics *metrics = lmapd->metrics;
+    struct metrics_buf tmp = { NULL, 0, 0, 0 };
+    struct evbuffer *reply;
+
+    /*
+     * Render into the reusable buffer unless it still belongs to a
+     * reply that has not been sent yet (slow or concurrent scrapes).
+     */
+
+    reply = evhttp_request_get_output_buffer(req);
+    evhttp_add_header(evhttp_request_get_output_headers(req),
+		      "Content-Type", METRICS_CONTENT_TYPE);
+    if (! metrics->busy) {
+	render(lmapd, &metrics->buf);
+	if (! metrics->buf.failed
+	    && evbuffer_add_reference(reply, metrics->buf.data,
+				      metrics->buf.len,
+				      released_cb, metrics) == 0) {
+	    metrics->busy = 1;
+	    evhttp_send_reply(req, 200, "OK", NULL);
+	    return;
+	}
+    } else {
+	render(lmapd, &tmp);
+	if (! tmp.failed && evbuffer_add(reply, tmp.data, tmp.len) == 0) {
+	    free(tmp.data);
+	    evhttp_send_reply(req, 200, "OK", NULL);
+	    return;
+	}
+	free(tmp.data);
+    }
+    evhttp_send_error(req, 500, NULL);
+}
+
+static void
+other_cb(struct evhttp_request *req, void *ctx)
+{
+    (void) ctx;
+    evhttp_send_error(req, 404, NULL);
+}
+
+/**
+ * @brief Opens the metrics endpoint
+ *
+ * Starts serving the metrics on 127.0.0.1 if a metrics port has been
+ * configured. Must be called after the event base has been created.
+ *
+ * @param lmapd pointer to the lmapd struct
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_metrics_open(struct lmapd *lmapd)
+{
+    struct metrics *metrics;
+
+    if (! lmapd->metrics_port || ! lmapd->base) {
+	return 0;
+    }
+
+    metrics = metrics_get(lmapd);
+    if (! metrics) {
+	return -1;
+    }
+    metrics->http = evhttp_new(lmapd->base);
+    if (! metrics->http) {
+	lmap_err("failed to create metrics endpoint");
+	return -1;
+    }
+    evhttp_set_allowed_methods(metrics->http, EVHTTP_REQ_GET);
+    if (evhttp_bind_socket(metrics->http, METRICS_ADDRESS,
+			   lmapd->metrics_port) != 0) {
+	lmap_err("failed to bind metrics endpoint to %s:%u",
+		 METRICS_ADDRESS, lmapd->metrics_port);
+	evhttp_free(metrics->http);
+	metrics->http = NULL;
+	return -1;
+    }
+    evhttp_set_cb(metrics->http, "/metrics", metrics_cb, lmapd);
+    evhttp_set_gencb(metrics->http, other_cb, lmapd);
+    return 0;
+}
+
+/**
+ * @brief Closes the metrics endpoint
+ *
+ * Stops serving the metrics and releases the metrics buffer. This
+ * must be called before the event base is freed.
+ *
+ * @param lmapd pointer to the lmapd struct
+ */
+
+void
+lmapd_metrics_close(struct lmapd *lmapd)
+{
+    struct metrics *metrics = lmapd->metrics;
+
+    if (! metrics) {
+	return;
+    }
+    if (metrics->http) {
+	evhttp_free(metrics->http);
+    }
+    free(metrics->buf.data);
+    free(metrics);
+    lmapd->metrics = NULL;
+}
@@ -0,0 +1,398 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The leafs of the objects of the data model (see model.h). The
+ * setters take typed objects; the LEAF() cast allows a single table
+ * type for all objects.
+ */
+
+#include <string.h>
+
+#include "lmap.h"
+#include "model.h"
+
+#define LEAF(f)		((lmap_leaf_func *) (f))
+
+const struct lmap_leaf lmap_agent_leafs[] = {
+    { .name = "agent-id",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_agent_id) },
+    { .name = "group-id",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_group_id) },
+    { .name = "measurement-point",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_measurement_point) },
+    { .name = "report-agent-id",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_report_agent_id) },
+    { .name = "report-group-id",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_report_group_id) },
+    { .name = "report-measurement-point",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_report_measurement_point) },
+    { .name = "controller-timeout",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_agent_set_controller_timeout) },
+    { .name = "last-started",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_agent_set_last_started) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_supp_leafs[] = {
+    { .name = "name",
+      .flags = YANG_CONFIG_TRUE | YANG_KEY,
+      .func = LEAF(lmap_supp_set_name) },
+    { .name = "start",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_supp_set_start) },
+    { .name = "end",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_supp_set_end) },
+    { .name = "match",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_supp_add_match) },
+    { .name = "stop-running",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_supp_set_stop_running) },
+    { .name = "state",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_supp_set_state) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_option_leafs[] = {
+    { .name = "id",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_option_set_id) },
+    { .name = "name",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_option_set_name) },
+    { .name = "value",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_option_set_value) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_registry_leafs[] = {
+    { .name = "uri",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_registry_set_uri) },
+    { .name = "role",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_registry_add_role) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_task_leafs[] = {
+    { .name = "name",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_task_set_name) },
+    { .name = "program",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_task_set_program) },
+    { .name = "tag",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_task_add_tag) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_capability_task_leafs[] = {
+    { .name = "name",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_task_set_name) },
+    { .name = "version",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_task_set_version) },
+    { .name = "program",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_task_set_program) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_capability_leafs[] = {
+    { .name = "version",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_capability_set_version) },
+    { .name = "tag",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_capability_add_tag) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_periodic_leafs[] = {
+    { .name = "interval",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_interval) },
+    { .name = "start",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_start) },
+    { .name = "end",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_end) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_calendar_leafs[] = {
+    { .name = "month",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_add_month) },
+    { .name = "day-of-month",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_add_day_of_month) },
+    { .name = "day-of-week",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_add_day_of_week) },
+    { .name = "hour",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_add_hour) },
+    { .name = "minute",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_add_minute) },
+    { .name = "second",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_add_second) },
+    { .name = "timezone-offset",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_timezone_offset) },
+    { .name = "start",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_start) },
+    { .name = "end",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_end) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_one_off_leafs[] = {
+    { .name = "time",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_start) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_event_leafs[] = {
+    { .name = "name",
+      .flags = YANG_CONFIG_TRUE | YANG_KEY,
+      .func = LEAF(lmap_event_set_name) },
+    { .name = "random-spread",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_random_spread) },
+    { .name = "cycle-interval",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_cycle_interval) },
+    { .name = "periodic",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = "calendar",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = "one-off",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = "immediate",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = "startup",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = "controller-lost",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = "controller-connected",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_event_set_type) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_action_leafs[] = {
+    { .name = "name",
+      .flags = YANG_CONFIG_TRUE | YANG_KEY,
+      .func = LEAF(lmap_action_set_name) },
+    { .name = "task",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_action_set_task) },
+    { .name = "destination",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_action_add_destination) },
+    { .name = "tag",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_action_add_tag) },
+    { .name = "suppression-tag",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_action_add_suppression_tag) },
+    { .name = "state",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_state) },
+    { .name = "storage",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_storage) },
+    { .name = "invocations",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_invocations) },
+    { .name = "suppressions",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_suppressions) },
+    { .name = "overlaps",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_overlaps) },
+    { .name = "failures",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_failures) },
+    { .name = "last-invocation",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_invocation) },
+    { .name = "last-completion",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_completion) },
+    { .name = "last-status",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_status) },
+    { .name = "last-message",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_message) },
+    { .name = "last-failed-completion",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_failed_completion) },
+    { .name = "last-failed-status",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_failed_status) },
+    { .name = "last-failed-message",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_action_set_last_failed_message) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_schedule_leafs[] = {
+    { .name = "name",
+      .flags = YANG_CONFIG_TRUE | YANG_KEY,
+      .func = LEAF(lmap_schedule_set_name) },
+    { .name = "start",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_schedule_set_start) },
+    { .name = "end",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_schedule_set_end) },
+    { .name = "duration",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_schedule_set_duration) },
+    { .name = "execution-mode",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_schedule_set_exec_mode) },
+    { .name = "tag",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_schedule_add_tag) },
+    { .name = "suppression-tag",
+      .flags = YANG_CONFIG_TRUE,
+      .func = LEAF(lmap_schedule_add_suppression_tag) },
+    { .name = "state",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_state) },
+    { .name = "storage",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_storage) },
+    { .name = "invocations",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_invocations) },
+    { .name = "suppressions",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_suppressions) },
+    { .name = "overlaps",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_overlaps) },
+    { .name = "failures",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_failures) },
+    { .name = "last-invocation",
+      .flags = YANG_CONFIG_FALSE,
+      .func = LEAF(lmap_schedule_set_last_invocation) },
+    { .name = NULL }
+};
+
+/*
+ * The leafs of a report (the agent) and of its results. They are
+ * always parsed. Reported agent leafs are marked as reported.
+ */
+
+const struct lmap_leaf lmap_report_leafs[] = {
+    { .name = "date",
+      .func = LEAF(lmap_agent_set_report_date) },
+    { .name = "agent-id",
+      .func = LEAF(lmap_agent_set_agent_id),
+      .report = LEAF(lmap_agent_set_report_agent_id) },
+    { .name = "group-id",
+      .func = LEAF(lmap_agent_set_group_id),
+      .report = LEAF(lmap_agent_set_report_group_id) },
+    { .name = "measurement-point",
+      .func = LEAF(lmap_agent_set_measurement_point),
+      .report = LEAF(lmap_agent_set_report_measurement_point) },
+    { .name = NULL }
+};
+
+const struct lmap_leaf lmap_result_leafs[] = {
+    { .name = "schedule",
+      .func = LEAF(lmap_result_set_schedule) },
+    { .name = "action",
+      .func = LEAF(lmap_result_set_action) },
+    { .name = "task",
+      .func = LEAF(lmap_result_set_task) },
+    { .name = "tag",
+      .func = LEAF(lmap_result_add_tag) },
+    { .name = "event",
+      .func = LEAF(lmap_result_set_event) },
+    { .name = "start",
+      .func = LEAF(lmap_result_set_start) },
+    { .name = "end",
+      .func = LEAF(lmap_result_set_end) },
+    { .name = "cycle-number",
+      .func = LEAF(lmap_result_set_cycle_number) },
+    { .name = "status",
+      .func = LEAF(lmap_result_set_status) },
+    { .name = NULL }
+};
+
+/**
+ * @brief Finds a leaf in a table of leafs
+ *
+ * Keys are always found, config true and config false leafs only if
+ * they are selected by what (PARSE_CONFIG_TRUE, PARSE_CONFIG_FALSE).
+ *
+ * @param tab The table of leafs
+ * @param name The name of the leaf
+ * @param what The leafs to parse
+ * @return pointer to the leaf or NULL if there is no such leaf
+ */
+
+const struct lmap_leaf *
+lmap_leaf_find(const struct lmap_leaf *tab, const char *name, int what)
+{
+    int flags;
+
+    for (; tab->name; tab++) {
+	flags = tab->flags;
+	if ((! flags || flags & YANG_KEY
+	     || (what & PARSE_CONFIG_TRUE && flags & YANG_CONFIG_TRUE)
+	     || (what & PARSE_CONFIG_FALSE && flags & YANG_CONFIG_FALSE))
+	    && ! strcmp(name, tab->name)) {
+	    return tab;
+	}
+    }
+    return NULL;
+}
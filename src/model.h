@@ -0,0 +1,63 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAP_MODEL_H
+#define LMAP_MODEL_H
+
+/*
+ * The leafs of the objects of the data model, mapping the names used
+ * by the YANG data model to the functions setting them. The tables
+ * are shared by the XML and the JSON parser; containers and lists
+ * nested in an object are handled by the parsers.
+ */
+
+#define PARSE_CONFIG_TRUE	0x01
+#define PARSE_CONFIG_FALSE	0x02
+
+#define YANG_CONFIG_TRUE	0x01
+#define YANG_CONFIG_FALSE	0x02
+#define YANG_KEY		0x04
+
+typedef int (lmap_leaf_func) (void *obj, const char *value);
+
+struct lmap_leaf {
+    const char *name;
+    int flags;				/* YANG_* flags (0 = always parsed) */
+    lmap_leaf_func *func;		/* sets the leaf of the object */
+    lmap_leaf_func *report;		/* marks the leaf as reported */
+};
+
+extern const struct lmap_leaf lmap_agent_leafs[];
+extern const struct lmap_leaf lmap_supp_leafs[];
+extern const struct lmap_leaf lmap_option_leafs[];
+extern const struct lmap_leaf lmap_registry_leafs[];
+extern const struct lmap_leaf lmap_task_leafs[];
+extern const struct lmap_leaf lmap_capability_task_leafs[];
+extern const struct lmap_leaf lmap_capability_leafs[];
+extern const struct lmap_leaf lmap_periodic_leafs[];
+extern const struct lmap_leaf lmap_calendar_leafs[];
+extern const struct lmap_leaf lmap_one_off_leafs[];
+extern const struct lmap_leaf lmap_event_leafs[];
+extern const struct lmap_leaf lmap_action_leafs[];
+extern const struct lmap_leaf lmap_schedule_leafs[];
+extern const struct lmap_leaf lmap_report_leafs[];
+extern const struct lmap_leaf lmap_result_leafs[];
+
+extern const struct lmap_leaf * lmap_leaf_find(const struct lmap_leaf *tab,
+					       const char *name, int what);
+
+#endif
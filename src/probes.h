@@ -0,0 +1,59 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAPD_PROBES_H
+#define LMAPD_PROBES_H
+
+/*
+ * Static tracepoints (USDT) of the provider lmapd. The probes are
+ * compiled in if lmapd is configured with -DENABLE_USDT=ON and
+ * <sys/sdt.h> (systemtap-sdt-dev) is available; otherwise they expand
+ * to nothing. An enabled probe is a single nop until a tracer such as
+ * bpftrace or perf attaches to it. The probes are listed in
+ * tools/lmapd.bt; string arguments are pointers to C strings.
+ */
+
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define LMAPD_PROBE1(name, a) \
+	DTRACE_PROBE1(lmapd, name, a)
+#define LMAPD_PROBE2(name, a, b) \
+	DTRACE_PROBE2(lmapd, name, a, b)
+#define LMAPD_PROBE3(name, a, b, c) \
+	DTRACE_PROBE3(lmapd, name, a, b, c)
+#define LMAPD_PROBE4(name, a, b, c, d) \
+	DTRACE_PROBE4(lmapd, name, a, b, c, d)
+
+#else
+
+/* sizeof() keeps the arguments "used" without evaluating them */
+
+#define LMAPD_PROBE1(name, a) \
+	do { (void) sizeof(a); } while (0)
+#define LMAPD_PROBE2(name, a, b) \
+	do { (void) sizeof(a); (void) sizeof(b); } while (0)
+#define LMAPD_PROBE3(name, a, b, c) \
+	do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); } while (0)
+#define LMAPD_PROBE4(name, a, b, c, d) \
+	do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); \
+	     (void) sizeof(d); } while (0)
+
+#endif
+
+#endif
@@ -37,6 +37,53 @@
 #include "workspace.h"
 #include "runner.h"
 #include "signals.h"
+#include "config.h"
+#include "journal.h"
+#include "control.h"
+#include "metrics.h"
+#include "latency.h"
+#include "probes.h"
+#include "sim.h"
+
+/*
+ * The clock and the timers of the runner. In simulation mode (see
+ * sim.c) they run on the virtual clock instead of the event loop.
+ */
+
+static void
+clock_now(struct lmapd *lmapd, struct timeval *tv)
+{
+    if (lmapd->sim) {
+	lmapd_sim_gettimeofday(lmapd->sim, tv);
+    } else {
+	event_base_gettimeofday_cached(lmapd->base, tv);
+    }
+}
+
+static uint64_t
+clock_mono(struct lmapd *lmapd)
+{
+    return lmapd->sim ? lmapd_sim_now(lmapd->sim) : lmap_latency_now();
+}
+
+static int
+timer_add(struct lmapd *lmapd, struct event *ev, const struct timeval *tv)
+{
+    if (lmapd->sim) {
+	return lmapd_sim_timer_add(lmapd->sim, ev, tv);
+    }
+    return event_add(ev, tv);
+}
+
+static void
+timer_free(struct lmapd *lmapd, struct event **ev)
+{
+    if (lmapd->sim) {
+	lmapd_sim_timer_del(lmapd->sim, *ev);
+    }
+    event_free(*ev);
+    *ev = NULL;
+}
 
 #if 1
 static void
@@ -46,7 +93,7 @@ event_gaga(struct event *event, struct event **ev,
     assert(event && event->lmapd && ev && *ev == NULL);
 
     *ev = event_new(event->lmapd->base, -1, what, func, event);
-    if (!*ev || event_add(*ev, tv) < 0)  {
+    if (!*ev || timer_add(event->lmapd, *ev, tv) < 0)  {
 	lmap_err("failed to create/add event for '%s'", event->name);
     }
 }
@@ -93,6 +140,75 @@ add_random_spread(struct event *event, struct timeval *tv)
     }
 }
 
+/*
+ * The timer lag of events: when a fire event is armed, the monotonic
+ * time it is due is remembered, when it fires the difference to the
+ * actual time goes into the lag histogram of the event. Periodic
+ * events compute the due time from the schedule of the trigger, so
+ * that a trigger that ran late shows up as lag as well.
+ */
+
+static uint64_t
+due_time(uint64_t base, const struct timeval *tv)
+{
+    return base + (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static uint64_t
+event_lag(struct event *event, uint64_t fired)
+{
+    uint64_t lag;
+
+    if (! event->fire_due) {
+	return 0;
+    }
+    lag = fired > event->fire_due ? fired - event->fire_due : 0;
+    event->fire_due = 0;
+
+    if (! event->lag) {
+	event->lag = calloc(1, sizeof(struct lmap_histogram));
+	if (! event->lag) {
+	    lmap_err("failed to allocate memory");
+	    return lag;
+	}
+    }
+    lmap_histogram_record(event->lag, lag);
+    if (lag >= LMAPD_WATCHDOG_THRESHOLD) {
+	lmap_wrn("event '%s' fired %" PRIu64 " ms late",
+		 event->name, lag / 1000);
+    }
+    return lag;
+}
+
+/**
+ * @brief Checks whether a callback blocked the event loop
+ *
+ * Callbacks doing synchronous work call this function when they are
+ * done. A callback that ran for LMAPD_WATCHDOG_THRESHOLD or longer
+ * delays all timers; it is logged and counted.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @param what description of the callback
+ * @param start monotonic time the callback started
+ */
+
+void
+lmapd_watchdog(struct lmapd *lmapd, const char *what, uint64_t start)
+{
+    uint64_t now = lmap_latency_now();
+    uint64_t blocked = now > start ? now - start : 0;
+
+    if (blocked < LMAPD_WATCHDOG_THRESHOLD) {
+	return;
+    }
+    lmapd->cnt_blocked++;
+    if (blocked > lmapd->max_blocked) {
+	lmapd->max_blocked = blocked;
+    }
+    lmap_wrn("%s blocked the event loop for %" PRIu64 " ms",
+	     what, blocked / 1000);
+}
+
 static struct action *
 find_action_by_pid(struct lmap *lmap, pid_t pid)
 {
@@ -148,9 +264,11 @@ big_tag_match(struct tag *match, struct tag *tags)
 }
 
 static int
-action_exec(struct lmapd *lmapd, struct schedule *schedule, struct action *action)
+action_exec(struct lmapd *lmapd, struct schedule *schedule,
+	    struct action *action, uint64_t ready)
 {
     pid_t pid;
+    uint64_t launched, forked;
     char *argv[256];
     struct timeval t;
     struct task *task;
@@ -213,7 +331,7 @@ action_exec(struct lmapd *lmapd, struct schedule *schedule, struct action *actio
 	return -1;
     }
 
-    event_base_gettimeofday_cached(lmapd->base, &t);
+    clock_now(lmapd, &t);
 
     /*
      * Create the argument vector. Note that the max. number of
@@ -249,13 +367,20 @@ action_exec(struct lmapd *lmapd, struct schedule *schedule, struct action *actio
     }
     argv[++i] = NULL;
 
-    pid = fork();
+    launched = clock_mono(lmapd);
+    pid = lmapd->sim ? lmapd_sim_spawn(lmapd->sim, task->name) : fork();
     if (pid < 0) {
 	lmap_err("failed to fork");
 	return -1;
     }
 
     if (pid) {
+	forked = clock_mono(lmapd);
+	LMAPD_PROBE3(action_spawn, schedule->name, action->name, pid);
+	if (lmap_latency_record(action, LMAP_LATENCY_QUEUE, ready, launched) == 0
+	    && lmap_latency_record(action, LMAP_LATENCY_LAUNCH, launched, forked) == 0) {
+	    action->latency->forked = forked;
+	}
 	action->pid = pid;
 	action->last_invocation = t.tv_sec;
 	action->state = LMAP_ACTION_STATE_RUNNING;
@@ -263,6 +388,11 @@ action_exec(struct lmapd *lmapd, struct schedule *schedule, struct action *actio
 	return 1;
     }
 
+    /*
+     * This is the child. It leaves with _exit() if the task cannot be
+     * started so that the atexit() handlers of the daemon do not run.
+     */
+
     /*
      * Pass some information to the task via the environment; this is
      * necessary so that a reporter can create a proper report.
@@ -288,7 +418,7 @@ action_exec(struct lmapd *lmapd, struct schedule *schedule, struct action *actio
 
     action->last_invocation = t.tv_sec;
     if (lmapd_workspace_action_meta_add_start(schedule, action, task)) {
-	exit(EXIT_FAILURE);
+	_exit(EXIT_FAILURE);
     }
     
     /*
@@ -298,24 +428,24 @@ action_exec(struct lmapd *lmapd, struct schedule *schedule, struct action *actio
     fd = lmapd_workspace_action_open_data(schedule, action,
 					  O_WRONLY | O_CREAT | O_TRUNC);
     if (fd == -1) {
-	exit(EXIT_FAILURE);
+	_exit(EXIT_FAILURE);
     }
     if (dup2(fd, STDOUT_FILENO) == -1) {
 	lmap_err("failed to redirect stdout");
-	exit(EXIT_FAILURE);
+	_exit(EXIT_FAILURE);
     }
     (void) close(fd);
     if (chdir(action->workspace) == -1) {
 	lmap_err("failed to change directory");
-	exit(EXIT_FAILURE);
+	_exit(EXIT_FAILURE);
     }
     execvp(task->program, argv);
     lmap_err("failed to execute action '%s'", action->name);
-    exit(EXIT_FAILURE);
+    _exit(EXIT_FAILURE);
 }
 
 static void
-schedule_exec(struct lmapd *lmapd, struct schedule *schedule)
+schedule_exec(struct lmapd *lmapd, struct schedule *schedule, uint64_t ready)
 {
     struct timeval t;
     struct action *act;
@@ -328,8 +458,9 @@ schedule_exec(struct lmapd *lmapd, struct schedule *schedule)
     }
 
     // lmap_dbg("executing schedule '%s'", schedule->name);
+    LMAPD_PROBE1(schedule_start, schedule->name);
     
-    event_base_gettimeofday_cached(lmapd->base, &t);
+    clock_now(lmapd, &t);
     
     switch (schedule->mode) {
     case LMAP_SCHEDULE_EXEC_MODE_SEQUENTIAL:
@@ -337,7 +468,7 @@ schedule_exec(struct lmapd *lmapd, struct schedule *schedule)
 	schedule->cnt_invocations++;
 	if (schedule->actions) {
 	    act = schedule->actions;
-	    rc = action_exec(lmapd, schedule, act);
+	    rc = action_exec(lmapd, schedule, act, ready);
 	    if (rc == 1) {
 		schedule->state = LMAP_SCHEDULE_STATE_RUNNING;
 	    }
@@ -348,7 +479,7 @@ schedule_exec(struct lmapd *lmapd, struct schedule *schedule)
 	schedule->cnt_invocations++;
 	if (schedule->actions) {
 	    for (act = schedule->actions; act; act = act->next) {
-		rc = action_exec(lmapd, schedule, act);
+		rc = action_exec(lmapd, schedule, act, ready);
 		if (rc == 1) {
 		    schedule->state = LMAP_SCHEDULE_STATE_RUNNING;
 		}
@@ -373,7 +504,9 @@ action_kill(struct lmapd *lmapd, struct action *action)
     }
 
     if (action->state == LMAP_ACTION_STATE_RUNNING) {
-	if (action->pid) {
+	if (action->pid && lmapd->sim) {
+	    lmapd_sim_kill(lmapd->sim, action->pid, SIGTERM);
+	} else if (action->pid) {
 	    (void) kill(action->pid, SIGTERM);
 	}
     }
@@ -395,23 +528,17 @@ schedule_kill(struct lmapd *lmapd, struct schedule *schedule)
     }
 }
 
-static int
-suppression_start(struct lmapd *lmapd, struct supp *supp)
+/*
+ * Applies an active suppression to the schedules and actions of an
+ * lmap, see suppression_start().
+ */
+
+static void
+suppression_apply(struct lmapd *lmapd, struct lmap *lmap, struct supp *supp)
 {
-    struct lmap *lmap;
     struct schedule *schedule;
     struct action *action;
 
-    assert(lmapd);
-
-    lmap = lmapd->lmap;
-    if (!lmap || !supp || !supp->match || !supp->name) {
-	return 0;
-    }
-
-    // lmap_dbg("starting suppression %s", supp->name);
-    supp->state = LMAP_SUPP_STATE_ACTIVE;
-
     for (schedule = lmap->schedules; schedule; schedule = schedule->next)
     {
 	if (schedule->state == LMAP_SCHEDULE_STATE_DISABLED) {
@@ -453,6 +580,24 @@ suppression_start(struct lmapd *lmapd, struct supp *supp)
 	    }
 	}
     }
+}
+
+static int
+suppression_start(struct lmapd *lmapd, struct supp *supp)
+{
+    struct lmap *lmap;
+
+    assert(lmapd);
+
+    lmap = lmapd->lmap;
+    if (!lmap || !supp || !supp->match || !supp->name) {
+	return 0;
+    }
+
+    // lmap_dbg("starting suppression %s", supp->name);
+    LMAPD_PROBE1(suppression_start, supp->name);
+    supp->state = LMAP_SUPP_STATE_ACTIVE;
+    suppression_apply(lmapd, lmap, supp);
 
     return 0;
 }
@@ -472,6 +617,7 @@ suppression_end(struct lmapd *lmapd, struct supp *supp)
     }
 
     // lmap_dbg("ending suppression %s", supp->name);
+    LMAPD_PROBE1(suppression_end, supp->name);
     supp->state = LMAP_SUPP_STATE_ENABLED;
 
     for (schedule = lmap->schedules; schedule; schedule = schedule->next)
@@ -513,133 +659,280 @@ suppression_end(struct lmapd *lmapd, struct supp *supp)
     return 0;
 }
 
+/*
+ * Actions that are removed or changed by a reload may still have
+ * running children. The old lmap is kept in lmapd->retired until
+ * all of them have been reaped so that their pids stay known and
+ * their workspaces can be cleaned.
+ */
+
+static int
+lmap_running(struct lmap *lmap)
+{
+    struct schedule *sched;
+    struct action *act;
+
+    for (sched = lmap->schedules; sched; sched = sched->next) {
+	for (act = sched->actions; act; act = act->next) {
+	    if (act->pid) {
+		return 1;
+	    }
+	}
+    }
+    return 0;
+}
+
+static void
+lmap_retire(struct lmapd *lmapd, struct lmap *lmap)
+{
+    struct lmap **retired;
+
+    if (! lmap_running(lmap)) {
+	lmap_free(lmap);
+	return;
+    }
+
+    retired = realloc(lmapd->retired,
+		      (lmapd->retired_len + 1) * sizeof(*retired));
+    if (! retired) {
+	lmap_err("failed to allocate memory");
+	lmap_free(lmap);
+	return;
+    }
+    retired[lmapd->retired_len++] = lmap;
+    lmapd->retired = retired;
+}
+
+static int
+workspace_busy(struct lmap *lmap, const char *workspace)
+{
+    struct schedule *sched;
+    struct action *act;
+
+    for (sched = lmap->schedules; sched; sched = sched->next) {
+	for (act = sched->actions; act; act = act->next) {
+	    if (act->state == LMAP_ACTION_STATE_RUNNING
+		&& act->workspace && !strcmp(act->workspace, workspace)) {
+		return 1;
+	    }
+	}
+    }
+    return 0;
+}
+
 /**
- * @brief Callback called from the event loop
+ * @brief Completes an action that was removed by a reload
  *
- * Function which is executed by the event loop periodically. It calls
- * waitpid() to see if any children changed their status. Does all the
- * moving of files from action to destination. Start any subsequent
- * actions in sequential schedules.
+ * The child was stopped by the reload, so there are no results to
+ * move. The workspace is cleaned unless it is shared with a running
+ * action of the current configuration. A retired lmap is released
+ * once its last child has been reaped.
  *
  * @param lmapd pointer to a struct lmapd
+ * @param pid the pid of the child
+ * @param status the exit status, or the negated signal number
+ * @return 1 if the child belonged to a retired lmap, 0 otherwise
  */
 
-void
-lmapd_cleanup(struct lmapd *lmapd)
+static int
+orphan_reap(struct lmapd *lmapd, pid_t pid, int status)
 {
-    pid_t pid;
-    int status, failed;
+    size_t i;
     struct lmap *lmap;
-    struct timeval t;
     struct action *action;
-    struct schedule *schedule;
-    struct tag *tag;
 
-    assert(lmapd);
-    lmap = lmapd->lmap;
-    if (! lmap) {
-	return;
+    for (i = 0; i < lmapd->retired_len; i++) {
+	lmap = lmapd->retired[i];
+	action = find_action_by_pid(lmap, pid);
+	if (action) {
+	    break;
+	}
+    }
+    if (i == lmapd->retired_len) {
+	return 0;
     }
-    
-    event_base_gettimeofday_cached(lmapd->base, &t);
 
-    while (1) {
-	pid = waitpid(0, &status, WNOHANG);
-	if (pid == 0 || pid == -1) {
-	    return;
-	}
+    lmap_dbg("reaped removed action '%s' (pid %d, status %d)",
+	     action->name, pid, status);
+    action->pid = 0;
+    action->state = LMAP_ACTION_STATE_ENABLED;
+    if (! lmapd->sim && action->workspace
+	&& ! (lmapd->lmap && workspace_busy(lmapd->lmap, action->workspace))) {
+	(void) lmapd_workspace_action_clean(lmapd, action);
+    }
 
-	if (!WIFEXITED(status) && !WIFSIGNALED(status)) {
-	    continue;
-	}
+    if (! lmap_running(lmap)) {
+	lmap_free(lmap);
+	lmapd->retired_len--;
+	memmove(lmapd->retired + i, lmapd->retired + i + 1,
+		(lmapd->retired_len - i) * sizeof(*lmapd->retired));
+    }
+    return 1;
+}
 
-	action = find_action_by_pid(lmap, pid);
-	if (! action) {
-	    lmap_dbg("ignoring pid '%d'", pid);
-	    continue;
-	}
-	schedule = find_schedule_by_pid(lmap, pid);
-	if (! schedule) {
-	    lmap_dbg("ignoring pid '%d'", pid);
-	    continue;
-	}
+/**
+ * @brief Completes the invocation of an action
+ *
+ * Records the status of a child that terminated, moves the results
+ * to the destinations and starts any subsequent action in sequential
+ * schedules. In simulation mode, no files are touched: the size of
+ * the result of the stub is added to the storage of the
+ * destinations instead.
+ *
+ * @param lmapd pointer to a struct lmapd
+ * @param pid the pid of the child
+ * @param status the exit status, or the negated signal number
+ */
 
-	action->pid = 0;
-	action->state = LMAP_ACTION_STATE_ENABLED;
-	action->last_completion = t.tv_sec;
-	if (WIFEXITED(status)) {
-	    action->last_status = WEXITSTATUS(status);
-	}
-	if (WIFSIGNALED(status)) {
-	    action->last_status = -WTERMSIG(status);
-	}
+static void
+action_reap(struct lmapd *lmapd, pid_t pid, int status)
+{
+    int failed;
+    uint64_t reaped, completed, moved;
+    struct lmap *lmap = lmapd->lmap;
+    struct timeval t;
+    struct action *action, *done;
+    struct schedule *schedule;
+    struct tag *tag;
 
-	if (action->last_status != 0) {
-	    action->last_failed_completion = action->last_completion;
-	    action->last_failed_status = action->last_status;
-	    action->cnt_failures++;
-	}
+    if (orphan_reap(lmapd, pid, status)) {
+	return;
+    }
+    action = done = find_action_by_pid(lmap, pid);
+    if (! action) {
+	lmap_dbg("ignoring pid '%d'", pid);
+	return;
+    }
+    schedule = find_schedule_by_pid(lmap, pid);
+    if (! schedule) {
+	lmap_dbg("ignoring pid '%d'", pid);
+	return;
+    }
+
+    clock_now(lmapd, &t);
+    reaped = clock_mono(lmapd);
+    (void) lmap_latency_record(action, LMAP_LATENCY_RUN,
+			action->latency ? action->latency->forked : 0, reaped);
+
+    action->pid = 0;
+    action->state = LMAP_ACTION_STATE_ENABLED;
+    action->last_completion = t.tv_sec;
+    action->last_status = status;
+    LMAPD_PROBE4(action_reap, schedule->name, action->name,
+		 pid, action->last_status);
+
+    if (action->last_status != 0) {
+	action->last_failed_completion = action->last_completion;
+	action->last_failed_status = action->last_status;
+	action->cnt_failures++;
+    }
 
-	/*
-	 * Save some meta information about the completion of this
-	 * action in the action workspace.
-	 */
+    /*
+     * Save some meta information about the completion of this
+     * action in the action workspace.
+     */
 
+    if (! lmapd->sim) {
 	(void) lmapd_workspace_action_meta_add_end(schedule, action);
+    }
+    completed = clock_mono(lmapd);
+    (void) lmap_latency_record(action, LMAP_LATENCY_REAP, reaped, completed);
 
-	/*
-	 * Move the results to the destinations and afterwards cleanup
-	 * the workspace.
-	 */
+    /*
+     * Move the results to the destinations and afterwards cleanup
+     * the workspace.
+     */
 
-	if (action->last_status == 0 && action->destinations) {
-	    for (tag = action->destinations; tag; tag = tag->next) {
-		struct schedule *dst = lmap_find_schedule(lmap, tag->tag);
-		if (dst) {
-		    (void) lmapd_workspace_action_move(lmapd, schedule, action, dst);
-		}
+    if (action->last_status == 0 && action->destinations) {
+	for (tag = action->destinations; tag; tag = tag->next) {
+	    struct schedule *dst = lmap_find_schedule(lmap, tag->tag);
+	    if (dst && lmapd->sim) {
+		dst->storage += lmapd_sim_bytes(lmapd->sim, action->task);
+	    } else if (dst) {
+		(void) lmapd_workspace_action_move(lmapd, schedule, action, dst);
 	    }
 	}
+    }
+    if (! lmapd->sim) {
 	(void) lmapd_workspace_action_clean(lmapd, action);
+    }
+    moved = clock_mono(lmapd);
+    (void) lmap_latency_record(action, LMAP_LATENCY_MOVE, completed, moved);
 
-	/*
-	 * Is there any subsequent action in a sequential schedule?
-	 * If so, execute the next action in sequence except when the
-	 * schedule got meanwhile suppressed and the stop all running
-	 * flag is set.
-	 */
-
-	if (action->next && schedule
-	    && schedule->mode == LMAP_SCHEDULE_EXEC_MODE_SEQUENTIAL) {
-	    if (schedule->state != LMAP_SCHEDULE_STATE_SUPPRESSED
-		&& ! (schedule->flags & LMAP_SCHEDULE_FLAG_STOP_RUNNING)) {
-		(void) action_exec(lmapd, schedule, action->next);
-	    }
+    /*
+     * Is there any subsequent action in a sequential schedule?
+     * If so, execute the next action in sequence except when the
+     * schedule got meanwhile suppressed and the stop all running
+     * flag is set.
+     */
+
+    if (action->next && schedule
+	&& schedule->mode == LMAP_SCHEDULE_EXEC_MODE_SEQUENTIAL) {
+	if (schedule->state != LMAP_SCHEDULE_STATE_SUPPRESSED
+	    && ! (schedule->flags & LMAP_SCHEDULE_FLAG_STOP_RUNNING)) {
+	    (void) action_exec(lmapd, schedule, action->next, moved);
 	}
+    }
 
-	/*
-	 * Change schedule state back to enabled if all actions have
-	 * left the running state.
-	 */
+    /*
+     * Change schedule state back to enabled if all actions have
+     * left the running state.
+     */
 
-	if (schedule->state == LMAP_SCHEDULE_STATE_RUNNING) {
-	    schedule->state = LMAP_SCHEDULE_STATE_ENABLED;
-	    if (schedule->cnt_active_suppressions) {
-		schedule->state = LMAP_SCHEDULE_STATE_SUPPRESSED;
-	    }
-	    failed = 0;
-	    for (action = schedule->actions; action; action = action->next) {
-		if (action->state == LMAP_ACTION_STATE_RUNNING) {
-		    schedule->state = LMAP_SCHEDULE_STATE_RUNNING;
-		}
-		if (action->last_status) {
-		    failed++;
-		}
+    if (schedule->state == LMAP_SCHEDULE_STATE_RUNNING) {
+	schedule->state = LMAP_SCHEDULE_STATE_ENABLED;
+	if (schedule->cnt_active_suppressions) {
+	    schedule->state = LMAP_SCHEDULE_STATE_SUPPRESSED;
+	}
+	failed = 0;
+	for (action = schedule->actions; action; action = action->next) {
+	    if (action->state == LMAP_ACTION_STATE_RUNNING) {
+		schedule->state = LMAP_SCHEDULE_STATE_RUNNING;
 	    }
-	    if (schedule->state != LMAP_SCHEDULE_STATE_RUNNING && failed) {
-		schedule->cnt_failures++;
+	    if (action->last_status) {
+		failed++;
 	    }
 	}
+	if (schedule->state != LMAP_SCHEDULE_STATE_RUNNING && failed) {
+	    schedule->cnt_failures++;
+	}
+    }
+
+    (void) lmapd_journal_action(lmapd, schedule, done);
+}
+
+/**
+ * @brief Callback called from the event loop
+ *
+ * Function which is executed by the event loop periodically. It calls
+ * waitpid() to see if any children changed their status and
+ * completes the invocations of their actions.
+ *
+ * @param lmapd pointer to a struct lmapd
+ */
+
+void
+lmapd_cleanup(struct lmapd *lmapd)
+{
+    pid_t pid;
+    int status;
+
+    assert(lmapd);
+    if (! lmapd->lmap) {
+	return;
+    }
+    
+    while (1) {
+	pid = waitpid(0, &status, WNOHANG);
+	if (pid == 0 || pid == -1) {
+	    return;
+	}
+
+	if (WIFEXITED(status)) {
+	    action_reap(lmapd, pid, WEXITSTATUS(status));
+	} else if (WIFSIGNALED(status)) {
+	    action_reap(lmapd, pid, -WTERMSIG(status));
+	}
     }
 }
 
@@ -651,10 +944,12 @@ lmapd_cleanup(struct lmapd *lmapd)
  * needs to be executed.
  *
  * @param lmapd pointer to a struct lmapd
+ * @param event pointer to the event that fired
+ * @param fired monotonic time the event fired (see latency.h)
  */
 
 static void
-execute_cb(struct lmapd *lmapd, struct event *event)
+execute_cb(struct lmapd *lmapd, struct event *event, uint64_t fired)
 {
     struct schedule *sched;
     
@@ -691,11 +986,11 @@ execute_cb(struct lmapd *lmapd, struct event *event)
 	    if (event->flags & LMAP_EVENT_FLAG_CYCLE_INTERVAL_SET
 		&& event->cycle_interval) {
 		struct timeval t;
-		event_base_gettimeofday_cached(lmapd->base, &t);
+		clock_now(lmapd, &t);
 		sched->cycle_number = (t.tv_sec / event->cycle_interval) * event->cycle_interval;
 	    }
 	    
-	    schedule_exec(lmapd, sched);
+	    schedule_exec(lmapd, sched, fired);
 	    if (event->type == LMAP_EVENT_TYPE_ONE_OFF
 		|| event->type == LMAP_EVENT_TYPE_IMMEDIATE
 		|| event->type == LMAP_EVENT_TYPE_STARTUP) {
@@ -778,17 +1073,22 @@ static void
 fire_cb(evutil_socket_t fd, short events, void *context)
 {
     struct event *event = (struct event *) context;
+    uint64_t start = lmap_latency_now();
+    uint64_t fired, lag;
 
     (void) fd;
     (void) events;
 
     assert(event && event->lmapd);
 
+    fired = clock_mono(event->lmapd);
+    lag = event_lag(event, fired);
+    LMAPD_PROBE2(event_fire, event->name, lag);
     suppress_cb(event->lmapd, event);
-    execute_cb(event->lmapd, event);
+    execute_cb(event->lmapd, event, fired);
     
-    event_free(event->fire_event);
-    event->fire_event = NULL;
+    timer_free(event->lmapd, &event->fire_event);
+    lmapd_watchdog(event->lmapd, "fire event", start);
 }
 
 static void
@@ -796,26 +1096,42 @@ trigger_periodic_cb(evutil_socket_t fd, short events, void *context)
 {
     struct event *event = (struct event *) context;
     struct timeval tv = { .tv_sec = 0, .tv_usec = 0 };
+    struct timeval interval = { .tv_sec = event->interval, .tv_usec = 0 };
     struct timeval t;
+    uint64_t now, base;
 
     (void) fd;
-    (void) events;
 
     assert(event && event->lmapd);
 
-    event_base_gettimeofday_cached(event->lmapd->base, &t);
+    /*
+     * The persistent trigger timer is rescheduled relative to when it
+     * was due (unless it missed a whole interval), the first trigger
+     * is called directly from startup_cb.
+     */
+
+    now = base = clock_mono(event->lmapd);
+    if (events & EV_TIMEOUT) {
+	base = event->trigger_due;
+	event->trigger_due = due_time(base, &interval);
+	if (event->trigger_due <= now) {
+	    event->trigger_due = due_time(now, &interval);
+	}
+    }
+
+    clock_now(event->lmapd, &t);
     if (event->flags & LMAP_EVENT_FLAG_END_SET) {
 	if (t.tv_sec > event->end) {
 	    /* XXX disable related schedules / suppressions */
 	    lmap_wrn("event '%s' ending", event->name);
-	    event_free(event->trigger_event);
-	    event->trigger_event = NULL;
+	    timer_free(event->lmapd, &event->trigger_event);
 	    return;
 	}
     }
 
     add_random_spread(event, &tv);
     event_gaga(event, &event->fire_event, EV_TIMEOUT, fire_cb, &tv);
+    event->fire_due = due_time(base, &tv);
 }
 
 static void
@@ -831,13 +1147,12 @@ trigger_calendar_cb(evutil_socket_t fd, short events, void *context)
 
     assert(event && event->lmapd);
 
-    event_base_gettimeofday_cached(event->lmapd->base, &t);
+    clock_now(event->lmapd, &t);
     if (event->flags & LMAP_EVENT_FLAG_END_SET) {
 	if (t.tv_sec > event->end) {
 	    /* XXX disable related schedules / suppressions */
 	    lmap_wrn("event '%s' ending", event->name);
-	    event_free(event->trigger_event);
-	    event->trigger_event = NULL;
+	    timer_free(event->lmapd, &event->trigger_event);
 	    return;
 	}
     }
@@ -845,22 +1160,22 @@ trigger_calendar_cb(evutil_socket_t fd, short events, void *context)
     match = lmap_event_calendar_match(event, &t.tv_sec);
     if (match < 0) {
 	lmap_err("shutting down '%s'", event->name);
-	event_free(event->trigger_event);
-	event->trigger_event = NULL;
+	timer_free(event->lmapd, &event->trigger_event);
 	return;
     }
     
     if (match == 0) {
 	tv.tv_sec = 1;
-	event_add(event->trigger_event, &tv);
+	timer_add(event->lmapd, event->trigger_event, &tv);
 	return;
     }
     
     add_random_spread(event, &tv);
     event_gaga(event, &event->fire_event, EV_TIMEOUT, fire_cb, &tv);
+    event->fire_due = due_time(clock_mono(event->lmapd), &tv);
     
     tv.tv_sec = match;
-    event_add(event->trigger_event, &tv);
+    timer_add(event->lmapd, event->trigger_event, &tv);
 }
 
 static void
@@ -876,6 +1191,7 @@ startup_cb(evutil_socket_t fd, short events, void *context)
     case LMAP_EVENT_TYPE_PERIODIC:
 	tv.tv_sec = event->interval;
 	event_gaga(event, &event->trigger_event, EV_PERSIST, trigger_periodic_cb, &tv);
+	event->trigger_due = due_time(clock_mono(event->lmapd), &tv);
 	trigger_periodic_cb(-1, 0, event);
 	break;
     case LMAP_EVENT_TYPE_CALENDAR:
@@ -885,26 +1201,191 @@ startup_cb(evutil_socket_t fd, short events, void *context)
 	break;
     }
 
-    event_free(event->start_event);
-    event->start_event = NULL;
+    timer_free(event->lmapd, &event->start_event);
 }
 
 /**
- * @brief Create and event loop and execute the schedules
+ * @brief Checks whether an event is referenced
  *
- * This function creates an event loop and registeres handlers to take
- * care of signals and to periodically check whether any schedules
- * need to be executed. The event loop usually runs until a SIGHUP or
- * SIGINT signal has been received. Upon receiving SIGUSR1 and
- * SIGUSR2, state and config information is written to files located
- * in the $prefix/var/run directory.
+ * An event is used if it starts or ends a schedule or a
+ * suppression. Events that are not used do not need any timers.
  *
- * @param lmapd pointer to the struct lmapd
- * @return 0 on success, -1 on error
+ * @param lmap pointer to the lmap
+ * @param event pointer to the event
+ * @return 1 if the event is used, 0 otherwise
  */
 
-int
-lmapd_run(struct lmapd *lmapd)
+static int
+event_used(struct lmap *lmap, struct event *event)
+{
+    struct schedule *sched;
+    struct supp *supp;
+
+    for (sched = lmap->schedules; sched; sched = sched->next) {
+	if (sched->start && ! strcmp(sched->start, event->name)) {
+	    return 1;
+	}
+	if (sched->end && ! strcmp(sched->end, event->name)) {
+	    return 1;
+	}
+    }
+
+    for (supp = lmap->supps; supp; supp = supp->next) {
+	if (supp->start && ! strcmp(supp->start, event->name)) {
+	    return 1;
+	}
+	if (supp->end && ! strcmp(supp->end, event->name)) {
+	    return 1;
+	}
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Creates the timers of an event
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @param event pointer to the event
+ * @param now the current time
+ */
+
+static void
+event_start(struct lmapd *lmapd, struct event *event, time_t now)
+{
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 0 };
+
+    event->lmapd = lmapd;	/* this avoids a new data structure */
+    switch (event->type) {
+    case LMAP_EVENT_TYPE_PERIODIC:
+	if (event->flags & LMAP_EVENT_FLAG_END_SET) {
+	    if (now > event->end) {
+		lmap_wrn("event '%s' ended in the past", event->name);
+		break;
+	    }
+	}
+	if (event->flags & LMAP_EVENT_FLAG_START_SET) {
+	    if (now > event->start) {
+		uint32_t delta = (now - event->start) / event->interval;
+		tv.tv_sec = (event->start + (delta + 1) * event->interval) - now;
+	    } else {
+		tv.tv_sec = event->start - now;
+	    }
+	}
+	event_gaga(event, &event->start_event, EV_TIMEOUT, startup_cb, &tv);
+	break;
+
+    case LMAP_EVENT_TYPE_CALENDAR:
+	if (event->flags & LMAP_EVENT_FLAG_END_SET) {
+	    if (now > event->end) {
+		lmap_wrn("event '%s' ended in the past", event->name);
+		break;
+	    }
+	}
+	event_gaga(event, &event->start_event, EV_TIMEOUT, startup_cb, &tv);
+	break;
+
+    case LMAP_EVENT_TYPE_ONE_OFF:
+	if (now < event->start) {
+	    lmap_wrn("event '%s' is in the past", event->name);
+	    break;
+	}
+	tv.tv_sec = event->start-now;
+	add_random_spread(event, &tv);
+	event_gaga(event, &event->fire_event, EV_TIMEOUT, fire_cb, &tv);
+	event->fire_due = due_time(clock_mono(lmapd), &tv);
+	break;
+	
+    case LMAP_EVENT_TYPE_STARTUP:
+    case LMAP_EVENT_TYPE_IMMEDIATE:
+	add_random_spread(event, &tv);
+	event_gaga(event, &event->fire_event, EV_TIMEOUT, fire_cb, &tv);
+	event->fire_due = due_time(clock_mono(lmapd), &tv);
+	break;
+	
+    default:
+	lmap_wrn("ignoring event '%s' (not implemented)", event->name);
+	break;
+    }
+}
+
+/**
+ * @brief Releases the timers of an event
+ *
+ * @param event pointer to the event
+ */
+
+static void
+event_stop(struct event *event)
+{
+    if (event->start_event) {
+	timer_free(event->lmapd, &event->start_event);
+    }
+    if (event->trigger_event) {
+	timer_free(event->lmapd, &event->trigger_event);
+    }
+    if (event->fire_event) {
+	timer_free(event->lmapd, &event->fire_event);
+    }
+}
+
+/**
+ * @brief Runs the event loop on the virtual clock
+ *
+ * Expired timers and completed stub children are dispatched in the
+ * order they are due until the end of the simulation. Every so often
+ * the event loop is polled so that signals can stop a simulation.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @return 0 on success, -1 on error
+ */
+
+static int
+sim_dispatch(struct lmapd *lmapd)
+{
+    struct event *ev;
+    event_callback_fn cb;
+    uint64_t steps = 0;
+    pid_t pid;
+    int status;
+
+    while (lmapd_sim_next(lmapd->sim, &ev, &pid, &status)) {
+	if (ev) {
+	    cb = event_get_callback(ev);
+	    cb(event_get_fd(ev), EV_TIMEOUT, event_get_callback_arg(ev));
+	} else {
+	    action_reap(lmapd, pid, status);
+	}
+	if (++steps % 1024 == 0) {
+	    if (event_base_loop(lmapd->base, EVLOOP_NONBLOCK) == -1) {
+		return -1;
+	    }
+	    if (event_base_got_break(lmapd->base)) {
+		break;
+	    }
+	}
+    }
+    return 0;
+}
+
+/**
+ * @brief Create and event loop and execute the schedules
+ *
+ * This function creates an event loop and registeres handlers to take
+ * care of signals and to periodically check whether any schedules
+ * need to be executed. The event loop usually runs until a SIGHUP or
+ * SIGINT signal has been received. Upon receiving SIGUSR1 and
+ * SIGUSR2, state and config information is written to files located
+ * in the $prefix/var/run directory. In simulation mode (lmapd->sim
+ * set), the schedules run on the virtual clock until the simulation
+ * ends, without the control socket and the metrics endpoint.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_run(struct lmapd *lmapd)
 {
     int i, ret;
     struct timeval one_sec = { .tv_sec = 1, .tv_usec = 0 };
@@ -950,99 +1431,29 @@ lmapd_run(struct lmapd *lmapd)
 	}
     }
 
+    if (! lmapd->sim) {
+	(void) lmapd_control_open(lmapd);
+	(void) lmapd_metrics_open(lmapd);
+    }
+
     if (lmapd->lmap) {
 	struct event *event;
-	time_t now = time(NULL);
+	struct timeval now;
+	clock_now(lmapd, &now);
 	for (event = lmapd->lmap->events; event; event = event->next) {
-	    struct timeval tv = { .tv_sec = 0, .tv_usec = 0 };
 	    if (! event->name) {
 		continue;
 	    }
-
-	    {
-		/* skip events that are not used by anyone */
-		struct schedule *sched;
-		struct supp *supp;
-		int used = 0;
-		
-		for (sched = lmapd->lmap->schedules; !used && sched; sched = sched->next) {
-		    if (sched->start && ! strcmp(sched->start, event->name)) {
-			used = 1;
-		    }
-		    if (sched->end && ! strcmp(sched->end, event->name)) {
-			used = 1;
-		    }
-		}
-		
-		for (supp = lmapd->lmap->supps; !used && supp; supp = supp->next) {
-		    if (supp->start && ! strcmp(supp->start, event->name)) {
-			used = 1;
-		    }
-		    if (supp->end && ! strcmp(supp->end, event->name)) {
-			used = 1;
-		    }
-		}
-		if (! used) {
-		    lmap_wrn("event '%s' is not used - skipping", event->name);
-		    continue;
-		}
-	    }
-	    
-	    event->lmapd = lmapd;	/* this avoids a new data structure */
-	    switch (event->type) {
-	    case LMAP_EVENT_TYPE_PERIODIC:
-		if (event->flags & LMAP_EVENT_FLAG_END_SET) {
-		    if (now > event->end) {
-			lmap_wrn("event '%s' ended in the past", event->name);
-			break;
-		    }
-		}
-		if (event->flags & LMAP_EVENT_FLAG_START_SET) {
-		    if (now > event->start) {
-			uint32_t delta = (now - event->start) / event->interval;
-			tv.tv_sec = (event->start + (delta + 1) * event->interval) - now;
-		    } else {
-			tv.tv_sec = event->start - now;
-		    }
-		}
-		event_gaga(event, &event->start_event, EV_TIMEOUT, startup_cb, &tv);
-		break;
-
-	    case LMAP_EVENT_TYPE_CALENDAR:
-		if (event->flags & LMAP_EVENT_FLAG_END_SET) {
-		    if (now > event->end) {
-			lmap_wrn("event '%s' ended in the past", event->name);
-			break;
-		    }
-		}
-		event_gaga(event, &event->start_event, EV_TIMEOUT, startup_cb, &tv);
-		break;
-
-	    case LMAP_EVENT_TYPE_ONE_OFF:
-		if (now < event->start) {
-		    lmap_wrn("event '%s' is in the past", event->name);
-		    break;
-		}
-		tv.tv_sec = event->start-now;
-		add_random_spread(event, &tv);
-		event_gaga(event, &event->fire_event, EV_TIMEOUT, fire_cb, &tv);
-		break;
-		
-	    case LMAP_EVENT_TYPE_STARTUP:
-	    case LMAP_EVENT_TYPE_IMMEDIATE:
-		add_random_spread(event, &tv);
-		event_gaga(event, &event->fire_event, EV_TIMEOUT, fire_cb, &tv);
-		break;
-		
-	    default:
-		lmap_wrn("ignoring event '%s' (not implemented)", event->name);
-		break;
+	    if (! event_used(lmapd->lmap, event)) {
+		lmap_wrn("event '%s' is not used - skipping", event->name);
+		continue;
 	    }
+	    event_start(lmapd, event, now.tv_sec);
 	}
     }
     
     lmap_dbg("event loop starting");
-    ret = event_base_dispatch(lmapd->base);
+    ret = lmapd->sim ? sim_dispatch(lmapd) : event_base_dispatch(lmapd->base);
     if (ret != 0) {
 	lmap_err("event loop failed");
     }
@@ -1055,21 +1466,12 @@ lmapd_run(struct lmapd *lmapd)
     if (lmapd->lmap) {
 	struct event *event;
 	for (event = lmapd->lmap->events; event; event = event->next) {
-	    if (event->start_event) {
-		event_free(event->start_event);
-		event->start_event = NULL;
-	    }
-	    if (event->trigger_event) {
-		event_free(event->trigger_event);
-		event->trigger_event = NULL;
-	    }
-	    if (event->fire_event) {
-		event_free(event->fire_event);
-		event->fire_event = NULL;
-	    }
+	    event_stop(event);
 	}
     }
     
+    lmapd_metrics_close(lmapd);
+    lmapd_control_close(lmapd);
     for (i = 0; tab[i].name; i++) {
 	if (tab[i].event) {
 	    event_free(tab[i].event);
@@ -1078,25 +1480,435 @@ lmapd_run(struct lmapd *lmapd)
     event_base_free(lmapd->base);
 
     /*
-     * Cleanup the lmap data model but keep the lmapd daemon state (in
-     * case we do a restart).
+     * Checkpoint the counters in the journal. The lmap data model is
+     * left to the caller, which frees it before a restart; until then
+     * the final state (counters, histograms) can still be inspected.
      */
     
-    if (lmapd->lmap) {
-	lmap_free(lmapd->lmap);
-	lmapd->lmap = NULL;
-    }
+    (void) lmapd_journal_checkpoint(lmapd);
     
     return (ret == 0) ? 0 : -1;
 }
 
+/*
+ * Support for reloading the configuration while the event loop is
+ * running. The new configuration is built completely and compared
+ * against the running one; objects that did not change take over the
+ * state of their running counterparts.
+ */
+
+static int
+str_eq(const char *a, const char *b)
+{
+    if (!a || !b) {
+	return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+static int
+tags_eq(struct tag *a, struct tag *b)
+{
+    for (; a && b; a = a->next, b = b->next) {
+	if (! str_eq(a->tag, b->tag)) {
+	    return 0;
+	}
+    }
+    return a == b;
+}
+
+static int
+options_eq(struct option *a, struct option *b)
+{
+    for (; a && b; a = a->next, b = b->next) {
+	if (! str_eq(a->id, b->id)
+	    || ! str_eq(a->name, b->name)
+	    || ! str_eq(a->value, b->value)) {
+	    return 0;
+	}
+    }
+    return a == b;
+}
+
+static int
+event_eq(struct event *a, struct event *b)
+{
+    return a->type == b->type
+	&& a->flags == b->flags
+	&& a->interval == b->interval
+	&& a->start == b->start
+	&& a->end == b->end
+	&& a->random_spread == b->random_spread
+	&& a->cycle_interval == b->cycle_interval
+	&& a->months == b->months
+	&& a->days_of_month == b->days_of_month
+	&& a->days_of_week == b->days_of_week
+	&& a->hours == b->hours
+	&& a->minutes == b->minutes
+	&& a->seconds == b->seconds
+	&& a->timezone_offset == b->timezone_offset;
+}
+
+static int
+supp_eq(struct supp *a, struct supp *b)
+{
+    return str_eq(a->start, b->start)
+	&& str_eq(a->end, b->end)
+	&& a->stop_running == b->stop_running
+	&& a->flags == b->flags
+	&& tags_eq(a->match, b->match);
+}
+
+static int
+action_eq(struct action *a, struct action *b)
+{
+    return str_eq(a->task, b->task)
+	&& tags_eq(a->destinations, b->destinations)
+	&& options_eq(a->options, b->options)
+	&& tags_eq(a->tags, b->tags)
+	&& tags_eq(a->suppression_tags, b->suppression_tags);
+}
+
+static int
+schedule_eq(struct schedule *a, struct schedule *b)
+{
+    const uint32_t mask = ~LMAP_SCHEDULE_FLAG_STOP_RUNNING;
+    
+    return str_eq(a->start, b->start)
+	&& str_eq(a->end, b->end)
+	&& a->duration == b->duration
+	&& a->mode == b->mode
+	&& (a->flags & mask) == (b->flags & mask)
+	&& tags_eq(a->tags, b->tags)
+	&& tags_eq(a->suppression_tags, b->suppression_tags);
+}
+
+static struct action *
+find_action(struct schedule *schedule, const char *name)
+{
+    struct action *act;
+
+    for (act = schedule->actions; act; act = act->next) {
+	if (str_eq(act->name, name)) {
+	    return act;
+	}
+    }
+
+    return NULL;
+}
+
+static void
+action_carry(struct action *from, struct action *to)
+{
+    to->state = from->state;
+    to->storage = from->storage;
+    to->last_invocation = from->last_invocation;
+    to->last_completion = from->last_completion;
+    to->last_status = from->last_status;
+    to->last_failed_completion = from->last_failed_completion;
+    to->last_failed_status = from->last_failed_status;
+    if (from->last_message) {
+	(void) lmap_action_set_last_message(to, from->last_message);
+    }
+    if (from->last_failed_message) {
+	(void) lmap_action_set_last_failed_message(to, from->last_failed_message);
+    }
+    to->cnt_invocations = from->cnt_invocations;
+    to->cnt_failures = from->cnt_failures;
+    to->cnt_suppressions = from->cnt_suppressions;
+    to->cnt_overlaps = from->cnt_overlaps;
+    to->cnt_active_suppressions = from->cnt_active_suppressions;
+
+    /* the running child and its histograms now belong to the new action */
+    to->pid = from->pid;
+    from->pid = 0;
+    to->latency = from->latency;
+    from->latency = NULL;
+}
+
+static void
+schedule_carry(struct schedule *from, struct schedule *to)
+{
+    struct action *act, *old;
+
+    to->state = from->state;
+    to->flags |= (from->flags & LMAP_SCHEDULE_FLAG_STOP_RUNNING);
+    to->cycle_number = from->cycle_number;
+    to->storage = from->storage;
+    to->cnt_invocations = from->cnt_invocations;
+    to->cnt_failures = from->cnt_failures;
+    to->cnt_suppressions = from->cnt_suppressions;
+    to->cnt_overlaps = from->cnt_overlaps;
+    to->last_invocation = from->last_invocation;
+    to->cnt_active_suppressions = from->cnt_active_suppressions;
+
+    for (act = to->actions; act; act = act->next) {
+	old = find_action(from, act->name);
+	if (old && action_eq(old, act)) {
+	    action_carry(old, act);
+	}
+    }
+}
+
+/**
+ * @brief Computes the time left until a timer expires
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @param ev pointer to the timer
+ * @param now the current time of the event loop
+ * @param tv set to the time left
+ * @return 0 if the timer is pending, -1 otherwise
+ */
+
+static int
+timer_left(struct lmapd *lmapd, struct event *ev,
+	   struct timeval *now, struct timeval *tv)
+{
+    struct timeval at;
+
+    if (lmapd->sim) {
+	return lmapd_sim_timer_left(lmapd->sim, ev, tv);
+    }
+    if (! event_pending(ev, EV_TIMEOUT, &at)) {
+	return -1;
+    }
+    tv->tv_sec = at.tv_sec - now->tv_sec;
+    tv->tv_usec = at.tv_usec - now->tv_usec;
+    if (tv->tv_usec < 0) {
+	tv->tv_sec--;
+	tv->tv_usec += 1000000;
+    }
+    if (tv->tv_sec < 0) {
+	tv->tv_sec = tv->tv_usec = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Moves the pending timers of an event to a new event
+ *
+ * The timers are recreated for the new event with the time left on
+ * the old ones so that an unchanged event keeps its phase. A pending
+ * periodic trigger is turned into a start timer, which recreates the
+ * trigger with the configured interval when it expires.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @param from pointer to the old event
+ * @param to pointer to the new event
+ * @return 1 if any timers were moved, 0 otherwise
+ */
+
+static int
+event_move(struct lmapd *lmapd, struct event *from, struct event *to)
+{
+    struct timeval now, tv;
+    int moved = 0;
+
+    clock_now(lmapd, &now);
+    to->lmapd = lmapd;
+    to->last_invocation = from->last_invocation;
+    to->fire_due = from->fire_due;
+    to->lag = from->lag;
+    from->lag = NULL;
+
+    if (from->start_event && timer_left(lmapd, from->start_event, &now, &tv) == 0) {
+	event_gaga(to, &to->start_event, EV_TIMEOUT, startup_cb, &tv);
+	moved = 1;
+    }
+    if (from->trigger_event && timer_left(lmapd, from->trigger_event, &now, &tv) == 0) {
+	if (to->type == LMAP_EVENT_TYPE_PERIODIC) {
+	    if (! to->start_event) {
+		event_gaga(to, &to->start_event, EV_TIMEOUT, startup_cb, &tv);
+	    }
+	} else {
+	    event_gaga(to, &to->trigger_event, EV_TIMEOUT, trigger_calendar_cb, &tv);
+	}
+	moved = 1;
+    }
+    if (from->fire_event && timer_left(lmapd, from->fire_event, &now, &tv) == 0) {
+	event_gaga(to, &to->fire_event, EV_TIMEOUT, fire_cb, &tv);
+	moved = 1;
+    }
+
+    event_stop(from);
+    return moved;
+}
+
+/**
+ * @brief Reloads the configuration without restarting
+ *
+ * Reads the configuration again and replaces the running lmap with
+ * the new one. Schedules, actions, suppressions and events that did
+ * not change take over the state of their running counterparts,
+ * including running children, pending timers and counters. Actions
+ * that were removed or changed are killed; their children are reaped
+ * later, see orphan_reap(). Tasks carry no state and
+ * are simply replaced. If the new configuration cannot be read or is
+ * invalid, the running configuration is kept.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_reload(struct lmapd *lmapd)
+{
+    struct lmap *old, *lmap;
+    struct schedule *sched, *os;
+    struct action *act;
+    struct supp *supp, *osupp;
+    struct event *event, *oe;
+    struct timeval now;
+    int valid = 0, kept = 0, touched = 0;
+
+    assert(lmapd);
+    clock_now(lmapd, &now);
+
+    old = lmapd->lmap;
+    lmapd->lmap = NULL;
+    if (lmapd_read_config(lmapd, &valid) != 0 || ! valid) {
+	lmap_err("failed to reload the configuration - keeping the current one");
+	if (lmapd->lmap) {
+	    lmap_free(lmapd->lmap);
+	}
+	lmapd->lmap = old;
+	LMAPD_PROBE3(config_reload, -1, 0, 0);
+	return -1;
+    }
+    lmap = lmapd->lmap;
+    lmapd->lmap = old;
+
+    if (! old) {
+	lmapd->lmap = lmap;
+	goto done;
+    }
+
+    /*
+     * Lift the active suppressions that were removed or changed so
+     * that the counters carried over do not include them. Unchanged
+     * active suppressions stay in place: they are applied to the new
+     * schedules and actions here and the unchanged ones take over
+     * their counters, which already include them, below.
+     */
+
+    for (osupp = old->supps; osupp; osupp = osupp->next) {
+	if (osupp->state != LMAP_SUPP_STATE_ACTIVE) {
+	    continue;
+	}
+	supp = lmap_find_supp(lmap, osupp->name);
+	if (! supp || ! supp_eq(osupp, supp)) {
+	    suppression_end(lmapd, osupp);
+	}
+    }
+
+    for (supp = lmap->supps; supp; supp = supp->next) {
+	osupp = lmap_find_supp(old, supp->name);
+	if (osupp && supp_eq(osupp, supp)) {
+	    supp->state = osupp->state;
+	    if (supp->state == LMAP_SUPP_STATE_ACTIVE && supp->match) {
+		suppression_apply(lmapd, lmap, supp);
+	    }
+	    kept++;
+	} else {
+	    touched++;
+	}
+    }
+
+    for (sched = lmap->schedules; sched; sched = sched->next) {
+	os = lmap_find_schedule(old, sched->name);
+	if (os && schedule_eq(os, sched)) {
+	    schedule_carry(os, sched);
+	    kept++;
+	} else {
+	    touched++;
+	}
+    }
+
+    for (event = lmap->events; event; event = event->next) {
+	if (! event->name) {
+	    continue;
+	}
+	oe = lmap_find_event(old, event->name);
+	if (oe && event_eq(oe, event)) {
+	    kept++;
+	    if (event_used(lmap, event)
+		&& ! event_move(lmapd, oe, event)
+		&& ! event_used(old, oe)) {
+		event_start(lmapd, event, now.tv_sec);
+	    }
+	} else {
+	    touched++;
+	    if (event_used(lmap, event)) {
+		event_start(lmapd, event, now.tv_sec);
+	    }
+	}
+    }
+
+    /*
+     * Stop what is left of the old configuration: timers of events
+     * that were removed or changed and the children of actions that
+     * were removed or changed. The old lmap is retired until these
+     * children have been reaped.
+     */
+
+    for (oe = old->events; oe; oe = oe->next) {
+	event_stop(oe);
+    }
+    for (os = old->schedules; os; os = os->next) {
+	schedule_kill(lmapd, os);
+    }
+
+    if (lmap->agent && old->agent) {
+	lmap->agent->last_started = old->agent->last_started;
+    }
+
+    lmapd->lmap = lmap;
+    lmap_retire(lmapd, old);
+    (void) lmapd_journal_checkpoint(lmapd);
+
+    /*
+     * A schedule stays running only as long as one of its actions
+     * is still running.
+     */
+
+    for (sched = lmap->schedules; sched; sched = sched->next) {
+	if (sched->state != LMAP_SCHEDULE_STATE_RUNNING) {
+	    continue;
+	}
+	for (act = sched->actions; act; act = act->next) {
+	    if (act->state == LMAP_ACTION_STATE_RUNNING) {
+		break;
+	    }
+	}
+	if (! act) {
+	    sched->state = sched->cnt_active_suppressions
+		? LMAP_SCHEDULE_STATE_SUPPRESSED : LMAP_SCHEDULE_STATE_ENABLED;
+	}
+    }
+
+    lmap_dbg("reloaded configuration (%d kept, %d added or changed)",
+	     kept, touched);
+
+done:
+    (void) lmapd_workspace_init(lmapd);
+    LMAPD_PROBE3(config_reload, 0, kept, touched);
+    return 0;
+}
+
 void
 lmapd_killall(struct lmapd *lmapd)
 {
     struct schedule *sched;
+    size_t i;
 
     assert(lmapd);
 
+    for (i = 0; i < lmapd->retired_len; i++) {
+	for (sched = lmapd->retired[i]->schedules; sched; sched = sched->next) {
+	    schedule_kill(lmapd, sched);
+	}
+    }
+
     if (! lmapd->lmap) {
 	return;
     }
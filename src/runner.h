@@ -24,7 +24,13 @@
 extern int lmapd_run(struct lmapd *lmapd);
 extern void lmapd_stop(struct lmapd *lmapd);
 extern void lmapd_restart(struct lmapd *lmapd);
+extern int lmapd_reload(struct lmapd *lmapd);
 
 extern void lmapd_cleanup(struct lmapd *lmapd);
 
+/* callbacks running longer than this (us) are logged as blocking */
+#define LMAPD_WATCHDOG_THRESHOLD	100000
+
+extern void lmapd_watchdog(struct lmapd *lmapd, const char *what, uint64_t start);
+
 #endif
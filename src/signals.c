@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "lmap.h"
 #include "lmapd.h"
@@ -29,6 +31,7 @@
 #include "runner.h"
 #include "signals.h"
 #include "workspace.h"
+#include "latency.h"
 
 /**
  * @brief Callback executed when SIGINT is received
@@ -82,8 +85,8 @@ lmapd_sigterm_cb(evutil_socket_t sig, short events, void *context)
  * @brief Callback executed when SIGHUP is received
  *
  * Function which is executed when SIGHUP is received by the daemon.
- * We simply signal to quit the eventloop and then let the lmapd main
- * loop reload and restart the system.
+ * The configuration is reloaded in place; running actions and timers
+ * that are not affected by configuration changes are left alone.
  *
  * @param sig unused
  * @param events unused
@@ -94,12 +97,14 @@ void
 lmapd_sighub_cb(evutil_socket_t sig, short events, void *context)
 {
     struct lmapd *lmapd = (struct lmapd *) context;
+    uint64_t start = lmap_latency_now();
 
     (void) sig;
     (void) events;
 
     assert(lmapd);
-    lmapd_restart(lmapd); 
+    (void) lmapd_reload(lmapd);
+    lmapd_watchdog(lmapd, "SIGHUP (reload)", start);
 }
 
 /**
@@ -118,20 +123,68 @@ void
 lmapd_sigchld_cb(evutil_socket_t sig, short events, void *context)
 {
     struct lmapd *lmapd = (struct lmapd *) context;
+    uint64_t start = lmap_latency_now();
 
     (void) sig;
     (void) events;
 
     assert(lmapd);
     lmapd_cleanup(lmapd);
+    lmapd_watchdog(lmapd, "SIGCHLD (cleanup)", start);
+}
+
+static void
+write_state(struct lmapd *lmapd)
+{
+    int fd;
+    char filename[PATH_MAX];
+    char tmpname[PATH_MAX];
+
+    snprintf(filename, sizeof(filename),
+	     "%s/%s", lmapd->run_path, LMAPD_STATUS_FILE);
+    if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename)
+	>= (int) sizeof(tmpname)) {
+	lmap_err("path to '%s' too long", filename);
+	return;
+    }
+    fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+	lmap_err("failed to open '%s': %s", tmpname, strerror(errno));
+	return;
+    }
+
+    if (lmap_xml_write_state(lmapd->lmap, lmap_write_fd, &fd) == -1) {
+	lmap_err("failed to render lmap state");
+	goto error;
+    }
+
+    if (close(fd) == -1) {
+	fd = -1;
+	lmap_err("failed to write to '%s': %s", tmpname, strerror(errno));
+	goto error;
+    }
+    fd = -1;
+
+    if (rename(tmpname, filename) == -1) {
+	lmap_err("failed to rename '%s': %s", tmpname, strerror(errno));
+	goto error;
+    }
+    return;
+
+error:
+    if (fd != -1) {
+	(void) close(fd);
+    }
+    (void) unlink(tmpname);
 }
 
 /**
  * @brief Callback executed when SIGUSR1 is received
  *
  * Function which is executed when SIGUSR1 is received by the
- * daemon. It obtains the lmap state information rendered in XML and
- * writes it into the lmap state file in the run directory.
+ * daemon. It streams the lmap state information rendered in XML
+ * into a temporary file in the run directory and renames it to the
+ * lmap state file, so that readers never see a partial state file.
  *
  * @param sig unused
  * @param events unused
@@ -141,10 +194,8 @@ lmapd_sigchld_cb(evutil_socket_t sig, short events, void *context)
 void
 lmapd_sigusr1_cb(evutil_socket_t sig, short events, void *context)
 {
-    FILE *f = NULL;
-    char *xml = NULL;
-    char filename[PATH_MAX];
     struct lmapd *lmapd = (struct lmapd *) context;
+    uint64_t start = lmap_latency_now();
     
     (void) sig;
     (void) events;
@@ -153,32 +204,8 @@ lmapd_sigusr1_cb(evutil_socket_t sig, short events, void *context)
     assert(lmapd->run_path);
 
     lmapd_workspace_update(lmapd);
-    xml = lmap_xml_render_state(lmapd->lmap);
-    if (! xml) {
-	lmap_err("failed to render lmap state");
-	return;
-    }
-
-    snprintf(filename, sizeof(filename),
-	     "%s/%s", lmapd->run_path, LMAPD_STATUS_FILE);
-    f = fopen(filename, "w");
-    if (! f) {
-	lmap_err("failed to open '%s': %s", filename, strerror(errno));
-	goto done;
-    }
-
-    if (fputs(xml, f) == EOF || fflush(f) == EOF) {
-	lmap_err("failed to write to '%s'", filename);
-	goto done;
-    }
-
-done:
-    if (f) {
-	(void) fclose(f);
-    }
-    if (xml) {
-	free(xml);
-    }
+    write_state(lmapd);
+    lmapd_watchdog(lmapd, "SIGUSR1 (state)", start);
 }
 
 /**
@@ -196,6 +223,7 @@ void
 lmapd_sigusr2_cb(evutil_socket_t sig, short events, void *context)
 {
     struct lmapd *lmapd = (struct lmapd *) context;
+    uint64_t start = lmap_latency_now();
     
     (void) sig;
     (void) events;
@@ -206,5 +234,6 @@ lmapd_sigusr2_cb(evutil_socket_t sig, short events, void *context)
     if (lmapd_workspace_clean(lmapd) == 0) {
 	(void) lmapd_workspace_init(lmapd);
     }
+    lmapd_watchdog(lmapd, "SIGUSR2 (clean)", start);
 }
 
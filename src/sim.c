@@ -0,0 +1,566 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lmap.h"
+#include "lmapd.h"
+#include "utils.h"
+#include "sim.h"
+
+#define SIM_TIMER	1
+#define SIM_CHILD	2
+
+/*
+ * Pending timers and stub children are entries of a binary heap
+ * ordered by the virtual time they are due; entries due at the same
+ * time keep the order in which they were added. A hash table keyed
+ * by the timer (or the pid) finds the entry of a timer that is
+ * deleted or re-added, or of a child that is killed.
+ */
+
+struct sim_entry {
+    int kind;			/* SIM_TIMER or SIM_CHILD */
+    uintptr_t key;		/* the timer or the pid of the child */
+    uint64_t due;		/* virtual time the entry is due */
+    uint64_t seq;		/* insertion order for equal due times */
+    uint64_t interval;		/* period of a persistent timer, or 0 */
+    int status;			/* exit status of a child */
+    size_t pos;			/* index of the entry in the heap */
+    struct sim_entry *chain;	/* next entry in the hash bucket */
+};
+
+struct sim_stub {
+    char *task;			/* NULL for the default stub */
+    uint64_t duration;
+    int status;
+    uint64_t bytes;		/* size of the result of an invocation */
+    struct sim_stub *next;
+};
+
+struct sim {
+    uint64_t now;		/* virtual time (us since the epoch) */
+    uint64_t end;		/* virtual time the simulation ends */
+    uint64_t seq;
+    pid_t pid;			/* last pid handed out to a stub child */
+    struct sim_entry **heap;
+    size_t len;
+    size_t size;
+    struct sim_entry **hash;
+    size_t buckets;		/* a power of two */
+    struct sim_stub stub;	/* used for tasks without a stub */
+    struct sim_stub *stubs;
+};
+
+static size_t
+hash_key(struct sim *sim, int kind, uintptr_t key)
+{
+    uint64_t h = ((uint64_t) key << 1 | (kind == SIM_CHILD)) * 0x9e3779b97f4a7c15ULL;
+
+    return (size_t) (h >> 32) & (sim->buckets - 1);
+}
+
+static struct sim_entry *
+hash_find(struct sim *sim, int kind, uintptr_t key)
+{
+    struct sim_entry *e;
+
+    for (e = sim->hash[hash_key(sim, kind, key)]; e; e = e->chain) {
+	if (e->kind == kind && e->key == key) {
+	    return e;
+	}
+    }
+    return NULL;
+}
+
+static void
+hash_remove(struct sim *sim, struct sim_entry *entry)
+{
+    struct sim_entry **ep;
+
+    for (ep = &sim->hash[hash_key(sim, entry->kind, entry->key)];
+	 *ep; ep = &(*ep)->chain) {
+	if (*ep == entry) {
+	    *ep = entry->chain;
+	    return;
+	}
+    }
+}
+
+static int
+earlier(const struct sim_entry *a, const struct sim_entry *b)
+{
+    return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+static void
+heap_place(struct sim *sim, struct sim_entry *entry, size_t pos)
+{
+    sim->heap[pos] = entry;
+    entry->pos = pos;
+}
+
+static void
+heap_up(struct sim *sim, size_t pos)
+{
+    struct sim_entry *entry = sim->heap[pos];
+
+    while (pos > 0 && earlier(entry, sim->heap[(pos - 1) / 2])) {
+	heap_place(sim, sim->heap[(pos - 1) / 2], pos);
+	pos = (pos - 1) / 2;
+    }
+    heap_place(sim, entry, pos);
+}
+
+static void
+heap_down(struct sim *sim, size_t pos)
+{
+    struct sim_entry *entry = sim->heap[pos];
+    size_t child;
+
+    while ((child = 2 * pos + 1) < sim->len) {
+	if (child + 1 < sim->len
+	    && earlier(sim->heap[child + 1], sim->heap[child])) {
+	    child++;
+	}
+	if (! earlier(sim->heap[child], entry)) {
+	    break;
+	}
+	heap_place(sim, sim->heap[child], pos);
+	pos = child;
+    }
+    heap_place(sim, entry, pos);
+}
+
+/*
+ * Removes an entry from the heap and the hash table without freeing
+ * it; the last entry of the heap takes its place.
+ */
+
+static void
+unlink_entry(struct sim *sim, struct sim_entry *entry)
+{
+    size_t pos = entry->pos;
+    struct sim_entry *last;
+
+    hash_remove(sim, entry);
+    last = sim->heap[--sim->len];
+    if (last != entry) {
+	heap_place(sim, last, pos);
+	heap_down(sim, pos);
+	heap_up(sim, last->pos);
+    }
+}
+
+static int
+grow(struct sim *sim)
+{
+    struct sim_entry **heap, **hash, *e, *next;
+    size_t i, j, size, buckets;
+
+    size = sim->size ? 2 * sim->size : 64;
+    heap = realloc(sim->heap, size * sizeof(*heap));
+    if (! heap) {
+	lmap_err("failed to allocate memory");
+	return -1;
+    }
+    sim->heap = heap;
+    sim->size = size;
+
+    /* the hash table grows with the heap and is rehashed */
+    hash = calloc(size, sizeof(*hash));
+    if (! hash) {
+	lmap_err("failed to allocate memory");
+	return -1;
+    }
+    buckets = sim->buckets;
+    sim->buckets = size;
+    for (i = 0; i < buckets; i++) {
+	for (e = sim->hash[i]; e; e = next) {
+	    next = e->chain;
+	    j = hash_key(sim, e->kind, e->key);
+	    e->chain = hash[j];
+	    hash[j] = e;
+	}
+    }
+    free(sim->hash);
+    sim->hash = hash;
+    return 0;
+}
+
+static int
+insert(struct sim *sim, struct sim_entry *entry)
+{
+    size_t i;
+
+    if (sim->len == sim->size && grow(sim) == -1) {
+	return -1;
+    }
+    entry->seq = sim->seq++;
+    i = hash_key(sim, entry->kind, entry->key);
+    entry->chain = sim->hash[i];
+    sim->hash[i] = entry;
+    heap_place(sim, entry, sim->len++);
+    heap_up(sim, entry->pos);
+    return 0;
+}
+
+static const struct sim_stub *
+find_stub(struct sim *sim, const char *task)
+{
+    struct sim_stub *stub;
+
+    for (stub = sim->stubs; stub; stub = stub->next) {
+	if (task && ! strcmp(stub->task, task)) {
+	    return stub;
+	}
+    }
+    return &sim->stub;
+}
+
+static uint64_t
+tv_usec(const struct timeval *tv)
+{
+    return tv ? (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec : 0;
+}
+
+/**
+ * @brief Creates a simulation
+ *
+ * The virtual clock starts at start and the simulation ends once no
+ * timer or child is due before start + duration. Tasks without a
+ * stub complete immediately with exit status 0.
+ *
+ * @param start wall clock time the simulation starts
+ * @param duration the number of seconds to simulate
+ * @return pointer to the simulation or NULL on error
+ */
+
+struct sim *
+lmapd_sim_new(time_t start, time_t duration)
+{
+    struct sim *sim;
+
+    sim = calloc(1, sizeof(struct sim));
+    if (! sim) {
+	lmap_err("failed to allocate memory");
+	return NULL;
+    }
+    sim->now = (uint64_t) start * 1000000;
+    sim->end = sim->now + (uint64_t) duration * 1000000;
+    if (grow(sim) == -1) {
+	lmapd_sim_free(sim);
+	return NULL;
+    }
+    return sim;
+}
+
+/**
+ * @brief Deallocates a simulation including all pending entries
+ */
+
+void
+lmapd_sim_free(struct sim *sim)
+{
+    struct sim_stub *stub;
+    size_t i;
+
+    if (! sim) {
+	return;
+    }
+    for (i = 0; i < sim->len; i++) {
+	free(sim->heap[i]);
+    }
+    while (sim->stubs) {
+	stub = sim->stubs->next;
+	free(sim->stubs->task);
+	free(sim->stubs);
+	sim->stubs = stub;
+    }
+    free(sim->heap);
+    free(sim->hash);
+    free(sim);
+}
+
+/**
+ * @brief Configures how the actions of a task are simulated
+ *
+ * @param sim pointer to the simulation
+ * @param task name of the task, NULL changes the default
+ * @param duration the run time of an invocation
+ * @param status the exit status of an invocation
+ * @param bytes the size of the result of a successful invocation
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_sim_stub(struct sim *sim, const char *task,
+	       uint64_t duration, int status, uint64_t bytes)
+{
+    struct sim_stub *stub;
+
+    if (! task) {
+	stub = &sim->stub;
+    } else {
+	for (stub = sim->stubs; stub; stub = stub->next) {
+	    if (! strcmp(stub->task, task)) {
+		break;
+	    }
+	}
+	if (! stub) {
+	    stub = calloc(1, sizeof(struct sim_stub));
+	    if (! stub || ! (stub->task = strdup(task))) {
+		lmap_err("failed to allocate memory");
+		free(stub);
+		return -1;
+	    }
+	    stub->next = sim->stubs;
+	    sim->stubs = stub;
+	}
+    }
+    stub->duration = duration;
+    stub->status = status;
+    stub->bytes = bytes;
+    return 0;
+}
+
+/**
+ * @brief Returns the virtual time in microseconds
+ *
+ * This replaces the monotonic clock (see lmap_latency_now()) in
+ * simulation mode.
+ */
+
+uint64_t
+lmapd_sim_now(struct sim *sim)
+{
+    return sim->now;
+}
+
+/**
+ * @brief Returns the virtual time as a wall clock time
+ */
+
+void
+lmapd_sim_gettimeofday(struct sim *sim, struct timeval *tv)
+{
+    tv->tv_sec = sim->now / 1000000;
+    tv->tv_usec = sim->now % 1000000;
+}
+
+/**
+ * @brief Arms a timer on the virtual clock
+ *
+ * Works like event_add(): a pending timer is rescheduled and a timer
+ * created with EV_PERSIST is re-armed with the same timeout whenever
+ * it expires.
+ *
+ * @param sim pointer to the simulation
+ * @param ev pointer to the timer
+ * @param tv the timeout
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmapd_sim_timer_add(struct sim *sim, struct event *ev, const struct timeval *tv)
+{
+    struct sim_entry *entry;
+
+    entry = hash_find(sim, SIM_TIMER, (uintptr_t) ev);
+    if (entry) {
+	unlink_entry(sim, entry);
+    } else {
+	entry = calloc(1, sizeof(struct sim_entry));
+	if (! entry) {
+	    lmap_err("failed to allocate memory");
+	    return -1;
+	}
+	entry->kind = SIM_TIMER;
+	entry->key = (uintptr_t) ev;
+    }
+    entry->due = sim->now + tv_usec(tv);
+    entry->interval = (event_get_events(ev) & EV_PERSIST) ? tv_usec(tv) : 0;
+    if (insert(sim, entry) == -1) {
+	free(entry);
+	return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Disarms a timer, must be called before the timer is freed
+ */
+
+void
+lmapd_sim_timer_del(struct sim *sim, struct event *ev)
+{
+    struct sim_entry *entry;
+
+    entry = hash_find(sim, SIM_TIMER, (uintptr_t) ev);
+    if (entry) {
+	unlink_entry(sim, entry);
+	free(entry);
+    }
+}
+
+/**
+ * @brief Returns the time left on a pending timer
+ *
+ * @param sim pointer to the simulation
+ * @param ev pointer to the timer
+ * @param tv set to the time left
+ * @return 0 if the timer is pending, -1 otherwise
+ */
+
+int
+lmapd_sim_timer_left(struct sim *sim, struct event *ev, struct timeval *tv)
+{
+    struct sim_entry *entry;
+    uint64_t left;
+
+    entry = hash_find(sim, SIM_TIMER, (uintptr_t) ev);
+    if (! entry) {
+	return -1;
+    }
+    left = entry->due > sim->now ? entry->due - sim->now : 0;
+    tv->tv_sec = left / 1000000;
+    tv->tv_usec = left % 1000000;
+    return 0;
+}
+
+/**
+ * @brief Starts a stub child for an action of a task
+ *
+ * @param sim pointer to the simulation
+ * @param task the name of the task
+ * @return the (virtual) pid of the child or -1 on error
+ */
+
+pid_t
+lmapd_sim_spawn(struct sim *sim, const char *task)
+{
+    const struct sim_stub *stub = find_stub(sim, task);
+    struct sim_entry *entry;
+
+    entry = calloc(1, sizeof(struct sim_entry));
+    if (! entry) {
+	lmap_err("failed to allocate memory");
+	return -1;
+    }
+    if (sim->pid == INT32_MAX) {
+	sim->pid = 0;
+    }
+    entry->kind = SIM_CHILD;
+    entry->key = (uintptr_t) ++sim->pid;
+    entry->due = sim->now + stub->duration;
+    entry->status = stub->status;
+    if (insert(sim, entry) == -1) {
+	free(entry);
+	return -1;
+    }
+    return (pid_t) entry->key;
+}
+
+/**
+ * @brief Terminates a stub child with a signal
+ *
+ * The child completes at the current virtual time with the negated
+ * signal number as its status, as lmapd records signaled children.
+ */
+
+void
+lmapd_sim_kill(struct sim *sim, pid_t pid, int signum)
+{
+    struct sim_entry *entry;
+
+    entry = hash_find(sim, SIM_CHILD, (uintptr_t) pid);
+    if (! entry || entry->due <= sim->now) {
+	return;
+    }
+    unlink_entry(sim, entry);
+    entry->due = sim->now;
+    entry->status = -signum;
+    /* the entry left a free slot, so it can always be queued again */
+    (void) insert(sim, entry);
+}
+
+/**
+ * @brief Returns the size of the result of an action of a task
+ */
+
+uint64_t
+lmapd_sim_bytes(struct sim *sim, const char *task)
+{
+    return find_stub(sim, task)->bytes;
+}
+
+/**
+ * @brief Advances the virtual clock to the next entry
+ *
+ * Removes the entry that is due next and advances the clock to the
+ * time it is due. A persistent timer is re-armed before it is
+ * returned. Once nothing is due before the end of the simulation,
+ * the clock is advanced to the end.
+ *
+ * @param sim pointer to the simulation
+ * @param ev set to the expired timer, or NULL for a child
+ * @param pid set to the pid of the completed child
+ * @param status set to the status of the completed child
+ * @return 1 if an entry was due, 0 if the simulation ended
+ */
+
+int
+lmapd_sim_next(struct sim *sim, struct event **ev, pid_t *pid, int *status)
+{
+    struct sim_entry *entry;
+
+    if (sim->len == 0 || sim->heap[0]->due > sim->end) {
+	sim->now = sim->end;
+	return 0;
+    }
+
+    entry = sim->heap[0];
+    unlink_entry(sim, entry);
+    if (entry->due > sim->now) {
+	sim->now = entry->due;
+    }
+
+    *ev = NULL;
+    *pid = 0;
+    *status = 0;
+    if (entry->kind == SIM_CHILD) {
+	*pid = (pid_t) entry->key;
+	*status = entry->status;
+	free(entry);
+	return 1;
+    }
+
+    *ev = (struct event *) entry->key;
+    if (entry->interval) {
+	entry->due += entry->interval;
+	if (insert(sim, entry) == -1) {
+	    free(entry);
+	}
+    } else {
+	free(entry);
+    }
+    return 1;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LMAPD_SIM_H
+#define LMAPD_SIM_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "lmapd.h"
+
+/*
+ * Simulation mode: with lmapd->sim set, lmapd_run() does not wait
+ * for real time. Timers go into a queue ordered by their due time on
+ * a virtual clock, which jumps to the next timer as soon as the
+ * previous callback returns. Actions are not forked; a stub child
+ * with the duration and exit status configured for the task of the
+ * action completes on the virtual clock. Durations are in
+ * microseconds.
+ */
+
+extern struct sim *lmapd_sim_new(time_t start, time_t duration);
+extern void lmapd_sim_free(struct sim *sim);
+extern int lmapd_sim_stub(struct sim *sim, const char *task,
+			  uint64_t duration, int status, uint64_t bytes);
+
+extern uint64_t lmapd_sim_now(struct sim *sim);
+extern void lmapd_sim_gettimeofday(struct sim *sim, struct timeval *tv);
+
+extern int lmapd_sim_timer_add(struct sim *sim, struct event *ev,
+			       const struct timeval *tv);
+extern void lmapd_sim_timer_del(struct sim *sim, struct event *ev);
+extern int lmapd_sim_timer_left(struct sim *sim, struct event *ev,
+				struct timeval *tv);
+
+extern pid_t lmapd_sim_spawn(struct sim *sim, const char *task);
+extern void lmapd_sim_kill(struct sim *sim, pid_t pid, int signum);
+extern uint64_t lmapd_sim_bytes(struct sim *sim, const char *task);
+
+extern int lmapd_sim_next(struct sim *sim, struct event **ev,
+			  pid_t *pid, int *status);
+
+#endif
@@ -0,0 +1,985 @@
+/*
+ * This file is part of lmapd.
+ *
+ * lmapd is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lmapd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lmapd. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A compiled snapshot of a parsed and validated config. The snapshot
+ * is a binary encoding of the object graph (without the runtime
+ * state of lmapd) preceded by a header carrying a key that identifies
+ * the config sources it was compiled from (see lmap_snapshot_key())
+ * and a checksum of the encoding. Loading a snapshot maps the file
+ * and rebuilds the object graph without parsing and validating the
+ * config again.
+ *
+ * Snapshots are only meant to be read by the lmapd binary that wrote
+ * them; the header records the version and the byte order and a
+ * snapshot that does not match exactly is ignored.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "lmap.h"
+#include "utils.h"
+#include "arena.h"
+#include "snapshot.h"
+#include "alloc.h"
+
+#define SNAPSHOT_MAGIC		"LMAPSNAP"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_BYTE_ORDER	0x01020304
+
+#define SNAPSHOT_NULL		UINT32_MAX
+
+#define FNV_OFFSET		14695981039346656037ULL
+#define FNV_PRIME		1099511628211ULL
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;			/* SNAPSHOT_VERSION */
+    uint32_t byte_order;		/* SNAPSHOT_BYTE_ORDER */
+    uint32_t lmap_version;		/* version of the writer */
+    uint32_t time_size;			/* sizeof(time_t) */
+    uint64_t key;			/* key of the config sources */
+    uint64_t size;			/* size of the encoding */
+    uint64_t checksum;			/* FNV-1a hash of the encoding */
+};
+
+static inline uint64_t
+fnv(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	h ^= p[i];
+	h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static int
+hash_file(const char *file, const struct stat *st, uint64_t *h)
+{
+    char buf[65536];
+    ssize_t n;
+    int fd;
+
+    *h = fnv(*h, file, strlen(file) + 1);
+    *h = fnv(*h, &st->st_size, sizeof(st->st_size));
+    *h = fnv(*h, &st->st_mtim, sizeof(st->st_mtim));
+
+    fd = open(file, O_RDONLY);
+    if (fd == -1) {
+	lmap_err("cannot open '%s': %s", file, strerror(errno));
+	return -1;
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+	*h = fnv(*h, buf, n);
+    }
+    (void) close(fd);
+    if (n < 0) {
+	lmap_err("cannot read '%s': %s", file, strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Computes the key of a set of config sources
+ *
+ * The key is a hash over the names, sizes, modification times and
+ * contents of the config files. For directories, all files that
+ * would be read by the config parsers (files with the suffix .xml or
+ * .json) are included in the order in which the parsers read them.
+ *
+ * @param paths NULL terminated array of config files or directories
+ * @param key The key to fill in
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_snapshot_key(const char **paths, uint64_t *key)
+{
+    char filepath[PATH_MAX];
+    struct dirent *dp;
+    struct stat st;
+    uint64_t h = FNV_OFFSET;
+    uint32_t v = (LMAP_VERSION_MAJOR << 16)
+	| (LMAP_VERSION_MINOR << 8) | LMAP_VERSION_PATCH;
+    int i, ret = 0;
+    DIR *dfd;
+
+    h = fnv(h, &v, sizeof(v));
+    for (i = 0; paths[i] && ret == 0; i++) {
+	if (stat(paths[i], &st) == -1) {
+	    lmap_err("cannot stat '%s': %s", paths[i], strerror(errno));
+	    return -1;
+	}
+	if (! S_ISDIR(st.st_mode)) {
+	    ret = hash_file(paths[i], &st, &h);
+	    continue;
+	}
+
+	dfd = opendir(paths[i]);
+	if (! dfd) {
+	    lmap_err("cannot read '%s': %s", paths[i], strerror(errno));
+	    return -1;
+	}
+	h = fnv(h, paths[i], strlen(paths[i]) + 1);
+	while (ret == 0 && (dp = readdir(dfd)) != NULL) {
+	    if (! lmap_has_suffix(dp->d_name, ".xml")
+		&& ! lmap_has_suffix(dp->d_name, ".json")) {
+		continue;
+	    }
+	    (void) snprintf(filepath, sizeof(filepath), "%s/%s",
+			    paths[i], dp->d_name);
+	    if (stat(filepath, &st) == -1) {
+		lmap_err("cannot stat '%s': %s", filepath, strerror(errno));
+		ret = -1;
+		break;
+	    }
+	    ret = hash_file(filepath, &st, &h);
+	}
+	(void) closedir(dfd);
+    }
+
+    *key = h;
+    return ret;
+}
+
+/*
+ * Encoding: integers are stored in host byte order, strings as a
+ * 32-bit length followed by the NUL terminated string (the length
+ * SNAPSHOT_NULL encodes a NULL pointer) and lists as a 32-bit count
+ * followed by the elements.
+ */
+
+struct writer {
+    char *buf;
+    size_t len;
+    size_t size;
+    int failed;
+};
+
+static void
+put(struct writer *w, const void *data, size_t len)
+{
+    char *p;
+    size_t size;
+
+    if (w->failed) {
+	return;
+    }
+    if (w->len + len > w->size) {
+	for (size = w->size ? w->size : 65536; size < w->len + len; size *= 2) ;
+	p = realloc(w->buf, size);
+	if (! p) {
+	    lmap_err("failed to allocate memory");
+	    w->failed = 1;
+	    return;
+	}
+	w->buf = p;
+	w->size = size;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void
+put_u8(struct writer *w, uint8_t v)
+{
+    put(w, &v, sizeof(v));
+}
+
+static void
+put_u32(struct writer *w, uint32_t v)
+{
+    put(w, &v, sizeof(v));
+}
+
+static void
+put_u64(struct writer *w, uint64_t v)
+{
+    put(w, &v, sizeof(v));
+}
+
+static void
+put_str(struct writer *w, const char *s)
+{
+    uint32_t len = s ? strlen(s) : SNAPSHOT_NULL;
+
+    put_u32(w, len);
+    if (s) {
+	put(w, s, len + 1);
+    }
+}
+
+static void
+put_tags(struct writer *w, struct tag *tags)
+{
+    struct tag *tag;
+    uint32_t n = 0;
+
+    for (tag = tags; tag; tag = tag->next) n++;
+    put_u32(w, n);
+    for (tag = tags; tag; tag = tag->next) {
+	put_str(w, tag->tag);
+    }
+}
+
+static void
+put_options(struct writer *w, struct option *options)
+{
+    struct option *option;
+    uint32_t n = 0;
+
+    for (option = options; option; option = option->next) n++;
+    put_u32(w, n);
+    for (option = options; option; option = option->next) {
+	put_str(w, option->id);
+	put_str(w, option->name);
+	put_str(w, option->value);
+    }
+}
+
+static void
+put_task(struct writer *w, struct task *task)
+{
+    struct registry *registry;
+    uint32_t n = 0;
+
+    put_str(w, task->name);
+    put_str(w, task->version);
+    put_str(w, task->program);
+    for (registry = task->registries; registry; registry = registry->next) n++;
+    put_u32(w, n);
+    for (registry = task->registries; registry; registry = registry->next) {
+	put_str(w, registry->uri);
+	put_tags(w, registry->roles);
+    }
+    put_options(w, task->options);
+    put_tags(w, task->tags);
+    put_u32(w, task->flags);
+}
+
+static void
+put_tasks(struct writer *w, struct task *tasks)
+{
+    struct task *task;
+    uint32_t n = 0;
+
+    for (task = tasks; task; task = task->next) n++;
+    put_u32(w, n);
+    for (task = tasks; task; task = task->next) {
+	put_task(w, task);
+    }
+}
+
+static void
+put_agent(struct writer *w, struct agent *agent)
+{
+    put_u8(w, agent != NULL);
+    if (! agent) {
+	return;
+    }
+    put_str(w, agent->agent_id);
+    put_str(w, agent->group_id);
+    put_str(w, agent->measurement_point);
+    put_u32(w, agent->report_agent_id);
+    put_u32(w, agent->report_group_id);
+    put_u32(w, agent->report_measurement_point);
+    put_u32(w, agent->controller_timeout);
+    put_u32(w, agent->flags);
+    put_u64(w, agent->report_date);
+    put_u64(w, agent->last_started);
+}
+
+static void
+put_capabilities(struct writer *w, struct capability *cap)
+{
+    put_u8(w, cap != NULL);
+    if (! cap) {
+	return;
+    }
+    put_str(w, cap->version);
+    put_tags(w, cap->tags);
+    put_tasks(w, cap->tasks);
+}
+
+static void
+put_supps(struct writer *w, struct supp *supps)
+{
+    struct supp *supp;
+    uint32_t n = 0;
+
+    for (supp = supps; supp; supp = supp->next) n++;
+    put_u32(w, n);
+    for (supp = supps; supp; supp = supp->next) {
+	put_str(w, supp->name);
+	put_str(w, supp->start);
+	put_str(w, supp->end);
+	put_tags(w, supp->match);
+	put_u32(w, supp->stop_running);
+	put_u32(w, supp->flags);
+	put_u8(w, supp->state);
+    }
+}
+
+static void
+put_events(struct writer *w, struct event *events)
+{
+    struct event *event;
+    uint32_t n = 0;
+
+    for (event = events; event; event = event->next) n++;
+    put_u32(w, n);
+    for (event = events; event; event = event->next) {
+	put_str(w, event->name);
+	put_u32(w, event->type);
+	put_u32(w, event->flags);
+	put_u64(w, event->last_invocation);
+	put_u32(w, event->interval);
+	put_u64(w, event->start);
+	put_u64(w, event->end);
+	put_u32(w, event->random_spread);
+	put_u32(w, event->cycle_interval);
+	put_u32(w, event->months);
+	put_u32(w, event->days_of_month);
+	put_u32(w, event->days_of_week);
+	put_u32(w, event->hours);
+	put_u64(w, event->minutes);
+	put_u64(w, event->seconds);
+	put_u32(w, (uint16_t) event->timezone_offset);
+    }
+}
+
+static void
+put_action(struct writer *w, struct action *action)
+{
+    put_str(w, action->name);
+    put_str(w, action->task);
+    put_tags(w, action->destinations);
+    put_options(w, action->options);
+    put_tags(w, action->tags);
+    put_tags(w, action->suppression_tags);
+    put_u8(w, action->state);
+    put_u64(w, action->storage);
+    put_u64(w, action->last_invocation);
+    put_u64(w, action->last_completion);
+    put_u32(w, action->last_status);
+    put_str(w, action->last_message);
+    put_u64(w, action->last_failed_completion);
+    put_u32(w, action->last_failed_status);
+    put_str(w, action->last_failed_message);
+    put_u32(w, action->cnt_invocations);
+    put_u32(w, action->cnt_failures);
+    put_u32(w, action->cnt_suppressions);
+    put_u32(w, action->cnt_overlaps);
+}
+
+static void
+put_schedules(struct writer *w, struct schedule *schedules)
+{
+    struct schedule *schedule;
+    struct action *action;
+    uint32_t n = 0;
+
+    for (schedule = schedules; schedule; schedule = schedule->next) n++;
+    put_u32(w, n);
+    for (schedule = schedules; schedule; schedule = schedule->next) {
+	put_str(w, schedule->name);
+	put_str(w, schedule->start);
+	put_str(w, schedule->end);
+	put_u64(w, schedule->cycle_number);
+	put_u64(w, schedule->duration);
+	put_u8(w, schedule->mode);
+	put_u32(w, schedule->flags);
+	put_tags(w, schedule->tags);
+	put_tags(w, schedule->suppression_tags);
+	for (n = 0, action = schedule->actions; action; action = action->next) n++;
+	put_u32(w, n);
+	for (action = schedule->actions; action; action = action->next) {
+	    put_action(w, action);
+	}
+	put_u8(w, schedule->state);
+	put_u64(w, schedule->storage);
+	put_u32(w, schedule->cnt_invocations);
+	put_u32(w, schedule->cnt_failures);
+	put_u32(w, schedule->cnt_suppressions);
+	put_u32(w, schedule->cnt_overlaps);
+	put_u64(w, schedule->last_invocation);
+    }
+}
+
+/**
+ * @brief Writes a snapshot of a config
+ *
+ * The snapshot is written to a temporary file that is renamed to the
+ * snapshot file once it is complete, i.e., a reader never sees a
+ * partially written snapshot. The config should have been validated
+ * since a snapshot is loaded without validating it again.
+ *
+ * @param lmap The config
+ * @param file The snapshot file
+ * @param key The key of the config sources
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_snapshot_save(struct lmap *lmap, const char *file, uint64_t key)
+{
+    struct writer w;
+    struct snapshot_header hdr;
+    char tmp[PATH_MAX];
+    FILE *f;
+    int ret = -1;
+
+    memset(&w, 0, sizeof(w));
+    put_agent(&w, lmap->agent);
+    put_capabilities(&w, lmap->capabilities);
+    put_supps(&w, lmap->supps);
+    put_tasks(&w, lmap->tasks);
+    put_events(&w, lmap->events);
+    put_schedules(&w, lmap->schedules);
+    if (w.failed) {
+	goto exit;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+    hdr.lmap_version = (LMAP_VERSION_MAJOR << 16)
+	| (LMAP_VERSION_MINOR << 8) | LMAP_VERSION_PATCH;
+    hdr.time_size = sizeof(time_t);
+    hdr.key = key;
+    hdr.size = w.len;
+    hdr.checksum = fnv(FNV_OFFSET, w.buf, w.len);
+
+    (void) snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    f = fopen(tmp, "w");
+    if (! f) {
+	lmap_err("cannot open '%s': %s", tmp, strerror(errno));
+	goto exit;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+	|| (w.len && fwrite(w.buf, w.len, 1, f) != 1)) {
+	lmap_err("cannot write '%s': %s", tmp, strerror(errno));
+	(void) fclose(f);
+	(void) unlink(tmp);
+	goto exit;
+    }
+    if (fclose(f) != 0) {
+	lmap_err("cannot write '%s': %s", tmp, strerror(errno));
+	(void) unlink(tmp);
+	goto exit;
+    }
+    if (rename(tmp, file) == -1) {
+	lmap_err("cannot rename '%s': %s", tmp, strerror(errno));
+	(void) unlink(tmp);
+	goto exit;
+    }
+    ret = 0;
+
+exit:
+    free(w.buf);
+    return ret;
+}
+
+struct reader {
+    const char *p;
+    const char *end;
+    int failed;
+};
+
+static void
+get(struct reader *r, void *data, size_t len)
+{
+    if (r->failed || (size_t) (r->end - r->p) < len) {
+	r->failed = 1;
+	memset(data, 0, len);
+	return;
+    }
+    memcpy(data, r->p, len);
+    r->p += len;
+}
+
+static uint8_t
+get_u8(struct reader *r)
+{
+    uint8_t v;
+
+    get(r, &v, sizeof(v));
+    return v;
+}
+
+static uint32_t
+get_u32(struct reader *r)
+{
+    uint32_t v;
+
+    get(r, &v, sizeof(v));
+    return v;
+}
+
+static uint64_t
+get_u64(struct reader *r)
+{
+    uint64_t v;
+
+    get(r, &v, sizeof(v));
+    return v;
+}
+
+/*
+ * Returns a pointer to a string in the mapped snapshot. The string
+ * is NUL terminated (this is checked) and must be copied.
+ */
+
+static const char *
+get_str(struct reader *r)
+{
+    uint32_t len = get_u32(r);
+    const char *s;
+
+    if (r->failed || len == SNAPSHOT_NULL) {
+	return NULL;
+    }
+    if ((size_t) (r->end - r->p) <= len || r->p[len] != 0) {
+	r->failed = 1;
+	return NULL;
+    }
+    s = r->p;
+    r->p += len + 1;
+    return s;
+}
+
+/*
+ * Copies a string into the arena of the object owning dp. Strings of
+ * a snapshot have been validated when the snapshot was written, hence
+ * the setters of the data model are bypassed. The copy is counted
+ * like the strings of set_string() in data.c since it is released by
+ * the same code.
+ */
+
+static void
+dup_str(struct reader *r, struct lmap_arena *arena, char **dp)
+{
+    const char *s = get_str(r);
+
+    if (! s) {
+	return;
+    }
+    *dp = arena ? lmap_arena_strdup(arena, s) : strdup(s);
+    if (! *dp) {
+	lmap_err("failed to allocate memory");
+	r->failed = 1;
+	return;
+    }
+    LMAP_ALLOC_COUNT(LMAP_ALLOC_STRING, 1, strlen(s) + 1);
+}
+
+static void
+get_tags(struct reader *r, void *obj,
+	 int (*add)(void *obj, const char *value))
+{
+    uint32_t i, n = get_u32(r);
+    const char *s;
+
+    for (i = 0; i < n && ! r->failed; i++) {
+	s = get_str(r);
+	if (! s || add(obj, s) != 0) {
+	    r->failed = 1;
+	}
+    }
+}
+
+static void
+get_options(struct reader *r, void *obj,
+	    int (*add)(void *obj, struct option *option))
+{
+    uint32_t i, n = get_u32(r);
+    struct option *option;
+
+    for (i = 0; i < n && ! r->failed; i++) {
+	option = lmap_option_new();
+	if (! option) {
+	    r->failed = 1;
+	    break;
+	}
+	dup_str(r, option->pool, &option->id);
+	dup_str(r, option->pool, &option->name);
+	dup_str(r, option->pool, &option->value);
+	if (r->failed || add(obj, option) != 0) {
+	    lmap_option_free(option);
+	    r->failed = 1;
+	}
+    }
+}
+
+/*
+ * The list functions of the data model take typed objects; these
+ * casts allow a single decoder per list type.
+ */
+
+#define ADD_TAG(f)	((int (*)(void *, const char *)) (f))
+#define ADD_OPTION(f)	((int (*)(void *, struct option *)) (f))
+
+static struct task *
+get_task(struct reader *r)
+{
+    struct task *task;
+    struct registry *registry;
+    uint32_t i, n;
+
+    task = lmap_task_new();
+    if (! task) {
+	r->failed = 1;
+	return NULL;
+    }
+    dup_str(r, task->pool, &task->name);
+    dup_str(r, task->pool, &task->version);
+    dup_str(r, task->pool, &task->program);
+    n = get_u32(r);
+    for (i = 0; i < n && ! r->failed; i++) {
+	registry = lmap_registry_new();
+	if (! registry) {
+	    r->failed = 1;
+	    break;
+	}
+	dup_str(r, registry->pool, &registry->uri);
+	get_tags(r, registry, ADD_TAG(lmap_registry_add_role));
+	if (r->failed || lmap_task_add_registry(task, registry) != 0) {
+	    lmap_registry_free(registry);
+	    r->failed = 1;
+	}
+    }
+    get_options(r, task, ADD_OPTION(lmap_task_add_option));
+    get_tags(r, task, ADD_TAG(lmap_task_add_tag));
+    task->flags = get_u32(r);
+    if (r->failed) {
+	lmap_task_free(task);
+	return NULL;
+    }
+    return task;
+}
+
+static void
+get_agent(struct reader *r, struct lmap *lmap)
+{
+    struct agent *agent;
+
+    if (! get_u8(r)) {
+	return;
+    }
+    agent = lmap_agent_new();
+    if (! agent) {
+	r->failed = 1;
+	return;
+    }
+    lmap->agent = agent;
+    dup_str(r, agent->pool, &agent->agent_id);
+    dup_str(r, agent->pool, &agent->group_id);
+    dup_str(r, agent->pool, &agent->measurement_point);
+    agent->report_agent_id = get_u32(r);
+    agent->report_group_id = get_u32(r);
+    agent->report_measurement_point = get_u32(r);
+    agent->controller_timeout = get_u32(r);
+    agent->flags = get_u32(r);
+    agent->report_date = get_u64(r);
+    agent->last_started = get_u64(r);
+}
+
+static void
+get_capabilities(struct reader *r, struct lmap *lmap)
+{
+    struct capability *cap;
+    struct task *task;
+    uint32_t i, n;
+
+    if (! get_u8(r)) {
+	return;
+    }
+    cap = lmap_capability_new();
+    if (! cap) {
+	r->failed = 1;
+	return;
+    }
+    lmap->capabilities = cap;
+    dup_str(r, cap->pool, &cap->version);
+    get_tags(r, cap, ADD_TAG(lmap_capability_add_tag));
+    n = get_u32(r);
+    for (i = 0; i < n && ! r->failed; i++) {
+	task = get_task(r);
+	if (task && lmap_capability_add_task(cap, task) != 0) {
+	    lmap_task_free(task);
+	    r->failed = 1;
+	}
+    }
+}
+
+static void
+get_supps(struct reader *r, struct lmap *lmap)
+{
+    struct supp *supp;
+    uint32_t i, n = get_u32(r);
+
+    for (i = 0; i < n && ! r->failed; i++) {
+	supp = lmap_supp_new();
+	if (! supp) {
+	    r->failed = 1;
+	    break;
+	}
+	dup_str(r, supp->pool, &supp->name);
+	dup_str(r, supp->pool, &supp->start);
+	dup_str(r, supp->pool, &supp->end);
+	get_tags(r, supp, ADD_TAG(lmap_supp_add_match));
+	supp->stop_running = get_u32(r);
+	supp->flags = get_u32(r);
+	supp->state = get_u8(r);
+	if (r->failed || lmap_add_supp(lmap, supp) != 0) {
+	    lmap_supp_free(supp);
+	    r->failed = 1;
+	}
+    }
+}
+
+static void
+get_tasks(struct reader *r, struct lmap *lmap)
+{
+    struct task *task;
+    uint32_t i, n = get_u32(r);
+
+    for (i = 0; i < n && ! r->failed; i++) {
+	task = get_task(r);
+	if (task && lmap_add_task(lmap, task) != 0) {
+	    lmap_task_free(task);
+	    r->failed = 1;
+	}
+    }
+}
+
+static void
+get_events(struct reader *r, struct lmap *lmap)
+{
+    struct event *event;
+    uint32_t i, n = get_u32(r);
+
+    for (i = 0; i < n && ! r->failed; i++) {
+	event = lmap_event_new();
+	if (! event) {
+	    r->failed = 1;
+	    break;
+	}
+	dup_str(r, event->pool, &event->name);
+	event->type = get_u32(r);
+	event->flags = get_u32(r);
+	event->last_invocation = get_u64(r);
+	event->interval = get_u32(r);
+	event->start = get_u64(r);
+	event->end = get_u64(r);
+	event->random_spread = get_u32(r);
+	event->cycle_interval = get_u32(r);
+	event->months = get_u32(r);
+	event->days_of_month = get_u32(r);
+	event->days_of_week = get_u32(r);
+	event->hours = get_u32(r);
+	event->minutes = get_u64(r);
+	event->seconds = get_u64(r);
+	event->timezone_offset = (int16_t) get_u32(r);
+	if (r->failed || lmap_add_event(lmap, event) != 0) {
+	    lmap_event_free(event);
+	    r->failed = 1;
+	}
+    }
+}
+
+static struct action *
+get_action(struct reader *r)
+{
+    struct action *action;
+
+    action = lmap_action_new();
+    if (! action) {
+	r->failed = 1;
+	return NULL;
+    }
+    dup_str(r, action->pool, &action->name);
+    dup_str(r, action->pool, &action->task);
+    get_tags(r, action, ADD_TAG(lmap_action_add_destination));
+    get_options(r, action, ADD_OPTION(lmap_action_add_option));
+    get_tags(r, action, ADD_TAG(lmap_action_add_tag));
+    get_tags(r, action, ADD_TAG(lmap_action_add_suppression_tag));
+    action->state = get_u8(r);
+    action->storage = get_u64(r);
+    action->last_invocation = get_u64(r);
+    action->last_completion = get_u64(r);
+    action->last_status = get_u32(r);
+    dup_str(r, action->pool, &action->last_message);
+    action->last_failed_completion = get_u64(r);
+    action->last_failed_status = get_u32(r);
+    dup_str(r, action->pool, &action->last_failed_message);
+    action->cnt_invocations = get_u32(r);
+    action->cnt_failures = get_u32(r);
+    action->cnt_suppressions = get_u32(r);
+    action->cnt_overlaps = get_u32(r);
+    if (r->failed) {
+	lmap_action_free(action);
+	return NULL;
+    }
+    return action;
+}
+
+static void
+get_schedules(struct reader *r, struct lmap *lmap)
+{
+    struct schedule *schedule;
+    struct action *action;
+    uint32_t i, j, n = get_u32(r), m;
+
+    for (i = 0; i < n && ! r->failed; i++) {
+	schedule = lmap_schedule_new();
+	if (! schedule) {
+	    r->failed = 1;
+	    break;
+	}
+	dup_str(r, schedule->pool, &schedule->name);
+	dup_str(r, schedule->pool, &schedule->start);
+	dup_str(r, schedule->pool, &schedule->end);
+	schedule->cycle_number = get_u64(r);
+	schedule->duration = get_u64(r);
+	schedule->mode = get_u8(r);
+	schedule->flags = get_u32(r);
+	get_tags(r, schedule, ADD_TAG(lmap_schedule_add_tag));
+	get_tags(r, schedule, ADD_TAG(lmap_schedule_add_suppression_tag));
+	m = get_u32(r);
+	for (j = 0; j < m && ! r->failed; j++) {
+	    action = get_action(r);
+	    if (action && lmap_schedule_add_action(schedule, action) != 0) {
+		lmap_action_free(action);
+		r->failed = 1;
+	    }
+	}
+	schedule->state = get_u8(r);
+	schedule->storage = get_u64(r);
+	schedule->cnt_invocations = get_u32(r);
+	schedule->cnt_failures = get_u32(r);
+	schedule->cnt_suppressions = get_u32(r);
+	schedule->cnt_overlaps = get_u32(r);
+	schedule->last_invocation = get_u64(r);
+	if (r->failed || lmap_add_schedule(lmap, schedule) != 0) {
+	    lmap_schedule_free(schedule);
+	    r->failed = 1;
+	}
+    }
+}
+
+/**
+ * @brief Loads a snapshot of a config
+ *
+ * Loads a snapshot written by lmap_snapshot_save() into an empty
+ * lmap if the snapshot exists, is intact and was compiled from the
+ * config sources identified by key. The objects are allocated like
+ * all other objects of the data model, i.e., from the arena in use
+ * by the calling thread. If loading fails, the lmap may have been
+ * partially filled and should be released.
+ *
+ * @param lmap The lmap to load the config into
+ * @param file The snapshot file
+ * @param key The key of the config sources
+ * @return 0 on success, 1 if there is no usable snapshot, -1 on error
+ */
+
+int
+lmap_snapshot_load(struct lmap *lmap, const char *file, uint64_t key)
+{
+    struct snapshot_header hdr;
+    struct reader r;
+    struct stat st;
+    void *map;
+    int fd, ret = 1;
+
+    fd = open(file, O_RDONLY);
+    if (fd == -1) {
+	if (errno != ENOENT) {
+	    lmap_wrn("cannot open snapshot '%s': %s", file, strerror(errno));
+	}
+	return 1;
+    }
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(hdr)) {
+	lmap_wrn("ignoring truncated snapshot '%s'", file);
+	(void) close(fd);
+	return 1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void) close(fd);
+    if (map == MAP_FAILED) {
+	lmap_wrn("cannot map snapshot '%s': %s", file, strerror(errno));
+	return 1;
+    }
+
+    memcpy(&hdr, map, sizeof(hdr));
+    if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic))
+	|| hdr.version != SNAPSHOT_VERSION
+	|| hdr.byte_order != SNAPSHOT_BYTE_ORDER
+	|| hdr.lmap_version != (uint32_t) ((LMAP_VERSION_MAJOR << 16)
+			| (LMAP_VERSION_MINOR << 8) | LMAP_VERSION_PATCH)
+	|| hdr.time_size != sizeof(time_t)) {
+	lmap_wrn("ignoring incompatible snapshot '%s'", file);
+	goto exit;
+    }
+    if (hdr.key != key) {
+	lmap_dbg("snapshot '%s' is out of date", file);
+	goto exit;
+    }
+    if (hdr.size != st.st_size - sizeof(hdr)
+	|| hdr.checksum != fnv(FNV_OFFSET, (char *) map + sizeof(hdr), hdr.size)) {
+	lmap_wrn("ignoring corrupted snapshot '%s'", file);
+	goto exit;
+    }
+
+    r.p = (char *) map + sizeof(hdr);
+    r.end = r.p + hdr.size;
+    r.failed = 0;
+    get_agent(&r, lmap);
+    get_capabilities(&r, lmap);
+    get_supps(&r, lmap);
+    get_tasks(&r, lmap);
+    get_events(&r, lmap);
+    get_schedules(&r, lmap);
+    if (r.failed || r.p != r.end) {
+	lmap_err("cannot load snapshot '%s'", file);
+	ret = -1;
+	goto exit;
+    }
+    ret = 0;
+
+exit:
+    (void) munmap(map, st.st_size);
+    return ret;
+}
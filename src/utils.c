@@ -16,6 +16,10 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "lmap.h"
 #include "utils.h"
@@ -101,3 +105,343 @@ void lmap_log(int level, const char *func, const char *format, ...)
     lmap_vlog(level, func, format, args);
     va_end(args);
 }
+
+
+/**
+ * @brief Writer passing data to a file descriptor
+ *
+ * A writer (see lmap_write_func) that writes all data to the file
+ * descriptor pointed to by ctx, restarting interrupted and partial
+ * writes.
+ *
+ * @param ctx Pointer to an int holding the file descriptor
+ * @param buf The data to write
+ * @param len The number of bytes in buf
+ * @return 0 on success, -1 on error
+ */
+
+int lmap_write_fd(void *ctx, const char *buf, size_t len)
+{
+    int fd = *(int *) ctx;
+    ssize_t n;
+
+    while (len > 0) {
+	n = write(fd, buf, len);
+	if (n == -1) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    lmap_err("write failed: %s", strerror(errno));
+	    return -1;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Conversions between days since the epoch and civil dates in the
+ * proleptic Gregorian calendar (see Howard Hinnant's date
+ * algorithms). They work for negative values as well.
+ */
+
+static int64_t
+days_from_civil(int64_t y, int m, int d)
+{
+    int64_t era, yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void
+civil_from_days(int64_t z, int64_t *y, int *m, int *d)
+{
+    int64_t era, doe, yoe, doy, mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+static int
+utc_offset(time_t t, long *offset)
+{
+    struct tm tm;
+
+    if (! localtime_r(&t, &tm)) {
+	return -1;
+    }
+    *offset = days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday)
+	* 86400 + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec - t;
+    return 0;
+}
+
+/*
+ * The UTC offset of the last hour we formatted a timestamp for. A
+ * report or state document mostly contains timestamps of a few
+ * hours, so this saves almost all localtime() calls.
+ */
+
+static __thread struct {
+    time_t hour;
+    long offset;
+    int valid;
+} tz_cache;
+
+static char *
+put2(char *p, int v)
+{
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+    return p + 2;
+}
+
+/**
+ * @brief Formats a datetime with the local UTC offset
+ *
+ * Formats t as an RFC 3339 datetime in local time including the UTC
+ * offset, e.g., 2016-12-20T08:17:31+01:00, which is the format used
+ * by the renderers. The UTC offset is cached per hour (unless the
+ * offset changes within the hour) and the digits are written
+ * directly, so that most calls do not need localtime() or
+ * strftime(). The cache is not invalidated if TZ changes.
+ *
+ * @param t The time to format
+ * @param buf The buffer receiving the formatted datetime
+ * @param len The size of buf (at least LMAP_DATETIME_LEN)
+ * @return the length of the formatted datetime or -1 on error
+ */
+
+int lmap_format_datetime(time_t t, char *buf, size_t len)
+{
+    time_t hour, local;
+    long offset, end;
+    int64_t days, year;
+    int month, day, secs;
+    char *p = buf;
+
+    if (len < LMAP_DATETIME_LEN) {
+	return -1;
+    }
+
+    hour = t - ((t % 3600) + 3600) % 3600;
+    if (tz_cache.valid && tz_cache.hour == hour) {
+	offset = tz_cache.offset;
+    } else if (utc_offset(hour, &offset) == 0
+	       && utc_offset(hour + 3599, &end) == 0 && offset == end) {
+	tz_cache.hour = hour;
+	tz_cache.offset = offset;
+	tz_cache.valid = 1;
+    } else if (utc_offset(t, &offset) == -1) {
+	return -1;
+    }
+
+    local = t + offset;
+    days = local / 86400;
+    secs = local % 86400;
+    if (secs < 0) {
+	secs += 86400;
+	days--;
+    }
+    civil_from_days(days, &year, &month, &day);
+    if (year < 0 || year > 9999) {
+	return -1;
+    }
+
+    p = put2(p, year / 100);
+    p = put2(p, year % 100);
+    *p++ = '-';
+    p = put2(p, month);
+    *p++ = '-';
+    p = put2(p, day);
+    *p++ = 'T';
+    p = put2(p, secs / 3600);
+    *p++ = ':';
+    p = put2(p, secs / 60 % 60);
+    *p++ = ':';
+    p = put2(p, secs % 60);
+    *p++ = offset < 0 ? '-' : '+';
+    offset = offset < 0 ? -offset : offset;
+    p = put2(p, offset / 3600);
+    *p++ = ':';
+    p = put2(p, offset / 60 % 60);
+    *p = 0;
+    return p - buf;
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static int
+count_digits(uint64_t v)
+{
+    int n = 1;
+
+    for (;;) {
+	if (v < 10) return n;
+	if (v < 100) return n + 1;
+	if (v < 1000) return n + 2;
+	if (v < 10000) return n + 3;
+	v /= 10000;
+	n += 4;
+    }
+}
+
+/**
+ * @brief Formats an unsigned integer in decimal
+ *
+ * Writes the decimal representation of v followed by a NUL into buf,
+ * two digits at a time using a lookup table.
+ *
+ * @param v The value to format
+ * @param buf The buffer receiving the digits (at least LMAP_INT_LEN)
+ * @return the number of digits written
+ */
+
+int lmap_u64toa(uint64_t v, char *buf)
+{
+    int len = count_digits(v);
+    char *p = buf + len;
+
+    *p = 0;
+    while (v >= 100) {
+	const char *d = digit_pairs + (v % 100) * 2;
+	v /= 100;
+	*--p = d[1];
+	*--p = d[0];
+    }
+    if (v >= 10) {
+	*--p = digit_pairs[v * 2 + 1];
+	*--p = digit_pairs[v * 2];
+    } else {
+	*--p = '0' + v;
+    }
+    return len;
+}
+
+/**
+ * @brief Formats a signed integer in decimal
+ *
+ * @param v The value to format
+ * @param buf The buffer receiving the digits (at least LMAP_INT_LEN)
+ * @return the number of characters written
+ */
+
+int lmap_i64toa(int64_t v, char *buf)
+{
+    if (v < 0) {
+	*buf = '-';
+	return 1 + lmap_u64toa(-(uint64_t) v, buf + 1);
+    }
+    return lmap_u64toa(v, buf);
+}
+
+/**
+ * @brief Parses an unsigned decimal integer
+ *
+ * Parses an optional '+' followed by decimal digits, without white
+ * space. Unlike strtoumax(), values out of range and negative values
+ * are rejected instead of being clamped or wrapped.
+ *
+ * @param s The string to parse
+ * @param max The largest acceptable value
+ * @param up Pointer to the result
+ * @return 0 on success, -1 on error
+ */
+
+int lmap_atou64(const char *s, uint64_t max, uint64_t *up)
+{
+    uint64_t u = 0;
+    unsigned d;
+
+    if (*s == '+') {
+	s++;
+    }
+    if (! *s) {
+	return -1;
+    }
+    for (; *s; s++) {
+	d = (unsigned char) *s - '0';
+	if (d > 9 || u > max / 10 || d > max - u * 10) {
+	    return -1;
+	}
+	u = u * 10 + d;
+    }
+    *up = u;
+    return 0;
+}
+
+/**
+ * @brief Parses a signed decimal integer
+ *
+ * Parses an optional '-' or '+' followed by decimal digits, see
+ * lmap_atou64(); only one sign is accepted. The result must be in
+ * the range [min, max].
+ *
+ * @param s The string to parse
+ * @param min The smallest acceptable value
+ * @param max The largest acceptable value
+ * @param ip Pointer to the result
+ * @return 0 on success, -1 on error
+ */
+
+int lmap_atoi64(const char *s, int64_t min, int64_t max, int64_t *ip)
+{
+    uint64_t u;
+    int64_t i;
+
+    if (*s == '-') {
+	if (s[1] == '+'
+	    || lmap_atou64(s + 1, min < 0 ? -(uint64_t) min : 0, &u) == -1) {
+	    return -1;
+	}
+	i = u ? -(int64_t) (u - 1) - 1 : 0;
+    } else {
+	if (lmap_atou64(s, max > 0 ? (uint64_t) max : 0, &u) == -1) {
+	    return -1;
+	}
+	i = u;
+    }
+    if (i < min || i > max) {
+	return -1;
+    }
+    *ip = i;
+    return 0;
+}
+
+/**
+ * @brief Tests whether a file name ends with a suffix
+ *
+ * @param name The file name
+ * @param suffix The suffix (e.g. ".xml")
+ * @return 1 if name ends with suffix and has a non-empty basename,
+ * 0 otherwise
+ */
+
+int lmap_has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name), slen = strlen(suffix);
+
+    return len > slen && ! strcmp(name + len - slen, suffix);
+}
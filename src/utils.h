@@ -20,6 +20,9 @@
 
 #include <syslog.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdint.h>
 
 /*
  * The following macros are the most frequently used interface to the
@@ -61,4 +64,55 @@ extern void lmap_set_log_handler(lmap_log_handler handler);
 extern void lmap_vlog_default(int level, const char *func,
 			      const char *format, va_list ap);
 
+/*
+ * Non-blocking log handler (see log.c): messages go through a ring
+ * buffer drained by a writer thread, every call site (format string)
+ * may log LMAP_LOG_BURST messages per LMAP_LOG_INTERVAL seconds and
+ * lines can be rendered as text, key=value pairs or JSON.
+ */
+
+#define LMAP_LOG_FORMAT_TEXT	0
+#define LMAP_LOG_FORMAT_KV	1
+#define LMAP_LOG_FORMAT_JSON	2
+
+#define LMAP_LOG_BURST		20
+#define LMAP_LOG_INTERVAL	60
+
+extern void lmap_vlog_ring(int level, const char *func,
+			   const char *format, va_list ap);
+extern int lmap_log_start(void);
+extern void lmap_log_stop(void);
+extern void lmap_log_set_format(int format);
+extern int lmap_log_parse_format(const char *name);
+extern void lmap_log_set_rate(unsigned int burst, unsigned int interval);
+extern void lmap_log_set_output(int (*func)(void *ctx, const char *buf,
+					    size_t len), void *ctx);
+extern void lmap_log_stats(uint64_t *suppressed, uint64_t *dropped);
+
+extern int lmap_write_fd(void *ctx, const char *buf, size_t len);
+
+/*
+ * Datetimes are rendered as 2016-12-20T08:17:31+01:00, which needs
+ * LMAP_DATETIME_LEN bytes including the terminating NUL.
+ */
+
+#define LMAP_DATETIME_LEN 26
+
+extern int lmap_format_datetime(time_t t, char *buf, size_t len);
+
+/*
+ * Conversions of integers to and from decimal strings used for the
+ * numeric leaves. LMAP_INT_LEN holds any 64-bit integer including
+ * the sign and the terminating NUL.
+ */
+
+#define LMAP_INT_LEN 21
+
+extern int lmap_u64toa(uint64_t v, char *buf);
+extern int lmap_i64toa(int64_t v, char *buf);
+extern int lmap_atou64(const char *s, uint64_t max, uint64_t *up);
+extern int lmap_atoi64(const char *s, int64_t min, int64_t max, int64_t *ip);
+
+extern int lmap_has_suffix(const char *name, const char *suffix);
+
 #endif
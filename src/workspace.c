@@ -36,6 +36,7 @@
 #include "utils.h"
 #include "csv.h"
 #include "workspace.h"
+#include "probes.h"
 
 static const char delimiter = ';';
 
@@ -248,6 +249,7 @@ lmapd_workspace_action_clean(struct lmapd *lmapd, struct action *action)
     if (!action || !action->workspace) {
 	return 0;
     }
+    LMAPD_PROBE2(workspace_clean, action->name, action->workspace);
 
     dfd = opendir(action->workspace);
     if (!dfd) {
@@ -293,6 +295,7 @@ lmapd_workspace_action_move(struct lmapd *lmapd, struct schedule *schedule,
     char newfilepath[PATH_MAX];
     struct dirent *dp;
     DIR *dfd;
+    int moved = 0;
 
     assert(lmapd);
     (void) lmapd;
@@ -320,10 +323,15 @@ lmapd_workspace_action_move(struct lmapd *lmapd, struct schedule *schedule,
 	if (link(oldfilepath, newfilepath) < 0) {
 	    lmap_err("failed to move '%s' to '%s'", oldfilepath, newfilepath);
 	    ret = -1;
+	    continue;
 	}
+	moved++;
     }
     (void) closedir(dfd);
 
+    LMAPD_PROBE4(action_move, schedule->name, action->name,
+		 destination->name, moved);
+
     return ret;
 }
 
@@ -524,8 +532,6 @@ read_table(int fd)
     int inrow = 0;
     FILE *file;
     struct table *tab;
-    struct row *row = NULL;
-    struct value *val;
 
     file = fdopen(fd, "r");
     if (! file) {
@@ -548,27 +554,15 @@ read_table(int fd)
 	    inrow = 0;
 	    continue;
 	}
-	if (!inrow) {
-	    row = lmap_row_new();
-	    if (! row) {
-		lmap_table_free(tab);
-		if (s) free(s);
-		(void) fclose(file);
-		return NULL;
-	    }
-	    lmap_table_add_row(tab, row);
-	    inrow++;
-	}
-	val = lmap_value_new();
-	if (! val) {
+	if ((!inrow && lmap_table_new_row(tab) == -1)
+	    || lmap_table_add_value(tab, s) == -1) {
 	    lmap_table_free(tab);
-	    if (s) free(s);
+	    free(s);
 	    (void) fclose(file);
 	    return NULL;
 	}
-	lmap_value_set_value(val, s);
-	lmap_row_add_value(row, val);
-	if (s) free(s);
+	inrow = 1;
+	free(s);
     }
 
     (void) fclose(file);
@@ -652,56 +646,89 @@ read_result(int fd)
     return res;
 }
 
+static int
+meta_filter(const struct dirent *dp)
+{
+    size_t len = strlen(dp->d_name);
+
+    return (len >= 5 && ! strcmp(dp->d_name + len - 5, ".meta"));
+}
+
+/**
+ * @brief Reads the results found in the current directory
+ *
+ * Reads all results (pairs of .meta and .data files) found in the
+ * current working directory and adds them to the lmap. The results
+ * are read in lexicographic file name order, i.e., in the order of
+ * the invocation time of the actions that produced them. Each result
+ * remembers the absolute path of the files it was read from (without
+ * the .meta / .data suffix) so that the files can be removed once
+ * the result has been delivered.
+ *
+ * @param lmapd pointer to the struct lmapd
+ * @return 0 on success, -1 on error
+ */
+
 int
 lmapd_workspace_read_results(struct lmapd *lmapd)
 {
     char *p;
-    struct dirent *dp;
-    DIR *dfd;
+    struct dirent **namelist;
     struct table *tab;
     struct result *res;
+    char cwd[PATH_MAX];
+    char path[PATH_MAX];
+    int i, n;
 
-    dfd = opendir(".");
-    if (!dfd) {
+    if (! getcwd(cwd, sizeof(cwd))) {
+	lmap_err("failed to obtain current working directory: %s",
+		 strerror(errno));
+	return -1;
+    }
+
+    n = scandir(".", &namelist, meta_filter, alphasort);
+    if (n == -1) {
 	lmap_err("failed to open workspace directory '%s'", ".");
 	return -1;
     }
 
-    while ((dp = readdir(dfd)) != NULL) {
-	if (strlen(dp->d_name) < 5) {
-	    continue;
-	}
+    for (i = 0; i < n; i++) {
+	struct dirent *dp = namelist[i];
+	int mfd, dfd;
+
 	p = strrchr(dp->d_name, '.');
-	if (! p) {
-	    continue;
+	mfd = open(dp->d_name, O_RDONLY);
+	if (mfd == -1) {
+	    lmap_err("failed to open meta file '%s': %s",
+		     dp->d_name, strerror(errno));
+	    goto next;
 	}
-
-	if (!strcmp(p, ".meta")) {
-	    int mfd, dfd;
-	    mfd = open(dp->d_name, O_RDONLY);
-	    if (mfd == -1) {
-		lmap_err("failed to open meta file '%s': %s",
-			 dp->d_name, strerror(errno));
-		continue;
-	    }
-	    strcpy(p, ".data");
-	    dfd = open(dp->d_name, O_RDONLY);
-	    if (dfd == -1) {
-		lmap_err("failed to open data file '%s': %s",
-			 dp->d_name, strerror(errno));
-		(void) close(mfd);
-		continue;
+	strcpy(p, ".data");
+	dfd = open(dp->d_name, O_RDONLY);
+	if (dfd == -1) {
+	    lmap_err("failed to open data file '%s': %s",
+		     dp->d_name, strerror(errno));
+	    (void) close(mfd);
+	    goto next;
+	}
+	res = read_result(mfd);
+	if (res) {
+	    *p = 0;
+	    if (snprintf(path, sizeof(path), "%s/%s", cwd, dp->d_name)
+		< (int) sizeof(path)) {
+		lmap_result_set_file(res, path);
 	    }
-	    res = read_result(mfd);
-	    if (res) {
-		lmap_add_result(lmapd->lmap, res);
-		tab = read_table(dfd);
-		if (tab) {
-		    lmap_result_add_table(res, tab);
-		}
+	    lmap_add_result(lmapd->lmap, res);
+	    tab = read_table(dfd);
+	    if (tab) {
+		lmap_result_add_table(res, tab);
 	    }
+	} else {
+	    (void) close(dfd);
 	}
+    next:
+	free(dp);
     }
-    (void) closedir(dfd);
+    free(namelist);
     return 0;
 }
@@ -26,26 +26,29 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <libxml/debugXML.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 
 #include "lmap.h"
 #include "utils.h"
+#include "arena.h"
 #include "xml-io.h"
+#include "json-io.h"
+#include "latency.h"
+#include "alloc.h"
+#include "model.h"
 
 #define RENDER_CONFIG_TRUE	0x01
 #define RENDER_CONFIG_FALSE	0x02
-
-#define PARSE_CONFIG_TRUE	0x01
-#define PARSE_CONFIG_FALSE	0x02
-
-#define YANG_CONFIG_TRUE	0x01
-#define YANG_CONFIG_FALSE	0x02
-#define YANG_KEY		0x04
+#define RENDER_REPORT		0x04
 
 /**
  * @brief Parses the agent information
@@ -54,88 +57,41 @@
  * @return 0 on success, -1 on error
  */
 static int
-parse_agent(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_agent(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
-    int i, j;
-    xmlXPathObjectPtr result;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:agent/lmapc:*";
+    int i;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct agent *a, const char *c);
-    } tab[] = {
-	{ .name = "agent-id",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_agent_id },
-	{ .name = "group-id",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_group_id },
-	{ .name = "measurement-point",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_measurement_point },
-	{ .name = "report-agent-id",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_report_agent_id },
-	{ .name = "report-group-id",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_report_group_id },
-	{ .name = "report-measurement-point",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_report_measurement_point },
-	{ .name = "controller-timeout",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_agent_set_controller_timeout },
-	{ .name = "last-started",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_agent_set_last_started },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
     
     assert(lmap);
     
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-    
-    if (!result->nodesetval || !result->nodesetval->nodeNr) {
-	xmlXPathFreeObject(result);
+    if (!set->nodeNr) {
 	return 0;
     }
 
     if (! lmap->agent) {
 	lmap->agent = lmap_agent_new();
 	if (! lmap->agent) {
-	    xmlXPathFreeObject(result);
 	    return -1;
 	}
     }
     
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	xmlNodePtr node = result->nodesetval->nodeTab[i];
+    for (i = 0; i < set->nodeNr; i++) {
+	xmlNodePtr node = set->nodeTab[i];
 	
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(lmap->agent, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_agent_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(lmap->agent, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
-    xmlXPathFreeObject(result);
     
     return 0;
 }
@@ -143,36 +99,11 @@ parse_agent(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
 static struct supp *
 parse_suppression(xmlNodePtr supp_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct supp *supp;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct supp *s, const char *c);
-    } tab[] = {
-	{ .name = "name",
-	  .flags = YANG_CONFIG_TRUE | YANG_KEY,
-	  .func = lmap_supp_set_name },
-	{ .name = "start",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_supp_set_start },
-	{ .name = "end",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_supp_set_end },
-	{ .name = "match",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_supp_add_match },
-	{ .name = "stop-running",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_supp_set_stop_running },
-	{ .name = "state",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_supp_set_state },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     supp = lmap_supp_new();
     if (! supp) {
 	return NULL;
@@ -183,22 +114,15 @@ parse_suppression(xmlNodePtr supp_node, int what)
 
 	if (node->ns != supp_node->ns) continue;
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(supp, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_supp_leafs, (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(supp, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -212,57 +136,31 @@ parse_suppression(xmlNodePtr supp_node, int what)
  * @return 0 on success, -1 on error
  */
 static int
-parse_suppressions(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_suppressions(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
     int i;
-    xmlXPathObjectPtr result;
     struct supp *supp;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:suppressions/lmapc:suppression";
 
     assert(lmap);
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	supp = parse_suppression(result->nodesetval->nodeTab[i], what);
+    for (i = 0; i < set->nodeNr; i++) {
+	supp = parse_suppression(set->nodeTab[i], what);
 	if (supp) {
 	    lmap_add_supp(lmap, supp);
 	}
     }
 
-    xmlXPathFreeObject(result);
     return 0;
 }
 
 static struct option *
 parse_option(xmlNodePtr option_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct option *option;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct option *s, const char *c);
-    } tab[] = {
-	{ .name = "id",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_option_set_id },
-	{ .name = "name",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_option_set_name },
-	{ .name = "value",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_option_set_value },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     option = lmap_option_new();
     if (! option) {
 	return NULL;
@@ -273,22 +171,16 @@ parse_option(xmlNodePtr option_node, int what)
 
 	if (node->ns != option_node->ns) continue;
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(option, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_option_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(option, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -298,24 +190,11 @@ parse_option(xmlNodePtr option_node, int what)
 static struct registry *
 parse_registry(xmlNodePtr registry_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct registry *registry;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct registry *s, const char *c);
-    } tab[] = {
-	{ .name = "uri",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_registry_set_uri },
-	{ .name = "role",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_registry_add_role },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     registry = lmap_registry_new();
     if (! registry) {
 	return NULL;
@@ -326,22 +205,16 @@ parse_registry(xmlNodePtr registry_node, int what)
 
 	if (node->ns != registry_node->ns) continue;
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(registry, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_registry_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(registry, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -351,27 +224,11 @@ parse_registry(xmlNodePtr registry_node, int what)
 static struct task *
 parse_task(xmlNodePtr task_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct task *task;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct task *s, const char *c);
-    } tab[] = {
-	{ .name = "name",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_task_set_name },
-	{ .name = "program",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_task_set_program },
-	{ .name = "tag",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_task_add_tag },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     task = lmap_task_new();
     if (! task) {
 	return NULL;
@@ -394,22 +251,15 @@ parse_task(xmlNodePtr task_node, int what)
 	    continue;
 	}
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(task, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_task_leafs, (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(task, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -423,57 +273,31 @@ parse_task(xmlNodePtr task_node, int what)
  * @return 0 on success, -1 on error
  */
 static int
-parse_tasks(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_tasks(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
     int i;
-    xmlXPathObjectPtr result;
     struct task *task;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:tasks/lmapc:task";
 
     assert(lmap);
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	task = parse_task(result->nodesetval->nodeTab[i], what);
+    for (i = 0; i < set->nodeNr; i++) {
+	task = parse_task(set->nodeTab[i], what);
 	if (task) {
 	    lmap_add_task(lmap, task);
 	}
     }
 
-    xmlXPathFreeObject(result);
     return 0;
 }
 
 static struct task *
 parse_capability_task(xmlNodePtr task_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct task *task;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct task *s, const char *c);
-    } tab[] = {
-	{ .name = "name",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_task_set_name },
-	{ .name = "version",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_task_set_version },
-	{ .name = "program",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_task_set_program },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     task = lmap_task_new();
     if (! task) {
 	return NULL;
@@ -490,22 +314,16 @@ parse_capability_task(xmlNodePtr task_node, int what)
 	    continue;
 	}
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(task, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_capability_task_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(task, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -519,38 +337,27 @@ parse_capability_task(xmlNodePtr task_node, int what)
  * @return 0 on success, -1 on error
  */
 static int
-parse_capability_tasks(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_capability_tasks(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
     int i;
-    xmlXPathObjectPtr result;
     struct task *task;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:capabilities/lmapc:tasks/lmapc:task";
 
     assert(lmap);
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-
     if (! lmap->capabilities) {
 	lmap->capabilities = lmap_capability_new();
 	if (! lmap->capabilities) {
-	    xmlXPathFreeObject(result);
 	    return -1;
 	}
     }
     
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	task = parse_capability_task(result->nodesetval->nodeTab[i], what);
+    for (i = 0; i < set->nodeNr; i++) {
+	task = parse_capability_task(set->nodeTab[i], what);
 	if (task) {
 	    lmap_capability_add_task(lmap->capabilities, task);
 	}
     }
 
-    xmlXPathFreeObject(result);
     return 0;
 }
 
@@ -561,74 +368,44 @@ parse_capability_tasks(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
  * @return 0 on success, -1 on error
  */
 static int
-parse_capabilities(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_capabilities(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
-    int i, j;
-    xmlXPathObjectPtr result;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:capabilities/lmapc:*";
+    int i;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct capability *a, const char *c);
-    } tab[] = {
-	{ .name = "version",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_capability_set_version },
-	{ .name = "tag",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_capability_add_tag },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
     
     assert(lmap);
     
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-
-    if (!result->nodesetval || !result->nodesetval->nodeNr) {
-	xmlXPathFreeObject(result);
+    if (!set->nodeNr) {
 	return 0;
     }
 
     if (! lmap->capabilities) {
 	lmap->capabilities = lmap_capability_new();
 	if (! lmap->capabilities) {
-	    xmlXPathFreeObject(result);
 	    return -1;
 	}
     }
     
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	xmlNodePtr node = result->nodesetval->nodeTab[i];
-
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST "tasks")) {
-		    goto outer;
-		}
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(lmap->capabilities, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
+    for (i = 0; i < set->nodeNr; i++) {
+	xmlNodePtr node = set->nodeTab[i];
+
+	if (!xmlStrcmp(node->name, BAD_CAST "tasks")) {
+	    continue;
 	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_capability_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(lmap->capabilities, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
-    outer: continue;
     }
-    xmlXPathFreeObject(result);
     
     return 0;
 }
@@ -636,47 +413,25 @@ parse_capabilities(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
 static void
 parse_periodic(struct event *event, xmlNodePtr period_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct event *e, const char *c);
-    } tab[] = {
-	{ .name = "interval",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_interval },
-	{ .name = "start",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_start },
-	{ .name = "end",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_end },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     for (node = xmlFirstElementChild(period_node);
 	 node; node = xmlNextElementSibling(node)) {
 	
 	if (node->ns != period_node->ns) continue;
 	
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(event, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_periodic_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(event, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 }
@@ -684,65 +439,25 @@ parse_periodic(struct event *event, xmlNodePtr period_node, int what)
 static void
 parse_calendar(struct event *event, xmlNodePtr calendar_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct event *e, const char *c);
-    } tab[] = {
-	{ .name = "month",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_add_month },
-	{ .name = "day-of-month",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_add_day_of_month },
-	{ .name = "day-of-week",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_add_day_of_week },
-	{ .name = "hour",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_add_hour },
-	{ .name = "minute",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_add_minute },
-	{ .name = "second",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_add_second },
-	{ .name = "timezone-offset",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_timezone_offset },
-	{ .name = "start",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_start },
-	{ .name = "end",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_end },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     for (node = xmlFirstElementChild(calendar_node);
 	 node; node = xmlNextElementSibling(node)) {
 	
 	if (node->ns != calendar_node->ns) continue;
 	
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(event, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_calendar_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(event, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 }
@@ -750,37 +465,25 @@ parse_calendar(struct event *event, xmlNodePtr calendar_node, int what)
 static void
 parse_one_off(struct event *event, xmlNodePtr one_off_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct event *e, const char *c);
-    } tab[] = {
-	{ .name = "time",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_start },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     for (node = xmlFirstElementChild(one_off_node);
 	 node; node = xmlNextElementSibling(node)) {
 	
 	if (node->ns != one_off_node->ns) continue;
 	
-	for (j = 0; tab[j].name; j++) {
-	    if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		xmlChar *content = xmlNodeGetContent(node);
-		tab[j].func(event, (char *) content);
-		if (content) {
-		    xmlFree(content);
-		}
-		break;
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_one_off_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(event, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 }
@@ -788,59 +491,11 @@ parse_one_off(struct event *event, xmlNodePtr one_off_node, int what)
 static struct event *
 parse_event(xmlNodePtr event_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct event *event;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct event *e, const char *c);
-	void (*parse)(struct event *e, xmlNodePtr node, int what);
-    } tab[] = {
-	{ .name = "name",
-	  .flags = YANG_CONFIG_TRUE | YANG_KEY,
-	  .func = lmap_event_set_name,
-	  .parse = NULL },
-	{ .name = "random-spread",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_random_spread,
-	  .parse = NULL },
-	{ .name = "cycle-interval",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_cycle_interval,
-	  .parse = NULL },
-	{ .name = "periodic",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = parse_periodic },
-	{ .name = "calendar",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = parse_calendar },
-	{ .name = "one-off",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = parse_one_off },
-	{ .name = "immediate",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = NULL },
-	{ .name = "startup",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = NULL },
-	{ .name = "controller-lost",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = NULL },
-	{ .name = "controller-connected",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_event_set_type,
-	  .parse = NULL },
-	{ .name = NULL, .flags = 0, .func = NULL, .parse = NULL }
-    };
-
     event = lmap_event_new();
     if (! event) {
 	return NULL;
@@ -851,29 +506,27 @@ parse_event(xmlNodePtr event_node, int what)
 	
 	if (node->ns != event_node->ns) continue;
 	
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    if (tab[j].func == lmap_event_set_type) {
-			tab[j].func(event, (char *) node->name);
-		    } else {
-			xmlChar *content = xmlNodeGetContent(node);
-			tab[j].func(event, (char *) content);
-			if (content) {
-			    xmlFree(content);
-			}
-		    }
-		    if (tab[j].parse) {
-			tab[j].parse(event, node, what);
-		    }
-		    break;
-		}
+	leaf = lmap_leaf_find(lmap_event_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
+	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	if (leaf->func == (lmap_leaf_func *) lmap_event_set_type) {
+	    leaf->func(event, (char *) node->name);
+	} else {
+	    content = xmlNodeGetContent(node);
+	    leaf->func(event, (char *) content);
+	    if (content) {
+		xmlFree(content);
 	    }
 	}
-	if (! tab[j].name) {
-	    lmap_wrn("unexpected element '%s'", node->name);
+	if (!xmlStrcmp(node->name, BAD_CAST "periodic")) {
+	    parse_periodic(event, node, what);
+	} else if (!xmlStrcmp(node->name, BAD_CAST "calendar")) {
+	    parse_calendar(event, node, what);
+	} else if (!xmlStrcmp(node->name, BAD_CAST "one-off")) {
+	    parse_one_off(event, node, what);
 	}
     }
 
@@ -887,102 +540,31 @@ parse_event(xmlNodePtr event_node, int what)
  * @return 0 on success, -1 on error
  */
 static int
-parse_events(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_events(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
     int i;
-    xmlXPathObjectPtr result;
     struct event *event;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:events/lmapc:event";
 
     assert(lmap);
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	event = parse_event(result->nodesetval->nodeTab[i], what);
+    for (i = 0; i < set->nodeNr; i++) {
+	event = parse_event(set->nodeTab[i], what);
 	if (event) {
 	    lmap_add_event(lmap, event);
 	}
     }
 
-    xmlXPathFreeObject(result);
     return 0;
 }
 
 static struct action *
 parse_action(xmlNodePtr action_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct action *action;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct action *s, const char *c);
-    } tab[] = {
-	{ .name = "name",
-	  .flags = YANG_CONFIG_TRUE | YANG_KEY,
-	  .func = lmap_action_set_name },
-	{ .name = "task",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_action_set_task },
-	{ .name = "destination",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_action_add_destination },
-	{ .name = "tag",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_action_add_tag },
-	{ .name = "suppression-tag",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_action_add_suppression_tag },
-	{ .name = "state",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_state },
-	{ .name = "storage",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_storage },
-	{ .name = "invocations",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_invocations },
-	{ .name = "suppressions",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_suppressions },
-	{ .name = "overlaps",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_overlaps },
-	{ .name = "failures",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_failures },
-	{ .name = "last-invocation",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_invocation },
-	{ .name = "last-completion",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_completion },
-	{ .name = "last-status",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_status },
-	{ .name = "last-message",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_message },
-	{ .name = "last-failed-completion",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_failed_completion },
-	{ .name = "last-failed-status",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_failed_status },
-	{ .name = "last-failed-message",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_action_set_last_failed_message },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     action = lmap_action_new();
     if (! action) {
 	return NULL;
@@ -999,22 +581,16 @@ parse_action(xmlNodePtr action_node, int what)
 	    continue;
 	}
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(action, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_action_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(action, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -1024,60 +600,11 @@ parse_action(xmlNodePtr action_node, int what)
 static struct schedule *
 parse_schedule(xmlNodePtr schedule_node, int what)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct schedule *schedule;
 
-    struct {
-	char *name;
-	int flags;
-	int (*func)(struct schedule *e, const char *c);
-    } tab[] = {
-	{ .name = "name",
-	  .flags = YANG_CONFIG_TRUE | YANG_KEY,
-	  .func = lmap_schedule_set_name },
-	{ .name = "start",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_schedule_set_start },
-	{ .name = "end",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_schedule_set_end },
-	{ .name = "duration",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_schedule_set_duration },
-	{ .name = "execution-mode",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_schedule_set_exec_mode },
-	{ .name = "tag",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_schedule_add_tag },
-	{ .name = "suppression-tag",
-	  .flags = YANG_CONFIG_TRUE,
-	  .func = lmap_schedule_add_suppression_tag },
-	{ .name = "state",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_state },
-	{ .name = "storage",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_storage },
-	{ .name = "invocations",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_invocations },
-	{ .name = "suppressions",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_suppressions },
-	{ .name = "overlaps",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_overlaps },
-	{ .name = "failures",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_failures },
-	{ .name = "last-invocation",
-	  .flags = YANG_CONFIG_FALSE,
-	  .func = lmap_schedule_set_last_invocation },
-	{ .name = NULL, .flags = 0, .func = NULL }
-    };
-
     schedule = lmap_schedule_new();
     if (! schedule) {
 	return NULL;
@@ -1094,22 +621,16 @@ parse_schedule(xmlNodePtr schedule_node, int what)
 	    continue;
 	}
 
-	for (j = 0; tab[j].name; j++) {
-	    if ((tab[j].flags & YANG_KEY)
-		|| (what & PARSE_CONFIG_TRUE && tab[j].flags & YANG_CONFIG_TRUE)
-		|| (what & PARSE_CONFIG_FALSE && tab[j].flags & YANG_CONFIG_FALSE)) {
-		if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		    xmlChar *content = xmlNodeGetContent(node);
-		    tab[j].func(schedule, (char *) content);
-		    if (content) {
-			xmlFree(content);
-		    }
-		    break;
-		}
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_schedule_leafs,
+			      (const char *) node->name, what);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(schedule, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
@@ -1123,79 +644,170 @@ parse_schedule(xmlNodePtr schedule_node, int what)
  * @return 0 on success, -1 on error
  */
 static int
-parse_schedules(struct lmap *lmap, xmlXPathContextPtr ctx, int what)
+parse_schedules(struct lmap *lmap, xmlNodeSetPtr set, int what)
 {
     int i;
-    xmlXPathObjectPtr result;
     struct schedule *schedule;
-    
-    const char *xpath = "//lmapc:lmap/lmapc:schedules/lmapc:schedule";
 
     assert(lmap);
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	schedule = parse_schedule(result->nodesetval->nodeTab[i], what);
+    for (i = 0; i < set->nodeNr; i++) {
+	schedule = parse_schedule(set->nodeTab[i], what);
 	if (schedule) {
 	    lmap_add_schedule(lmap, schedule);
 	}
     }
 
-    xmlXPathFreeObject(result);
+    return 0;
+}
+
+/*
+ * The sections of a control document, i.e., the lmapc elements below
+ * the lmap container(s), are collected in a single walk over the tree
+ * and handed to the section parsers in the order shown below. This
+ * replaces one XPath evaluation (and tree traversal) per section.
+ */
+
+struct sections {
+    xmlNodeSetPtr capabilities;		/* lmap/capabilities/ * */
+    xmlNodeSetPtr capability_tasks;	/* lmap/capabilities/tasks/task */
+    xmlNodeSetPtr agent;		/* lmap/agent/ * */
+    xmlNodeSetPtr schedules;		/* lmap/schedules/schedule */
+    xmlNodeSetPtr suppressions;		/* lmap/suppressions/suppression */
+    xmlNodeSetPtr tasks;		/* lmap/tasks/task */
+    xmlNodeSetPtr events;		/* lmap/events/event */
+};
+
+static int
+is_lmapc(xmlNodePtr node, const char *name)
+{
+    return node->type == XML_ELEMENT_NODE
+	&& node->ns && node->ns->href
+	&& !xmlStrcmp(node->ns->href, BAD_CAST LMAPC_XML_NAMESPACE)
+	&& (!name || !xmlStrcmp(node->name, BAD_CAST name));
+}
+
+static int
+collect_children(xmlNodeSetPtr set, xmlNodePtr parent, const char *name)
+{
+    xmlNodePtr node;
+
+    for (node = parent->children; node; node = node->next) {
+	if (is_lmapc(node, name)) {
+	    if (xmlXPathNodeSetAddUnique(set, node) < 0) {
+		lmap_err("failed to allocate memory");
+		return -1;
+	    }
+	}
+    }
+    return 0;
+}
+
+static int
+collect_lmap(struct sections *sec, xmlNodePtr lmap)
+{
+    int ret = 0;
+    xmlNodePtr node, tasks;
+
+    for (node = lmap->children; node && !ret; node = node->next) {
+	if (! is_lmapc(node, NULL)) {
+	    continue;
+	}
+	if (!xmlStrcmp(node->name, BAD_CAST "capabilities")) {
+	    ret = collect_children(sec->capabilities, node, NULL);
+	    for (tasks = node->children; tasks && !ret; tasks = tasks->next) {
+		if (is_lmapc(tasks, "tasks")) {
+		    ret = collect_children(sec->capability_tasks, tasks, "task");
+		}
+	    }
+	} else if (!xmlStrcmp(node->name, BAD_CAST "agent")) {
+	    ret = collect_children(sec->agent, node, NULL);
+	} else if (!xmlStrcmp(node->name, BAD_CAST "schedules")) {
+	    ret = collect_children(sec->schedules, node, "schedule");
+	} else if (!xmlStrcmp(node->name, BAD_CAST "suppressions")) {
+	    ret = collect_children(sec->suppressions, node, "suppression");
+	} else if (!xmlStrcmp(node->name, BAD_CAST "tasks")) {
+	    ret = collect_children(sec->tasks, node, "task");
+	} else if (!xmlStrcmp(node->name, BAD_CAST "events")) {
+	    ret = collect_children(sec->events, node, "event");
+	}
+    }
+    return ret;
+}
+
+/*
+ * Finds the lmap containers anywhere in the document (like the
+ * //lmapc:lmap location path did). Containers nested inside of an
+ * lmap container are not valid and hence not searched for.
+ */
+
+static int
+collect_sections(struct sections *sec, xmlNodePtr node)
+{
+    for (; node; node = node->next) {
+	if (node->type != XML_ELEMENT_NODE) {
+	    continue;
+	}
+	if (is_lmapc(node, "lmap")) {
+	    if (collect_lmap(sec, node) != 0) {
+		return -1;
+	    }
+	} else if (collect_sections(sec, node->children) != 0) {
+	    return -1;
+	}
+    }
     return 0;
 }
 
 static int
 parse_control(struct lmap *lmap, xmlDocPtr doc, int what)
 {
-    int i, ret;
-    xmlXPathContextPtr ctx = NULL;
+    int i, ret = 0;
+    struct sections sec;
 
     struct {
-	int (*parse)(struct lmap *lmap, xmlXPathContextPtr ctx, int what);
+	xmlNodeSetPtr *set;
+	int (*parse)(struct lmap *lmap, xmlNodeSetPtr set, int what);
     } tab[] = {
-	{ parse_capabilities },
-	{ parse_capability_tasks },
-	{ parse_agent },
-	{ parse_schedules },
-	{ parse_suppressions },
-	{ parse_tasks },
-	{ parse_events },
-	{ NULL }
+	{ &sec.capabilities,	 parse_capabilities },
+	{ &sec.capability_tasks, parse_capability_tasks },
+	{ &sec.agent,		 parse_agent },
+	{ &sec.schedules,	 parse_schedules },
+	{ &sec.suppressions,	 parse_suppressions },
+	{ &sec.tasks,		 parse_tasks },
+	{ &sec.events,		 parse_events },
+	{ NULL, NULL }
     };
 
     assert(lmap && doc);
 
-    ctx = xmlXPathNewContext(doc);
-    if (! ctx) {
-	lmap_err("cannot create xpath context");
-	ret = -1;
-	goto exit;
+    memset(&sec, 0, sizeof(sec));
+    for (i = 0; tab[i].parse; i++) {
+	*tab[i].set = xmlXPathNodeSetCreate(NULL);
+	if (! *tab[i].set) {
+	    lmap_err("failed to allocate memory");
+	    ret = -1;
+	    goto exit;
+	}
     }
 
-    ret = xmlXPathRegisterNs(ctx, BAD_CAST LMAPC_XML_PREFIX,
-			     BAD_CAST LMAPC_XML_NAMESPACE);
+    ret = collect_sections(&sec, doc->children);
     if (ret != 0) {
-	lmap_err("cannot register xpath namespace '%s'", LMAPC_XML_NAMESPACE);
-	ret = -1;
 	goto exit;
     }
 
     for (i = 0; tab[i].parse; i++) {
-	ret = tab[i].parse(lmap, ctx, what);
+	ret = tab[i].parse(lmap, *tab[i].set, what);
 	if (ret != 0) {
 	    goto exit;
 	}
     }
 
 exit:
-    if (ctx) {
-	xmlXPathFreeContext(ctx);
+    for (i = 0; tab[i].parse; i++) {
+	if (*tab[i].set) {
+	    xmlXPathFreeNodeSet(*tab[i].set);
+	}
     }
     return ret;
 }
@@ -1206,42 +818,251 @@ parse_config_doc(struct lmap *lmap, xmlDocPtr doc)
     return parse_control(lmap, doc, PARSE_CONFIG_TRUE);
 }
 
-int
-lmap_xml_parse_config_path(struct lmap *lmap, const char *path)
-{
-    int ret = 0;
-    char filepath[PATH_MAX];
-    struct dirent *dp;
-    DIR *dfd;
-    
-    assert(path);
+/*
+ * Config and capability directories are parsed by a small pool of
+ * threads. Each file is parsed into an lmap fragment of its own and
+ * the fragments are merged in the order of the sorted file names, so
+ * the result neither depends on thread scheduling nor on the order of
+ * the directory entries. If the caller builds the lmap in an arena,
+ * every worker allocates from an arena of its own, which is merged
+ * into the caller's arena afterwards.
+ */
 
-    dfd = opendir(path);
-    if (!dfd) {
-	if (errno == ENOTDIR) {
-	    return lmap_xml_parse_config_file(lmap, path);
-	} else {
-	    lmap_err("cannot read config path '%s'", path);
-	    return -1;
-	}
-    }
+#define PARSE_THREADS_MAX	8
 
-    while ((dp = readdir(dfd)) != NULL) {
-	size_t len = strlen(dp->d_name);
-	if (len < 5) {
-	    continue;
+struct parse_job {
+    char **files;
+    int count;
+    int next;				/* next file to parse (atomic) */
+    int what;
+    struct lmap **frags;
+    int *rets;
+};
+
+struct parse_worker {
+    pthread_t thread;
+    struct parse_job *job;
+    struct lmap_arena *arena;
+};
+
+static int
+parse_xml_file(struct lmap *lmap, const char *file, int what)
+{
+    int ret;
+    xmlDocPtr doc;
+
+    doc = xmlParseFile(file);
+    if (! doc) {
+	lmap_err("cannot parse %s file '%s'",
+		 (what & PARSE_CONFIG_FALSE) ? "state" : "config", file);
+	return -1;
+    }
+
+    ret = parse_control(lmap, doc, what);
+    xmlFreeDoc(doc);
+    return ret;
+}
+
+static int
+parse_file(struct lmap *lmap, const char *file, int what)
+{
+    if (lmap_has_suffix(file, ".json")) {
+	return (what & PARSE_CONFIG_FALSE)
+	    ? lmap_json_parse_state_file(lmap, file)
+	    : lmap_json_parse_config_file(lmap, file);
+    }
+    return parse_xml_file(lmap, file, what);
+}
+
+static void *
+parse_worker(void *arg)
+{
+    struct parse_worker *worker = (struct parse_worker *) arg;
+    struct parse_job *job = worker->job;
+    struct lmap *frag;
+    int i;
+
+    (void) lmap_arena_use(worker->arena);
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+	frag = lmap_new();
+	job->frags[i] = frag;
+	job->rets[i] = frag ? parse_file(frag, job->files[i], job->what) : -1;
+    }
+    (void) lmap_arena_use(NULL);
+    return NULL;
+}
+
+static int
+parse_filter(const struct dirent *dp)
+{
+    return lmap_has_suffix(dp->d_name, ".xml")
+	|| lmap_has_suffix(dp->d_name, ".json");
+}
+
+static int parse_threads_max = 0;	/* 0 means one per CPU */
+
+/**
+ * @brief Sets the number of threads used to parse directories
+ *
+ * @param threads The max. number of threads, 0 selects one thread
+ *		  per online CPU and 1 disables concurrent parsing
+ */
+
+void
+lmap_xml_set_parse_threads(int threads)
+{
+    parse_threads_max = (threads < 0) ? 0 : threads;
+}
+
+static int
+parse_threads(int count)
+{
+    long cpus = parse_threads_max;
+
+    if (! cpus) {
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (cpus > PARSE_THREADS_MAX) {
+	cpus = PARSE_THREADS_MAX;
+    }
+    return (cpus < count) ? (int) cpus : count;
+}
+
+static int
+parse_path(struct lmap *lmap, const char *path, int what)
+{
+    struct dirent **names = NULL;
+    struct parse_worker workers[PARSE_THREADS_MAX];
+    struct parse_job job;
+    struct lmap_arena *arena = lmap_arena_current();
+    char filepath[PATH_MAX];
+    int i, n, nthreads, started = 0, ret = 0;
+
+    n = scandir(path, &names, parse_filter, alphasort);
+    if (n < 0) {
+	if (errno == ENOTDIR) {
+	    return parse_file(lmap, path, what);
 	}
-	if (strcmp(dp->d_name + len - 4, ".xml")) {
-	    continue;
+	lmap_err("cannot read %s path '%s'",
+		 (what & PARSE_CONFIG_FALSE) ? "capability" : "config", path);
+	return -1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.what = what;
+    job.files = calloc(n ? n : 1, sizeof(char *));
+    job.frags = calloc(n ? n : 1, sizeof(struct lmap *));
+    job.rets = calloc(n ? n : 1, sizeof(int));
+    if (!job.files || !job.frags || !job.rets) {
+	lmap_err("failed to allocate memory");
+	ret = -1;
+	goto exit;
+    }
+    for (i = 0; i < n; i++) {
+	(void) snprintf(filepath, sizeof(filepath), "%s/%s", path, names[i]->d_name);
+	job.files[i] = strdup(filepath);
+	if (! job.files[i]) {
+	    lmap_err("failed to allocate memory");
+	    ret = -1;
+	    goto exit;
+	}
+	job.count++;
+    }
+
+    /*
+     * Start the workers. libxml2 must be initialized before it is
+     * used by several threads. If no worker can be started, the
+     * files are parsed one after the other.
+     */
+
+    nthreads = parse_threads(n);
+    if (nthreads > 1) {
+	xmlInitParser();
+	for (i = 0; i < nthreads; i++) {
+	    workers[started].job = &job;
+	    workers[started].arena = NULL;
+	    if (arena) {
+		workers[started].arena = lmap_arena_new();
+		if (! workers[started].arena) {
+		    break;
+		}
+	    }
+	    if (pthread_create(&workers[started].thread, NULL,
+			       parse_worker, &workers[started]) != 0) {
+		lmap_arena_free(workers[started].arena);
+		break;
+	    }
+	    started++;
 	}
-	(void) snprintf(filepath, sizeof(filepath), "%s/%s", path, dp->d_name);
-	if (lmap_xml_parse_config_file(lmap, filepath) < 0) {
+    }
+
+    if (! started) {
+	for (i = 0; i < n; i++) {
+	    if (parse_file(lmap, job.files[i], what) < 0) {
+		ret = -1;
+		break;
+	    }
+	}
+	goto exit;
+    }
+
+    for (i = 0; i < started; i++) {
+	(void) pthread_join(workers[i].thread, NULL);
+	lmap_arena_merge(arena, workers[i].arena);
+    }
+
+    /*
+     * Merge the fragments in order, stopping at the first file that
+     * failed to parse like a sequential parse would do.
+     */
+
+    for (i = 0; i < n; i++) {
+	if (ret == 0 && job.rets[i] == 0) {
+	    lmap_merge(lmap, job.frags[i]);
+	} else {
 	    ret = -1;
-	    break;
 	}
+	lmap_free(job.frags[i]);
     }
-    (void) closedir(dfd);
-    
+
+exit:
+    for (i = 0; i < n; i++) {
+	if (job.files) {
+	    free(job.files[i]);
+	}
+	free(names[i]);
+    }
+    free(names);
+    free(job.files);
+    free(job.frags);
+    free(job.rets);
+    return ret;
+}
+
+/**
+ * @brief Parses config files
+ *
+ * Parses a config file or all config files of a config directory.
+ * Files with the suffix .json are parsed as JSON documents, all other
+ * files as XML documents. When reading a directory, files that have
+ * neither the suffix .xml nor .json are ignored. The files of a
+ * directory are parsed concurrently and merged in the order of their
+ * names.
+ *
+ * @param lmap The lmap to add the config to
+ * @param path The config file or directory
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_xml_parse_config_path(struct lmap *lmap, const char *path)
+{
+    int ret;
+
+    assert(lmap && path);
+
+    ret = parse_path(lmap, path, PARSE_CONFIG_TRUE);
+    xmlCleanupParser();
     return ret;
 }
 
@@ -1249,24 +1070,11 @@ int
 lmap_xml_parse_config_file(struct lmap *lmap, const char *file)
 {
     int ret;
-    xmlDocPtr doc = NULL;
-    
-    assert(file);
-    
-    doc = xmlParseFile(file);
-    if (! doc) {
-	lmap_err("cannot parse config file '%s'", file);
-	ret = -1;
-	goto exit;
-    }
 
-    ret = parse_config_doc(lmap, doc);
+    assert(file);
 
-exit:
-    if (doc) {
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
-    }
+    ret = parse_xml_file(lmap, file, PARSE_CONFIG_TRUE);
+    xmlCleanupParser();
     return ret;
 }
 
@@ -1304,39 +1112,12 @@ parse_state_doc(struct lmap *lmap, xmlDocPtr doc)
 int
 lmap_xml_parse_state_path(struct lmap *lmap, const char *path)
 {
-    int ret = 0;
-    char filepath[PATH_MAX];
-    struct dirent *dp;
-    DIR *dfd;
-    
-    assert(path);
+    int ret;
 
-    dfd = opendir(path);
-    if (!dfd) {
-	if (errno == ENOTDIR) {
-	    return lmap_xml_parse_state_file(lmap, path);
-	} else {
-	    lmap_err("cannot read capability path '%s'", path);
-	    return -1;
-	}
-    }
+    assert(lmap && path);
 
-    while ((dp = readdir(dfd)) != NULL) {
-	size_t len = strlen(dp->d_name);
-	if (len < 5) {
-	    continue;
-	}
-	if (strcmp(dp->d_name + len - 4, ".xml")) {
-	    continue;
-	}
-	(void) snprintf(filepath, sizeof(filepath), "%s/%s", path, dp->d_name);
-	if (lmap_xml_parse_state_file(lmap, filepath) < 0) {
-	    ret = -1;
-	    break;
-	}
-    }
-    (void) closedir(dfd);
-    
+    ret = parse_path(lmap, path, PARSE_CONFIG_TRUE | PARSE_CONFIG_FALSE);
+    xmlCleanupParser();
     return ret;
 }
 
@@ -1344,24 +1125,11 @@ int
 lmap_xml_parse_state_file(struct lmap *lmap, const char *file)
 {
     int ret;
-    xmlDocPtr doc = NULL;
-    
-    assert(file);
-    
-    doc = xmlParseFile(file);
-    if (! doc) {
-	lmap_err("cannot parse state file '%s'", file);
-	ret = -1;
-	goto exit;
-    }
 
-    ret = parse_state_doc(lmap, doc);
+    assert(file);
 
-exit:
-    if (doc) {
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
-    }
+    ret = parse_xml_file(lmap, file, PARSE_CONFIG_TRUE | PARSE_CONFIG_FALSE);
+    xmlCleanupParser();
     return ret;
 }
 
@@ -1391,113 +1159,39 @@ exit:
 }
 
 static int
-parse_report(struct lmap *lmap, xmlXPathContextPtr ctx)
+parse_report(struct lmap *lmap, xmlNodePtr node)
 {
-    int i, j;
-    xmlXPathObjectPtr result;
-
-    const char *xpath = "//lmapr:report/lmapr:*";
-
-    struct {
-	char *name;
-	int (*func)(struct agent *a, const char *c);
-    } tab[] = {
-	{ .name = "date",
-	  .func = lmap_agent_set_report_date },
-	{ .name = "agent-id",
-	  .func = lmap_agent_set_agent_id },
-	{ .name = "group-id",
-	  .func = lmap_agent_set_group_id },
-	{ .name = "measurement-point",
-	  .func = lmap_agent_set_measurement_point },
-	{ .name = NULL, .func = NULL }
-    };
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
 
-    assert(lmap);
+    assert(lmap && lmap->agent);
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
-    
-    if (!result->nodesetval || !result->nodesetval->nodeNr) {
-	xmlXPathFreeObject(result);
+    leaf = lmap_leaf_find(lmap_report_leafs, (const char *) node->name, 0);
+    if (! leaf) {
+	lmap_wrn("unexpected element '%s'", node->name);
 	return 0;
     }
-
-    if (! lmap->agent) {
-	lmap->agent = lmap_agent_new();
-	if (! lmap->agent) {
-	    xmlXPathFreeObject(result);
-	    return -1;
-	}
+    if (leaf->report) {
+	leaf->report(lmap->agent, "true");
     }
-    
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	xmlNodePtr node = result->nodesetval->nodeTab[i];
-
-	for (j = 0; tab[j].name; j++) {
-	    if (!xmlStrcmp(node->name, BAD_CAST "result")) {
-		goto outer;
-	    }
-	    if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		xmlChar *content = xmlNodeGetContent(node);
-		if (!xmlStrcmp(node->name, BAD_CAST "agent-id")) {
-		    lmap_agent_set_report_agent_id(lmap->agent, "true");
-		}
-		if (!xmlStrcmp(node->name, BAD_CAST "group-id")) {
-		    lmap_agent_set_report_group_id(lmap->agent, "true");
-		}
-		if (!xmlStrcmp(node->name, BAD_CAST "measurement-point")) {
-		    lmap_agent_set_report_measurement_point(lmap->agent, "true");
-		}
-		if (tab[j].func) {
-		    tab[j].func(lmap->agent, (char *) content);
-		}
-		if (content) {
-		    xmlFree(content);
-		}
-		break;
-	    }
-	}
-	if (! tab[j].name) {
-	    lmap_wrn("unexpected element '%s'", node->name);
-	}
-    outer: continue;
+    content = xmlNodeGetContent(node);
+    leaf->func(lmap->agent, (char *) content);
+    if (content) {
+	xmlFree(content);
     }
-    xmlXPathFreeObject(result);
     
     return 0;
 }
 
-static struct value *
-parse_value(xmlNodePtr value_node)
-{
-    struct value *value;
-    xmlChar *content;
-
-    value = lmap_value_new();
-    if (! value) {
-	return NULL;
-    }
-    
-    content = xmlNodeGetContent(value_node);
-    lmap_value_set_value(value, (char *) content);
-    xmlFree(content);
-    
-    return value;
-}
-
-static struct row *
-parse_row(xmlNodePtr row_node)
+static int
+parse_row(struct table *tab, xmlNodePtr row_node)
 {
     xmlNodePtr node;
-    struct row *row;
+    xmlChar *content;
+    int ret;
 
-    row = lmap_row_new();
-    if (! row) {
-	return NULL;
+    if (lmap_table_new_row(tab) == -1) {
+	return -1;
     }
     
     for (node = xmlFirstElementChild(row_node);
@@ -1506,11 +1200,15 @@ parse_row(xmlNodePtr row_node)
 	if (node->ns != row_node->ns) continue;
 	
 	if (!xmlStrcmp(node->name, BAD_CAST "value")) {
-	    struct value *value = parse_value(node);
-	    lmap_row_add_value(row, value);
+	    content = xmlNodeGetContent(node);
+	    ret = lmap_table_add_value(tab, (char *) content);
+	    xmlFree(content);
+	    if (ret == -1) {
+		return -1;
+	    }
 	}
     }
-    return row;
+    return 0;
 }
 
 static struct table *
@@ -1530,8 +1228,9 @@ parse_table(xmlNodePtr table_node)
 	if (node->ns != table_node->ns) continue;
 	
 	if (!xmlStrcmp(node->name, BAD_CAST "row")) {
-	    struct row *row = parse_row(node);
-	    lmap_table_add_row(tab, row);
+	    if (parse_row(tab, node) == -1) {
+		break;
+	    }
 	}
     }
     return tab;    
@@ -1540,35 +1239,11 @@ parse_table(xmlNodePtr table_node)
 static struct result *
 parse_result(xmlNodePtr result_node)
 {
-    int j;
+    const struct lmap_leaf *leaf;
+    xmlChar *content;
     xmlNodePtr node;
     struct result *res;
 
-    struct {
-	char *name;
-	int (*func)(struct result *r, const char *c);
-    } tab[] = {
-	{ .name = "schedule",
-	  .func = lmap_result_set_schedule },
-	{ .name = "action",
-	  .func = lmap_result_set_action },
-	{ .name = "task",
-	  .func = lmap_result_set_task },
-	{ .name = "tag",
-	  .func = lmap_result_add_tag },
-	{ .name = "event",
-	  .func = lmap_result_set_event },
-	{ .name = "start",
-	  .func = lmap_result_set_start },
-	{ .name = "end",
-	  .func = lmap_result_set_end },
-	{ .name = "cycle-number",
-	  .func = lmap_result_set_cycle_number },
-	{ .name = "status",
-	  .func = lmap_result_set_status },
-	{ .name = NULL, .func = NULL }
-    };
-
     res = lmap_result_new();
     if (! res) {
 	return NULL;
@@ -1592,216 +1267,280 @@ parse_result(xmlNodePtr result_node)
 	    continue;
 	}
 
-	for (j = 0; tab[j].name; j++) {
-	    if (!xmlStrcmp(node->name, BAD_CAST tab[j].name)) {
-		xmlChar *content = xmlNodeGetContent(node);
-		tab[j].func(res, (char *) content);
-		if (content) {
-		    xmlFree(content);
-		}
-		break;
-	    }
-	}
-	if (! tab[j].name) {
+	leaf = lmap_leaf_find(lmap_result_leafs, (const char *) node->name, 0);
+	if (! leaf) {
 	    lmap_wrn("unexpected element '%s'", node->name);
+	    continue;
+	}
+	content = xmlNodeGetContent(node);
+	leaf->func(res, (char *) content);
+	if (content) {
+	    xmlFree(content);
 	}
     }
 
     return res;
 }
 
-/**
- * @brief Parses the schedule information
- * @details Function to parse the schedule information from the XML config
- * file
- * @return 0 on success, -1 on error
+/*
+ * Reports can be huge and hence they are read with a pull parser.
+ * Only the subtree of the report element being processed is kept in
+ * memory; every result is handed to the result handler as soon as it
+ * has been parsed and its subtree is released when the reader moves
+ * on to the next element.
  */
+
 static int
-parse_results(struct lmap *lmap, xmlXPathContextPtr ctx)
+read_report(struct lmap *lmap, xmlTextReaderPtr reader,
+	    lmap_result_func *func, void *ctx)
 {
-    int i;
-    xmlXPathObjectPtr result;
+    int ret, depth, report = -1;
+    const xmlChar *uri;
+    xmlNodePtr node;
     struct result *res;
-    
-    const char *xpath = "//lmapr:report/lmapr:result";
+    struct lmap_arena *arena;
 
-    assert(lmap);
+    ret = xmlTextReaderRead(reader);
+    while (ret == 1) {
+	if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+	    ret = xmlTextReaderRead(reader);
+	    continue;
+	}
 
-    result = xmlXPathEvalExpression(BAD_CAST xpath, ctx);
-    if (! result) {
-	lmap_err("error in xpath expression '%s'", xpath);
-	return -1;
-    }
+	depth = xmlTextReaderDepth(reader);
+	if (report >= 0 && depth <= report) {
+	    report = -1;
+	}
+	uri = xmlTextReaderConstNamespaceUri(reader);
+	if (!uri || xmlStrcmp(uri, BAD_CAST LMAPR_XML_NAMESPACE)
+	    || (report >= 0 && depth > report + 1)) {
+	    ret = xmlTextReaderRead(reader);
+	    continue;
+	}
+	if (report < 0) {
+	    if (!xmlStrcmp(xmlTextReaderConstLocalName(reader),
+			   BAD_CAST "report")) {
+		report = depth;
+	    }
+	    ret = xmlTextReaderRead(reader);
+	    continue;
+	}
+
+	node = xmlTextReaderExpand(reader);
+	if (! node) {
+	    ret = -1;
+	    break;
+	}
 
-    for (i = 0; result->nodesetval && i < result->nodesetval->nodeNr; i++) {
-	res = parse_result(result->nodesetval->nodeTab[i]);
-	if (res) {
-	    lmap_add_result(lmap, res);
+	if (! lmap->agent) {
+	    lmap->agent = lmap_agent_new();
+	    if (! lmap->agent) {
+		return -1;
+	    }
 	}
+
+	if (xmlStrcmp(node->name, BAD_CAST "result")) {
+	    parse_report(lmap, node);
+	} else if (func) {
+	    /* results handed out are freed one by one - keep them on
+	     * the heap instead of letting them pile up in an arena */
+	    arena = lmap_arena_use(NULL);
+	    res = parse_result(node);
+	    (void) lmap_arena_use(arena);
+	    if (res && func(res, ctx) == -1) {
+		return 0;
+	    }
+	} else {
+	    res = parse_result(node);
+	    if (res) {
+		lmap_add_result(lmap, res);
+	    }
+	}
+	ret = xmlTextReaderNext(reader);
     }
 
-    xmlXPathFreeObject(result);
+    if (ret != 0) {
+	lmap_err("cannot parse report");
+	return -1;
+    }
     return 0;
 }
 
-static int
-parse_report_doc(struct lmap *lmap, xmlDocPtr doc)
-{
-    int i, ret;
-    xmlXPathContextPtr ctx = NULL;
-
-    struct {
-	int (*parse)(struct lmap *lmap, xmlXPathContextPtr ctx);
-    } tab[] = {
-	{ parse_report },
-	{ parse_results },
-	{ NULL }
-    };
+/**
+ * @brief Reads a report file and passes each result to a handler
+ *
+ * The report is parsed incrementally so that memory use does not grow
+ * with the size of the report as long as the handler releases the
+ * results. Report meta data is stored in the agent of lmap. If func
+ * is NULL, the results are added to lmap.
+ *
+ * @param lmap The lmap receiving the report meta data
+ * @param file The name of the report file
+ * @param func The result handler or NULL
+ * @param ctx The context passed to the result handler
+ * @return 0 on success, -1 on error
+ */
 
-    assert(lmap && doc);
+int
+lmap_xml_read_report_file(struct lmap *lmap, const char *file,
+			  lmap_result_func *func, void *ctx)
+{
+    int ret;
+    xmlTextReaderPtr reader;
 
-    ctx = xmlXPathNewContext(doc);
-    if (! ctx) {
-	lmap_err("cannot create xpath context");
-	ret = -1;
-	goto exit;
-    }
+    assert(lmap && file);
 
-    ret = xmlXPathRegisterNs(ctx, BAD_CAST LMAPR_XML_PREFIX,
-			     BAD_CAST LMAPR_XML_NAMESPACE);
-    if (ret != 0) {
-	lmap_err("cannot register xpath namespace '%s'", LMAPC_XML_NAMESPACE);
-	ret = -1;
-	goto exit;
-    }
-    
-    for (i = 0; tab[i].parse; i++) {
-	ret = tab[i].parse(lmap, ctx);
-	if (ret != 0) {
-	    goto exit;
-	}
+    reader = xmlReaderForFile(file, NULL, 0);
+    if (! reader) {
+	lmap_err("cannot parse report file '%s'", file);
+	return -1;
     }
 
-exit:
-    if (ctx) {
-	xmlXPathFreeContext(ctx);
-    }
+    ret = read_report(lmap, reader, func, ctx);
+    xmlFreeTextReader(reader);
+    xmlCleanupParser();
     return ret;
 }
 
+/**
+ * @brief Reads a report from a string and passes each result to a handler
+ *
+ * See lmap_xml_read_report_file() for details.
+ *
+ * @param lmap The lmap receiving the report meta data
+ * @param string The report
+ * @param func The result handler or NULL
+ * @param ctx The context passed to the result handler
+ * @return 0 on success, -1 on error
+ */
+
 int
-lmap_xml_parse_report_file(struct lmap *lmap, const char *file)
+lmap_xml_read_report_string(struct lmap *lmap, const char *string,
+			    lmap_result_func *func, void *ctx)
 {
     int ret;
-    xmlDocPtr doc = NULL;
-    
-    assert(file);
-    
-    doc = xmlParseFile(file);
-    if (! doc) {
-	lmap_err("cannot parse state file '%s'", file);
-	ret = -1;
-	goto exit;
-    }
+    xmlTextReaderPtr reader;
 
-    ret = parse_report_doc(lmap, doc);
+    assert(lmap && string);
 
-exit:
-    if (doc) {
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
+    reader = xmlReaderForMemory(string, strlen(string), NULL, NULL, 0);
+    if (! reader) {
+	lmap_err("cannot parse from string");
+	return -1;
     }
+
+    ret = read_report(lmap, reader, func, ctx);
+    xmlFreeTextReader(reader);
+    xmlCleanupParser();
     return ret;
 }
 
+int
+lmap_xml_parse_report_file(struct lmap *lmap, const char *file)
+{
+    return lmap_xml_read_report_file(lmap, file, NULL, NULL);
+}
+
 int
 lmap_xml_parse_report_string(struct lmap *lmap, const char *string)
 {
-    int ret;
-    xmlDocPtr doc = NULL;
-    
-    assert(string);
+    return lmap_xml_read_report_string(lmap, string, NULL, NULL);
+}
+
+static void
+render_start(xmlTextWriterPtr writer, const char *ns, const char *name)
+{
+    (void) xmlTextWriterStartElementNS(writer, BAD_CAST ns, BAD_CAST name, NULL);
+}
+
+static void
+render_end(xmlTextWriterPtr writer)
+{
+    (void) xmlTextWriterEndElement(writer);
+}
 
-    doc = xmlParseMemory(string, strlen(string));
-    if (! doc) {
-	lmap_err("cannot parse from string");
-	ret = -1;
-	goto exit;
-    }
+/*
+ * Writes character data escaping only what must be escaped in element
+ * content, like libxml2's tree serializer does (quotes stay as they
+ * are). Runs without special characters go out unchanged.
+ */
 
-    ret = parse_report_doc(lmap, doc);
+static void
+render_text(xmlTextWriterPtr writer, const char *content)
+{
+    const char *p, *ref;
 
-exit:
-    if (doc) {
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
+    for (p = content; *p; content = ++p) {
+	p += strcspn(p, "&<>\r");
+	if (p > content) {
+	    (void) xmlTextWriterWriteRawLen(writer, BAD_CAST content, p - content);
+	}
+	switch (*p) {
+	case '&':  ref = "&amp;";  break;
+	case '<':  ref = "&lt;";   break;
+	case '>':  ref = "&gt;";   break;
+	case '\r': ref = "&#13;";  break;
+	default:
+	    return;
+	}
+	(void) xmlTextWriterWriteRaw(writer, BAD_CAST ref);
     }
-    return ret;
 }
 
 static void
-render_leaf(xmlNodePtr root, xmlNsPtr ns, char *name, char *content)
+render_leaf(xmlTextWriterPtr writer, const char *ns, char *name, const char *content)
 {
-    assert(root && ns);
+    assert(writer && ns);
     
     if (name && content) {
-	xmlNewChild(root, ns, BAD_CAST name, BAD_CAST content);
+	render_start(writer, ns, name);
+	if (*content) {
+	    render_text(writer, content);
+	}
+	render_end(writer);
     }
 }
 
 static void
-render_leaf_int32(xmlNodePtr root, xmlNsPtr ns, char *name, int32_t value)
+render_leaf_int32(xmlTextWriterPtr writer, const char *ns, char *name, int32_t value)
 {
-    char buf[32];
+    char buf[LMAP_INT_LEN];
     
-    snprintf(buf, sizeof(buf), "%" PRIi32, value);
-    render_leaf(root, ns, name, buf);
+    lmap_i64toa(value, buf);
+    render_leaf(writer, ns, name, buf);
 }
 
 static void
-render_leaf_uint32(xmlNodePtr root, xmlNsPtr ns, char *name, uint32_t value)
+render_leaf_uint32(xmlTextWriterPtr writer, const char *ns, char *name, uint32_t value)
 {
-    char buf[32];
+    char buf[LMAP_INT_LEN];
     
-    snprintf(buf, sizeof(buf), "%" PRIu32, value);
-    render_leaf(root, ns, name, buf);
+    lmap_u64toa(value, buf);
+    render_leaf(writer, ns, name, buf);
 }
 
 static void
-render_leaf_uint64(xmlNodePtr root, xmlNsPtr ns, char *name, uint64_t value)
+render_leaf_uint64(xmlTextWriterPtr writer, const char *ns, char *name, uint64_t value)
 {
-    char buf[64];
+    char buf[LMAP_INT_LEN];
     
-    snprintf(buf, sizeof(buf), "%" PRIu64, value);
-    render_leaf(root, ns, name, buf);
+    lmap_u64toa(value, buf);
+    render_leaf(writer, ns, name, buf);
 }
 
 static void
-render_leaf_datetime(xmlNodePtr root, xmlNsPtr ns, char *name, time_t *tp)
+render_leaf_datetime(xmlTextWriterPtr writer, const char *ns, char *name, time_t *tp)
 {
-    char buf[32];
-    struct tm *tmp;
-    
-    tmp = localtime(tp);
-    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", tmp);
-
-    /*
-     * Hack to insert the ':' in the timezone offset since strftime()
-     * implementations do not generate this separator.
-     */
+    char buf[LMAP_DATETIME_LEN];
     
-    if (strlen(buf) == 24) {
-	buf[25] = buf[24];
-	buf[24] = buf[23];
-	buf[23] = buf[22];
-	buf[22] = ':';
+    if (lmap_format_datetime(*tp, buf, sizeof(buf)) == -1) {
+	return;
     }
-    
-    render_leaf(root, ns, name, buf); 
+    render_leaf(writer, ns, name, buf);
 }
 
 static void
-render_leaf_months(xmlNodePtr root, xmlNsPtr ns, char *name, uint16_t months)
+render_leaf_months(xmlTextWriterPtr writer, const char *ns, char *name, uint16_t months)
 {
     int i;
     struct {
@@ -1824,36 +1563,36 @@ render_leaf_months(xmlNodePtr root, xmlNsPtr ns, char *name, uint16_t months)
     };
 
     if (months == UINT16_MAX) {
-	render_leaf(root, ns, name, "*");
+	render_leaf(writer, ns, name, "*");
 	return;
     }
 	
     for (i = 0; tab[i].name; i++) {
 	if (months & tab[i].value) {
-	    render_leaf(root, ns, name, tab[i].name); 
+	    render_leaf(writer, ns, name, tab[i].name); 
 	}
     }
 }
 
 static void
-render_leaf_days_of_month(xmlNodePtr root, xmlNsPtr ns, char *name, uint32_t days_of_month)
+render_leaf_days_of_month(xmlTextWriterPtr writer, const char *ns, char *name, uint32_t days_of_month)
 {
     int i;
     
     if (days_of_month == UINT32_MAX) {
-	render_leaf(root, ns, name, "*");
+	render_leaf(writer, ns, name, "*");
 	return;
     }
 
     for (i = 1; i < 32; i++) {
 	if (days_of_month & (1 << i)) {
-	    render_leaf_int32(root, ns, name, i); 
+	    render_leaf_int32(writer, ns, name, i); 
 	}
     }
 }
 
 static void
-render_leaf_days_of_week(xmlNodePtr root, xmlNsPtr ns, char *name, uint8_t days_of_week)
+render_leaf_days_of_week(xmlTextWriterPtr writer, const char *ns, char *name, uint8_t days_of_week)
 {
     int i;
     struct {
@@ -1871,183 +1610,278 @@ render_leaf_days_of_week(xmlNodePtr root, xmlNsPtr ns, char *name, uint8_t days_
     };
 
     if (days_of_week == UINT8_MAX) {
-	render_leaf(root, ns, name, "*");
+	render_leaf(writer, ns, name, "*");
 	return;
     }
 	
     for (i = 0; tab[i].name; i++) {
 	if (days_of_week & tab[i].value) {
-	    render_leaf(root, ns, name, tab[i].name); 
+	    render_leaf(writer, ns, name, tab[i].name); 
 	}
     }
 }
 
 static void
-render_leaf_hours(xmlNodePtr root, xmlNsPtr ns, char *name, uint32_t hours)
+render_leaf_hours(xmlTextWriterPtr writer, const char *ns, char *name, uint32_t hours)
 {
     int i;
     
     if (hours == UINT32_MAX) {
-	render_leaf(root, ns, name, "*");
+	render_leaf(writer, ns, name, "*");
 	return;
     }
 
     for (i = 0; i < 24; i++) {
 	if (hours & (1 << i)) {
-	    render_leaf_int32(root, ns, name, i); 
+	    render_leaf_int32(writer, ns, name, i); 
 	}
     }
 }
 
 static void
-render_leaf_minsecs(xmlNodePtr root, xmlNsPtr ns, char *name, uint64_t minsecs)
+render_leaf_minsecs(xmlTextWriterPtr writer, const char *ns, char *name, uint64_t minsecs)
 {
     int i;
     
     if (minsecs == UINT64_MAX) {
-	render_leaf(root, ns, name, "*");
+	render_leaf(writer, ns, name, "*");
 	return;
     }
 
     for (i = 0; i < 60; i++) {
 	if (minsecs & (1ull << i)) {
-	    render_leaf_int32(root, ns, name, i); 
+	    render_leaf_int32(writer, ns, name, i); 
 	}
     }
 }
 
 static void
-render_registry(struct registry *registry, xmlNodePtr root, xmlNsPtr ns)
+render_registry(struct registry *registry, xmlTextWriterPtr writer, const char *ns)
 {
     struct tag *tag;
-    xmlNodePtr node;
 
     if (! registry) {
 	return;
     }
     
-    node = xmlNewChild(root, ns, BAD_CAST "function", NULL);
-    if (! node) {
-	return;
-    }
-
-    render_leaf(node, ns, "uri", registry->uri);
+    render_start(writer, ns, "function");
+    render_leaf(writer, ns, "uri", registry->uri);
     for (tag = registry->roles; tag; tag = tag->next) {
-	render_leaf(node, ns, "role", tag->tag);
+	render_leaf(writer, ns, "role", tag->tag);
     }
+    render_end(writer);
 }
 
 static void
-render_option(struct option *option, xmlNodePtr root, xmlNsPtr ns)
+render_option(struct option *option, xmlTextWriterPtr writer, const char *ns)
 {
-    xmlNodePtr node;
-
     if (! option) {
 	return;
     }
     
-    node = xmlNewChild(root, ns, BAD_CAST "option", NULL);
+    render_start(writer, ns, "option");
+    render_leaf(writer, ns, "id", option->id);
+    render_leaf(writer, ns, "name", option->name);
+    render_leaf(writer, ns, "value", option->value);
+    render_end(writer);
+}
 
-    if (! node) {
-	return;
-    }
+static int render_allocations_on = 0;
+
+/**
+ * @brief Includes the allocation counters in state renderings
+ *
+ * The counters (see alloc.h) belong to the process, not to the
+ * rendered lmap, and change with every allocation. They are therefore
+ * only rendered into the agent state if enabled, which lmapd does for
+ * its own state output.
+ *
+ * @param on 1 renders the counters (if compiled in), 0 omits them
+ */
 
-    render_leaf(node, ns, "id", option->id);
-    render_leaf(node, ns, "name", option->name);
-    render_leaf(node, ns, "value", option->value);
+void
+lmap_xml_set_render_allocations(int on)
+{
+    render_allocations_on = on;
 }
 
 static void
-render_agent(struct agent *agent, xmlNodePtr root, xmlNsPtr ns, int what)
+render_allocations(xmlTextWriterPtr writer)
 {
-    xmlNodePtr node;
+    const char *ns = LMAPD_XML_PREFIX;
+    struct lmap_alloc_stats stats;
+    int i;
 
-    if (! agent) {
+    if (! render_allocations_on || ! lmap_alloc_enabled()) {
 	return;
     }
 
-    node = xmlNewChild(root, ns, BAD_CAST "agent", NULL);
-    if (! node) {
+    (void) xmlTextWriterStartElementNS(writer, BAD_CAST ns, BAD_CAST "allocations",
+				       BAD_CAST LMAPD_XML_NAMESPACE);
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	if (lmap_alloc_stats(i, &stats) == -1 || ! stats.total) {
+	    continue;
+	}
+	render_start(writer, ns, "type");
+	render_leaf(writer, ns, "name", lmap_alloc_type_name(i));
+	render_leaf_uint64(writer, ns, "live", stats.live);
+	render_leaf_uint64(writer, ns, "total", stats.total);
+	render_leaf_uint64(writer, ns, "bytes", stats.bytes);
+	render_leaf_uint64(writer, ns, "peak", stats.peak);
+	render_end(writer);
+    }
+    render_end(writer);
+}
+
+static void
+render_agent(struct agent *agent, xmlTextWriterPtr writer, const char *ns, int what)
+{
+    if (! agent) {
 	return;
     }
 
+    render_start(writer, ns, "agent");
     if (what & RENDER_CONFIG_TRUE) {
-	render_leaf(node, ns, "agent-id", agent->agent_id);
-	render_leaf(node, ns, "group-id", agent->group_id);
-	render_leaf(node, ns, "measurement-point", agent->measurement_point);
+	render_leaf(writer, ns, "agent-id", agent->agent_id);
+	render_leaf(writer, ns, "group-id", agent->group_id);
+	render_leaf(writer, ns, "measurement-point", agent->measurement_point);
 	if (agent->flags & LMAP_AGENT_FLAG_REPORT_AGENT_ID_SET) {
-	    render_leaf(node, ns, "report-agent-id",
+	    render_leaf(writer, ns, "report-agent-id",
 			agent->report_agent_id ? "true" : "false");
 	}
 	if (agent->flags & LMAP_AGENT_FLAG_REPORT_GROUP_ID_SET) {
-	    render_leaf(node, ns, "report-group-id",
+	    render_leaf(writer, ns, "report-group-id",
 			agent->report_group_id ? "true" : "false");
 	}
 	if (agent->flags & LMAP_AGENT_FLAG_REPORT_MEASUREMENT_POINT_SET) {
-	    render_leaf(node, ns, "report-measurement-point",
+	    render_leaf(writer, ns, "report-measurement-point",
 			agent->report_measurement_point ? "true" : "false");
 	}
 	if (agent->flags & LMAP_AGENT_FLAG_CONTROLLER_TIMEOUT_SET) {
-	    render_leaf_uint32(node, ns, "controller-timeout",
+	    render_leaf_uint32(writer, ns, "controller-timeout",
 			       agent->controller_timeout);
 	}
     }
     if (what & RENDER_CONFIG_FALSE) {
 	if (agent->last_started) {
-	    render_leaf_datetime(node, ns, "last-started", &agent->last_started);
+	    render_leaf_datetime(writer, ns, "last-started", &agent->last_started);
 	}
+	render_allocations(writer);
     }
+    render_end(writer);
 }
 
 static void
-render_agent_report(struct agent *agent, xmlNodePtr root, xmlNsPtr ns)
+render_agent_report(struct agent *agent, xmlTextWriterPtr writer, const char *ns)
 {
     if (! agent) {
 	return;
     }
 
-    render_leaf_datetime(root, ns, "date", &agent->report_date);
+    render_leaf_datetime(writer, ns, "date", &agent->report_date);
     if (agent->agent_id && agent->report_agent_id) {
-	render_leaf(root, ns, "agent-id", agent->agent_id);
+	render_leaf(writer, ns, "agent-id", agent->agent_id);
     }
     if (agent->group_id && agent->report_group_id) {
-	render_leaf(root, ns, "group-id", agent->group_id);
+	render_leaf(writer, ns, "group-id", agent->group_id);
     }
     if (agent->measurement_point && agent->report_measurement_point) {
-	render_leaf(root, ns, "measurement-point", agent->measurement_point);
+	render_leaf(writer, ns, "measurement-point", agent->measurement_point);
     }
 }
 
+/*
+ * Renders latency histograms in the lmapd namespace. Times are in
+ * microseconds, only buckets with samples are rendered; the le leaf
+ * of a bucket is the largest value it holds.
+ */
+
 static void
-render_action(struct action *action, xmlNodePtr root, xmlNsPtr ns, int what)
+render_histogram(struct lmap_histogram *h, xmlTextWriterPtr writer, const char *ns)
 {
-    struct option *option;
-    struct tag *tag;
-    xmlNodePtr node;
+    int i;
 
-    if (! action) {
+    render_leaf_uint64(writer, ns, "count", h->count);
+    render_leaf_uint64(writer, ns, "sum", h->sum);
+    render_leaf_uint64(writer, ns, "max", h->max);
+    render_leaf_uint64(writer, ns, "p50", lmap_histogram_percentile(h, 50));
+    render_leaf_uint64(writer, ns, "p90", lmap_histogram_percentile(h, 90));
+    render_leaf_uint64(writer, ns, "p99", lmap_histogram_percentile(h, 99));
+    for (i = 0; i < LMAP_HISTOGRAM_BUCKETS; i++) {
+	if (! h->buckets[i]) {
+	    continue;
+	}
+	render_start(writer, ns, "bucket");
+	render_leaf_uint64(writer, ns, "le", lmap_histogram_bucket_max(i));
+	render_leaf_uint64(writer, ns, "count", h->buckets[i]);
+	render_end(writer);
+    }
+}
+
+static void
+render_latency(struct lmap_latency *latency, xmlTextWriterPtr writer)
+{
+    const char *ns = LMAPD_XML_PREFIX;
+    int i;
+
+    if (! latency) {
+	return;
+    }
+
+    (void) xmlTextWriterStartElementNS(writer, BAD_CAST ns, BAD_CAST "latency",
+				       BAD_CAST LMAPD_XML_NAMESPACE);
+    for (i = 0; i < LMAP_LATENCY_STAGES; i++) {
+	if (! latency->stages[i].count) {
+	    continue;
+	}
+	render_start(writer, ns, "stage");
+	render_leaf(writer, ns, "name", lmap_latency_stage_name(i));
+	render_histogram(&latency->stages[i], writer, ns);
+	render_end(writer);
+    }
+    render_end(writer);
+}
+
+static void
+render_lag(struct lmap_histogram *lag, xmlTextWriterPtr writer)
+{
+    const char *ns = LMAPD_XML_PREFIX;
+
+    if (! lag) {
 	return;
     }
 
-    node = xmlNewChild(root, ns, BAD_CAST "action", NULL);
-    if (! node) {
+    (void) xmlTextWriterStartElementNS(writer, BAD_CAST ns, BAD_CAST "lag",
+				       BAD_CAST LMAPD_XML_NAMESPACE);
+    render_histogram(lag, writer, ns);
+    render_end(writer);
+}
+
+static void
+render_action(struct action *action, xmlTextWriterPtr writer, const char *ns, int what)
+{
+    struct option *option;
+    struct tag *tag;
+
+    if (! action) {
 	return;
     }
 
-    render_leaf(node, ns, "name", action->name);
+    render_start(writer, ns, "action");
+    render_leaf(writer, ns, "name", action->name);
     if (what & RENDER_CONFIG_TRUE) {
-	render_leaf(node, ns, "task", action->task);
+	render_leaf(writer, ns, "task", action->task);
 	for (tag = action->destinations; tag; tag = tag->next) {
-	    render_leaf(node, ns, "destination", tag->tag);
+	    render_leaf(writer, ns, "destination", tag->tag);
 	}
 	for (option = action->options; option; option = option->next) {
-	    render_option(option, node, ns);
+	    render_option(option, writer, ns);
 	}
 	for (tag = action->tags; tag; tag = tag->next) {
-	    render_leaf(node, ns, "tag", tag->tag);
+	    render_leaf(writer, ns, "tag", tag->tag);
 	}
 	for (tag = action->suppression_tags; tag; tag = tag->next) {
-	    render_leaf(node, ns, "suppression-tag", tag->tag);
+	    render_leaf(writer, ns, "suppression-tag", tag->tag);
 	}
     }
     if (what & RENDER_CONFIG_FALSE) {
@@ -2067,71 +1901,65 @@ render_action(struct action *action, xmlNodePtr root, xmlNsPtr ns, int what)
 	    break;
 	}
 	if (state) {
-	    render_leaf(node, ns, "state", state);
+	    render_leaf(writer, ns, "state", state);
 	}
 	
-	render_leaf_uint64(node, ns, "storage", action->storage);
-	render_leaf_uint32(node, ns, "invocations", action->cnt_invocations);
-	render_leaf_uint32(node, ns, "suppressions", action->cnt_suppressions);
-	render_leaf_uint32(node, ns, "overlaps", action->cnt_overlaps);
-	render_leaf_uint32(node, ns, "failures", action->cnt_failures);
+	render_leaf_uint64(writer, ns, "storage", action->storage);
+	render_leaf_uint32(writer, ns, "invocations", action->cnt_invocations);
+	render_leaf_uint32(writer, ns, "suppressions", action->cnt_suppressions);
+	render_leaf_uint32(writer, ns, "overlaps", action->cnt_overlaps);
+	render_leaf_uint32(writer, ns, "failures", action->cnt_failures);
 	
 	if (action->last_invocation) {
-	    render_leaf_datetime(node, ns, "last-invocation",
+	    render_leaf_datetime(writer, ns, "last-invocation",
 				 &action->last_invocation);
 	}
 	if (action->last_completion) {
-	    render_leaf_datetime(node, ns, "last-completion",
+	    render_leaf_datetime(writer, ns, "last-completion",
 				 &action->last_completion);
-	    render_leaf_int32(node, ns, "last-status",
+	    render_leaf_int32(writer, ns, "last-status",
 			      action->last_status);
 	    if (action->last_message) {
-		render_leaf(node, ns, "last-message",
+		render_leaf(writer, ns, "last-message",
 			    action->last_message);
 	    }
 	}
 	if (action->last_failed_completion) {
-	    render_leaf_datetime(node, ns, "last-failed-completion",
+	    render_leaf_datetime(writer, ns, "last-failed-completion",
 				 &action->last_failed_completion);
-	    render_leaf_int32(node, ns, "last-failed-status",
+	    render_leaf_int32(writer, ns, "last-failed-status",
 			      action->last_failed_status);
 	    if (action->last_failed_message) {
-		render_leaf(node, ns, "last-failed-message",
+		render_leaf(writer, ns, "last-failed-message",
 			    action->last_failed_message);
 	    }
 	}
+	render_latency(action->latency, writer);
     }
+    render_end(writer);
 }
 
 static void
-render_schedules(struct schedule *schedule, xmlNodePtr root, xmlNsPtr ns, int what)
+render_schedules(struct schedule *schedule, xmlTextWriterPtr writer, const char *ns, int what)
 {
     struct tag *tag;
     struct action *action;
-    xmlNodePtr node;
 
     if (! schedule) {
 	return;
     }
 
-    root = xmlNewChild(root, ns, BAD_CAST "schedules", NULL);
-    if (!root) {
-	return;
-    }
-
+    render_start(writer, ns, "schedules");
     for (; schedule; schedule = schedule->next) {
-	node = xmlNewChild(root, ns, BAD_CAST "schedule", NULL);
-	if (! node) {
-	    continue;
-	}
-	render_leaf(node, ns, "name", schedule->name);
+	render_start(writer, ns, "schedule");
+	render_leaf(writer, ns, "name", schedule->name);
 	if (what & RENDER_CONFIG_TRUE) {
-	    render_leaf(node, ns, "start", schedule->start);
+	    render_leaf(writer, ns, "start", schedule->start);
 	    if (schedule->flags & LMAP_SCHEDULE_FLAG_END_SET) {
-		render_leaf(node, ns, "end", schedule->end);
+		render_leaf(writer, ns, "end", schedule->end);
 	    }
 	    if (schedule->flags & LMAP_SCHEDULE_FLAG_DURATION_SET) {
-		render_leaf_uint64(node, ns, "duration", schedule->duration);
+		render_leaf_uint64(writer, ns, "duration", schedule->duration);
 	    }
 	    if (schedule->flags & LMAP_SCHEDULE_FLAG_EXEC_MODE_SET) {
 		char *mode = NULL;
@@ -2147,14 +1975,14 @@ render_schedules(struct schedule *schedule, xmlNodePtr root, xmlNsPtr ns, int wh
 		    break;
 		}
 		if (mode) {
-		    render_leaf(node, ns, "execution-mode", mode);
+		    render_leaf(writer, ns, "execution-mode", mode);
 		}
 	    }
 	    for (tag = schedule->tags; tag; tag = tag->next) {
-		render_leaf(node, ns, "tag", tag->tag);
+		render_leaf(writer, ns, "tag", tag->tag);
 	    }
 	    for (tag = schedule->suppression_tags; tag; tag = tag->next) {
-		render_leaf(node, ns, "suppression-tag", tag->tag);
+		render_leaf(writer, ns, "suppression-tag", tag->tag);
 	    }
 	}
 	if (what & RENDER_CONFIG_FALSE) {
@@ -2174,56 +2002,50 @@ render_schedules(struct schedule *schedule, xmlNodePtr root, xmlNsPtr ns, int wh
 		break;
 	    }
 	    if (state) {
-		render_leaf(node, ns, "state", state);
+		render_leaf(writer, ns, "state", state);
 	    }
 	    
-	    render_leaf_uint64(node, ns, "storage", schedule->storage);
-	    render_leaf_uint32(node, ns, "invocations", schedule->cnt_invocations);
-	    render_leaf_uint32(node, ns, "suppressions", schedule->cnt_suppressions);
-	    render_leaf_uint32(node, ns, "overlaps", schedule->cnt_overlaps);
-	    render_leaf_uint32(node, ns, "failures", schedule->cnt_failures);
+	    render_leaf_uint64(writer, ns, "storage", schedule->storage);
+	    render_leaf_uint32(writer, ns, "invocations", schedule->cnt_invocations);
+	    render_leaf_uint32(writer, ns, "suppressions", schedule->cnt_suppressions);
+	    render_leaf_uint32(writer, ns, "overlaps", schedule->cnt_overlaps);
+	    render_leaf_uint32(writer, ns, "failures", schedule->cnt_failures);
 	    
 	    if (schedule->last_invocation) {
-		render_leaf_datetime(node, ns, "last-invocation",
+		render_leaf_datetime(writer, ns, "last-invocation",
 				     &schedule->last_invocation);
 	    }
 	}
 
 	for (action = schedule->actions; action; action = action->next) {
-	    render_action(action, node, ns, what);
+	    render_action(action, writer, ns, what);
 	}
+	render_end(writer);
     }
+    render_end(writer);
 }
 
 static void
-render_suppressions(struct supp *supp, xmlNodePtr root, xmlNsPtr ns, int what)
+render_suppressions(struct supp *supp, xmlTextWriterPtr writer, const char *ns, int what)
 {
     struct tag *tag;
-    xmlNodePtr node;
 
     if (! supp) {
 	return;
     }
 
-    root = xmlNewChild(root, ns, BAD_CAST "suppressions", NULL);
-    if (!root) {
-	return;
-    }
-
+    render_start(writer, ns, "suppressions");
     for (; supp; supp = supp->next) {
-	node = xmlNewChild(root, ns, BAD_CAST "suppression", NULL);
-	if (! node) {
-	    continue;
-	}
-	render_leaf(node, ns, "name", supp->name);
+	render_start(writer, ns, "suppression");
+	render_leaf(writer, ns, "name", supp->name);
 	if (what & RENDER_CONFIG_TRUE) {
-	    render_leaf(node, ns, "start", supp->start);
-	    render_leaf(node, ns, "end", supp->end);
+	    render_leaf(writer, ns, "start", supp->start);
+	    render_leaf(writer, ns, "end", supp->end);
 	    for (tag = supp->match; tag; tag = tag->next) {
-		render_leaf(node, ns, "match", tag->tag);
+		render_leaf(writer, ns, "match", tag->tag);
 	    }
 	    if (supp->flags & LMAP_SUPP_FLAG_STOP_RUNNING_SET) {
-		render_leaf(node, ns, "stop-running",
+		render_leaf(writer, ns, "stop-running",
 			    supp->stop_running ? "true" : "false");
 	    }
 	}
@@ -2241,58 +2063,53 @@ render_suppressions(struct supp *supp, xmlNodePtr root, xmlNsPtr ns, int what)
 		break;
 	    }
 	    if (state) {
-		render_leaf(node, ns, "state", state);
+		render_leaf(writer, ns, "state", state);
 	    }
 	}
+	render_end(writer);
     }
+    render_end(writer);
 }
 
 static void
-render_tasks(struct task *task, xmlNodePtr root, xmlNsPtr ns, int what)
+render_tasks(struct task *task, xmlTextWriterPtr writer, const char *ns, int what)
 {
     struct registry *registry;
     struct option *option;
     struct tag *tag;
-    xmlNodePtr node;
 
     if (! task) {
 	return;
     }
 
-    root = xmlNewChild(root, ns, BAD_CAST "tasks", NULL);
-    if (!root) {
-	return;
-    }
-
+    render_start(writer, ns, "tasks");
     for (; task; task = task->next) {
-	node = xmlNewChild(root, ns, BAD_CAST "task", NULL);
-	if (! node) {
-	    continue;
-	}
-	render_leaf(node, ns, "name", task->name);
+	render_start(writer, ns, "task");
+	render_leaf(writer, ns, "name", task->name);
 	for (registry = task->registries; registry; registry = registry->next) {
-	    render_registry(registry, node, ns);
+	    render_registry(registry, writer, ns);
 	}
 	if (what & RENDER_CONFIG_FALSE) {
-	    render_leaf(node, ns, "version", task->version);
+	    render_leaf(writer, ns, "version", task->version);
 	}
-	render_leaf(node, ns, "program", task->program);
+	render_leaf(writer, ns, "program", task->program);
 	if (what & RENDER_CONFIG_TRUE) {
 	    for (option = task->options; option; option = option->next) {
-		render_option(option, node, ns);
+		render_option(option, writer, ns);
 	    }
 	    for (tag = task->tags; tag; tag = tag->next) {
-		render_leaf(node, ns, "tag", tag->tag);
+		render_leaf(writer, ns, "tag", tag->tag);
 	    }
 	}
+	render_end(writer);
     }
+    render_end(writer);
 }
 
 static void
-render_capabilities(struct capability *capability, xmlNodePtr root, xmlNsPtr ns, int what)
+render_capabilities(struct capability *capability, xmlTextWriterPtr writer, const char *ns, int what)
 {
     struct tag *tag;
-    xmlNodePtr node;
 
     if (! capability) {
 	return;
@@ -2306,85 +2123,68 @@ render_capabilities(struct capability *capability, xmlNodePtr root, xmlNsPtr ns,
 	return;
     }
 
-    node = xmlNewChild(root, ns, BAD_CAST "capabilities", NULL);
-    if (! node) {
-	return;
-    }
-
+    render_start(writer, ns, "capabilities");
     if (capability->version) {
-	render_leaf(node, ns, "version", capability->version);
+	render_leaf(writer, ns, "version", capability->version);
     }
     for (tag = capability->tags; tag; tag = tag->next) {
-	render_leaf(node, ns, "tag", tag->tag);
+	render_leaf(writer, ns, "tag", tag->tag);
     }
-    render_tasks(capability->tasks, node, ns, what);
+    render_tasks(capability->tasks, writer, ns, what);
+    render_end(writer);
 }
 
 static void
-render_events(struct event *event, xmlNodePtr root, xmlNsPtr ns, int what)
+render_events(struct event *event, xmlTextWriterPtr writer, const char *ns, int what)
 {
-    xmlNodePtr node, subnode;
-
     if (! event) {
 	return;
     }
 
-    root = xmlNewChild(root, ns, BAD_CAST "events", NULL);
-    if (!root) {
-	return;
-    }
-
+    render_start(writer, ns, "events");
     for (; event; event = event->next) {
-	node = xmlNewChild(root, ns, BAD_CAST "event", NULL);
-	if (! node) {
-	    continue;
-	}
-	render_leaf(node, ns, "name", event->name);
+	render_start(writer, ns, "event");
+	render_leaf(writer, ns, "name", event->name);
 	if (what & RENDER_CONFIG_TRUE) {
 	    if (event->flags & LMAP_EVENT_FLAG_RANDOM_SPREAD_SET) {
-		render_leaf_int32(node, ns, "random-spread", event->random_spread);
+		render_leaf_int32(writer, ns, "random-spread", event->random_spread);
 	    }
 	    if (event->flags & LMAP_EVENT_FLAG_CYCLE_INTERVAL_SET) {
-		render_leaf_int32(node, ns, "cycle-interval", event->cycle_interval);
+		render_leaf_int32(writer, ns, "cycle-interval", event->cycle_interval);
 	    }
 	    switch (event->type) {
 	    case LMAP_EVENT_TYPE_PERIODIC:
-		subnode = xmlNewChild(node, ns, BAD_CAST "periodic", NULL);
-		if (! subnode) {
-		    continue;
-		}
+		render_start(writer, ns, "periodic");
 		if (event->flags & LMAP_EVENT_FLAG_INTERVAL_SET) {
-		    render_leaf_uint32(subnode, ns, "interval", event->interval);
+		    render_leaf_uint32(writer, ns, "interval", event->interval);
 		}
 		if (event->flags & LMAP_EVENT_FLAG_START_SET) {
-		    render_leaf_datetime(subnode, ns, "start", &event->start);
+		    render_leaf_datetime(writer, ns, "start", &event->start);
 		}
 		if (event->flags & LMAP_EVENT_FLAG_END_SET) {
-		    render_leaf_datetime(subnode, ns, "end", &event->end);
+		    render_leaf_datetime(writer, ns, "end", &event->end);
 		}
+		render_end(writer);
 		break;
 	    case LMAP_EVENT_TYPE_CALENDAR:
-		subnode = xmlNewChild(node, ns, BAD_CAST "calendar", NULL);
-		if (! subnode) {
-		    continue;
-		}
+		render_start(writer, ns, "calendar");
 		if (event->months) {
-		    render_leaf_months(subnode, ns, "month", event->months);
+		    render_leaf_months(writer, ns, "month", event->months);
 		}
 		if (event->days_of_month) {
-		    render_leaf_days_of_month(subnode, ns, "day-of-month", event->days_of_month);
+		    render_leaf_days_of_month(writer, ns, "day-of-month", event->days_of_month);
 		}
 		if (event->days_of_week) {
-		    render_leaf_days_of_week(subnode, ns, "day-of-week", event->days_of_week);
+		    render_leaf_days_of_week(writer, ns, "day-of-week", event->days_of_week);
 		}
 		if (event->hours) {
-		    render_leaf_hours(subnode, ns, "hour", event->hours);
+		    render_leaf_hours(writer, ns, "hour", event->hours);
 		}
 		if (event->minutes) {
-		    render_leaf_minsecs(subnode, ns, "minute", event->minutes);
+		    render_leaf_minsecs(writer, ns, "minute", event->minutes);
 		}
 		if (event->seconds) {
-		    render_leaf_minsecs(subnode, ns, "second", event->seconds);
+		    render_leaf_minsecs(writer, ns, "second", event->seconds);
 		}
 		if (event->flags & LMAP_EVENT_FLAG_TIMEZONE_OFFSET_SET) {
 		    char buf[42];
@@ -2393,172 +2193,268 @@ render_events(struct event *event, xmlNodePtr root, xmlNsPtr ns, int what)
 		    offset = (offset < 0) ? -1 * offset : offset;
 		    snprintf(buf, sizeof(buf), "%c%02d:%02d",
 			     c, offset / 60, offset % 60);
-		    render_leaf(subnode, ns, "timezone-offset", buf);
+		    render_leaf(writer, ns, "timezone-offset", buf);
 		}
 		if (event->flags & LMAP_EVENT_FLAG_START_SET) {
-		    render_leaf_datetime(subnode, ns, "start", &event->start);
+		    render_leaf_datetime(writer, ns, "start", &event->start);
 		}
 		if (event->flags & LMAP_EVENT_FLAG_END_SET) {
-		    render_leaf_datetime(subnode, ns, "end", &event->end);
+		    render_leaf_datetime(writer, ns, "end", &event->end);
 		}
+		render_end(writer);
 		break;
 	    case LMAP_EVENT_TYPE_ONE_OFF:
-		subnode = xmlNewChild(node, ns, BAD_CAST "one-off", NULL);
-		if (! subnode) {
-		    continue;
-		}
+		render_start(writer, ns, "one-off");
 		if (event->flags & LMAP_EVENT_FLAG_START_SET) {
-		    render_leaf_datetime(subnode, ns, "time", &event->start);
+		    render_leaf_datetime(writer, ns, "time", &event->start);
 		}
+		render_end(writer);
 		break;
 	    case LMAP_EVENT_TYPE_STARTUP:
-		render_leaf(node, ns, "startup", "");
+		render_leaf(writer, ns, "startup", "");
 		break;
 	    case LMAP_EVENT_TYPE_IMMEDIATE:
-		render_leaf(node, ns, "immediate", "");
+		render_leaf(writer, ns, "immediate", "");
 		break;
 	    case LMAP_EVENT_TYPE_CONTROLLER_LOST:
-		render_leaf(node, ns, "controller-lost", "");
+		render_leaf(writer, ns, "controller-lost", "");
 		break;
 	    case LMAP_EVENT_TYPE_CONTROLLER_CONNECTED:
-		render_leaf(node, ns, "controller-connected", "");
+		render_leaf(writer, ns, "controller-connected", "");
 		break;
 	    }
 	}
+	if (what & RENDER_CONFIG_FALSE) {
+	    render_lag(event->lag, writer);
+	}
+	render_end(writer);
     }
+    render_end(writer);
 }
 
 static void
-render_row(struct row *row, xmlNodePtr root, xmlNsPtr ns)
+render_row(struct table *tab, uint32_t r, xmlTextWriterPtr writer, const char *ns)
 {
-    xmlNodePtr node;
-    struct value *val;
-
-    node = xmlNewChild(root, ns, BAD_CAST "row", NULL);
-    if (!node) {
-	return;
-    }
+    uint32_t c, offset;
 
-    for (val = row->values; val; val = val->next) {
-	render_leaf(node, ns, "value", val->value ? val->value : "");
+    render_start(writer, ns, "row");
+    for (c = 0; c < tab->row_len[r]; c++) {
+	offset = tab->columns[c].offsets[r];
+	render_leaf(writer, ns, "value",
+		    offset == LMAP_TABLE_NULL ? "" : tab->arena + offset);
     }
+    render_end(writer);
 }
 
 static void
-render_table(struct table *tab, xmlNodePtr root, xmlNsPtr ns)
+render_table(struct table *tab, xmlTextWriterPtr writer, const char *ns)
 {
-    xmlNodePtr node;
-    struct row *row;
+    uint32_t r;
     
-    node = xmlNewChild(root, ns, BAD_CAST "table", NULL);
-    if (!node) {
-	return;
-    }
-
-    for (row = tab->rows; row; row = row->next) {
-	render_row(row, node, ns);
+    (void) lmap_table_flatten(tab);
+    render_start(writer, ns, "table");
+    for (r = 0; r < tab->nrows; r++) {
+	render_row(tab, r, writer, ns);
     }
+    render_end(writer);
 }
 
 static void
-render_result(struct result *res, xmlNodePtr root, xmlNsPtr ns)
+render_result(struct result *res, xmlTextWriterPtr writer, const char *ns)
 {
-    xmlNodePtr node;
     struct option *option;
     struct tag *tag;
     struct table *tab;
     
-    node = xmlNewChild(root, ns, BAD_CAST "result", NULL);
-    if (!node) {
-	return;
-    }
-    
-    render_leaf(node, ns, "schedule", res->schedule);
-    render_leaf(node, ns, "action", res->action);
-    render_leaf(node, ns, "task", res->task);
+    render_start(writer, ns, "result");
+    render_leaf(writer, ns, "schedule", res->schedule);
+    render_leaf(writer, ns, "action", res->action);
+    render_leaf(writer, ns, "task", res->task);
     for (option = res->options; option; option = option->next) {
-	render_option(option, node, ns);
+	render_option(option, writer, ns);
     }
     for (tag = res->tags; tag; tag = tag->next) {
-	render_leaf(node, ns, "tag", tag->tag);
+	render_leaf(writer, ns, "tag", tag->tag);
     }
     
     if (res->event) {
-	render_leaf_datetime(node, ns, "event", &res->start);
+	render_leaf_datetime(writer, ns, "event", &res->start);
     }
     
     if (res->start) {
-	render_leaf_datetime(node, ns, "start", &res->start);
+	render_leaf_datetime(writer, ns, "start", &res->start);
     }
     
     if (res->end) {
-	render_leaf_datetime(node, ns, "end", &res->end);
+	render_leaf_datetime(writer, ns, "end", &res->end);
     }
 
     if (res->cycle_number) {
-	render_leaf(node, ns, "cycle-number", res->cycle_number);
+	render_leaf(writer, ns, "cycle-number", res->cycle_number);
     }
 
     if (res->flags & LMAP_RESULT_FLAG_STATUS_SET) {
-	render_leaf_int32(node, ns, "status", res->status);
+	render_leaf_int32(writer, ns, "status", res->status);
     }
     
     for (tab = res->tables; tab; tab = tab->next) {
-	render_table(tab, node, ns);
+	render_table(tab, writer, ns);
+    }
+    render_end(writer);
+}
+
+/*
+ * Starts an indented document with a root element declaring the
+ * namespace prefix used by all other elements.
+ */
+
+static int
+render_root(xmlTextWriterPtr writer, const char *root,
+	    const char *prefix, const char *namespace)
+{
+    if (xmlTextWriterSetIndent(writer, 1) < 0
+	|| xmlTextWriterSetIndentString(writer, BAD_CAST "  ") < 0
+	|| xmlTextWriterStartDocument(writer, NULL, "UTF-8", NULL) < 0
+	|| xmlTextWriterStartElement(writer, BAD_CAST root) < 0
+	|| xmlTextWriterWriteAttributeNS(writer, BAD_CAST "xmlns",
+					       BAD_CAST prefix, NULL,
+					       BAD_CAST namespace) < 0) {
+	return -1;
     }
+    return 0;
 }
 
-static char*
-render_control(struct lmap *lmap, int what)
+static int
+render_control(xmlTextWriterPtr writer, struct lmap *lmap, int what)
 {
-    xmlDocPtr doc;
-    xmlNodePtr root, node;
-    xmlNsPtr ns = NULL;
-    char *config = NULL;
-    xmlChar *p = NULL;
-    int len = 0;
+    const char *ns = LMAPC_XML_PREFIX;
 
     assert(lmap);
 
-    doc = xmlNewDoc(BAD_CAST "1.0");
-    if (doc == NULL) {
-	goto exit;
+    if (render_root(writer, (what & RENDER_CONFIG_FALSE) ? "data" : "config",
+		    LMAPC_XML_PREFIX, LMAPC_XML_NAMESPACE) == -1) {
+	return -1;
     }
 
-    root = xmlNewNode(NULL, BAD_CAST
-		      ((what & RENDER_CONFIG_FALSE) ? "data" : "config"));
-    if (! root) {
-	goto exit;
+    render_start(writer, ns, "lmap");
+    render_capabilities(lmap->capabilities, writer, ns, what);
+    render_agent(lmap->agent, writer, ns, what);
+    render_tasks(lmap->tasks, writer, ns, what);
+    render_schedules(lmap->schedules, writer, ns, what);
+    render_suppressions(lmap->supps, writer, ns, what);
+    render_events(lmap->events, writer, ns, what);
+
+    return xmlTextWriterEndDocument(writer) < 0 ? -1 : 0;
+}
+
+static int
+render_report(xmlTextWriterPtr writer, struct lmap *lmap)
+{
+    const char *ns = LMAPR_XML_PREFIX;
+    struct result *res;
+
+    assert(lmap);
+
+    if (render_root(writer, "rpc",
+		    LMAPR_XML_PREFIX, LMAPR_XML_NAMESPACE) == -1) {
+	return -1;
     }
-    xmlDocSetRootElement(doc, root);
-    
-    ns = xmlNewNs(root, BAD_CAST LMAPC_XML_NAMESPACE, BAD_CAST LMAPC_XML_PREFIX);
-    if (ns == NULL) {
+
+    render_start(writer, ns, "report");
+    render_agent_report(lmap->agent, writer, ns);
+    for (res = lmap->results; res; res = res->next) {
+	render_result(res, writer, ns);
+    }
+
+    return xmlTextWriterEndDocument(writer) < 0 ? -1 : 0;
+}
+
+static int
+render(xmlTextWriterPtr writer, struct lmap *lmap, int what)
+{
+    if (what & RENDER_REPORT) {
+	return render_report(writer, lmap);
+    }
+    return render_control(writer, lmap, what);
+}
+
+/*
+ * Renders into a memory buffer and returns a copy of the document,
+ * which is what the lmap_xml_render_*() functions hand out.
+ */
+
+static char *
+render_string(struct lmap *lmap, int what)
+{
+    xmlBufferPtr buf;
+    xmlTextWriterPtr writer;
+    char *doc = NULL;
+    int ret;
+
+    buf = xmlBufferCreate();
+    if (! buf) {
 	goto exit;
     }
-    
-    node = xmlNewChild(root, ns, BAD_CAST "lmap", NULL);
-    if (! node) {
+    writer = xmlNewTextWriterMemory(buf, 0);
+    if (! writer) {
 	goto exit;
     }
-    
-    render_capabilities(lmap->capabilities, node, ns, what);
-    render_agent(lmap->agent, node, ns, what);
-    render_tasks(lmap->tasks, node, ns, what);
-    render_schedules(lmap->schedules, node, ns, what);
-    render_suppressions(lmap->supps, node, ns, what);
-    render_events(lmap->events, node, ns, what);
+    ret = render(writer, lmap, what);
+    xmlFreeTextWriter(writer);
+    if (ret == 0) {
+	doc = strdup((char *) xmlBufferContent(buf));
+    }
+
+exit:
+    if (buf) xmlBufferFree(buf);
+    xmlCleanupParser();
+    return doc;
+}
+
+struct writer {
+    lmap_write_func *func;
+    void *ctx;
+};
+
+static int
+writer_cb(void *context, const char *buffer, int len)
+{
+    struct writer *writer = context;
+
+    if (writer->func(writer->ctx, buffer, len) == -1) {
+	return -1;
+    }
+    return len;
+}
+
+/*
+ * Streams the document through libxml2's output buffer into the
+ * writer func; the document never exists in memory as a whole.
+ */
+
+static int
+render_write(struct lmap *lmap, int what, lmap_write_func *func, void *ctx)
+{
+    xmlOutputBufferPtr out;
+    xmlTextWriterPtr writer;
+    struct writer w = { .func = func, .ctx = ctx };
+    int ret = -1;
 
-    xmlDocDumpFormatMemoryEnc(doc, &p, &len, "UTF-8", 1);
-    if (p) {
-	config = strdup((char *) p);
-	xmlFree(p);
+    out = xmlOutputBufferCreateIO(writer_cb, NULL, &w, NULL);
+    if (! out) {
+	goto exit;
+    }
+    writer = xmlNewTextWriter(out);
+    if (! writer) {
+	(void) xmlOutputBufferClose(out);
+	goto exit;
     }
+    ret = render(writer, lmap, what);
+    xmlFreeTextWriter(writer);
 
 exit:
-    if (doc) xmlFreeDoc(doc);
     xmlCleanupParser();
-    return config;
+    return ret;
 }
 
 /**
@@ -2575,7 +2471,7 @@ exit:
 char *
 lmap_xml_render_config(struct lmap *lmap)
 {
-    return render_control(lmap, RENDER_CONFIG_TRUE);
+    return render_string(lmap, RENDER_CONFIG_TRUE);
 }
 
 /**
@@ -2592,7 +2488,7 @@ lmap_xml_render_config(struct lmap *lmap)
 char *
 lmap_xml_render_state(struct lmap *lmap)
 {
-    return render_control(lmap, (RENDER_CONFIG_TRUE | RENDER_CONFIG_FALSE));
+    return render_string(lmap, (RENDER_CONFIG_TRUE | RENDER_CONFIG_FALSE));
 }
 
 /**
@@ -2609,48 +2505,66 @@ lmap_xml_render_state(struct lmap *lmap)
 char *
 lmap_xml_render_report(struct lmap *lmap)
 {
-    xmlDocPtr doc;
-    xmlNodePtr root, node;
-    xmlNsPtr ns = NULL;
-    char *report = NULL;
-    xmlChar *p = NULL;
-    int len = 0;
-    struct result *res;
+    return render_string(lmap, RENDER_REPORT);
+}
 
-    assert(lmap);
+/**
+ * @brief Writes an XML rendering of the lmap configuration
+ *
+ * This function renders the current lmap configuration into an XML
+ * document according to the IETF's LMAP YANG data model. The
+ * document is serialized directly into the writer func, i.e., no
+ * serialized copy of the document is kept in memory.
+ *
+ * @param lmap The pointer to the lmap config to be rendered.
+ * @param func The writer receiving the serialized document.
+ * @param ctx The context passed to the writer.
+ * @return 0 on success, -1 on error
+ */
 
-    doc = xmlNewDoc(BAD_CAST "1.0");
-    if (doc == NULL) {
-	goto exit;
-    }
+int
+lmap_xml_write_config(struct lmap *lmap, lmap_write_func *func, void *ctx)
+{
+    return render_write(lmap, RENDER_CONFIG_TRUE, func, ctx);
+}
 
-    root = xmlNewNode(NULL, BAD_CAST "rpc");
-    if (! root) {
-	goto exit;
-    }
-    xmlDocSetRootElement(doc, root);
-    
-    ns = xmlNewNs(root, BAD_CAST LMAPR_XML_NAMESPACE, BAD_CAST LMAPR_XML_PREFIX);
-    if (ns == NULL) {
-	goto exit;
-    }
+/**
+ * @brief Writes an XML rendering of the lmap state
+ *
+ * This function renders the current lmap state into an XML document
+ * according to the IETF's LMAP YANG data model. The document is
+ * serialized directly into the writer func, i.e., no serialized copy
+ * of the document is kept in memory.
+ *
+ * @param lmap The pointer to the lmap state to be rendered.
+ * @param func The writer receiving the serialized document.
+ * @param ctx The context passed to the writer.
+ * @return 0 on success, -1 on error
+ */
 
-    node = xmlNewChild(root, ns, BAD_CAST "report", NULL);
-    if (! node) {
-	goto exit;
-    }
-    render_agent_report(lmap->agent, node, ns);
-    for (res = lmap->results; res; res = res->next) {
-	render_result(res, node, ns);
-    }
-    xmlDocDumpFormatMemoryEnc(doc, &p, &len, "UTF-8", 1);
-    if (p) {
-	report = strdup((char *) p);
-	xmlFree(p);
-    }
+int
+lmap_xml_write_state(struct lmap *lmap, lmap_write_func *func, void *ctx)
+{
+    return render_write(lmap, (RENDER_CONFIG_TRUE | RENDER_CONFIG_FALSE),
+			func, ctx);
+}
 
-exit:
-    if (doc) xmlFreeDoc(doc);
-    xmlCleanupParser();
-    return report;
+/**
+ * @brief Writes an XML rendering of the lmap report
+ *
+ * This function renders the current lmap report into an XML document
+ * according to the IETF's LMAP YANG data model. The document is
+ * serialized directly into the writer func, i.e., no serialized copy
+ * of the document is kept in memory.
+ *
+ * @param lmap The pointer to the lmap report to be rendered.
+ * @param func The writer receiving the serialized document.
+ * @param ctx The context passed to the writer.
+ * @return 0 on success, -1 on error
+ */
+
+int
+lmap_xml_write_report(struct lmap *lmap, lmap_write_func *func, void *ctx)
+{
+    return render_write(lmap, RENDER_REPORT, func, ctx);
 }
@@ -26,6 +26,10 @@
 #define LMAPR_XML_NAMESPACE	"urn:ietf:params:xml:ns:yang:ietf-lmap-report"
 #define LMAPR_XML_PREFIX	"lmapr"
 
+/* lmapd specific state (latency histograms, timer lag, allocations) */
+#define LMAPD_XML_NAMESPACE	"urn:lmapd:params:xml:ns:lmapd-latency"
+#define LMAPD_XML_PREFIX	"lmapd"
+
 extern int lmap_xml_parse_config_path(struct lmap *lmap, const char *path);
 extern int lmap_xml_parse_config_file(struct lmap *lmap, const char *file);
 extern int lmap_xml_parse_config_string(struct lmap *lmap, const char *string);
@@ -34,11 +38,25 @@ extern int lmap_xml_parse_state_path(struct lmap *lmap, const char *path);
 extern int lmap_xml_parse_state_file(struct lmap *lmap, const char *file);
 extern int lmap_xml_parse_state_string(struct lmap *lmap, const char *string);
 
+extern void lmap_xml_set_parse_threads(int threads);
+extern void lmap_xml_set_render_allocations(int on);
+
 extern int lmap_xml_parse_report_file(struct lmap *lmap, const char *file);
 extern int lmap_xml_parse_report_string(struct lmap *lmap, const char *string);
+extern int lmap_xml_read_report_file(struct lmap *lmap, const char *file,
+				     lmap_result_func *func, void *ctx);
+extern int lmap_xml_read_report_string(struct lmap *lmap, const char *string,
+				       lmap_result_func *func, void *ctx);
 
 extern char * lmap_xml_render_config(struct lmap *lmap);
 extern char * lmap_xml_render_state(struct lmap *lmap);
 extern char * lmap_xml_render_report(struct lmap *lmap);
 
+extern int lmap_xml_write_config(struct lmap *lmap,
+				 lmap_write_func *func, void *ctx);
+extern int lmap_xml_write_state(struct lmap *lmap,
+				lmap_write_func *func, void *ctx);
+extern int lmap_xml_write_report(struct lmap *lmap,
+				 lmap_write_func *func, void *ctx);
+
 #endif
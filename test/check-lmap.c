@@ -17,13 +17,31 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <check.h>
 #include <inttypes.h>
 
 #include "lmap.h"
 #include "utils.h"
 #include "xml-io.h"
+#include "json-io.h"
+#include "compress.h"
+#include "chunk.h"
 #include "csv.h"
+#include "lmapd.h"
+#include "workspace.h"
+#include "arena.h"
+#include "snapshot.h"
+#include "latency.h"
+#include "alloc.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 static char last_error_msg[1024];
 
@@ -495,6 +513,251 @@ START_TEST(test_lmap_lmap)
 }
 END_TEST
 
+START_TEST(test_lmap_lists)
+{
+    struct lmap *lmap;
+    struct event *event;
+    struct result *res, **rp;
+    struct tag *tag;
+    char name[32];
+    int i, n;
+
+    lmap = lmap_new();
+
+    /* enough events to switch the lookup over to the hash table */
+    for (i = 0; i < 100; i++) {
+	snprintf(name, sizeof(name), "event-%d", i);
+	event = lmap_event_new();
+	ck_assert_int_eq(lmap_event_set_name(event, name), 0);
+	ck_assert_int_eq(lmap_add_event(lmap, event), 0);
+    }
+    event = lmap_event_new();
+    ck_assert_int_eq(lmap_event_set_name(event, "event-42"), 0);
+    ck_assert_int_eq(lmap_add_event(lmap, event), -1);
+    ck_assert_str_eq(last_error_msg, "duplicate event 'event-42'");
+    lmap_event_free(event);
+    ck_assert_ptr_ne(lmap_find_event(lmap, "event-99"), NULL);
+    ck_assert_ptr_eq(lmap_find_event(lmap, "event-100"), NULL);
+    for (i = 0, event = lmap->events; event; event = event->next, i++) {
+	snprintf(name, sizeof(name), "event-%d", i);
+	ck_assert_str_eq(event->name, name);
+    }
+    ck_assert_int_eq(i, 100);
+
+    /* unlinking the tail must not break later appends */
+    for (i = 0; i < 4; i++) {
+	res = lmap_result_new();
+	res->status = i;
+	ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+    }
+    for (rp = &lmap->results; (*rp)->next; rp = &(*rp)->next) ;
+    lmap_result_free(lmap_unlink_result(lmap, rp));
+    lmap_result_free(lmap_unlink_result(lmap, &lmap->results));
+    res = lmap_result_new();
+    res->status = 4;
+    ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+    for (n = 0, res = lmap->results; res; res = res->next, n++) {
+	ck_assert_int_eq(res->status, n == 2 ? 4 : n + 1);
+    }
+    ck_assert_int_eq(n, 3);
+
+    res = lmap->results;
+    for (i = 0; i < 20; i++) {
+	snprintf(name, sizeof(name), "tag-%d", i);
+	ck_assert_int_eq(lmap_result_add_tag(res, name), 0);
+    }
+    ck_assert_int_eq(lmap_result_add_tag(res, "tag-7"), -1);
+    ck_assert_str_eq(last_error_msg, "ignoring duplicate tag 'tag-7'");
+    for (n = 0, tag = res->tags; tag; tag = tag->next, n++) ;
+    ck_assert_int_eq(n, 20);
+
+    lmap_free(lmap);
+}
+END_TEST
+
+START_TEST(test_lmap_arena)
+{
+    struct lmap *lmap;
+    struct lmap_arena *arena, *other;
+    struct lmap_arena_stats stats;
+    struct schedule *schedule;
+    struct result *res;
+    struct table *tab;
+    char name[32], *p;
+    int i;
+
+    lmap = lmap_new_with_arena();
+    ck_assert_ptr_ne(lmap, NULL);
+    ck_assert_ptr_ne(lmap->arena, NULL);
+    ck_assert_ptr_eq(lmap_arena_find(lmap), lmap->arena);
+    ck_assert_ptr_eq(lmap_arena_use(lmap->arena), NULL);
+
+    for (i = 0; i < 20; i++) {
+	snprintf(name, sizeof(name), "schedule-%d", i);
+	schedule = lmap_schedule_new();
+	ck_assert_ptr_eq(lmap_arena_find(schedule), lmap->arena);
+	ck_assert_ptr_eq(schedule->pool, lmap->arena);
+	ck_assert_int_eq(lmap_schedule_set_name(schedule, name), 0);
+	ck_assert_int_eq(lmap_add_schedule(lmap, schedule), 0);
+    }
+    schedule = lmap_find_schedule(lmap, "schedule-7");
+    ck_assert_ptr_ne(schedule, NULL);
+    ck_assert_ptr_eq(lmap_arena_find(schedule->name), lmap->arena);
+
+    /* a duplicate is freed object by object, which must not crash */
+    schedule = lmap_schedule_new();
+    ck_assert_int_eq(lmap_schedule_set_name(schedule, "schedule-7"), 0);
+    ck_assert_int_eq(lmap_add_schedule(lmap, schedule), -1);
+    lmap_schedule_free(schedule);
+
+    /* tables grow inside the arena */
+    res = lmap_result_new();
+    tab = lmap_table_new();
+    for (i = 0; i < 1000; i++) {
+	ck_assert_int_eq(lmap_table_new_row(tab), 0);
+	ck_assert_int_eq(lmap_table_add_value(tab, "42"), 0);
+	ck_assert_int_eq(lmap_table_add_value(tab, "foo"), 0);
+    }
+    ck_assert_ptr_eq(lmap_arena_find(tab->arena), lmap->arena);
+    ck_assert_str_eq(lmap_table_get_value(tab, 999, 1), "foo");
+    ck_assert_int_eq(lmap_result_add_table(res, tab), 0);
+    ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+
+    /* strings follow the object, not the arena in use */
+    arena = lmap_arena_use(NULL);
+    ck_assert_int_eq(lmap_result_set_schedule(res, "foo"), 0);
+    ck_assert_ptr_eq(lmap_arena_find(res->schedule), arena);
+
+    /* a shorter string reuses the memory of the old one */
+    p = res->schedule;
+    ck_assert_int_eq(lmap_result_set_schedule(res, "fo"), 0);
+    ck_assert_ptr_eq(res->schedule, p);
+    ck_assert_str_eq(res->schedule, "fo");
+
+    /* objects of a merged arena allocate from the arena merged into */
+    other = lmap_arena_new();
+    ck_assert_ptr_ne(other, NULL);
+    (void) lmap_arena_use(other);
+    schedule = lmap_schedule_new();
+    (void) lmap_arena_use(NULL);
+    ck_assert_ptr_eq(schedule->pool, other);
+    lmap_arena_merge(arena, other);
+    ck_assert_int_eq(lmap_schedule_set_name(schedule, "merged"), 0);
+    ck_assert_ptr_eq(lmap_arena_find(schedule->name), arena);
+    ck_assert_ptr_eq(lmap_arena_find(schedule), arena);
+    ck_assert_int_eq(lmap_add_schedule(lmap, schedule), 0);
+
+    lmap_arena_stats(arena, &stats);
+    ck_assert_int_gt(stats.allocs, 40);
+    ck_assert_int_ge(stats.reserved, stats.bytes);
+    ck_assert_int_ge(stats.peak, stats.reserved);
+    ck_assert_int_eq(lmap_arena_foreign(arena), 0);
+
+    /* heap objects linked into the arena graph are still released */
+    res = lmap_result_new();
+    ck_assert_ptr_eq(lmap_arena_find(res), NULL);
+    ck_assert_ptr_eq(res->pool, NULL);
+    ck_assert_int_eq(lmap_result_add_tag(res, "heap"), 0);
+    ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+    ck_assert_int_eq(lmap_arena_foreign(arena), 1);
+
+    lmap_free(lmap);
+    ck_assert_ptr_eq(lmap_arena_current(), NULL);
+}
+END_TEST
+
+START_TEST(test_lmap_alloc)
+{
+    struct lmap_alloc_stats before[LMAP_ALLOC_TYPES], stats;
+    struct lmap *lmap;
+    struct schedule *schedule;
+    struct action *action;
+    struct result *res;
+    struct table *tab;
+    char *doc;
+    int i;
+
+    /* the counters are only rendered into the state on request */
+    lmap = lmap_new();
+    lmap->agent = lmap_agent_new();
+    doc = lmap_xml_render_state(lmap);
+    ck_assert_ptr_ne(doc, NULL);
+    ck_assert_ptr_eq(strstr(doc, "allocations"), NULL);
+    free(doc);
+    lmap_xml_set_render_allocations(1);
+    doc = lmap_xml_render_state(lmap);
+    lmap_xml_set_render_allocations(0);
+    ck_assert_ptr_ne(doc, NULL);
+    ck_assert_int_eq(strstr(doc, "<lmapd:allocations") != NULL,
+		     lmap_alloc_enabled());
+    free(doc);
+    lmap_free(lmap);
+
+    ck_assert_str_eq(lmap_alloc_type_name(LMAP_ALLOC_SCHEDULE), "schedule");
+    ck_assert_str_eq(lmap_alloc_type_name(LMAP_ALLOC_STRING), "string");
+    ck_assert_ptr_eq(lmap_alloc_type_name(LMAP_ALLOC_TYPES), NULL);
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_TYPES, &stats), -1);
+    if (! lmap_alloc_enabled()) {
+	ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_ROW, &stats), -1);
+	return;
+    }
+
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	ck_assert_int_eq(lmap_alloc_stats(i, &before[i]), 0);
+    }
+
+    lmap = lmap_new_with_arena();
+    ck_assert_ptr_eq(lmap_arena_use(lmap->arena), NULL);
+    schedule = lmap_schedule_new();
+    ck_assert_int_eq(lmap_schedule_set_name(schedule, "demo"), 0);
+    action = lmap_action_new();
+    ck_assert_int_eq(lmap_action_set_name(action, "a1"), 0);
+    ck_assert_int_eq(lmap_action_add_tag(action, "t1"), 0);
+    ck_assert_int_eq(lmap_schedule_add_action(schedule, action), 0);
+    ck_assert_int_eq(lmap_add_schedule(lmap, schedule), 0);
+    res = lmap_result_new();
+    tab = lmap_table_new();
+    for (i = 0; i < 100; i++) {
+	ck_assert_int_eq(lmap_table_new_row(tab), 0);
+	ck_assert_int_eq(lmap_table_add_value(tab, "42"), 0);
+	ck_assert_int_eq(lmap_table_add_value(tab, "foo"), 0);
+    }
+    ck_assert_int_eq(lmap_result_add_table(res, tab), 0);
+    ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+    (void) lmap_arena_use(NULL);
+
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_SCHEDULE, &stats), 0);
+    ck_assert_int_eq(stats.live - before[LMAP_ALLOC_SCHEDULE].live, 1);
+    ck_assert_int_eq(stats.total - before[LMAP_ALLOC_SCHEDULE].total, 1);
+    ck_assert_int_ge(stats.peak, stats.bytes);
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_TAG, &stats), 0);
+    ck_assert_int_eq(stats.live - before[LMAP_ALLOC_TAG].live, 1);
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_STRING, &stats), 0);
+    ck_assert_int_eq(stats.live - before[LMAP_ALLOC_STRING].live, 3);
+    ck_assert_int_eq(stats.bytes - before[LMAP_ALLOC_STRING].bytes, 5 + 3 + 3);
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_ROW, &stats), 0);
+    ck_assert_int_eq(stats.live - before[LMAP_ALLOC_ROW].live, 100);
+    ck_assert_int_ge(stats.bytes - before[LMAP_ALLOC_ROW].bytes,
+		     100 * 3 * sizeof(uint32_t));
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_VALUE, &stats), 0);
+    ck_assert_int_eq(stats.live - before[LMAP_ALLOC_VALUE].live, 200);
+    ck_assert_int_ge(stats.bytes - before[LMAP_ALLOC_VALUE].bytes, 100 * 7);
+
+    lmap_free(lmap);
+
+    /* everything is released again, the peaks remain */
+    for (i = 0; i < LMAP_ALLOC_TYPES; i++) {
+	ck_assert_int_eq(lmap_alloc_stats(i, &stats), 0);
+	ck_assert_int_eq(stats.live, before[i].live);
+	ck_assert_int_eq(stats.bytes, before[i].bytes);
+	ck_assert_int_ge(stats.peak, before[i].peak);
+    }
+    lmap_alloc_reset_peak();
+    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_VALUE, &stats), 0);
+    ck_assert_int_eq(stats.peak, stats.bytes);
+}
+END_TEST
+
 START_TEST(test_lmap_val)
 {
     struct value *val = lmap_value_new();
@@ -546,6 +809,118 @@ START_TEST(test_lmap_table)
 }
 END_TEST
 
+START_TEST(test_lmap_table_columns)
+{
+    struct table *tab;
+    struct row *row;
+    struct value *val;
+    int64_t i;
+    double d;
+    const char *rows[][4] = {
+	{ "42", "2.5", "2016-12-25T16:33:02+01:00", "foo" },
+	{ "-7", "1e3", "1970-01-01T00:00:00Z", "012" },
+	{ "0", "-3", NULL, NULL },
+    };
+    int r, c;
+
+    tab = lmap_table_new();
+    ck_assert_ptr_ne(tab, NULL);
+    for (r = 0; r < 3; r++) {
+	ck_assert_int_eq(lmap_table_new_row(tab), 0);
+	for (c = 0; c < 4 && rows[r][c]; c++) {
+	    ck_assert_int_eq(lmap_table_add_value(tab, rows[r][c]), 0);
+	}
+    }
+    ck_assert_int_eq(tab->nrows, 3);
+    ck_assert_int_eq(tab->ncols, 4);
+    ck_assert_int_eq(tab->row_len[2], 2);
+    ck_assert_str_eq(lmap_table_get_value(tab, 1, 3), "012");
+    ck_assert_ptr_eq(lmap_table_get_value(tab, 2, 2), NULL);
+    ck_assert_ptr_eq(lmap_table_get_value(tab, 3, 0), NULL);
+
+    ck_assert_int_eq(lmap_table_column_type(tab, 0), LMAP_COLUMN_TYPE_INT64);
+    ck_assert_int_eq(lmap_table_column_type(tab, 1), LMAP_COLUMN_TYPE_DOUBLE);
+    ck_assert_int_eq(lmap_table_column_type(tab, 2), LMAP_COLUMN_TYPE_DATETIME);
+    ck_assert_int_eq(lmap_table_column_type(tab, 3), LMAP_COLUMN_TYPE_STRING);
+    ck_assert_int_eq(lmap_table_get_int64(tab, 1, 0, &i), 0);
+    ck_assert_int_eq(i, -7);
+    ck_assert_int_eq(lmap_table_get_int64(tab, 0, 2, &i), 0);
+    ck_assert_int_eq(i, 1482679982);
+    ck_assert_int_eq(lmap_table_get_int64(tab, 1, 2, &i), 0);
+    ck_assert_int_eq(i, 0);
+    ck_assert_int_eq(lmap_table_get_int64(tab, 0, 3, &i), -1);
+    ck_assert_int_eq(lmap_table_get_double(tab, 1, 1, &d), 0);
+    ck_assert(d == 1000.0);
+    ck_assert_int_eq(lmap_table_get_double(tab, 0, 0, &d), 0);
+    ck_assert(d == 42.0);
+
+    /* the compatibility view */
+    for (r = 0, row = lmap_table_rows(tab); row; r++, row = row->next) {
+	for (c = 0, val = row->values; val; c++, val = val->next) {
+	    ck_assert_str_eq(val->value, rows[r][c]);
+	}
+	ck_assert_int_eq(c, tab->row_len[r]);
+    }
+    ck_assert_int_eq(r, 3);
+
+    /* adding a value invalidates the view and narrows the type */
+    ck_assert_int_eq(lmap_table_add_value(tab, "00"), 0);
+    ck_assert_ptr_eq(tab->rows, NULL);
+    ck_assert_int_eq(lmap_table_column_type(tab, 2), LMAP_COLUMN_TYPE_STRING);
+    ck_assert_int_eq(lmap_table_valid(NULL, tab), 1);
+    ck_assert_int_eq(lmap_table_add_value(tab, NULL), 0);
+    ck_assert_int_eq(lmap_table_valid(NULL, tab), 0);
+    ck_assert_str_eq(last_error_msg, "val requires a value");
+
+    lmap_table_free(tab);
+}
+END_TEST
+
+START_TEST(test_lmap_table_add_row)
+{
+    struct table *tab;
+    struct row *row1, *row2;
+    struct value *val;
+
+    tab = lmap_table_new();
+    ck_assert_ptr_ne(tab, NULL);
+    row1 = lmap_row_new();
+    val = lmap_value_new();
+    lmap_value_set_value(val, "42");
+    lmap_row_add_value(row1, val);
+    ck_assert_int_eq(lmap_table_add_row(tab, row1), 0);
+
+    /* values may still be appended to rows after they were added */
+    row2 = lmap_row_new();
+    ck_assert_int_eq(lmap_table_add_row(tab, row2), 0);
+    val = lmap_value_new();
+    ck_assert_int_eq(lmap_row_add_value(row2, val), 0);
+    ck_assert_int_eq(lmap_value_set_value(val, "b0"), 0);
+    val = lmap_value_new();
+    lmap_value_set_value(val, "43");
+    ck_assert_int_eq(lmap_row_add_value(row1, val), 0);
+    ck_assert_int_eq(tab->nrows, 2);
+    ck_assert_str_eq(lmap_table_get_value(tab, 0, 1), "43");
+    ck_assert_str_eq(lmap_table_get_value(tab, 1, 0), "b0");
+    ck_assert_int_eq(lmap_table_column_type(tab, 0), LMAP_COLUMN_TYPE_STRING);
+
+    /* later values are copied when the table is read the next time */
+    val = lmap_value_new();
+    lmap_value_set_value(val, "b1");
+    ck_assert_int_eq(lmap_row_add_value(row2, val), 0);
+    ck_assert_int_eq(tab->row_len[1], 1);
+    ck_assert_int_eq(lmap_table_flatten(tab), 0);
+    ck_assert_int_eq(tab->row_len[0], 2);
+    ck_assert_int_eq(tab->row_len[1], 2);
+    ck_assert_str_eq(lmap_table_get_value(tab, 1, 1), "b1");
+    ck_assert_ptr_eq(lmap_table_get_value(tab, 1, 2), NULL);
+    ck_assert_int_eq(lmap_table_valid(NULL, tab), 1);
+
+    /* the rows are released together with the table */
+    lmap_table_free(tab);
+}
+END_TEST
+
 START_TEST(test_lmap_result)
 {
     struct result *res;
@@ -564,6 +939,100 @@ START_TEST(test_lmap_result)
 }
 END_TEST
 
+START_TEST(test_lmap_int)
+{
+    uint64_t uv[] = { 0, 9, 10, 99, 100, 4294967295u, 4294967296u,
+		      9999999999999999999u, UINT64_MAX };
+    int64_t iv[] = { 0, -1, -10, INT32_MIN, INT64_MAX, INT64_MIN };
+    char buf[LMAP_INT_LEN], ref[32];
+    uint64_t u;
+    int64_t i;
+    size_t k;
+
+    for (k = 0; k < sizeof(uv) / sizeof(uv[0]); k++) {
+	snprintf(ref, sizeof(ref), "%" PRIu64, uv[k]);
+	ck_assert_int_eq(lmap_u64toa(uv[k], buf), strlen(ref));
+	ck_assert_str_eq(buf, ref);
+	ck_assert_int_eq(lmap_atou64(buf, UINT64_MAX, &u), 0);
+	ck_assert(u == uv[k]);
+    }
+    for (k = 0; k < sizeof(iv) / sizeof(iv[0]); k++) {
+	snprintf(ref, sizeof(ref), "%" PRIi64, iv[k]);
+	ck_assert_int_eq(lmap_i64toa(iv[k], buf), strlen(ref));
+	ck_assert_str_eq(buf, ref);
+	ck_assert_int_eq(lmap_atoi64(buf, INT64_MIN, INT64_MAX, &i), 0);
+	ck_assert(i == iv[k]);
+    }
+    for (u = 1; u < 100000; u = u * 3 + 1) {
+	snprintf(ref, sizeof(ref), "%" PRIu64, u);
+	lmap_u64toa(u, buf);
+	ck_assert_str_eq(buf, ref);
+    }
+
+    ck_assert_int_eq(lmap_atou64("+42", UINT32_MAX, &u), 0);
+    ck_assert(u == 42);
+    ck_assert_int_eq(lmap_atou64("4294967295", UINT32_MAX, &u), 0);
+    ck_assert_int_eq(lmap_atou64("4294967296", UINT32_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64("18446744073709551616", UINT64_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64("-1", UINT64_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64("", UINT64_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64("+", UINT64_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64(" 1", UINT64_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64("1x", UINT64_MAX, &u), -1);
+    ck_assert_int_eq(lmap_atou64("5", 4, &u), -1);
+    ck_assert_int_eq(lmap_atoi64("-2147483648", INT32_MIN, INT32_MAX, &i), 0);
+    ck_assert(i == INT32_MIN);
+    ck_assert_int_eq(lmap_atoi64("-2147483649", INT32_MIN, INT32_MAX, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("2147483648", INT32_MIN, INT32_MAX, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("-0", INT32_MIN, INT32_MAX, &i), 0);
+    ck_assert(i == 0);
+    ck_assert_int_eq(lmap_atoi64("-", INT32_MIN, INT32_MAX, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("-+5", INT32_MIN, INT32_MAX, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("+-5", INT32_MIN, INT32_MAX, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("-1", 0, INT32_MAX, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("-3", -10, -5, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("-7", -10, -5, &i), 0);
+    ck_assert(i == -7);
+    ck_assert_int_eq(lmap_atoi64("0", -10, -5, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("3", 5, 10, &i), -1);
+    ck_assert_int_eq(lmap_atoi64("-0", 0, 10, &i), 0);
+    ck_assert(i == 0);
+}
+END_TEST
+
+START_TEST(test_lmap_datetime)
+{
+    const char *zones[] = {
+	"GMT", "CET-1CEST,M3.5.0,M10.5.0/3", "NPT-5:45",
+	"NST3:30NDT,M3.2.0,M11.1.0", NULL
+    };
+    time_t edges[] = { 0, -1, 946684799, 951782400, 1482221851, 4102444799 };
+    char buf[LMAP_DATETIME_LEN], ref[32];
+    struct tm *tm;
+    time_t t;
+    size_t i, z;
+
+    for (z = 0; zones[z]; z++) {
+	setenv("TZ", zones[z], 1);
+	tzset();
+	for (i = 0; i < 2 * 365 * 24 * 4 + sizeof(edges) / sizeof(edges[0]); i++) {
+	    t = (i < sizeof(edges) / sizeof(edges[0]))
+		? edges[i] : 1609459200 + (time_t) i * 907;
+	    tm = localtime(&t);
+	    strftime(ref, sizeof(ref), "%Y-%m-%dT%H:%M:%S%z", tm);
+	    memmove(ref + 23, ref + 22, 3);
+	    ref[22] = ':';
+	    ck_assert_int_eq(lmap_format_datetime(t, buf, sizeof(buf)), 25);
+	    ck_assert_str_eq(buf, ref);
+	}
+    }
+    ck_assert_int_eq(lmap_format_datetime(0, buf, sizeof(buf) - 1), -1);
+
+    setenv("TZ", "GMT", 1);
+    tzset();
+}
+END_TEST
+
 START_TEST(test_parser_config_agent)
 {
     const char *a =
@@ -1519,6 +1988,212 @@ START_TEST(test_parser_config_merge)
 }
 END_TEST
 
+START_TEST(test_parser_config_path)
+{
+    const char *docs[] = {
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:agent>"
+        "      <lmapc:controller-timeout>42</lmapc:controller-timeout>"
+        "    </lmapc:agent>"
+        "    <lmapc:suppressions>"
+        "      <lmapc:suppression>"
+        "       <lmapc:name>suppression</lmapc:name>"
+        "       <lmapc:match>*</lmapc:match>"
+        "      </lmapc:suppression>"
+        "    </lmapc:suppressions>"
+        "  </lmapc:lmap>"
+        "</config>",
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:agent>"
+        "      <lmapc:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapc:agent-id>"
+        "      <lmapc:controller-timeout>43</lmapc:controller-timeout>"
+        "    </lmapc:agent>"
+        "    <lmapc:suppressions>"
+        "      <lmapc:suppression>"
+        "       <lmapc:name>suppression</lmapc:name>"
+        "       <lmapc:match>foo</lmapc:match>"
+        "      </lmapc:suppression>"
+        "    </lmapc:suppressions>"
+        "  </lmapc:lmap>"
+        "</config>",
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:events>"
+        "      <lmapc:event>"
+        "        <lmapc:name>periodic</lmapc:name>"
+        "        <lmapc:periodic>"
+        "          <lmapc:interval>4321</lmapc:interval>"
+        "        </lmapc:periodic>"
+        "      </lmapc:event>"
+        "    </lmapc:events>"
+        "  </lmapc:lmap>"
+        "</config>",
+    };
+    const int n = sizeof(docs)/sizeof(docs[0]);
+    char dir[] = "/tmp/check-lmap-XXXXXX";
+    char path[PATH_MAX];
+    struct lmap *lmap;
+    char *x, *y;
+    FILE *f;
+    int i;
+
+    /* the expected result of merging the documents in order */
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    for (i = 0; i < n; i++) {
+	(void) lmap_xml_parse_config_string(lmap, docs[i]);
+    }
+    x = lmap_xml_render_config(lmap);
+    ck_assert_ptr_ne(x, NULL);
+    ck_assert_int_eq(lmap->agent->controller_timeout, 43);
+    ck_assert_str_eq(lmap->supps->match->tag, "*");
+    lmap_free(lmap);
+
+    /* write the files in reverse order, they are merged by name */
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    for (i = n - 1; i >= 0; i--) {
+	snprintf(path, sizeof(path), "%s/%d.xml", dir, i);
+	f = fopen(path, "w");
+	ck_assert_ptr_ne(f, NULL);
+	fputs(docs[i], f);
+	fclose(f);
+    }
+
+    for (i = 0; i < 2; i++) {
+	lmap_xml_set_parse_threads(i ? 4 : 1);
+
+	lmap = lmap_new();
+	ck_assert_ptr_ne(lmap, NULL);
+	ck_assert_int_eq(lmap_xml_parse_config_path(lmap, dir), 0);
+	y = lmap_xml_render_config(lmap);
+	ck_assert_str_eq(x, y);
+	lmap_free(lmap);
+	free(y);
+
+	lmap = lmap_new_with_arena();
+	ck_assert_ptr_ne(lmap, NULL);
+	(void) lmap_arena_use(lmap->arena);
+	ck_assert_int_eq(lmap_xml_parse_config_path(lmap, dir), 0);
+	(void) lmap_arena_use(NULL);
+	ck_assert_int_eq(lmap_arena_foreign(lmap->arena), 0);
+	y = lmap_xml_render_config(lmap);
+	ck_assert_str_eq(x, y);
+	lmap_free(lmap);
+	free(y);
+    }
+    lmap_xml_set_parse_threads(0);
+
+    for (i = 0; i < n; i++) {
+	snprintf(path, sizeof(path), "%s/%d.xml", dir, i);
+	unlink(path);
+    }
+    rmdir(dir);
+    free(x);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_parser_config_sections)
+{
+    const char *a =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\""
+        "        xmlns:x=\"urn:example\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:events>"
+        "      <lmapc:event>"
+        "        <lmapc:name>startup</lmapc:name>"
+        "        <lmapc:startup/>"
+        "      </lmapc:event>"
+        "    </lmapc:events>"
+        "    <x:schedules>"
+        "      <lmapc:schedule>"
+        "        <lmapc:name>foreign</lmapc:name>"
+        "        <lmapc:start>startup</lmapc:start>"
+        "      </lmapc:schedule>"
+        "    </x:schedules>"
+        "    <lmapc:schedules>"
+        "      <lmapc:schedule>"
+        "        <lmapc:name>first</lmapc:name>"
+        "        <lmapc:start>startup</lmapc:start>"
+        "      </lmapc:schedule>"
+        "    </lmapc:schedules>"
+        "  </lmapc:lmap>"
+        "  <x:wrapper>"
+        "    <lmapc:lmap>"
+        "      <lmapc:tasks>"
+        "        <lmapc:task>"
+        "          <lmapc:name>task</lmapc:name>"
+        "          <lmapc:program>/bin/true</lmapc:program>"
+        "        </lmapc:task>"
+        "      </lmapc:tasks>"
+        "      <lmapc:schedules>"
+        "        <lmapc:schedule>"
+        "          <lmapc:name>second</lmapc:name>"
+        "          <lmapc:start>startup</lmapc:start>"
+        "        </lmapc:schedule>"
+        "      </lmapc:schedules>"
+        "      <lmapc:agent>"
+        "        <lmapc:controller-timeout>42</lmapc:controller-timeout>"
+        "      </lmapc:agent>"
+        "    </lmapc:lmap>"
+        "  </x:wrapper>"
+        "</config>";
+
+    const char *x =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+        "  <lmapc:lmap>\n"
+        "    <lmapc:agent>\n"
+        "      <lmapc:controller-timeout>42</lmapc:controller-timeout>\n"
+        "    </lmapc:agent>\n"
+        "    <lmapc:tasks>\n"
+        "      <lmapc:task>\n"
+        "        <lmapc:name>task</lmapc:name>\n"
+        "        <lmapc:program>/bin/true</lmapc:program>\n"
+        "      </lmapc:task>\n"
+        "    </lmapc:tasks>\n"
+        "    <lmapc:schedules>\n"
+        "      <lmapc:schedule>\n"
+        "        <lmapc:name>first</lmapc:name>\n"
+        "        <lmapc:start>startup</lmapc:start>\n"
+        "      </lmapc:schedule>\n"
+        "      <lmapc:schedule>\n"
+        "        <lmapc:name>second</lmapc:name>\n"
+        "        <lmapc:start>startup</lmapc:start>\n"
+        "      </lmapc:schedule>\n"
+        "    </lmapc:schedules>\n"
+        "    <lmapc:events>\n"
+        "      <lmapc:event>\n"
+        "        <lmapc:name>startup</lmapc:name>\n"
+        "        <lmapc:startup/>\n"
+        "      </lmapc:event>\n"
+        "    </lmapc:events>\n"
+        "  </lmapc:lmap>\n"
+        "</config>\n";
+    char *b;
+    struct lmap *lmap = NULL;
+
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    ck_assert_int_eq(lmap_xml_parse_config_string(lmap, a), 0);
+    ck_assert_ptr_ne(lmap->agent, NULL);
+    ck_assert_ptr_ne(lmap_find_schedule(lmap, "first"), NULL);
+    ck_assert_ptr_ne(lmap_find_schedule(lmap, "second"), NULL);
+    ck_assert_ptr_eq(lmap_find_schedule(lmap, "foreign"), NULL);
+    b = lmap_xml_render_config(lmap);
+    ck_assert_ptr_ne(b, NULL);
+    ck_assert_str_eq(b, x);
+
+    ck_assert_str_eq(last_error_msg, "");
+
+    lmap_free(lmap);
+    free(b);
+}
+END_TEST
+
 START_TEST(test_parser_state_agent)
 {
     const char *a =
@@ -2034,51 +2709,1011 @@ START_TEST(test_parser_report)
 }
 END_TEST
 
-START_TEST(test_csv)
+struct membuf {
+    char buf[8192];
+    size_t len;
+};
+
+static int
+membuf_write(void *ctx, const char *buf, size_t len)
 {
-    FILE *f;
-    const char delimiter = 'x';
-    const char *msg =
-	"This message is something rather long including funny characters; "
-	"such as ' or . or ? and then even more;\"";
-    char buf[256];
-    char *s;
+    struct membuf *m = ctx;
 
-    f = tmpfile();
-    ck_assert_ptr_ne(f, NULL);
-    csv_start(f, delimiter, "0");
-    csv_append(f, delimiter, "1");
-    csv_append(f, delimiter, "2");
-    csv_end(f);
-    csv_start(f, delimiter, "3");
-    csv_append(f, delimiter, "4");
-    csv_append(f, delimiter, "5");
-    csv_append(f, delimiter, "6");
-    csv_end(f);
-    csv_start(f, delimiter, msg);
-    csv_end(f);
-    rewind(f);
-    s = fgets(buf, sizeof(buf), f);
-    ck_assert_ptr_ne(s, NULL);
-    ck_assert_str_eq(buf, "0x1x2\n");
-    s = fgets(buf, sizeof(buf), f);
-    ck_assert_ptr_ne(s, NULL);
-    ck_assert_str_eq(buf, "3x4x5x6\n");
-    s = fgets(buf, sizeof(buf), f);
-    ck_assert_ptr_ne(s, NULL);
-    if (strlen(buf) > 3) {
-	buf[strlen(buf)-3] = 0;
+    if (m->len + len > sizeof(m->buf)) {
+	return -1;
     }
-    ck_assert_str_eq(buf+1, msg);
-    fclose(f);
+    memcpy(m->buf + m->len, buf, len);
+    m->len += len;
+    return 0;
 }
-END_TEST
 
-START_TEST(test_csv_key_value)
+static int
+count_result(struct result *res, void *ctx)
 {
-    FILE *f;
-    const char delimiter = ';';
-    const char *hello = "hel;lo";
+    int *count = ctx;
+
+    (*count)++;
+    lmap_result_free(res);
+    return (*count == 2) ? -1 : 0;
+}
+
+START_TEST(test_parser_report_stream)
+{
+    const char *a =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<rpc xmlns:lmapr=\"urn:ietf:params:xml:ns:yang:ietf-lmap-report\">\n"
+	"  <lmapr:report>\n"
+	"    <lmapr:date>2016-12-25T16:33:02+00:00</lmapr:date>\n"
+	"    <lmapr:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapr:agent-id>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>one</lmapr:action>\n"
+	"    </lmapr:result>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>two</lmapr:action>\n"
+	"    </lmapr:result>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>three</lmapr:action>\n"
+	"    </lmapr:result>\n"
+	"  </lmapr:report>\n"
+	"</rpc>\n";
+    int count = 0;
+    struct lmap *lmap;
+
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    ck_assert_int_eq(lmap_xml_read_report_string(lmap, a, count_result, &count), 0);
+    ck_assert_int_eq(count, 2);
+    ck_assert_ptr_eq(lmap->results, NULL);
+    ck_assert_ptr_ne(lmap->agent, NULL);
+    ck_assert_str_eq(lmap->agent->agent_id, "550e8400-e29b-41d4-a716-446655440000");
+    lmap_free(lmap);
+
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    ck_assert_int_eq(lmap_xml_read_report_string(lmap, a, NULL, NULL), 0);
+    ck_assert_ptr_ne(lmap->results, NULL);
+    ck_assert_str_eq(lmap->results->next->next->action, "three");
+    lmap_free(lmap);
+
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    ck_assert_int_eq(lmap_xml_read_report_string(lmap, "<rpc><unterminated", NULL, NULL), -1);
+    lmap_free(lmap);
+}
+END_TEST
+
+START_TEST(test_report_write)
+{
+    const char *a =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<rpc xmlns:lmapr=\"urn:ietf:params:xml:ns:yang:ietf-lmap-report\">\n"
+	"  <lmapr:report>\n"
+	"    <lmapr:date>2016-12-25T16:33:02+00:00</lmapr:date>\n"
+	"    <lmapr:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapr:agent-id>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>mtr-search-sites</lmapr:action>\n"
+	"      <lmapr:task>mtr</lmapr:task>\n"
+	"      <lmapr:tag>\"quoted\"</lmapr:tag>\n"
+	"      <lmapr:table>\n"
+	"        <lmapr:row>\n"
+	"          <lmapr:value>1482221851</lmapr:value>\n"
+	"          <lmapr:value>OK</lmapr:value>\n"
+	"        </lmapr:row>\n"
+	"      </lmapr:table>\n"
+	"    </lmapr:result>\n"
+	"  </lmapr:report>\n"
+	"</rpc>\n";
+    const char *b =
+	"{\n"
+	"  \"ietf-lmap-report:report\":{\n"
+	"    \"date\":\"2016-12-25T16:33:02+00:00\",\n"
+	"    \"agent-id\":\"550e8400-e29b-41d4-a716-446655440000\",\n"
+	"    \"result\":[\n"
+	"      {\n"
+	"        \"schedule\":\"demo\",\n"
+	"        \"action\":\"mtr-search-sites\",\n"
+	"        \"task\":\"mtr\",\n"
+	"        \"option\":[],\n"
+	"        \"tag\":[\n"
+	"          \"\\\"quoted\\\"\"\n"
+	"        ],\n"
+	"        \"table\":[\n"
+	"          {\n"
+	"            \"row\":[\n"
+	"              {\n"
+	"                \"value\":[\n"
+	"                  \"1482221851\",\n"
+	"                  \"OK\"\n"
+	"                ]\n"
+	"              }\n"
+	"            ]\n"
+	"          }\n"
+	"        ]\n"
+	"      }\n"
+	"    ]\n"
+	"  }\n"
+	"}\n";
+    struct lmap *lmap;
+    struct membuf m;
+    char *c;
+
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    ck_assert_int_eq(lmap_xml_parse_report_string(lmap, a), 0);
+
+    memset(&m, 0, sizeof(m));
+    ck_assert_int_eq(lmap_xml_write_report(lmap, membuf_write, &m), 0);
+    ck_assert_int_eq(m.len, strlen(a));
+    ck_assert_int_eq(memcmp(m.buf, a, m.len), 0);
+
+    c = lmap_json_render_report(lmap);
+    ck_assert_ptr_ne(c, NULL);
+    ck_assert_str_eq(c, b);
+    free(c);
+
+    lmap_free(lmap);
+}
+END_TEST
+
+START_TEST(test_state_write)
+{
+    const char *a =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:tasks>"
+        "      <lmapc:task>"
+        "        <lmapc:name>t1</lmapc:name>"
+        "        <lmapc:program>/bin/true</lmapc:program>"
+        "        <lmapc:option>"
+        "          <lmapc:id>q</lmapc:id>"
+        "          <lmapc:value>a&amp;b&lt;c&gt;\"d\"</lmapc:value>"
+        "        </lmapc:option>"
+        "      </lmapc:task>"
+        "    </lmapc:tasks>"
+        "  </lmapc:lmap>"
+        "</config>";
+    struct lmap *lmapa = NULL, *lmapb = NULL;
+    struct membuf m;
+    char *b;
+
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_xml_parse_config_string(lmapa, a), 0);
+    ck_assert_str_eq(lmapa->tasks->options->value, "a&b<c>\"d\"");
+
+    b = lmap_xml_render_state(lmapa);
+    ck_assert_ptr_ne(b, NULL);
+    ck_assert_ptr_ne(strstr(b, "<lmapc:value>a&amp;b&lt;c&gt;\"d\"</lmapc:value>"), NULL);
+
+    memset(&m, 0, sizeof(m));
+    ck_assert_int_eq(lmap_xml_write_state(lmapa, membuf_write, &m), 0);
+    ck_assert_int_eq(m.len, strlen(b));
+    ck_assert_int_eq(memcmp(m.buf, b, m.len), 0);
+
+    lmapb = lmap_new();
+    ck_assert_ptr_ne(lmapb, NULL);
+    ck_assert_int_eq(lmap_xml_parse_state_string(lmapb, b), 0);
+    ck_assert_str_eq(lmapb->tasks->options->value, "a&b<c>\"d\"");
+
+    ck_assert_str_eq(last_error_msg, "");
+
+    lmap_free(lmapa); lmap_free(lmapb);
+    free(b);
+}
+END_TEST
+
+START_TEST(test_latency)
+{
+    const char *a =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:schedules>"
+        "      <lmapc:schedule>"
+        "        <lmapc:name>s1</lmapc:name>"
+        "        <lmapc:start>e1</lmapc:start>"
+        "        <lmapc:action>"
+        "          <lmapc:name>a1</lmapc:name>"
+        "          <lmapc:task>t1</lmapc:task>"
+        "        </lmapc:action>"
+        "      </lmapc:schedule>"
+        "    </lmapc:schedules>"
+        "  </lmapc:lmap>"
+        "</config>";
+    struct lmap *lmapa = NULL, *lmapb = NULL;
+    struct lmap_histogram h;
+    struct action *action;
+    uint64_t v;
+    char *b;
+    int i;
+
+    /* bucket boundaries are contiguous and bound the values they hold */
+    for (v = 0; v < 100000; v++) {
+	memset(&h, 0, sizeof(h));
+	lmap_histogram_record(&h, v);
+	for (i = 0; ! h.buckets[i]; i++) ;
+	ck_assert(v <= lmap_histogram_bucket_max(i));
+	ck_assert(i == 0 || v > lmap_histogram_bucket_max(i - 1));
+	ck_assert(v < 4 || lmap_histogram_bucket_max(i) - v < v / 4);
+    }
+    memset(&h, 0, sizeof(h));
+    lmap_histogram_record(&h, UINT64_MAX);
+    ck_assert_int_eq(h.buckets[LMAP_HISTOGRAM_BUCKETS - 1], 1);
+
+    memset(&h, 0, sizeof(h));
+    ck_assert(lmap_histogram_percentile(&h, 50) == 0);
+    for (v = 1; v <= 100; v++) {
+	lmap_histogram_record(&h, v * 1000);
+    }
+    ck_assert(h.count == 100 && h.max == 100000 && h.sum == 5050000);
+    v = lmap_histogram_percentile(&h, 50);
+    ck_assert(v >= 50000 && v < 50000 + 50000 / 4);
+    ck_assert(lmap_histogram_percentile(&h, 100) == 100000);
+
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_xml_parse_config_string(lmapa, a), 0);
+    action = lmapa->schedules->actions;
+    ck_assert_int_eq(lmap_latency_record(action, LMAP_LATENCY_RUN, 1000, 1250), 0);
+    ck_assert_int_eq(lmap_latency_record(action, LMAP_LATENCY_RUN, 0, 1250), 0);
+    ck_assert_int_eq(lmap_latency_record(action, LMAP_LATENCY_STAGES, 1, 2), -1);
+    ck_assert(action->latency->stages[LMAP_LATENCY_RUN].count == 1);
+
+    b = lmap_xml_render_state(lmapa);
+    ck_assert_ptr_ne(b, NULL);
+    ck_assert_ptr_ne(strstr(b, "<lmapd:latency xmlns:lmapd=\"" LMAPD_XML_NAMESPACE "\">"), NULL);
+    ck_assert_ptr_ne(strstr(b, "<lmapd:name>run</lmapd:name>"), NULL);
+    ck_assert_ptr_eq(strstr(b, "<lmapd:name>queue</lmapd:name>"), NULL);
+    ck_assert_ptr_ne(strstr(b, "<lmapd:le>255</lmapd:le>"), NULL);
+
+    /* the state parser skips the lmapd namespace */
+    lmapb = lmap_new();
+    ck_assert_ptr_ne(lmapb, NULL);
+    ck_assert_int_eq(lmap_xml_parse_state_string(lmapb, b), 0);
+    ck_assert_ptr_eq(lmapb->schedules->actions->latency, NULL);
+    ck_assert_str_eq(last_error_msg, "");
+
+    lmap_free(lmapa); lmap_free(lmapb);
+    free(b);
+}
+END_TEST
+
+START_TEST(test_log)
+{
+    struct membuf m;
+    uint64_t suppressed, dropped;
+    char *p;
+    int i, lines, status;
+    pid_t pid;
+
+    m.len = 0;
+    lmap_log_set_output(membuf_write, &m);
+    lmap_log_set_format(LMAP_LOG_FORMAT_JSON);
+    lmap_log_set_rate(3, 3600);
+    ck_assert_int_eq(lmap_log_start(), 0);
+    for (i = 0; i < 10; i++) {
+	lmap_wrn("action '%s' still running (pid %d) - skipping", "a\"1", i);
+    }
+    lmap_err("other call site");
+
+    /* a forked child does not inherit the suppressed messages */
+    pid = fork();
+    ck_assert_int_ne(pid, -1);
+    if (pid == 0) {
+	lmap_log_stats(&suppressed, &dropped);
+	_exit(suppressed == 0 && dropped == 0 ? 0 : 1);
+    }
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+    ck_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    lmap_log_stop();
+    lmap_set_log_handler(vlog);
+    lmap_log_set_output(NULL, NULL);
+    lmap_log_set_rate(LMAP_LOG_BURST, LMAP_LOG_INTERVAL);
+    lmap_log_set_format(LMAP_LOG_FORMAT_TEXT);
+
+    /* three messages, the other call site and the summary */
+    m.buf[m.len] = 0;
+    for (lines = 0, p = m.buf; (p = strchr(p, '\n')); p++) {
+	lines++;
+    }
+    ck_assert_int_eq(lines, 5);
+    ck_assert_ptr_ne(strstr(m.buf, "\"level\":\"warning\",\"func\":\"test_log"), NULL);
+    ck_assert_ptr_ne(strstr(m.buf, "\"msg\":\"action 'a\\\"1' still running "
+			    "(pid 2) - skipping\"}\n"), NULL);
+    ck_assert_ptr_eq(strstr(m.buf, "(pid 3)"), NULL);
+    ck_assert_ptr_ne(strstr(m.buf, "\"level\":\"err\""), NULL);
+    ck_assert_ptr_ne(strstr(m.buf, "suppressed 7 messages like"), NULL);
+    lmap_log_stats(&suppressed, &dropped);
+    ck_assert_int_eq(suppressed, 7);
+    ck_assert_int_eq(dropped, 0);
+
+    ck_assert_int_eq(lmap_log_parse_format("kv"), LMAP_LOG_FORMAT_KV);
+    ck_assert_int_eq(lmap_log_parse_format("xml"), -1);
+}
+END_TEST
+
+START_TEST(test_parser_json_config)
+{
+    int i, fd;
+    size_t len;
+    FILE *f;
+    char path[] = "/tmp/check-lmap-XXXXXX";
+    char *t;
+    struct lmap_alloc_stats before[LMAP_ALLOC_TYPES], stats;
+    const char nul[] = "{ \"ietf-lmap-control:lmap\": { \"agent\": "
+	"{ \"agent-id\": \"a\0b\" } } }";
+    const char *bad[] = {
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id\" \"g\" } } }",
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id\": \"g\" "
+	"\"measurement-point\": \"m\" } } }",
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id\": \"g\", } } }",
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id\": [ \"g\" ] ] } }",
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id\": \"g\\u0000\" } } }",
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id\",: \"g\" } } }",
+	"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"group-id-"
+	"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+	"\": \"g\" } } }",
+	NULL
+    };
+    const char *dup[] = {
+	"{ \"ietf-lmap-control:lmap\": { \"tasks\": { \"task\": [ "
+	"{ \"name\": \"t\", \"option\": [ { \"id\": \"o\" }, { \"id\": \"o\" }, "
+	"{ \"name\": \"n\" } ], \"function\": [ { \"uri\": \"u\" }, "
+	"{ \"uri\": \"u\" }, { \"role\": [ \"r\" ] } ] }, "
+	"{ \"name\": \"t\" }, { \"program\": \"p\" } ] } } }",
+	"{ \"ietf-lmap-control:lmap\": { \"schedules\": { \"schedule\": [ "
+	"{ \"name\": \"s\", \"action\": [ { \"name\": \"a\", \"option\": "
+	"[ { \"id\": \"o\" }, { \"id\": \"o\" } ] }, { \"name\": \"a\" }, "
+	"{ \"task\": \"t\" }, { \"name\": \"b\", \"task\": [ ] } ] }, "
+	"{ \"name\": \"s\" } ] } } }",
+	NULL
+    };
+    const char *a =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:agent>"
+	"      <lmapc:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapc:agent-id>"
+	"      <lmapc:report-agent-id>true</lmapc:report-agent-id>"
+	"      <lmapc:controller-timeout>604800</lmapc:controller-timeout>"
+        "    </lmapc:agent>"
+        "    <lmapc:suppressions>"
+        "      <lmapc:suppression>"
+        "        <lmapc:name>quiet</lmapc:name>"
+        "        <lmapc:match>*</lmapc:match>"
+        "        <lmapc:match>\xc3\xa9t\xc3\xa9</lmapc:match>"
+        "      </lmapc:suppression>"
+        "    </lmapc:suppressions>"
+        "    <lmapc:tasks>"
+        "      <lmapc:task>"
+        "        <lmapc:name>mtr</lmapc:name>"
+        "        <lmapc:function>"
+        "          <lmapc:uri>urn:example:mtr</lmapc:uri>"
+        "          <lmapc:role>client</lmapc:role>"
+        "        </lmapc:function>"
+        "        <lmapc:program>/usr/bin/mtr</lmapc:program>"
+        "        <lmapc:option>"
+        "          <lmapc:id>report</lmapc:id>"
+        "          <lmapc:name>--csv</lmapc:name>"
+        "        </lmapc:option>"
+        "        <lmapc:tag>\"quoted\"</lmapc:tag>"
+        "      </lmapc:task>"
+        "    </lmapc:tasks>"
+        "    <lmapc:schedules>"
+        "      <lmapc:schedule>"
+        "        <lmapc:name>demo</lmapc:name>"
+        "        <lmapc:start>hourly</lmapc:start>"
+        "        <lmapc:execution-mode>sequential</lmapc:execution-mode>"
+        "        <lmapc:action>"
+        "          <lmapc:name>mtr</lmapc:name>"
+        "          <lmapc:task>mtr</lmapc:task>"
+        "          <lmapc:option>"
+        "            <lmapc:id>target</lmapc:id>"
+        "            <lmapc:value>www.example.com</lmapc:value>"
+        "          </lmapc:option>"
+        "          <lmapc:destination>demo</lmapc:destination>"
+        "        </lmapc:action>"
+        "      </lmapc:schedule>"
+        "    </lmapc:schedules>"
+        "    <lmapc:events>"
+        "      <lmapc:event>"
+        "        <lmapc:name>hourly</lmapc:name>"
+        "        <lmapc:periodic>"
+        "          <lmapc:interval>3600</lmapc:interval>"
+        "        </lmapc:periodic>"
+        "      </lmapc:event>"
+        "      <lmapc:event>"
+        "        <lmapc:name>daily</lmapc:name>"
+        "        <lmapc:calendar>"
+        "          <lmapc:month>*</lmapc:month>"
+        "          <lmapc:day-of-month>*</lmapc:day-of-month>"
+        "          <lmapc:day-of-week>*</lmapc:day-of-week>"
+        "          <lmapc:hour>4</lmapc:hour>"
+        "          <lmapc:hour>16</lmapc:hour>"
+        "          <lmapc:minute>0</lmapc:minute>"
+        "          <lmapc:second>0</lmapc:second>"
+        "        </lmapc:calendar>"
+        "      </lmapc:event>"
+        "      <lmapc:event>"
+        "        <lmapc:name>now</lmapc:name>"
+        "        <lmapc:immediate/>"
+        "      </lmapc:event>"
+        "    </lmapc:events>"
+        "  </lmapc:lmap>"
+        "</config>";
+    const char *j =
+	"{\n"
+	"  \"ietf-lmap-control:lmap\": {\n"
+	"    \"agent\": {\n"
+	"      \"agent-id\": \"550e8400-e29b-41d4-a716-446655440000\",\n"
+	"      \"report-agent-id\": true,\n"
+	"      \"controller-timeout\": 604800,\n"
+	"      \"example:extension\": { \"foo\": [ 1, 2, { \"bar\": null } ] }\n"
+	"    },\n"
+	"    \"suppressions\": {\n"
+	"      \"suppression\": [\n"
+	"        { \"name\": \"quiet\", \"match\": [ \"*\", \"\\u00e9t\\u00e9\" ] }\n"
+	"      ]\n"
+	"    },\n"
+	"    \"tasks\": {\n"
+	"      \"task\": [\n"
+	"        {\n"
+	"          \"name\": \"mtr\",\n"
+	"          \"function\": [\n"
+	"            { \"uri\": \"urn:example:mtr\", \"role\": [ \"client\" ] }\n"
+	"          ],\n"
+	"          \"program\": \"/usr/bin/mtr\",\n"
+	"          \"option\": [ { \"id\": \"report\", \"name\": \"--csv\" } ],\n"
+	"          \"tag\": [ \"\\\"quoted\\\"\" ]\n"
+	"        }\n"
+	"      ]\n"
+	"    },\n"
+	"    \"schedules\": {\n"
+	"      \"schedule\": [\n"
+	"        {\n"
+	"          \"name\": \"demo\",\n"
+	"          \"start\": \"hourly\",\n"
+	"          \"execution-mode\": \"sequential\",\n"
+	"          \"action\": [\n"
+	"            {\n"
+	"              \"name\": \"mtr\",\n"
+	"              \"task\": \"mtr\",\n"
+	"              \"option\": [\n"
+	"                { \"id\": \"target\", \"value\": \"www.example.com\" }\n"
+	"              ],\n"
+	"              \"destination\": [ \"demo\" ]\n"
+	"            }\n"
+	"          ]\n"
+	"        }\n"
+	"      ]\n"
+	"    },\n"
+	"    \"events\": {\n"
+	"      \"event\": [\n"
+	"        { \"name\": \"hourly\", \"periodic\": { \"interval\": 3600 } },\n"
+	"        {\n"
+	"          \"name\": \"daily\",\n"
+	"          \"calendar\": {\n"
+	"            \"month\": [ \"*\" ], \"day-of-month\": [ \"*\" ],\n"
+	"            \"day-of-week\": [ \"*\" ], \"hour\": [ 4, 16 ],\n"
+	"            \"minute\": [ 0 ], \"second\": [ 0 ]\n"
+	"          }\n"
+	"        },\n"
+	"        { \"name\": \"now\", \"immediate\": [ null ] }\n"
+	"      ]\n"
+	"    }\n"
+	"  }\n"
+	"}\n";
+    char *b, *c;
+    struct lmap *lmapa = NULL, *lmapb = NULL;
+
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_xml_parse_config_string(lmapa, a), 0);
+    b = lmap_xml_render_config(lmapa);
+    ck_assert_ptr_ne(b, NULL);
+
+    lmapb = lmap_new();
+    ck_assert_ptr_ne(lmapb, NULL);
+    ck_assert_int_eq(lmap_json_parse_config_string(lmapb, j), 0);
+    c = lmap_xml_render_config(lmapb);
+    ck_assert_ptr_ne(c, NULL);
+
+    ck_assert_str_eq(b, c);
+    ck_assert_str_eq(last_error_msg, "");
+
+    lmap_free(lmapa); lmap_free(lmapb);
+    free(b); free(c);
+
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_json_parse_config_string(lmapa,
+		"{ \"ietf-lmap-control:lmap\": { \"agent\": { \"agent-id\": "), -1);
+    ck_assert_int_eq(lmap_json_parse_config_string(lmapa,
+		"{ \"ietf-lmap-control:lmap\": { } } }"), -1);
+    ck_assert_int_eq(lmap_json_parse_config_string(lmapa,
+		"{ \"ietf-lmap-control:lmap\": { \"tasks\": { \"task\": [ x ] } } }"), -1);
+    lmap_free(lmapa);
+
+    /* separators are checked, not skipped like white space */
+    for (i = 0; bad[i]; i++) {
+	lmapa = lmap_new();
+	ck_assert_ptr_ne(lmapa, NULL);
+	last_error_msg[0] = 0;
+	ck_assert_int_eq(lmap_json_parse_config_string(lmapa, bad[i]), -1);
+	ck_assert_str_ne(last_error_msg, "");
+	lmap_free(lmapa);
+    }
+
+    /* objects that cannot be added are released */
+    for (i = 0; lmap_alloc_enabled() && i < LMAP_ALLOC_TYPES; i++) {
+	ck_assert_int_eq(lmap_alloc_stats(i, &before[i]), 0);
+    }
+    for (i = 0; dup[i]; i++) {
+	lmapa = lmap_new();
+	ck_assert_ptr_ne(lmapa, NULL);
+	(void) lmap_json_parse_config_string(lmapa, dup[i]);
+	lmap_free(lmapa);
+    }
+    t = strdup(j);
+    ck_assert_ptr_ne(t, NULL);
+    for (len = strlen(j) - 2; len > 0; len--) {
+	t[len] = 0;
+	lmapa = lmap_new();
+	ck_assert_ptr_ne(lmapa, NULL);
+	ck_assert_int_eq(lmap_json_parse_config_string(lmapa, t), -1);
+	lmap_free(lmapa);
+    }
+    free(t);
+    for (i = 0; lmap_alloc_enabled() && i < LMAP_ALLOC_TYPES; i++) {
+	ck_assert_int_eq(lmap_alloc_stats(i, &stats), 0);
+	ck_assert_int_eq(stats.live, before[i].live);
+	ck_assert_int_eq(stats.bytes, before[i].bytes);
+    }
+
+    /* embedded NUL bytes are rejected */
+    fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    f = fdopen(fd, "w");
+    ck_assert_ptr_ne(f, NULL);
+    ck_assert_int_eq(fwrite(nul, 1, sizeof(nul) - 1, f), sizeof(nul) - 1);
+    fclose(f);
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_json_parse_config_file(lmapa, path), -1);
+    lmap_free(lmapa);
+    unlink(path);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_parser_json_state)
+{
+    const char *a =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<data xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:agent>"
+	"      <lmapc:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapc:agent-id>"
+	"      <lmapc:last-started>2016-02-21T22:13:40+01:00</lmapc:last-started>"
+        "    </lmapc:agent>"
+        "    <lmapc:capabilities>"
+        "      <lmapc:version>lmapd version 0.3</lmapc:version>"
+        "      <lmapc:tag>system:Linux</lmapc:tag>"
+        "      <lmapc:tasks>"
+        "        <lmapc:task>"
+        "          <lmapc:name>mtr</lmapc:name>"
+        "          <lmapc:version>0.86</lmapc:version>"
+        "          <lmapc:program>/usr/bin/mtr</lmapc:program>"
+        "        </lmapc:task>"
+        "      </lmapc:tasks>"
+        "    </lmapc:capabilities>"
+        "    <lmapc:schedules>"
+        "      <lmapc:schedule>"
+        "        <lmapc:name>demo</lmapc:name>"
+        "        <lmapc:state>enabled</lmapc:state>"
+        "        <lmapc:invocations>2</lmapc:invocations>"
+        "        <lmapc:action>"
+        "          <lmapc:name>mtr</lmapc:name>"
+        "          <lmapc:state>enabled</lmapc:state>"
+        "          <lmapc:failures>2</lmapc:failures>"
+        "          <lmapc:last-invocation>2016-02-23T14:31:52+01:00</lmapc:last-invocation>"
+        "          <lmapc:last-status>1</lmapc:last-status>"
+        "          <lmapc:last-message>failed</lmapc:last-message>"
+        "        </lmapc:action>"
+	"      </lmapc:schedule>"
+	"    </lmapc:schedules>"
+        "  </lmapc:lmap>"
+        "</data>";
+    const char *j =
+	"{\"ietf-lmap-control:lmap\":{"
+	"\"agent\":{\"agent-id\":\"550e8400-e29b-41d4-a716-446655440000\","
+	"\"last-started\":\"2016-02-21T22:13:40+01:00\"},"
+	"\"capabilities\":{\"version\":\"lmapd version 0.3\","
+	"\"tag\":[\"system:Linux\"],"
+	"\"tasks\":{\"task\":[{\"name\":\"mtr\",\"version\":\"0.86\","
+	"\"program\":\"/usr/bin/mtr\"}]}},"
+	"\"schedules\":{\"schedule\":[{\"name\":\"demo\",\"state\":\"enabled\","
+	"\"invocations\":2,\"action\":[{\"name\":\"mtr\",\"state\":\"enabled\","
+	"\"failures\":2,\"last-invocation\":\"2016-02-23T14:31:52+01:00\","
+	"\"last-status\":1,\"last-message\":\"failed\"}]}]}}}";
+    char *b, *c;
+    struct lmap *lmapa = NULL, *lmapb = NULL;
+
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_xml_parse_state_string(lmapa, a), 0);
+    b = lmap_xml_render_state(lmapa);
+    ck_assert_ptr_ne(b, NULL);
+
+    lmapb = lmap_new();
+    ck_assert_ptr_ne(lmapb, NULL);
+    ck_assert_int_eq(lmap_json_parse_state_string(lmapb, j), 0);
+    c = lmap_xml_render_state(lmapb);
+    ck_assert_ptr_ne(c, NULL);
+
+    ck_assert_str_eq(b, c);
+    ck_assert_str_eq(last_error_msg, "");
+
+    lmap_free(lmapa); lmap_free(lmapb);
+    free(b); free(c);
+}
+END_TEST
+
+START_TEST(test_parser_json_report)
+{
+    const char *a =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<rpc xmlns:lmapr=\"urn:ietf:params:xml:ns:yang:ietf-lmap-report\">\n"
+	"  <lmapr:report>\n"
+	"    <lmapr:date>2016-12-25T16:33:02+00:00</lmapr:date>\n"
+	"    <lmapr:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapr:agent-id>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>one</lmapr:action>\n"
+	"      <lmapr:task>mtr</lmapr:task>\n"
+	"      <lmapr:option>\n"
+	"        <lmapr:id>target</lmapr:id>\n"
+	"        <lmapr:value>www.example.com</lmapr:value>\n"
+	"      </lmapr:option>\n"
+	"      <lmapr:tag>\"quoted\"\ttab</lmapr:tag>\n"
+	"      <lmapr:status>0</lmapr:status>\n"
+	"      <lmapr:table>\n"
+	"        <lmapr:row>\n"
+	"          <lmapr:value>1482221851</lmapr:value>\n"
+	"          <lmapr:value>OK</lmapr:value>\n"
+	"        </lmapr:row>\n"
+	"        <lmapr:row>\n"
+	"          <lmapr:value>1482221852</lmapr:value>\n"
+	"          <lmapr:value></lmapr:value>\n"
+	"        </lmapr:row>\n"
+	"      </lmapr:table>\n"
+	"    </lmapr:result>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>two</lmapr:action>\n"
+	"    </lmapr:result>\n"
+	"    <lmapr:result>\n"
+	"      <lmapr:schedule>demo</lmapr:schedule>\n"
+	"      <lmapr:action>three</lmapr:action>\n"
+	"    </lmapr:result>\n"
+	"  </lmapr:report>\n"
+	"</rpc>\n";
+    int count = 0;
+    char *b, *c, *x, *y;
+    struct lmap *lmapa = NULL, *lmapb = NULL;
+
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_xml_parse_report_string(lmapa, a), 0);
+    b = lmap_json_render_report(lmapa);
+    ck_assert_ptr_ne(b, NULL);
+    x = lmap_xml_render_report(lmapa);
+    ck_assert_ptr_ne(x, NULL);
+
+    lmapb = lmap_new();
+    ck_assert_ptr_ne(lmapb, NULL);
+    ck_assert_int_eq(lmap_json_parse_report_string(lmapb, b), 0);
+    c = lmap_json_render_report(lmapb);
+    ck_assert_ptr_ne(c, NULL);
+    y = lmap_xml_render_report(lmapb);
+    ck_assert_ptr_ne(y, NULL);
+
+    ck_assert_str_eq(b, c);
+    ck_assert_str_eq(x, y);
+    ck_assert_str_eq(last_error_msg, "");
+
+    lmap_free(lmapb);
+    lmapb = lmap_new();
+    ck_assert_ptr_ne(lmapb, NULL);
+    ck_assert_int_eq(lmap_json_read_report_string(lmapb, b, count_result, &count), 0);
+    ck_assert_int_eq(count, 2);
+    ck_assert_ptr_eq(lmapb->results, NULL);
+    ck_assert_ptr_ne(lmapb->agent, NULL);
+    ck_assert_str_eq(lmapb->agent->agent_id, "550e8400-e29b-41d4-a716-446655440000");
+    ck_assert_int_eq(lmap_json_read_report_string(lmapb, "{ \"ietf-lmap-report:report\": [", NULL, NULL), -1);
+
+    lmap_free(lmapa); lmap_free(lmapb);
+    free(b); free(c); free(x); free(y);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_compress)
+{
+    struct membuf plain, packed;
+    struct lmap_compress *z;
+    const char *msg = "hello hello hello hello hello world\n";
+    int i;
+
+    ck_assert_int_eq(lmap_compress_method("none"), LMAP_COMPRESS_NONE);
+    ck_assert_int_eq(lmap_compress_method("bogus"), -1);
+    ck_assert_str_eq(last_error_msg, "unsupported compression method 'bogus'");
+
+    memset(&plain, 0, sizeof(plain));
+    z = lmap_compress_new(LMAP_COMPRESS_NONE, LMAP_COMPRESS_LEVEL_DEFAULT, 0,
+			  membuf_write, &plain);
+    ck_assert_ptr_ne(z, NULL);
+    ck_assert_int_eq(lmap_compress_write(z, msg, strlen(msg)), 0);
+    ck_assert_int_eq(lmap_compress_finish(z), 0);
+    ck_assert_int_eq(plain.len, strlen(msg));
+    ck_assert_int_eq(memcmp(plain.buf, msg, plain.len), 0);
+
+#ifdef HAVE_ZLIB
+    {
+	z_stream zs;
+	
+	ck_assert_int_eq(lmap_compress_method("gzip"), LMAP_COMPRESS_GZIP);
+	ck_assert_ptr_eq(lmap_compress_new(LMAP_COMPRESS_GZIP, 42, 0,
+					   membuf_write, &packed), NULL);
+
+	memset(&packed, 0, sizeof(packed));
+	z = lmap_compress_new(LMAP_COMPRESS_GZIP, 9, 0, membuf_write, &packed);
+	ck_assert_ptr_ne(z, NULL);
+	for (i = 0; i < 100; i++) {
+	    ck_assert_int_eq(lmap_compress_write(z, msg, strlen(msg)), 0);
+	}
+	ck_assert_int_eq(lmap_compress_finish(z), 0);
+	ck_assert_int_lt(packed.len, strlen(msg) * 100);
+	ck_assert_int_eq((unsigned char) packed.buf[0], 0x1f);
+	ck_assert_int_eq((unsigned char) packed.buf[1], 0x8b);
+
+	memset(&zs, 0, sizeof(zs));
+	ck_assert_int_eq(inflateInit2(&zs, 16 + MAX_WBITS), Z_OK);
+	zs.next_in = (Bytef *) packed.buf;
+	zs.avail_in = packed.len;
+	zs.next_out = (Bytef *) plain.buf;
+	zs.avail_out = sizeof(plain.buf);
+	ck_assert_int_eq(inflate(&zs, Z_FINISH), Z_STREAM_END);
+	ck_assert_int_eq(zs.total_out, strlen(msg) * 100);
+	for (i = 0; i < 100; i++) {
+	    ck_assert_int_eq(memcmp(plain.buf + i * strlen(msg),
+				    msg, strlen(msg)), 0);
+	}
+	inflateEnd(&zs);
+    }
+#endif
+}
+END_TEST
+
+/*
+ * Creates an lmap with an agent and n results whose workspace files
+ * ws/r<i>.meta and ws/r<i>.data exist.
+ */
+
+static struct lmap *
+chunk_lmap(const char *ws, int first, int n)
+{
+    char file[PATH_MAX], path[PATH_MAX + 8];
+    struct lmap *lmap;
+    struct result *res;
+    FILE *f;
+    int i;
+
+    lmap = lmap_new();
+    ck_assert_ptr_ne(lmap, NULL);
+    lmap->agent = lmap_agent_new();
+    ck_assert_ptr_ne(lmap->agent, NULL);
+    lmap->agent->report_date = 1234;
+    for (i = first; i < first + n; i++) {
+	snprintf(file, sizeof(file), "%s/r%d", ws, i);
+	snprintf(path, sizeof(path), "%s.meta", file);
+	f = fopen(path, "w");
+	ck_assert_ptr_ne(f, NULL);
+	fclose(f);
+	snprintf(path, sizeof(path), "%s.data", file);
+	f = fopen(path, "w");
+	ck_assert_ptr_ne(f, NULL);
+	fclose(f);
+	res = lmap_result_new();
+	ck_assert_int_eq(lmap_result_set_schedule(res, "demo"), 0);
+	ck_assert_int_eq(lmap_result_set_action(res, "a"), 0);
+	ck_assert_int_eq(lmap_result_set_file(res, file), 0);
+	ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+    }
+    return lmap;
+}
+
+START_TEST(test_chunk)
+{
+    char dir[] = "/tmp/check-lmap-XXXXXX";
+    char ws[64], path[PATH_MAX], expect[512];
+    struct lmap_chunker chunker;
+    struct membuf names;
+    struct lmap *lmap;
+    struct result *res, *last;
+    FILE *f;
+    int i;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(ws, sizeof(ws), "%s/ws", dir);
+    ck_assert_int_eq(mkdir(ws, 0700), 0);
+
+    memset(&chunker, 0, sizeof(chunker));
+    chunker.dir = dir;
+    chunker.suffix = ".xml";
+    chunker.max_results = 2;
+    chunker.report = lmap_xml_write_report;
+    chunker.compress_method = LMAP_COMPRESS_NONE;
+    chunker.compress_level = LMAP_COMPRESS_LEVEL_DEFAULT;
+    chunker.names = membuf_write;
+    chunker.names_ctx = &names;
+
+    /* five results make three chunks */
+    memset(&names, 0, sizeof(names));
+    lmap = chunk_lmap(ws, 0, 5);
+    ck_assert_int_eq(lmap_chunk_report(lmap, &chunker), 0);
+    /* the results are kept in order and the list index stays usable */
+    for (i = 0, res = lmap->results; res; res = res->next, i++) {
+	snprintf(path, sizeof(path), "%s/r%d", ws, i);
+	ck_assert_str_eq(res->file, path);
+    }
+    ck_assert_int_eq(i, 5);
+    res = lmap_result_new();
+    ck_assert_ptr_ne(res, NULL);
+    ck_assert_int_eq(lmap_add_result(lmap, res), 0);
+    for (last = lmap->results; last->next; last = last->next) ;
+    ck_assert_ptr_eq(last, res);
+    lmap_free(lmap);
+    names.buf[names.len] = 0;
+    snprintf(expect, sizeof(expect),
+	     "%s/report-1234-0001.xml\n%s/report-1234-0002.xml\n"
+	     "%s/report-1234-0003.xml\n", dir, dir, dir);
+    ck_assert_str_eq(names.buf, expect);
+    snprintf(path, sizeof(path), "%s/report-1234-0001.xml.files", dir);
+    f = fopen(path, "r");
+    ck_assert_ptr_ne(f, NULL);
+    memset(&names, 0, sizeof(names));
+    names.len = fread(names.buf, 1, sizeof(names.buf) - 1, f);
+    fclose(f);
+    snprintf(expect, sizeof(expect), "%s/r0.meta\n%s/r0.data\n"
+	     "%s/r1.meta\n%s/r1.data\n", ws, ws, ws, ws);
+    ck_assert_str_eq(names.buf, expect);
+
+    /*
+     * Pending results are not reported again and a new chunk does
+     * not replace a pending chunk with the same name.
+     */
+
+    memset(&names, 0, sizeof(names));
+    lmap = chunk_lmap(ws, 0, 6);
+    ck_assert_int_eq(lmap_chunk_report(lmap, &chunker), 0);
+    ck_assert_ptr_eq(lmap->results->next, NULL);
+    lmap_free(lmap);
+    names.buf[names.len] = 0;
+    snprintf(expect, sizeof(expect), "%s/report-1234-0004.xml\n", dir);
+    ck_assert_str_eq(names.buf, expect);
+
+    /* a chunk that cannot be acknowledged keeps its manifest */
+    snprintf(path, sizeof(path), "%s/report-1234-0002.xml.files", dir);
+    f = fopen(path, "a");
+    ck_assert_ptr_ne(f, NULL);
+    fprintf(f, "%s\n", ws);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/report-1234-0002.xml", dir);
+    ck_assert_int_eq(lmap_chunk_ack(path), -1);
+    ck_assert_int_eq(access(path, F_OK), 0);
+    snprintf(path, sizeof(path), "%s/report-1234-0009.xml", dir);
+    ck_assert_int_eq(lmap_chunk_ack(path), -1);
+
+    /* acknowledged chunks remove their workspace files */
+    for (i = 1; i <= 4; i++) {
+	if (i == 2) {
+	    continue;
+	}
+	snprintf(path, sizeof(path), "%s/report-1234-%04d.xml", dir, i);
+	ck_assert_int_eq(lmap_chunk_ack(path), 0);
+	ck_assert_int_eq(access(path, F_OK), -1);
+	snprintf(path, sizeof(path), "%s/report-1234-%04d.xml.files", dir, i);
+	ck_assert_int_eq(access(path, F_OK), -1);
+    }
+    for (i = 0; i < 6; i++) {
+	snprintf(path, sizeof(path), "%s/r%d.meta", ws, i);
+	ck_assert_int_eq(access(path, F_OK), -1);
+	snprintf(path, sizeof(path), "%s/r%d.data", ws, i);
+	ck_assert_int_eq(access(path, F_OK), -1);
+    }
+
+    snprintf(path, sizeof(path), "%s/report-1234-0002.xml", dir);
+    ck_assert_int_eq(unlink(path), 0);
+    snprintf(path, sizeof(path), "%s/report-1234-0002.xml.files", dir);
+    ck_assert_int_eq(unlink(path), 0);
+    ck_assert_int_eq(rmdir(ws), 0);
+    ck_assert_int_eq(rmdir(dir), 0);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_csv)
+{
+    FILE *f;
+    const char delimiter = 'x';
+    const char *msg =
+	"This message is something rather long including funny characters; "
+	"such as ' or . or ? and then even more;\"";
+    char buf[256];
+    char *s;
+
+    f = tmpfile();
+    ck_assert_ptr_ne(f, NULL);
+    csv_start(f, delimiter, "0");
+    csv_append(f, delimiter, "1");
+    csv_append(f, delimiter, "2");
+    csv_end(f);
+    csv_start(f, delimiter, "3");
+    csv_append(f, delimiter, "4");
+    csv_append(f, delimiter, "5");
+    csv_append(f, delimiter, "6");
+    csv_end(f);
+    csv_start(f, delimiter, msg);
+    csv_end(f);
+    rewind(f);
+    s = fgets(buf, sizeof(buf), f);
+    ck_assert_ptr_ne(s, NULL);
+    ck_assert_str_eq(buf, "0x1x2\n");
+    s = fgets(buf, sizeof(buf), f);
+    ck_assert_ptr_ne(s, NULL);
+    ck_assert_str_eq(buf, "3x4x5x6\n");
+    s = fgets(buf, sizeof(buf), f);
+    ck_assert_ptr_ne(s, NULL);
+    if (strlen(buf) > 3) {
+	buf[strlen(buf)-3] = 0;
+    }
+    ck_assert_str_eq(buf+1, msg);
+
+    /* a quoted last value does not swallow the end of the row */
+    rewind(f);
+    ck_assert_int_eq(ftruncate(fileno(f), 0), 0);
+    csv_start(f, ';', "a");
+    csv_append(f, ';', "b c");
+    csv_end(f);
+    csv_start(f, ';', "d");
+    csv_end(f);
+    rewind(f);
+    s = csv_next(f, ';');
+    ck_assert_str_eq(s, "a");
+    free(s);
+    s = csv_next(f, ';');
+    ck_assert_str_eq(s, "b c");
+    free(s);
+    ck_assert_ptr_eq(csv_next(f, ';'), NULL);
+    s = csv_next(f, ';');
+    ck_assert_str_eq(s, "d");
+    free(s);
+    fclose(f);
+}
+END_TEST
+
+START_TEST(test_csv_key_value)
+{
+    FILE *f;
+    const char delimiter = ';';
+    const char *hello = "hel;lo";
     const char *world = "wo\"rld";
     char *key, *value;
 
@@ -2106,10 +3741,224 @@ START_TEST(test_csv_key_value)
 }
 END_TEST
 
+START_TEST(test_snapshot)
+{
+    const char *a =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<data xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">"
+        "  <lmapc:lmap>"
+        "    <lmapc:agent>"
+	"      <lmapc:agent-id>550e8400-e29b-41d4-a716-446655440000</lmapc:agent-id>"
+	"      <lmapc:report-agent-id>true</lmapc:report-agent-id>"
+	"      <lmapc:controller-timeout>60</lmapc:controller-timeout>"
+        "    </lmapc:agent>"
+        "    <lmapc:capabilities>"
+        "      <lmapc:tag>system:Linux</lmapc:tag>"
+        "      <lmapc:tasks>"
+        "        <lmapc:task>"
+        "          <lmapc:name>mtr</lmapc:name>"
+        "          <lmapc:version>0.86</lmapc:version>"
+        "        </lmapc:task>"
+        "      </lmapc:tasks>"
+        "    </lmapc:capabilities>"
+        "    <lmapc:suppressions>"
+        "      <lmapc:suppression>"
+        "        <lmapc:name>quiet</lmapc:name>"
+        "        <lmapc:match>*</lmapc:match>"
+        "        <lmapc:stop-running>true</lmapc:stop-running>"
+        "      </lmapc:suppression>"
+        "    </lmapc:suppressions>"
+        "    <lmapc:tasks>"
+        "      <lmapc:task>"
+        "        <lmapc:name>mtr</lmapc:name>"
+        "        <lmapc:function>"
+        "          <lmapc:uri>urn:example:mtr</lmapc:uri>"
+        "          <lmapc:role>client</lmapc:role>"
+        "        </lmapc:function>"
+        "        <lmapc:program>/usr/bin/mtr</lmapc:program>"
+        "        <lmapc:option>"
+        "          <lmapc:id>csv</lmapc:id>"
+        "          <lmapc:name>--csv</lmapc:name>"
+        "        </lmapc:option>"
+        "      </lmapc:task>"
+        "    </lmapc:tasks>"
+        "    <lmapc:schedules>"
+        "      <lmapc:schedule>"
+        "        <lmapc:name>demo</lmapc:name>"
+        "        <lmapc:start>daily</lmapc:start>"
+        "        <lmapc:duration>600</lmapc:duration>"
+        "        <lmapc:tag>demo</lmapc:tag>"
+        "        <lmapc:action>"
+        "          <lmapc:name>mtr</lmapc:name>"
+        "          <lmapc:task>mtr</lmapc:task>"
+        "          <lmapc:option>"
+        "            <lmapc:id>target</lmapc:id>"
+        "            <lmapc:value>www.example.com</lmapc:value>"
+        "          </lmapc:option>"
+        "          <lmapc:suppression-tag>quiet</lmapc:suppression-tag>"
+        "          <lmapc:invocations>2</lmapc:invocations>"
+        "          <lmapc:last-message>failed</lmapc:last-message>"
+        "        </lmapc:action>"
+	"      </lmapc:schedule>"
+	"    </lmapc:schedules>"
+        "    <lmapc:events>"
+        "      <lmapc:event>"
+        "        <lmapc:name>daily</lmapc:name>"
+        "        <lmapc:random-spread>10</lmapc:random-spread>"
+        "        <lmapc:calendar>"
+        "          <lmapc:month>*</lmapc:month>"
+        "          <lmapc:day-of-month>*</lmapc:day-of-month>"
+        "          <lmapc:day-of-week>monday</lmapc:day-of-week>"
+        "          <lmapc:hour>4</lmapc:hour>"
+        "          <lmapc:minute>30</lmapc:minute>"
+        "          <lmapc:second>0</lmapc:second>"
+        "          <lmapc:timezone-offset>-05:00</lmapc:timezone-offset>"
+        "        </lmapc:calendar>"
+        "      </lmapc:event>"
+        "    </lmapc:events>"
+        "  </lmapc:lmap>"
+        "</data>";
+    char dir[] = "/tmp/check-lmap-XXXXXX";
+    char config[PATH_MAX], snap[PATH_MAX];
+    const char *paths[] = { config, NULL };
+    uint64_t key, key2;
+    struct lmap *lmapa, *lmapb;
+    struct lmap_alloc_stats before[LMAP_ALLOC_TYPES], stats;
+    char *b, *c;
+    FILE *f;
+    int i;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(snap, sizeof(snap), "%s/snapshot", dir);
+    f = fopen(config, "w");
+    ck_assert_ptr_ne(f, NULL);
+    fputs(a, f);
+    fclose(f);
+
+    ck_assert_int_eq(lmap_snapshot_key(paths, &key), 0);
+    lmapa = lmap_new();
+    ck_assert_ptr_ne(lmapa, NULL);
+    ck_assert_int_eq(lmap_xml_parse_state_path(lmapa, config), 0);
+    ck_assert_int_eq(lmap_snapshot_load(lmapa, snap, key), 1);
+    ck_assert_int_eq(lmap_snapshot_save(lmapa, snap, key), 0);
+    b = lmap_xml_render_state(lmapa);
+    ck_assert_ptr_ne(b, NULL);
+
+    lmapb = lmap_new_with_arena();
+    ck_assert_ptr_ne(lmapb, NULL);
+    (void) lmap_arena_use(lmapb->arena);
+    ck_assert_int_eq(lmap_snapshot_load(lmapb, snap, key), 0);
+    (void) lmap_arena_use(NULL);
+    c = lmap_xml_render_state(lmapb);
+    ck_assert_ptr_ne(c, NULL);
+    ck_assert_str_eq(b, c);
+    ck_assert_int_eq(lmap_valid(lmapb), 1);
+    lmap_free(lmapb);
+    free(c);
+
+    /* loading and releasing a snapshot keeps the counters balanced */
+    for (i = 0; lmap_alloc_enabled() && i < LMAP_ALLOC_TYPES; i++) {
+	ck_assert_int_eq(lmap_alloc_stats(i, &before[i]), 0);
+    }
+    for (i = 0; i < 2; i++) {
+	lmapb = i ? lmap_new_with_arena() : lmap_new();
+	ck_assert_ptr_ne(lmapb, NULL);
+	(void) lmap_arena_use(lmapb->arena);
+	ck_assert_int_eq(lmap_snapshot_load(lmapb, snap, key), 0);
+	(void) lmap_arena_use(NULL);
+	if (lmap_alloc_enabled()) {
+	    ck_assert_int_eq(lmap_alloc_stats(LMAP_ALLOC_STRING, &stats), 0);
+	    ck_assert_int_gt(stats.live, before[LMAP_ALLOC_STRING].live);
+	}
+	lmap_free(lmapb);
+    }
+    for (i = 0; lmap_alloc_enabled() && i < LMAP_ALLOC_TYPES; i++) {
+	ck_assert_int_eq(lmap_alloc_stats(i, &stats), 0);
+	ck_assert_int_eq(stats.live, before[i].live);
+	ck_assert_int_eq(stats.bytes, before[i].bytes);
+    }
+
+    /* a changed config file invalidates the snapshot */
+    f = fopen(config, "a");
+    ck_assert_ptr_ne(f, NULL);
+    fputs("\n", f);
+    fclose(f);
+    ck_assert_int_eq(lmap_snapshot_key(paths, &key2), 0);
+    ck_assert(key != key2);
+    lmapb = lmap_new();
+    ck_assert_int_eq(lmap_snapshot_load(lmapb, snap, key2), 1);
+    ck_assert_ptr_eq(lmapb->schedules, NULL);
+
+    /* a corrupted snapshot is ignored */
+    f = fopen(snap, "r+");
+    ck_assert_ptr_ne(f, NULL);
+    ck_assert_int_eq(fseek(f, -8, SEEK_END), 0);
+    fputc('x', f);
+    fclose(f);
+    ck_assert_int_eq(lmap_snapshot_load(lmapb, snap, key), 1);
+    ck_assert_ptr_eq(lmapb->schedules, NULL);
+    lmap_free(lmapb);
+
+    lmap_free(lmapa);
+    free(b);
+    unlink(config);
+    unlink(snap);
+    ck_assert_int_eq(rmdir(dir), 0);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_workspace_read_results)
+{
+    char dir[] = "/tmp/check-lmap-XXXXXX";
+    char cwd[PATH_MAX], path[PATH_MAX + 32];
+    struct lmapd *lmapd;
+    struct result *res;
+    FILE *f;
+    int i;
+
+    ck_assert_ptr_ne(getcwd(cwd, sizeof(cwd)), NULL);
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    ck_assert_int_eq(chdir(dir), 0);
+    for (i = 3; i > 0; i--) {
+	snprintf(path, sizeof(path), "%d-demo-a%d.meta", i, i);
+	f = fopen(path, "w");
+	ck_assert_ptr_ne(f, NULL);
+	fprintf(f, "schedule;demo\naction;a%d\n", i);
+	fclose(f);
+	snprintf(path, sizeof(path), "%d-demo-a%d.data", i, i);
+	f = fopen(path, "w");
+	ck_assert_ptr_ne(f, NULL);
+	fprintf(f, "%d;foo\n", i);
+	fclose(f);
+    }
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd->lmap = lmap_new();
+    ck_assert_ptr_ne(lmapd->lmap, NULL);
+    ck_assert_int_eq(lmapd_workspace_read_results(lmapd), 0);
+    for (i = 1, res = lmapd->lmap->results; res; i++, res = res->next) {
+	snprintf(path, sizeof(path), "%s/%d-demo-a%d", dir, i, i);
+	ck_assert_str_eq(res->file, path);
+	ck_assert_ptr_ne(res->tables, NULL);
+	unlink(strcat(path, ".meta"));
+	strcpy(path + strlen(path) - 5, ".data");
+	unlink(path);
+    }
+    ck_assert_int_eq(i, 4);
+    lmapd_free(lmapd);
+
+    ck_assert_int_eq(chdir(cwd), 0);
+    ck_assert_int_eq(rmdir(dir), 0);
+}
+END_TEST
+
 Suite * lmap_suite(void)
 {
     Suite *s;
-    TCase *tc_core, *tc_parser, *tc_csv;
+    TCase *tc_core, *tc_parser, *tc_csv, *tc_snapshot, *tc_workspace;
 
     s = suite_create("lmap");
 
@@ -2130,10 +3979,18 @@ Suite * lmap_suite(void)
     tcase_add_test(tc_core, test_lmap_schedule);
     tcase_add_test(tc_core, test_lmap_action);
     tcase_add_test(tc_core, test_lmap_lmap);
+    tcase_add_test(tc_core, test_lmap_lists);
+    tcase_add_test(tc_core, test_lmap_arena);
+    tcase_add_test(tc_core, test_lmap_alloc);
     tcase_add_test(tc_core, test_lmap_val);
     tcase_add_test(tc_core, test_lmap_row);
     tcase_add_test(tc_core, test_lmap_table);
+    tcase_add_test(tc_core, test_lmap_table_columns);
+    tcase_add_test(tc_core, test_lmap_table_add_row);
     tcase_add_test(tc_core, test_lmap_result);
+    tcase_add_test(tc_core, test_lmap_datetime);
+    tcase_add_test(tc_core, test_lmap_int);
+    tcase_add_test(tc_core, test_log);
     suite_add_tcase(s, tc_core);
 
     /* Parser test case */
@@ -2149,12 +4006,23 @@ Suite * lmap_suite(void)
     tcase_add_test(tc_parser, test_parser_config_schedules);
     tcase_add_test(tc_parser, test_parser_config_actions);
     tcase_add_test(tc_parser, test_parser_config_merge);
+    tcase_add_test(tc_parser, test_parser_config_path);
+    tcase_add_test(tc_parser, test_parser_config_sections);
     tcase_add_test(tc_parser, test_parser_state_agent);
     tcase_add_test(tc_parser, test_parser_state_capabilities);
     tcase_add_test(tc_parser, test_parser_state_capability_tasks);
     tcase_add_test(tc_parser, test_parser_state_schedules);
     tcase_add_test(tc_parser, test_parser_state_actions);
     tcase_add_test(tc_parser, test_parser_report);
+    tcase_add_test(tc_parser, test_parser_report_stream);
+    tcase_add_test(tc_parser, test_report_write);
+    tcase_add_test(tc_parser, test_state_write);
+    tcase_add_test(tc_parser, test_latency);
+    tcase_add_test(tc_parser, test_parser_json_config);
+    tcase_add_test(tc_parser, test_parser_json_state);
+    tcase_add_test(tc_parser, test_parser_json_report);
+    tcase_add_test(tc_parser, test_compress);
+    tcase_add_test(tc_parser, test_chunk);
     suite_add_tcase(s, tc_parser);
 
     tc_csv = tcase_create("Csv");
@@ -2162,6 +4030,14 @@ Suite * lmap_suite(void)
     tcase_add_test(tc_csv, test_csv_key_value);
     suite_add_tcase(s, tc_csv);
 
+    tc_snapshot = tcase_create("Snapshot");
+    tcase_add_test(tc_snapshot, test_snapshot);
+    suite_add_tcase(s, tc_snapshot);
+
+    tc_workspace = tcase_create("Workspace");
+    tcase_add_test(tc_workspace, test_workspace_read_results);
+    suite_add_tcase(s, tc_workspace);
+
     return s;
 }
 
@@ -17,13 +17,24 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <check.h>
 #include <unistd.h>
 #include <signal.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "lmap.h"
 #include "lmapd.h"
 #include "runner.h"
+#include "config.h"
+#include "workspace.h"
+#include "journal.h"
+#include "control.h"
+#include "metrics.h"
+#include "latency.h"
+#include "sim.h"
 #include "utils.h"
 
 static char last_error_msg[1024];
@@ -79,6 +90,654 @@ START_TEST(test_lmapd_run)
 }
 END_TEST
 
+static void
+write_reload_config(const char *path, const char *target)
+{
+    FILE *f;
+
+    f = fopen(path, "w");
+    ck_assert_ptr_ne(f, NULL);
+    fprintf(f,
+	"<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	"  <lmapc:lmap>\n"
+	"    <lmapc:schedules>\n"
+	"      <lmapc:schedule>\n"
+	"        <lmapc:name>s1</lmapc:name>\n"
+	"        <lmapc:start>hourly</lmapc:start>\n"
+	"        <lmapc:action>\n"
+	"          <lmapc:name>a1</lmapc:name>\n"
+	"          <lmapc:task>sleep</lmapc:task>\n"
+	"        </lmapc:action>\n"
+	"      </lmapc:schedule>\n"
+	"      <lmapc:schedule>\n"
+	"        <lmapc:name>s2</lmapc:name>\n"
+	"        <lmapc:start>hourly</lmapc:start>\n"
+	"        <lmapc:action>\n"
+	"          <lmapc:name>a2</lmapc:name>\n"
+	"          <lmapc:task>sleep</lmapc:task>\n"
+	"          <lmapc:option>\n"
+	"            <lmapc:id>time</lmapc:id>\n"
+	"            <lmapc:value>%s</lmapc:value>\n"
+	"          </lmapc:option>\n"
+	"        </lmapc:action>\n"
+	"      </lmapc:schedule>\n"
+	"    </lmapc:schedules>\n"
+	"    <lmapc:tasks>\n"
+	"      <lmapc:task>\n"
+	"        <lmapc:name>sleep</lmapc:name>\n"
+	"        <lmapc:program>/bin/sleep</lmapc:program>\n"
+	"      </lmapc:task>\n"
+	"    </lmapc:tasks>\n"
+	"    <lmapc:events>\n"
+	"      <lmapc:event>\n"
+	"        <lmapc:name>hourly</lmapc:name>\n"
+	"        <lmapc:periodic>\n"
+	"          <lmapc:interval>3600</lmapc:interval>\n"
+	"        </lmapc:periodic>\n"
+	"      </lmapc:event>\n"
+	"    </lmapc:events>\n"
+	"  </lmapc:lmap>\n"
+	"</config>\n", target);
+    ck_assert_int_eq(fclose(f), 0);
+}
+
+static pid_t
+spawn_child(void)
+{
+    pid_t pid = fork();
+
+    ck_assert_int_ne(pid, -1);
+    if (pid == 0) {
+	(void) alarm(10);
+	pause();
+	_exit(0);
+    }
+    return pid;
+}
+
+START_TEST(test_lmapd_reload)
+{
+    struct lmapd *lmapd;
+    struct schedule *s1, *s2;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX], queue[PATH_MAX];
+    pid_t pid1, pid2;
+    int i, valid = 0, status;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    snprintf(queue, sizeof(queue), "%s/queue", dir);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    ck_assert_int_eq(mkdir(queue, 0700), 0);
+    write_reload_config(config, "1");
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    lmapd_set_queue_path(lmapd, queue);
+    lmapd->base = event_base_new();
+    ck_assert_ptr_ne(lmapd->base, NULL);
+    ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+    ck_assert_int_eq(valid, 1);
+
+    /* pretend that both schedules are running */
+    pid1 = spawn_child();
+    pid2 = spawn_child();
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    s2 = lmap_find_schedule(lmapd->lmap, "s2");
+    s1->state = s2->state = LMAP_SCHEDULE_STATE_RUNNING;
+    s1->cnt_invocations = s2->cnt_invocations = 7;
+    s1->actions->state = s2->actions->state = LMAP_ACTION_STATE_RUNNING;
+    s1->actions->cnt_invocations = s2->actions->cnt_invocations = 7;
+    s1->actions->pid = pid1;
+    s2->actions->pid = pid2;
+
+    /* only the action of s2 changes, s2 itself is kept */
+    write_reload_config(config, "2");
+    ck_assert_int_eq(lmapd_reload(lmapd), 0);
+
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    s2 = lmap_find_schedule(lmapd->lmap, "s2");
+    ck_assert_int_eq(s1->state, LMAP_SCHEDULE_STATE_RUNNING);
+    ck_assert_int_eq(s1->cnt_invocations, 7);
+    ck_assert_int_eq(s1->actions->state, LMAP_ACTION_STATE_RUNNING);
+    ck_assert_int_eq(s1->actions->cnt_invocations, 7);
+    ck_assert_int_eq(s1->actions->pid, pid1);
+    ck_assert_int_eq(s2->state, LMAP_SCHEDULE_STATE_ENABLED);
+    ck_assert_int_eq(s2->cnt_invocations, 7);
+    ck_assert_int_eq(s2->actions->cnt_invocations, 0);
+    ck_assert_int_eq(s2->actions->pid, 0);
+    ck_assert_str_eq(s2->actions->options->value, "2");
+
+    /* the child of the changed action was stopped and is reaped
+     * later, the other one keeps running */
+    ck_assert_int_eq(lmapd->retired_len, 1);
+    for (i = 0; lmapd->retired_len && i < 500; i++) {
+	(void) usleep(10000);
+	lmapd_cleanup(lmapd);
+    }
+    ck_assert_int_eq(lmapd->retired_len, 0);
+    ck_assert_int_eq(kill(pid2, 0), -1);
+    ck_assert_int_eq(waitpid(pid1, &status, WNOHANG), 0);
+    (void) kill(pid1, SIGKILL);
+    (void) waitpid(pid1, &status, 0);
+
+    /* a broken config keeps the running one */
+    write_reload_config(config, "<");
+    ck_assert_int_eq(lmapd_reload(lmapd), -1);
+    ck_assert_ptr_eq(lmap_find_schedule(lmapd->lmap, "s1"), s1);
+
+    (void) lmapd_workspace_clean(lmapd);
+    event_base_free(lmapd->base);
+    lmapd_free(lmapd);
+    (void) unlink(config);
+    (void) rmdir(queue);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+static void
+write_supp_config(const char *path)
+{
+    FILE *f;
+
+    f = fopen(path, "w");
+    ck_assert_ptr_ne(f, NULL);
+    fprintf(f,
+	"<config xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	"  <lmapc:lmap>\n"
+	"    <lmapc:suppressions>\n"
+	"      <lmapc:suppression>\n"
+	"        <lmapc:name>q</lmapc:name>\n"
+	"        <lmapc:match>x</lmapc:match>\n"
+	"        <lmapc:stop-running>true</lmapc:stop-running>\n"
+	"      </lmapc:suppression>\n"
+	"    </lmapc:suppressions>\n"
+	"    <lmapc:schedules>\n"
+	"      <lmapc:schedule>\n"
+	"        <lmapc:name>s1</lmapc:name>\n"
+	"        <lmapc:start>hourly</lmapc:start>\n"
+	"        <lmapc:action>\n"
+	"          <lmapc:name>a1</lmapc:name>\n"
+	"          <lmapc:task>sleep</lmapc:task>\n"
+	"        </lmapc:action>\n"
+	"      </lmapc:schedule>\n"
+	"      <lmapc:schedule>\n"
+	"        <lmapc:name>s2</lmapc:name>\n"
+	"        <lmapc:start>hourly</lmapc:start>\n"
+	"        <lmapc:suppression-tag>x</lmapc:suppression-tag>\n"
+	"        <lmapc:action>\n"
+	"          <lmapc:name>a2</lmapc:name>\n"
+	"          <lmapc:task>sleep</lmapc:task>\n"
+	"        </lmapc:action>\n"
+	"      </lmapc:schedule>\n"
+	"    </lmapc:schedules>\n"
+	"    <lmapc:tasks>\n"
+	"      <lmapc:task>\n"
+	"        <lmapc:name>sleep</lmapc:name>\n"
+	"        <lmapc:program>/bin/sleep</lmapc:program>\n"
+	"      </lmapc:task>\n"
+	"    </lmapc:tasks>\n"
+	"    <lmapc:events>\n"
+	"      <lmapc:event>\n"
+	"        <lmapc:name>hourly</lmapc:name>\n"
+	"        <lmapc:periodic>\n"
+	"          <lmapc:interval>3600</lmapc:interval>\n"
+	"        </lmapc:periodic>\n"
+	"      </lmapc:event>\n"
+	"    </lmapc:events>\n"
+	"  </lmapc:lmap>\n"
+	"</config>\n");
+    ck_assert_int_eq(fclose(f), 0);
+}
+
+START_TEST(test_lmapd_reload_supp)
+{
+    struct lmapd *lmapd;
+    struct schedule *s1, *s2;
+    struct supp *q;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX];
+    pid_t pid;
+    int valid = 0, status;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    write_supp_config(config);
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    lmapd->base = event_base_new();
+    ck_assert_ptr_ne(lmapd->base, NULL);
+    ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+    ck_assert_int_eq(valid, 1);
+
+    /* q is active and suppresses s2; s1 was hit by a stop-running
+     * suppression earlier and is running again */
+    q = lmap_find_supp(lmapd->lmap, "q");
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    s2 = lmap_find_schedule(lmapd->lmap, "s2");
+    q->state = LMAP_SUPP_STATE_ACTIVE;
+    s2->state = LMAP_SCHEDULE_STATE_SUPPRESSED;
+    s2->flags |= LMAP_SCHEDULE_FLAG_STOP_RUNNING;
+    s2->cnt_active_suppressions = 1;
+    pid = spawn_child();
+    s1->flags |= LMAP_SCHEDULE_FLAG_STOP_RUNNING;
+    s1->state = LMAP_SCHEDULE_STATE_RUNNING;
+    s1->actions->state = LMAP_ACTION_STATE_RUNNING;
+    s1->actions->pid = pid;
+
+    /* an unchanged config neither lifts nor restarts q */
+    ck_assert_int_eq(lmapd_reload(lmapd), 0);
+    q = lmap_find_supp(lmapd->lmap, "q");
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    s2 = lmap_find_schedule(lmapd->lmap, "s2");
+    ck_assert_int_eq(q->state, LMAP_SUPP_STATE_ACTIVE);
+    ck_assert_int_eq(s2->state, LMAP_SCHEDULE_STATE_SUPPRESSED);
+    ck_assert_int_eq(s2->cnt_active_suppressions, 1);
+    ck_assert_int_eq(s1->state, LMAP_SCHEDULE_STATE_RUNNING);
+    ck_assert_int_eq(s1->actions->pid, pid);
+    ck_assert_int_eq(lmapd->retired_len, 0);
+    (void) usleep(100000);
+    ck_assert_int_eq(waitpid(pid, &status, WNOHANG), 0);
+
+    (void) kill(pid, SIGKILL);
+    (void) waitpid(pid, &status, 0);
+    event_base_free(lmapd->base);
+    lmapd_free(lmapd);
+    (void) unlink(config);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_lmapd_journal)
+{
+    struct lmapd *lmapd;
+    struct schedule *s1;
+    struct action *a1;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX], journal[PATH_MAX];
+    int i, valid = 0;
+    FILE *f;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    snprintf(journal, sizeof(journal), "%s/journal", dir);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    write_reload_config(config, "1");
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    lmapd_set_journal_path(lmapd, journal);
+
+    /* run twice, the second run starts from the journal */
+    for (i = 0; i < 2; i++) {
+	ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+	ck_assert_int_eq(valid, 1);
+	ck_assert_int_eq(lmapd_journal_open(lmapd), 0);
+	ck_assert_int_ne(lmapd->journal_fd, -1);
+	s1 = lmap_find_schedule(lmapd->lmap, "s1");
+	a1 = s1->actions;
+	ck_assert_int_eq(s1->cnt_invocations, 3 * i);
+	ck_assert_int_eq(a1->cnt_invocations, 3 * i);
+	ck_assert_int_eq(a1->cnt_failures, i);
+	ck_assert_int_eq(a1->last_failed_status, i ? 2 : 0);
+	ck_assert_int_eq(a1->last_completion, i ? 1234 : 0);
+
+	s1->cnt_invocations += 3;
+	a1->cnt_invocations += 3;
+	a1->cnt_failures++;
+	a1->last_failed_status = 2;
+	a1->last_completion = 1234;
+	ck_assert_int_eq(lmapd_journal_action(lmapd, s1, a1), 0);
+
+	/* a torn record at the end is ignored */
+	f = fopen(journal, "a");
+	ck_assert_ptr_ne(f, NULL);
+	fputs("torn", f);
+	fclose(f);
+
+	lmap_free(lmapd->lmap);
+	lmapd->lmap = NULL;
+	lmapd_journal_close(lmapd);
+	ck_assert_int_eq(lmapd->journal_fd, -1);
+    }
+
+    lmapd_free(lmapd);
+    (void) unlink(journal);
+    (void) unlink(config);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_lmapd_journal_limit)
+{
+    struct lmapd *lmapd;
+    struct schedule *s1;
+    struct action *a1;
+    struct stat st;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX], journal[PATH_MAX];
+    int i, valid = 0, checkpoints = 0;
+    off_t size;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    snprintf(journal, sizeof(journal), "%s/journal", dir);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    write_reload_config(config, "1");
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    lmapd_set_journal_path(lmapd, journal);
+    ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+    ck_assert_int_eq(valid, 1);
+    ck_assert_int_eq(lmapd_journal_open(lmapd), 0);
+    ck_assert_int_eq(lmapd->journal_limit, LMAPD_JOURNAL_LIMIT);
+    ck_assert_int_eq(stat(journal, &st), 0);
+    size = st.st_size;
+
+    /* appending checkpoints the journal once the limit is reached */
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    a1 = s1->actions;
+    for (i = 0; i < 2000; i++) {
+	s1->cnt_invocations++;
+	a1->cnt_invocations++;
+	ck_assert_int_eq(lmapd_journal_action(lmapd, s1, a1), 0);
+	ck_assert_int_lt(lmapd->journal_bytes, lmapd->journal_limit);
+	ck_assert_int_eq(stat(journal, &st), 0);
+	ck_assert_int_eq(st.st_size, size + lmapd->journal_bytes);
+	checkpoints += (lmapd->journal_bytes == 0);
+    }
+    ck_assert_int_gt(checkpoints, 0);
+
+    /* nothing is lost by a checkpoint */
+    lmap_free(lmapd->lmap);
+    lmapd->lmap = NULL;
+    lmapd_journal_close(lmapd);
+    ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+    ck_assert_int_eq(lmapd_journal_open(lmapd), 0);
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    ck_assert_int_eq(s1->cnt_invocations, 2000);
+    ck_assert_int_eq(s1->actions->cnt_invocations, 2000);
+
+    lmapd_free(lmapd);
+    (void) unlink(journal);
+    (void) unlink(config);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+}
+END_TEST
+
+static int
+doc_write(void *ctx, const char *buf, size_t len)
+{
+    char *doc = ctx;
+    size_t n = strlen(doc);
+
+    if (n + len >= 65536) {
+	return -1;
+    }
+    memcpy(doc + n, buf, len);
+    doc[n + len] = 0;
+    return 0;
+}
+
+START_TEST(test_lmapd_control)
+{
+    struct lmapd *lmapd;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX], queue[PATH_MAX], sock[PATH_MAX];
+    static char doc[65536];
+    int i, status, valid = 0;
+    pid_t pid;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    snprintf(queue, sizeof(queue), "%s/queue", dir);
+    snprintf(sock, sizeof(sock), "%s/%s", dir, LMAPD_CONTROL_SOCKET);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    ck_assert_int_eq(mkdir(queue, 0700), 0);
+    write_reload_config(config, "1");
+
+    pid = fork();
+    ck_assert_int_ne(pid, -1);
+    if (pid == 0) {
+	(void) alarm(10);
+	lmapd = lmapd_new();
+	lmapd_set_config_path(lmapd, config);
+	lmapd_set_capability_path(lmapd, caps);
+	lmapd_set_queue_path(lmapd, queue);
+	lmapd_set_run_path(lmapd, dir);
+	if (lmapd_read_config(lmapd, &valid) != 0 || ! valid
+	    || lmapd_workspace_init(lmapd) != 0) {
+	    _exit(1);
+	}
+	_exit(lmapd_run(lmapd) == 0 ? 0 : 1);
+    }
+
+    /* wait for the daemon to answer */
+    for (i = 0; i < 100; i++) {
+	doc[0] = 0;
+	if (lmapd_control_request(dir, "status", doc_write, doc) == 0) {
+	    break;
+	}
+	usleep(20000);
+    }
+    ck_assert_int_lt(i, 100);
+    ck_assert_ptr_ne(strstr(doc, "<data xmlns:lmapc="), NULL);
+    ck_assert_ptr_ne(strstr(doc, "<lmapc:name>a2</lmapc:name>"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "<lmapc:invocations>0</lmapc:invocations>"), NULL);
+
+    doc[0] = 0;
+    ck_assert_int_eq(lmapd_control_request(dir, "config", doc_write, doc), 0);
+    ck_assert_ptr_ne(strstr(doc, "<config xmlns:lmapc="), NULL);
+    ck_assert_ptr_eq(strstr(doc, "<lmapc:invocations>"), NULL);
+
+    ck_assert_int_eq(lmapd_control_request(dir, "bogus", NULL, NULL), -1);
+    ck_assert_str_eq(last_error_msg, "lmapd: unknown request 'bogus'");
+
+    write_reload_config(config, "2");
+    ck_assert_int_eq(lmapd_control_request(dir, "reload", NULL, NULL), 0);
+    doc[0] = 0;
+    ck_assert_int_eq(lmapd_control_request(dir, "config", doc_write, doc), 0);
+    ck_assert_ptr_ne(strstr(doc, "<lmapc:value>2</lmapc:value>"), NULL);
+    ck_assert_int_eq(lmapd_control_request(dir, "clean", NULL, NULL), 0);
+
+    ck_assert_int_eq(lmapd_control_request(dir, "shutdown", NULL, NULL), 0);
+    ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+    ck_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    ck_assert_int_eq(access(sock, F_OK), -1);
+    ck_assert_int_eq(lmapd_control_request(dir, "status", NULL, NULL), -1);
+
+    (void) unlink(config);
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_queue_path(lmapd, queue);
+    (void) lmapd_workspace_clean(lmapd);
+    lmapd_free(lmapd);
+    (void) rmdir(queue);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
+START_TEST(test_lmapd_metrics)
+{
+    struct lmapd *lmapd;
+    struct schedule *s1;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX];
+    const char *doc, *again;
+    size_t len;
+    int valid = 0;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    write_reload_config(config, "1");
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+    ck_assert_int_eq(valid, 1);
+
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    s1->cnt_invocations = 7;
+    s1->storage = 4096;
+    s1->actions->cnt_failures = 2;
+    s1->actions->pid = 1;
+    lmap_find_schedule(lmapd->lmap, "s2")->storage = 100;
+
+    doc = lmapd_metrics_render(lmapd, &len);
+    ck_assert_ptr_ne(doc, NULL);
+    ck_assert_int_eq(doc[len - 1], '\n');
+    ck_assert_ptr_ne(strstr(doc, "# TYPE lmapd_schedule_invocations_total counter\n"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "\nlmapd_schedule_invocations_total{schedule=\"s1\"} 7\n"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "\nlmapd_schedule_storage_bytes{schedule=\"s1\"} 4096\n"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "\nlmapd_action_failures_total{schedule=\"s1\",action=\"a1\"} 2\n"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "\nlmapd_running_children 1\n"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "\nlmapd_queue_bytes 4196\n"), NULL);
+    ck_assert_ptr_ne(strstr(doc, "\nlmapd_actions 2\n"), NULL);
+
+    /* the buffer is reused across scrapes */
+    s1->actions->pid = 0;
+    again = lmapd_metrics_render(lmapd, &len);
+    ck_assert_ptr_eq(again, doc);
+    ck_assert_ptr_ne(strstr(again, "\nlmapd_running_children 0\n"), NULL);
+
+    lmapd_metrics_close(lmapd);
+    ck_assert_ptr_eq(lmapd->metrics, NULL);
+    lmapd_free(lmapd);
+    (void) unlink(config);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_lmapd_watchdog)
+{
+    struct lmapd *lmapd;
+    uint64_t now;
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+
+    now = lmap_latency_now();
+    ck_assert(now != 0);
+    lmapd_watchdog(lmapd, "fast", now);
+    ck_assert(lmapd->cnt_blocked == 0);
+
+    last_error_msg[0] = 0;
+    lmapd_watchdog(lmapd, "slow", now - 2 * LMAPD_WATCHDOG_THRESHOLD);
+    ck_assert(lmapd->cnt_blocked == 1);
+    ck_assert(lmapd->max_blocked >= 2 * LMAPD_WATCHDOG_THRESHOLD);
+    ck_assert_ptr_ne(strstr(last_error_msg, "slow blocked the event loop"), NULL);
+
+    lmapd_free(lmapd);
+}
+END_TEST
+
+START_TEST(test_lmapd_sim)
+{
+    struct lmapd *lmapd;
+    struct schedule *s1;
+    struct sim *sim;
+    char dir[] = "/tmp/check-lmapd-XXXXXX";
+    char config[PATH_MAX], caps[PATH_MAX], cap[PATH_MAX], queue[PATH_MAX];
+    FILE *f;
+    time_t start = 1500000000;
+    int valid = 0;
+
+    ck_assert_ptr_ne(mkdtemp(dir), NULL);
+    snprintf(config, sizeof(config), "%s/config.xml", dir);
+    snprintf(caps, sizeof(caps), "%s/caps", dir);
+    snprintf(cap, sizeof(cap), "%s/caps/caps.xml", dir);
+    snprintf(queue, sizeof(queue), "%s/queue", dir);
+    ck_assert_int_eq(mkdir(caps, 0700), 0);
+    ck_assert_int_eq(mkdir(queue, 0700), 0);
+    write_reload_config(config, "1");
+    f = fopen(cap, "w");
+    ck_assert_ptr_ne(f, NULL);
+    fprintf(f,
+	"<data xmlns:lmapc=\"urn:ietf:params:xml:ns:yang:ietf-lmap-control\">\n"
+	"  <lmapc:lmap><lmapc:capabilities><lmapc:tasks><lmapc:task>\n"
+	"    <lmapc:name>sleep</lmapc:name>\n"
+	"    <lmapc:program>/bin/sleep</lmapc:program>\n"
+	"  </lmapc:task></lmapc:tasks></lmapc:capabilities></lmapc:lmap>\n"
+	"</data>\n");
+    ck_assert_int_eq(fclose(f), 0);
+
+    lmapd = lmapd_new();
+    ck_assert_ptr_ne(lmapd, NULL);
+    lmapd_set_config_path(lmapd, config);
+    lmapd_set_capability_path(lmapd, caps);
+    lmapd_set_queue_path(lmapd, queue);
+    ck_assert_int_eq(lmapd_read_config(lmapd, &valid), 0);
+    ck_assert_int_eq(valid, 1);
+    ck_assert_int_eq(lmapd_workspace_init(lmapd), 0);
+    s1 = lmap_find_schedule(lmapd->lmap, "s1");
+    ck_assert_ptr_ne(s1, NULL);
+    s1->mode = LMAP_SCHEDULE_EXEC_MODE_SEQUENTIAL;
+
+    /*
+     * A day of hourly schedules whose action runs for two hours and
+     * fails: every other hour is an overlap, the invocation started
+     * at the end of the day is still running.
+     */
+
+    sim = lmapd_sim_new(start, 86400);
+    ck_assert_ptr_ne(sim, NULL);
+    ck_assert_int_eq(lmapd_sim_stub(sim, "sleep", 7200000000ULL, 3, 0), 0);
+    lmapd->sim = sim;
+    ck_assert_int_eq(lmapd_run(lmapd), 0);
+    ck_assert(lmapd_sim_now(sim) == (uint64_t) (start + 86400) * 1000000);
+
+    ck_assert_int_eq(s1->cnt_invocations, 13);
+    ck_assert_int_eq(s1->cnt_overlaps, 12);
+    ck_assert_int_eq(s1->cnt_failures, 12);
+    ck_assert_int_eq(s1->actions->cnt_invocations, 13);
+    ck_assert_int_eq(s1->actions->last_status, 3);
+    ck_assert_int_eq(s1->actions->state, LMAP_ACTION_STATE_RUNNING);
+    ck_assert_int_eq(s1->actions->last_invocation, start + 86400);
+    ck_assert(s1->actions->latency->stages[LMAP_LATENCY_RUN].max
+	      == 7200000000ULL);
+
+    (void) lmapd_workspace_clean(lmapd);
+    lmapd_free(lmapd);
+    lmapd_sim_free(sim);
+    (void) unlink(config);
+    (void) unlink(cap);
+    (void) rmdir(queue);
+    (void) rmdir(caps);
+    (void) rmdir(dir);
+    last_error_msg[0] = 0;
+}
+END_TEST
+
 Suite * lmap_suite(void)
 {
     Suite *s;
@@ -92,6 +751,14 @@ Suite * lmap_suite(void)
     tcase_add_checked_fixture(tc_core, setup, teardown);
     tcase_add_test(tc_core, test_lmapd);
     tcase_add_test(tc_core, test_lmapd_run);
+    tcase_add_test(tc_core, test_lmapd_reload);
+    tcase_add_test(tc_core, test_lmapd_reload_supp);
+    tcase_add_test(tc_core, test_lmapd_journal);
+    tcase_add_test(tc_core, test_lmapd_journal_limit);
+    tcase_add_test(tc_core, test_lmapd_control);
+    tcase_add_test(tc_core, test_lmapd_metrics);
+    tcase_add_test(tc_core, test_lmapd_watchdog);
+    tcase_add_test(tc_core, test_lmapd_sim);
     suite_add_tcase(s, tc_core);
 
     return s;